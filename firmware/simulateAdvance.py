@@ -0,0 +1,211 @@
+#!/usr/bin/env python
+#
+# Simulates the nozzle pressure of the linear advance in the accelerated stepper driver
+"""Linear Advance Nozzle Pressure Simulator
+
+Runs a short print path through the planner trapezoids and the linear advance of the
+accelerated stepper driver (StepperAccelPlanner.cc / StepperAccel.cc), using the same
+fixed point maths, and estimates the pressure in the nozzle with and without advance.
+
+The nozzle is modelled as a spring (the filament between the drive gear and the nozzle)
+draining through the nozzle: the compression c (mm of filament) builds up with the extruder
+and the nozzle flow is c / tau. An advance K equal to tau gives a nozzle flow that follows
+the commanded flow.
+
+Usage: python simulateAdvance.py [options]
+
+Options:
+  -h, --help			show this help
+  --k=...			advance K (s) as stored in the eeprom / 100000 (default: 0.05)
+  --tau=...			time constant of the simulated extruder in s (default: 0.05)
+  --accel=...			acceleration in mm/s^2 (default: 2000)
+  --jerk=...			xy jerk in mm/s (default: 20)
+  --e-steps=...			extruder steps per mm of filament (default: 44)
+  --e-per-mm=...		mm of filament per mm of travel (default: 0.033)
+  --plot=...			write a plot to this file (needs matplotlib), otherwise
+				time, commanded flow, nozzle flow and pressure are printed as csv
+"""
+
+from math import *
+import sys
+import getopt
+
+DT = 0.0005		# Integration step (s)
+
+class Block:
+	"A planner block, a line in x with extrusion"
+	def __init__(self, length, feedrate, e):
+		self.length = length			# mm
+		self.feedrate = feedrate		# mm/s
+		self.e = e				# mm of filament, negative for a retract
+
+def speeds(blocks, accel, jerk):
+	"Entry and exit speeds of each block, starting and finishing at rest"
+	n = len(blocks)
+	entry = [0.0] * (n + 1)
+	for i in range(1, n):
+		a = blocks[i - 1]
+		b = blocks[i]
+		if (a.length == 0) != (b.length == 0) or (a.e < 0) != (b.e < 0):
+			entry[i] = 0.0
+		else:
+			entry[i] = min(a.feedrate, b.feedrate, jerk)
+	# Reverse and forward pass, no block may need more than its length to change speed
+	for i in range(n - 1, -1, -1):
+		d = max(blocks[i].length, abs(blocks[i].e))
+		entry[i] = min(entry[i], sqrt(entry[i + 1] ** 2 + 2 * accel * d))
+	for i in range(n):
+		d = max(blocks[i].length, abs(blocks[i].e))
+		entry[i + 1] = min(entry[i + 1], sqrt(entry[i] ** 2 + 2 * accel * d))
+	return entry
+
+def profile(block, v0, v1, accel):
+	"Speed along the block over time, a trapezoid (or triangle) from v0 to v1"
+	d = max(block.length, abs(block.e))
+	vmax = min(block.feedrate, sqrt((2 * accel * d + v0 * v0 + v1 * v1) / 2))
+	t_acc = (vmax - v0) / accel
+	t_dec = (vmax - v1) / accel
+	d_cruise = d - (vmax * vmax - v0 * v0) / (2 * accel) - (vmax * vmax - v1 * v1) / (2 * accel)
+	t_cruise = max(d_cruise, 0.0) / vmax
+	t = 0.0
+	out = []
+	while t < t_acc + t_cruise + t_dec:
+		if t < t_acc:
+			v = v0 + accel * t
+		elif t < t_acc + t_cruise:
+			v = vmax
+		else:
+			v = vmax - accel * (t - t_acc - t_cruise)
+		out.append(max(v, 0.0) / d)	# fraction of the block per second
+		t += DT
+	return out
+
+def advance_rate(block, k, e_steps):
+	"block->advance_rate as the planner calculates it"
+	if k == 0.0 or block.e <= 0.0 or block.length == 0.0:
+		return 0
+	e_block_steps = round(block.e * e_steps)
+	step_event_count = max(e_block_steps, round(block.length * 94.14))	# X at 94.14 steps/mm
+	return min(int(k * 65536.0 * e_block_steps / step_event_count), 65535), step_event_count
+
+def simulate(blocks, k, tau, accel, jerk, e_steps):
+	"Returns time, commanded flow, nozzle flow, nozzle pressure (mm of compression) and printing"
+	entry = speeds(blocks, accel, jerk)
+	e_cmd = 0.0		# Commanded extruder position (mm)
+	e_out = 0.0		# Filament that left the nozzle (mm)
+	old_advance = 0		# Advance steps applied
+	t = 0.0
+	result = []
+	for i in range(len(blocks)):
+		b = blocks[i]
+		rate = advance_rate(b, k, e_steps)
+		printing = b.length > 0.0 and b.e > 0.0
+		for f in profile(b, entry[i], entry[i + 1], accel):
+			v_e = f * b.e
+			e_cmd += v_e * DT
+			advance = 0
+			if rate:
+				step_rate = int(f * rate[1])
+				advance = (step_rate * rate[0]) >> 8
+			# The extruder gets the commanded steps plus the advance steps (>> 8 like the isr)
+			old_advance = advance >> 8
+			e_motor = e_cmd + old_advance / float(e_steps)
+			c = e_motor - e_out
+			flow = max(c, 0.0) / tau
+			e_out += flow * DT
+			result.append((t, v_e, flow, c, printing))
+			t += DT
+	# Let the nozzle drain
+	for n in range(int(3 * tau / DT)):
+		c = e_cmd - e_out
+		flow = max(c, 0.0) / tau
+		e_out += flow * DT
+		result.append((t, 0.0, flow, c, False))
+		t += DT
+	return result
+
+def path(e_per_mm):
+	"A long perimeter, a few short infill lines, a retract and a travel"
+	blocks = [Block(40.0, 60.0, 40.0 * e_per_mm)]
+	for n in range(6):
+		blocks.append(Block(3.0, 60.0, 3.0 * e_per_mm))
+	blocks.append(Block(0.0, 25.0, -1.0))
+	blocks.append(Block(20.0, 150.0, 0.0))
+	blocks.append(Block(0.0, 25.0, 1.0))
+	blocks.append(Block(20.0, 60.0, 20.0 * e_per_mm))
+	return blocks
+
+def main(argv):
+
+	k = 0.05
+	tau = 0.05
+	accel = 2000.0
+	jerk = 20.0
+	e_steps = 44.0
+	e_per_mm = 0.033
+	plot = None
+
+	try:
+		opts, args = getopt.getopt(argv, "h", ["help", "k=", "tau=", "accel=", "jerk=", "e-steps=", "e-per-mm=", "plot="])
+	except getopt.GetoptError:
+		usage()
+		sys.exit(2)
+
+	for opt, arg in opts:
+		if opt in ("-h", "--help"):
+			usage()
+			sys.exit()
+		elif opt == "--k":
+			k = float(arg)
+		elif opt == "--tau":
+			tau = float(arg)
+		elif opt == "--accel":
+			accel = float(arg)
+		elif opt == "--jerk":
+			jerk = float(arg)
+		elif opt == "--e-steps":
+			e_steps = float(arg)
+		elif opt == "--e-per-mm":
+			e_per_mm = float(arg)
+		elif opt == "--plot":
+			plot = arg
+
+	blocks = path(e_per_mm)
+	off = simulate(blocks, 0.0, tau, accel, jerk, e_steps)
+	on = simulate(blocks, k, tau, accel, jerk, e_steps)
+
+	# Flow error: how far the nozzle flow is from the commanded flow while extruding
+	for name, r in (("off", off), ("on", on)):
+		err = max([abs(s[1] - s[2]) for s in r if s[4]])
+		sys.stderr.write("advance %s: max flow error %.4f mm/s, peak pressure %.4f mm\n" % (name, err, max([s[3] for s in r])))
+
+	if plot:
+		try:
+			import matplotlib
+		except ImportError:
+			sys.stderr.write("--plot needs matplotlib\n")
+			sys.exit(1)
+		matplotlib.use("Agg")
+		import matplotlib.pyplot as plt
+		fig, (ax1, ax2) = plt.subplots(2, 1, sharex=True)
+		ax1.plot([s[0] for s in off], [s[1] for s in off], label="commanded")
+		ax1.plot([s[0] for s in off], [s[2] for s in off], label="nozzle, advance off")
+		ax1.plot([s[0] for s in on], [s[2] for s in on], label="nozzle, K=%g" % k)
+		ax1.set_ylabel("flow (mm/s filament)")
+		ax1.legend()
+		ax2.plot([s[0] for s in off], [s[3] for s in off], label="advance off")
+		ax2.plot([s[0] for s in on], [s[3] for s in on], label="K=%g" % k)
+		ax2.set_ylabel("pressure (mm compression)")
+		ax2.set_xlabel("time (s)")
+		ax2.legend()
+		fig.savefig(plot)
+	else:
+		print("time,commanded,nozzle_off,pressure_off,nozzle_on,pressure_on")
+		for a, b in zip(off, on):
+			print("%.4f,%.4f,%.4f,%.4f,%.4f,%.4f" % (a[0], a[1], a[2], a[3], b[2], b[3]))
+
+def usage():
+	print(__doc__)
+
+if __name__ == "__main__":
+	main(sys.argv[1:])
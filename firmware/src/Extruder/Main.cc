@@ -26,6 +26,8 @@
 #include "EepromMap.hh"
 #include "ExtruderBoard.hh"
 #include "MotorController.hh"
+#include "Scheduler.hh"
+#include <avr/pgmspace.h>
 
 void reset() {
 	cli();
@@ -40,14 +42,20 @@ void reset() {
 	sei();
 }
 
+void runExtruderSlice() {
+	ExtruderBoard::getBoard().runExtruderSlice();
+}
+
 int main() {
 	reset();
-	while (1) {
-		// Host interaction thread.
-		runHostSlice();
 
-		// Temperature monitoring thread
-		ExtruderBoard::getBoard().runExtruderSlice();
+	// Host interaction thread.
+	scheduler::addTask(PSTR("Host"), runHostSlice, 2000L);
+	// Temperature monitoring thread
+	scheduler::addTask(PSTR("Ext"), runExtruderSlice, 5000L);
+
+	while (1) {
+		scheduler::runCycle();
 	}
 	return 0;
 }
@@ -25,6 +25,9 @@
 // TODO: Ditch this in favor of a unified board.hh, or something.
 #define IS_EXTRUDER_BOARD
 
+// The main loop only has the host and extruder slices (see Scheduler.hh)
+#define SCHEDULER_MAX_TASKS	2
+
 // Interval for timer update in microseconds
 // Servos are locked to this, so this must be 2500.
 // (It turns out that nothing needed microsecond timing, anyway.)
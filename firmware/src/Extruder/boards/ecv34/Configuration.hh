@@ -26,6 +26,9 @@
 // TODO: Ditch this in favor of a unified board.hh, or something.
 #define IS_EXTRUDER_BOARD
 
+// The main loop only has the host and extruder slices (see Scheduler.hh)
+#define SCHEDULER_MAX_TASKS	2
+
 // Interval for timer update in microseconds
 #define INTERVAL_IN_MICROSECONDS 64
 
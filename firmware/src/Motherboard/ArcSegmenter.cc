@@ -0,0 +1,86 @@
+/*
+ * Arc Segmenter
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "ArcSegmenter.hh"
+#include <math.h>
+
+/// Most chords an arc is cut into
+#define ARC_MAX_SEGMENTS	1000
+
+void ArcSegmenter::start(const int32_t end_in[ARC_AXIS_COUNT], int32_t center_x_in, int32_t center_y_in,
+			 bool clockwise, uint32_t us) {
+	for (uint8_t i = 0; i < ARC_AXIS_COUNT; i ++) {
+		end[i] = end_in[i];
+		last[i] = 0;
+	}
+	center_x = center_x_in;
+	center_y = center_y_in;
+	total_us = us;
+	given_us = 0;
+	segment = 0;
+
+	// Angles and radii of the start and the end, seen from the center
+	start_angle = atan2(-center_y, -center_x);
+	float end_angle = atan2((float)end[1] - center_y, (float)end[0] - center_x);
+	start_radius = sqrt(center_x * center_x + center_y * center_y);
+	float end_radius = sqrt(((float)end[0] - center_x) * ((float)end[0] - center_x) +
+				((float)end[1] - center_y) * ((float)end[1] - center_y));
+	radius_change = end_radius - start_radius;
+
+	sweep = end_angle - start_angle;
+	if (( clockwise ) && ( sweep >= 0.0 ))		sweep -= 2.0 * M_PI;
+	else if (( ! clockwise ) && ( sweep <= 0.0 ))	sweep += 2.0 * M_PI;
+
+	// The sagitta of a chord over angle a is r (1 - cos(a / 2))
+	float radius = ( start_radius > end_radius ) ? start_radius : end_radius;
+	float length = fabs(sweep) * radius;
+	float count = 1.0;
+	if ( radius > ARC_TOLERANCE_STEPS ) {
+		float angle = 2.0 * acos(1.0 - ARC_TOLERANCE_STEPS / radius);
+		count = ceil(fabs(sweep) / angle);
+	}
+	if ( length / count < ARC_MIN_CHORD_STEPS )	count = floor(length / ARC_MIN_CHORD_STEPS);
+	if ( count < 1.0 )				count = 1.0;
+	if ( count > ARC_MAX_SEGMENTS )			count = ARC_MAX_SEGMENTS;
+	segments = (uint16_t)count;
+}
+
+bool ArcSegmenter::next(int32_t delta[ARC_AXIS_COUNT], uint32_t& us) {
+	if ( segment >= segments )	return false;
+	segment ++;
+
+	int32_t point[ARC_AXIS_COUNT];
+	if ( segment == segments ) {
+		for (uint8_t i = 0; i < ARC_AXIS_COUNT; i ++)	point[i] = end[i];
+		us = total_us - given_us;
+	} else {
+		float fraction = (float)segment / (float)segments;
+		float angle = start_angle + sweep * fraction;
+		float radius = start_radius + radius_change * fraction;
+		point[0] = lround(center_x + radius * cos(angle));
+		point[1] = lround(center_y + radius * sin(angle));
+		for (uint8_t i = 2; i < ARC_AXIS_COUNT; i ++)	point[i] = lround((float)end[i] * fraction);
+		us = (uint32_t)((float)total_us * fraction) - given_us;
+	}
+
+	for (uint8_t i = 0; i < ARC_AXIS_COUNT; i ++) {
+		delta[i] = point[i] - last[i];
+		last[i] = point[i];
+	}
+	given_us += us;
+	return true;
+}
@@ -0,0 +1,88 @@
+/*
+ * Arc Segmenter
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef ARC_SEGMENTER_HH_
+#define ARC_SEGMENTER_HH_
+
+#include <stdint.h>
+
+#define ARC_AXIS_COUNT		5
+
+/// HOST_CMD_QUEUE_ARC: end x, y, z, e (int32, steps, relative to the start), center
+/// x, y (int32, steps, relative to the start), duration (uint32, us), flags (uint8)
+#define ARC_COMMAND_LENGTH	30
+
+#define ARC_FLAG_CLOCKWISE	0x01	///< G2, counterclockwise otherwise
+#define ARC_FLAG_EXTRUDER_B	0x02	///< e is for B, A otherwise
+
+/// Furthest a chord may be from the arc (steps). Within a step is as close as the
+/// steppers can follow it anyway.
+#ifndef ARC_TOLERANCE_STEPS
+#define ARC_TOLERANCE_STEPS	1.0
+#endif
+
+/// Shortest chord (steps), the planner drops moves of 5 steps or less
+#ifndef ARC_MIN_CHORD_STEPS
+#define ARC_MIN_CHORD_STEPS	10
+#endif
+
+/// Cuts an arc in the XY plane into chords. Z and the extruders move linearly along
+/// the arc, so helixes work too. Every chord end is worked out from the start of the
+/// arc, so the rounding doesn't add up, and the last chord finishes exactly on the end
+/// point.
+///
+/// Has no hardware dependencies, so it also builds on the host.
+class ArcSegmenter {
+public:
+	/// Start an arc
+	/// \param[in] end End point (steps), relative to the start of the arc
+	/// \param[in] center_x, center_y Center (steps), relative to the start of the arc
+	/// \param[in] clockwise Direction, an arc that ends where it starts is a full circle
+	/// \param[in] us Duration of the whole arc
+	void start(const int32_t end[ARC_AXIS_COUNT], int32_t center_x, int32_t center_y,
+		   bool clockwise, uint32_t us);
+
+	/// Get the next chord
+	/// \param[out] delta Steps to move each axis by
+	/// \param[out] us Duration of the chord
+	/// \return False if there are no chords left
+	bool next(int32_t delta[ARC_AXIS_COUNT], uint32_t& us);
+
+	/// \return True while there are chords left
+	bool isActive() const { return segment < segments; }
+
+	/// \return Number of chords of the arc
+	uint16_t getSegmentCount() const { return segments; }
+
+	/// Stop the arc, no more chords are given out
+	void abort() { segment = segments; }
+
+private:
+	int32_t end[ARC_AXIS_COUNT];
+	int32_t last[ARC_AXIS_COUNT];	///< Where the last chord ended, relative to the start
+	float center_x, center_y;
+	float start_angle;
+	float sweep;			///< Radians, negative clockwise
+	float start_radius;
+	float radius_change;		///< End radius - start radius, they differ by the rounding
+	uint32_t total_us;
+	uint32_t given_us;		///< Duration of the chords given out so far
+	uint16_t segments;
+	uint16_t segment;		///< Next chord
+};
+
+#endif // ARC_SEGMENTER_HH_
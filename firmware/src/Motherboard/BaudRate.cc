@@ -0,0 +1,67 @@
+/*
+ * Host Baud Rate Negotiation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "BaudRate.hh"
+
+bool getBaudRateDivisor(uint32_t baud, uint32_t clock, uint16_t& ubrr) {
+	if (baud == 0) return false;
+	// 8 samples a bit at double speed, rounded to the nearest divisor
+	uint32_t divisor = (clock / 4 / baud + 1) / 2;
+	if (divisor == 0 || divisor > 4096) return false;
+
+	uint32_t actual = clock / 8 / divisor;
+	uint32_t error = ( actual > baud ) ? actual - baud : baud - actual;
+	if (error * 1000 > baud * (uint32_t)BAUD_RATE_MAX_ERROR) return false;
+
+	ubrr = divisor - 1;
+	return true;
+}
+
+BaudRateNegotiator::BaudRateNegotiator(uint32_t baud, uint32_t clock_in) :
+	clock(clock_in),
+	state(IDLE),
+	baud_rate(baud),
+	proposed(baud) {
+}
+
+bool BaudRateNegotiator::propose(uint32_t baud) {
+	uint16_t ubrr;
+	if (state != IDLE || !getBaudRateDivisor(baud, clock, ubrr)) {
+		return false;
+	}
+	proposed = baud;
+	state = SWITCHING;
+	return true;
+}
+
+uint32_t BaudRateNegotiator::switchRate() {
+	state = CONFIRMING;
+	return proposed;
+}
+
+void BaudRateNegotiator::packetReceived() {
+	if (state == CONFIRMING) {
+		baud_rate = proposed;
+		state = IDLE;
+	}
+}
+
+uint32_t BaudRateNegotiator::revert() {
+	proposed = baud_rate;
+	state = IDLE;
+	return baud_rate;
+}
@@ -0,0 +1,89 @@
+/*
+ * Host Baud Rate Negotiation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef BAUD_RATE_HH_
+#define BAUD_RATE_HH_
+
+#include <stdint.h>
+
+/// Most a baud rate may be off (per mille) and still be taken. The receiver samples
+/// the middle of each bit, so both ends can be a few percent apart; the 115200 the
+/// mb24 host UART starts at is 2.1% off.
+#define BAUD_RATE_MAX_ERROR	25
+
+/// Get the UBRR of a baud rate, with the UART at double speed (U2X)
+/// \param[in] baud Baud rate
+/// \param[in] clock CPU clock (Hz)
+/// \param[out] ubrr Baud rate register value
+/// \return False if the UART can't run close enough to the baud rate
+bool getBaudRateDivisor(uint32_t baud, uint32_t clock, uint16_t& ubrr);
+
+/// Switches the host UART to the baud rate the host proposes. The host gets the
+/// acceptance at the old rate, then both ends switch. If no valid packet comes in at
+/// the new rate before the timeout, both ends go back to the rate they had.
+///
+///	IDLE --propose()--> SWITCHING --switchRate()--> CONFIRMING
+///	CONFIRMING --packetReceived()--> IDLE, on the new rate
+///	CONFIRMING --revert()--> IDLE, on the old rate
+///
+/// Doesn't touch the UART or keep the time itself, so it also builds on the host.
+class BaudRateNegotiator {
+public:
+	/// \param[in] baud Rate the UART starts at
+	/// \param[in] clock CPU clock (Hz)
+	BaudRateNegotiator(uint32_t baud, uint32_t clock);
+
+	/// The host proposes a rate
+	/// \return True if it's taken, false if a switch is under way already or the rate
+	/// can't be made
+	bool propose(uint32_t baud);
+
+	/// \return True if a rate was taken, and the UART switches once the acceptance
+	/// is sent
+	bool isSwitching() const { return state == SWITCHING; }
+
+	/// The acceptance is sent, the UART switches and the timeout starts
+	/// \return Rate to switch to
+	uint32_t switchRate();
+
+	/// \return True while the new rate waits for a valid packet
+	bool isConfirming() const { return state == CONFIRMING; }
+
+	/// A valid packet came in, the new rate stays if it was waiting for one
+	void packetReceived();
+
+	/// The timeout elapsed, or the link was reset
+	/// \return Rate to go back to
+	uint32_t revert();
+
+	/// \return Rate the UART runs at, or is switching to
+	uint32_t getBaudRate() const { return ( state == IDLE ) ? baud_rate : proposed; }
+
+private:
+	enum State {
+		IDLE,
+		SWITCHING,
+		CONFIRMING
+	};
+
+	const uint32_t clock;
+	State state;
+	uint32_t baud_rate;		///< Last confirmed rate
+	uint32_t proposed;		///< Rate being switched to
+};
+
+#endif // BAUD_RATE_HH_
@@ -0,0 +1,219 @@
+/*
+ * Build Time Estimator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifdef __AVR__
+#include "Configuration.hh"
+#endif
+
+// Only the accelerated stepper driver needs it, on the host it's always built
+#if defined(HAS_STEPPER_ACCELERATION) || ! defined(__AVR__)
+
+#include "BuildEstimator.hh"
+#include "StepperAccel.hh"
+#include "PlannerMath.hh"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ESTIMATOR_BLOCK_MASK	(ESTIMATOR_BLOCK_COUNT - 1)
+
+void BuildEstimator::init(const EstimatorSettings& newSettings) {
+	settings = newSettings;
+	for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++)
+		axis_steps_per_sqr_second[i] = settings.max_acceleration[i] * settings.steps_per_mm[i];
+	reset();
+}
+
+void BuildEstimator::reset() {
+	head = 0;
+	tail = 0;
+	count = 0;
+	retired_us = 0;
+	memset(position, 0, sizeof(position));
+	memset(previous_speed, 0, sizeof(previous_speed));
+	previous_nominal_speed = 0.0;
+}
+
+void BuildEstimator::definePosition(const int32_t newPosition[ESTIMATOR_AXIS_COUNT]) {
+	flush();
+	memcpy(position, newPosition, sizeof(position));
+	// Like plan_set_position(), junction speeds restart from rest
+	memset(previous_speed, 0, sizeof(previous_speed));
+	previous_nominal_speed = 0.0;
+}
+
+// The feed rate (mm/s) steppers::setTarget() hands the planner, from the interval (us)
+// per step of the dominant axis
+static float estimatorFeedRate(const float steps_per_mm[], const int32_t from[],
+			       const int32_t to[], int32_t interval) {
+	int32_t master_steps = 0;
+	float distance = 0.0;
+
+	for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++) {
+		int32_t delta = labs(to[i] - from[i]);
+		if ( delta > master_steps )	master_steps = delta;
+
+		const float delta_mm = (float)delta / steps_per_mm[i];
+		distance += delta_mm * delta_mm;
+	}
+	if (( master_steps == 0 ) || ( interval <= 0 ))	return 0.0;
+
+	return (sqrt(distance) * 1000000.0) / ((float)interval * (float)master_steps);
+}
+
+void BuildEstimator::moveTo(const int32_t target[ESTIMATOR_AXIS_COUNT], int32_t dda) {
+	float feed_rate = estimatorFeedRate(settings.steps_per_mm, position, target, dda);
+	if ( feed_rate > 0.0 )	bufferLine(target, feed_rate);
+}
+
+void BuildEstimator::moveToNew(const int32_t target[ESTIMATOR_AXIS_COUNT], int32_t us, uint8_t relative) {
+	int32_t newPosition[ESTIMATOR_AXIS_COUNT];
+	int32_t max_delta = 0;
+
+	for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++) {
+		newPosition[i] = ( relative & (1 << i) ) ? position[i] + target[i] : target[i];
+		int32_t delta = labs(newPosition[i] - position[i]);
+		if ( delta > max_delta )	max_delta = delta;
+	}
+	if ( max_delta == 0 )	return;
+
+	float feed_rate = estimatorFeedRate(settings.steps_per_mm, position, newPosition, us / max_delta);
+	if ( feed_rate > 0.0 )	bufferLine(newPosition, feed_rate);
+}
+
+void BuildEstimator::addDelay(uint32_t microseconds) {
+	flush();
+	retired_us += microseconds;
+}
+
+void BuildEstimator::flush() {
+	while ( count > 0 ) {
+		retireBlock(( count > 1 ) ? blocks[(tail + 1) & ESTIMATOR_BLOCK_MASK].entry_speed : MINIMUM_PLANNER_SPEED);
+	}
+}
+
+uint32_t BuildEstimator::getSeconds() const {
+	float seconds = 0.0;
+	for (uint8_t i = 0, index = tail; i < count; i ++, index = (index + 1) & ESTIMATOR_BLOCK_MASK) {
+		float exit_speed = ( i + 1 < count ) ? blocks[(index + 1) & ESTIMATOR_BLOCK_MASK].entry_speed : MINIMUM_PLANNER_SPEED;
+		seconds += blockTime(blocks[index], exit_speed);
+	}
+	return (uint32_t)(retired_us / 1000000) + (uint32_t)seconds;
+}
+
+void BuildEstimator::retireBlock(float exit_speed) {
+	retired_us += (uint64_t)(blockTime(blocks[tail], exit_speed) * 1000000.0);
+	tail = (tail + 1) & ESTIMATOR_BLOCK_MASK;
+	count --;
+}
+
+// Time (s) to run steps starting at rate (steps/s), which changes by acceleration (steps/s^2)
+// until it reaches limit and then stays there. rate is left at the rate at the end.
+static float rampTime(float steps, float& rate, float acceleration, float limit) {
+	if ( steps <= 0.0 )	return 0.0;
+
+	float ramp_steps = (limit * limit - rate * rate) / (2.0 * acceleration);
+	if ( ramp_steps <= 0.0 ) {
+		rate = limit;
+		return steps / limit;
+	}
+	if ( steps >= ramp_steps ) {
+		float t = (limit - rate) / acceleration + (steps - ramp_steps) / limit;
+		rate = limit;
+		return t;
+	}
+	float end_rate = sqrt(rate * rate + 2.0 * acceleration * steps);
+	float t = (end_rate - rate) / acceleration;
+	rate = end_rate;
+	return t;
+}
+
+// Time (s) the stepper interrupt takes for the trapezoid the planner gives a block entering
+// at its entry speed and leaving at exit_speed: it accelerates from the initial rate up to
+// accelerate_until, runs at the nominal rate up to decelerate_after and then decelerates
+// down to the final rate
+float BuildEstimator::blockTime(const Block& block, float exit_speed) const {
+	if ( block.acceleration_st == 0 )
+		return (float)block.step_event_count / (float)block.nominal_rate;
+
+	trapezoid_t trapezoid;
+	calculate_trapezoid(&block, block.entry_speed / block.nominal_speed,
+			    exit_speed / block.nominal_speed, &trapezoid);
+
+	// An exit faster than the nominal speed puts the deceleration past the end of the block
+	const int32_t steps = block.step_event_count;
+	const int32_t accelerate_until = ( trapezoid.accelerate_until < steps ) ? trapezoid.accelerate_until : steps;
+	const int32_t decelerate_after = ( trapezoid.decelerate_after < steps ) ? trapezoid.decelerate_after : steps;
+
+	const float acceleration = block.acceleration_st;
+	float rate = trapezoid.initial_rate;
+	float t = 0.0;
+
+	if ( accelerate_until > 0 )
+		t += rampTime(accelerate_until, rate, acceleration, block.nominal_rate);
+	t += (float)(decelerate_after - accelerate_until) / (float)block.nominal_rate;
+	t += rampTime(steps - decelerate_after, rate, -acceleration, trapezoid.final_rate);
+	return t;
+}
+
+// plan_buffer_line() without the stepper, the bresenham and advance parts
+void BuildEstimator::bufferLine(const int32_t target[ESTIMATOR_AXIS_COUNT], float feed_rate) {
+	int32_t steps[ESTIMATOR_AXIS_COUNT];
+	int32_t step_event_count = 0;
+	for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++) {
+		steps[i] = labs(target[i] - position[i]);
+		if ( steps[i] > step_event_count )	step_event_count = steps[i];
+	}
+
+	// The planner drops tiny moves without updating its position
+	if ( step_event_count <= dropsegments )	return;
+
+	// Make room like the stepper does for the planner, the oldest block leaves at the
+	// entry speed of the one after it
+	if ( count == ESTIMATOR_BLOCK_COUNT - 1 )
+		retireBlock(blocks[(tail + 1) & ESTIMATOR_BLOCK_MASK].entry_speed);
+
+	Block& block = blocks[head];
+	block.step_event_count = step_event_count;
+
+	float delta_mm[ESTIMATOR_AXIS_COUNT];
+	for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++)
+		delta_mm[i] = (target[i] - position[i]) / settings.steps_per_mm[i];
+	planner_set_length(&block, steps, delta_mm);
+
+	float current_speed[ESTIMATOR_AXIS_COUNT];
+	planner_set_speed(&block, delta_mm, feed_rate, settings.max_feedrate, current_speed);
+	planner_set_acceleration(&block, steps, settings.acceleration, settings.retract_acceleration,
+				 axis_steps_per_sqr_second);
+	planner_set_entry_speed(&block, planner_junction_speed(current_speed, previous_speed,
+		block.nominal_speed, previous_nominal_speed, count, settings.max_xy_jerk, settings.max_z_jerk));
+
+	memcpy(previous_speed, current_speed, sizeof(previous_speed));
+	previous_nominal_speed = block.nominal_speed;
+	memcpy(position, target, sizeof(position));
+
+	head = (head + 1) & ESTIMATOR_BLOCK_MASK;
+	count ++;
+
+	planner_reverse_pass(blocks, head, tail, ESTIMATOR_BLOCK_COUNT);
+	planner_forward_pass(blocks, head, tail, ESTIMATOR_BLOCK_COUNT);
+
+	// Without the planner each move runs on its own
+	if ( ! settings.lookahead )	flush();
+}
+
+#endif
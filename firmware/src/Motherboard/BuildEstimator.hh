@@ -0,0 +1,118 @@
+/*
+ * Build Time Estimator
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef BUILD_ESTIMATOR_HH_
+#define BUILD_ESTIMATOR_HH_
+
+#include <stdint.h>
+#include "StepperAccel.hh"
+
+/// Size of the ring of planned moves, a power of 2. Like the planner's block buffer it
+/// holds one move less, so the estimate looks as far ahead as the planner does.
+#define ESTIMATOR_BLOCK_COUNT	BLOCK_BUFFER_SIZE
+
+#define ESTIMATOR_AXIS_COUNT	NUM_AXIS
+
+/// Machine settings for the estimate, the same values the planner runs with
+struct EstimatorSettings {
+	float steps_per_mm[ESTIMATOR_AXIS_COUNT];
+	float max_feedrate[ESTIMATOR_AXIS_COUNT];		///< mm/s
+	uint32_t max_acceleration[ESTIMATOR_AXIS_COUNT];	///< mm/s^2
+	float acceleration;					///< mm/s^2, 0 when acceleration is off
+	float retract_acceleration;				///< mm/s^2, extruder only moves
+	float max_xy_jerk;					///< mm/s
+	float max_z_jerk;					///< mm/s
+	bool lookahead;						///< False if the planner holds a single move
+};
+
+/// Estimates how long a build takes on the accelerated stepper driver. Moves are planned
+/// by the junction, look-ahead and trapezoid functions of StepperAccelPlanner (PlannerMath.hh),
+/// but nothing is stepped; the time of each move is taken from its trapezoid when it drops
+/// out of the look-ahead window.
+///
+/// Has no hardware dependencies, so it also builds on the host (tools/s3gEstimate).
+class BuildEstimator {
+public:
+	/// Set the machine settings, and start a new estimate
+	void init(const EstimatorSettings& settings);
+
+	/// Start a new estimate at position 0
+	void reset();
+
+	/// Define the current position (steps). The planner restarts from rest.
+	void definePosition(const int32_t position[ESTIMATOR_AXIS_COUNT]);
+
+	/// Position (steps) the moves so far finish at
+	const int32_t* getPosition() const { return position; }
+
+	/// A move as HOST_CMD_QUEUE_POINT_ABS / EXT
+	/// \param[in] target Absolute target (steps)
+	/// \param[in] dda Microseconds per step of the dominant axis
+	void moveTo(const int32_t target[ESTIMATOR_AXIS_COUNT], int32_t dda);
+
+	/// A move as HOST_CMD_QUEUE_POINT_NEW
+	/// \param[in] target Target (steps), relative on the axes set in relative
+	/// \param[in] us Duration of the move without acceleration
+	/// \param[in] relative Bitfield of the relative axes
+	void moveToNew(const int32_t target[ESTIMATOR_AXIS_COUNT], int32_t us, uint8_t relative);
+
+	/// The planner empties, e.g. for a delay, a wait or homing. The last move
+	/// finishes at the minimum planner speed.
+	void flush();
+
+	/// A pause in the build (microseconds), the planner empties first
+	void addDelay(uint32_t microseconds);
+
+	/// Estimated time of everything so far, including the moves still in the window
+	/// (planned to stop after the last one)
+	uint32_t getSeconds() const;
+
+private:
+	/// The fields of block_t the planner math needs
+	struct Block {
+		uint32_t step_event_count;
+		uint32_t nominal_rate;		///< steps/s
+		uint32_t acceleration_st;	///< steps/s^2
+		float nominal_speed;		///< mm/s
+		float entry_speed;		///< mm/s
+		float max_entry_speed;		///< mm/s
+		float millimeters;
+		float acceleration;		///< mm/s^2
+		uint8_t recalculate_flag;	///< Unused, set by the planner math
+		uint8_t nominal_length_flag;	///< Nominal speed is reached whatever the entry / exit speed
+	};
+
+	void bufferLine(const int32_t target[ESTIMATOR_AXIS_COUNT], float feed_rate);
+	void retireBlock(float exit_speed);
+	float blockTime(const Block& block, float exit_speed) const;
+
+	EstimatorSettings settings;
+	uint32_t axis_steps_per_sqr_second[ESTIMATOR_AXIS_COUNT];
+
+	Block blocks[ESTIMATOR_BLOCK_COUNT];
+	uint8_t head;			///< Next block to be added
+	uint8_t tail;			///< Oldest block in the window
+	uint8_t count;			///< Blocks in the window
+
+	int32_t position[ESTIMATOR_AXIS_COUNT];
+	float previous_speed[ESTIMATOR_AXIS_COUNT];
+	float previous_nominal_speed;
+
+	uint64_t retired_us;		///< Time of the blocks that left the window and the delays
+};
+
+#endif // BUILD_ESTIMATOR_HH_
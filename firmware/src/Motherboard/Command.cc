@@ -27,17 +27,98 @@
 #include "EepromMap.hh"
 #include "Eeprom.hh"
 #include "SDCard.hh"
+#include "CompactMove.hh"
+#include "ArcSegmenter.hh"
+#include "CommandCheck.hh"
 #include "ExtruderControl.hh"
+#include "CommandTrace.hh"
 
 #ifdef HAS_STEPPER_ACCELERATION
 #include "StepperAccel.hh"
+#include "BuildEstimator.hh"
 #endif
 
 namespace command {
 
 #define COMMAND_BUFFER_SIZE 512
-uint8_t buffer_data[COMMAND_BUFFER_SIZE];
-CircularBuffer command_buffer(COMMAND_BUFFER_SIZE, buffer_data);
+MaskedCircularBufferTempl<uint8_t, COMMAND_BUFFER_SIZE> command_buffer;
+
+/// Number of decoded commands queued in front of the executor, must be a power of 2
+#define DECODED_COMMAND_COUNT	4
+
+/// Largest tool command payload, longer ones are refused as they're received
+#define DECODED_TOOL_PAYLOAD	TOOL_COMMAND_MAX_PAYLOAD
+
+/// A complete command taken off the command buffer. The arguments are decoded into
+/// a fixed size record so the executor only has to dispatch on the tag.
+struct DecodedCommand {
+	uint8_t tag;					///< HOST_CMD_* of the command
+#if COMMAND_TRACING
+	uint8_t trace;					///< See commandtrace::decoded()
+#endif
+	union {
+		struct {
+			int32_t p[AXIS_COUNT];
+			int32_t dda;			///< dda, us for HOST_CMD_QUEUE_POINT_NEW
+			uint8_t relative;
+		} move;					///< HOST_CMD_QUEUE_POINT_*, HOST_CMD_SET_POSITION*
+		struct {
+			uint8_t flags;
+			uint32_t feedrate;		///< us per step
+			uint16_t timeout_s;
+		} homing;				///< HOST_CMD_FIND_AXES_*
+		struct {
+			uint8_t tool;
+			uint8_t code;
+			uint8_t length;
+			uint8_t payload[DECODED_TOOL_PAYLOAD];
+		} tool;					///< HOST_CMD_TOOL_COMMAND
+		struct {
+			int32_t end[4];			///< x, y, z, e
+			int32_t center[2];
+			uint32_t us;
+			uint8_t flags;
+		} arc;					///< HOST_CMD_QUEUE_ARC
+		int32_t args[5];			///< HOST_CMD_MOOD_LIGHT_*
+		uint32_t microseconds;			///< HOST_CMD_DELAY, HOST_CMD_WAIT_FOR_* timeout
+		uint8_t bytes[3];			///< Single byte arguments, HOST_CMD_BUZZER_BUZZ
+	};
+};
+
+DecodedCommand decoded[DECODED_COMMAND_COUNT];
+uint8_t decoded_head = 0;
+uint8_t decoded_tail = 0;
+uint8_t decoded_count = 0;
+
+/// Chords of the HOST_CMD_QUEUE_ARC at the front of the decoded queue, one is queued
+/// each time the steppers have room
+ArcSegmenter arc;
+
+/// Firmware retraction. The retract in effect is undone by the next unretract, with
+/// the settings it was made with.
+bool retracted = false;
+uint8_t retract_axis;				///< 3 = A, 4 = B
+int32_t retract_steps;
+uint32_t retract_us;
+int32_t retract_hop_steps;
+uint32_t retract_hop_us;
+uint8_t retract_moves = 0;			///< Moves of the retract at the front queued so far
+
+/// Time the SD estimate runs for before it gives the other slices a turn (microseconds)
+#define ESTIMATE_SLICE_MICROS	20000
+
+#ifdef HAS_STEPPER_ACCELERATION
+/// Number of commands that can wait on the planner, must be a power of 2
+#define DEFERRED_COMMAND_COUNT	8
+
+/// Non-motion commands waiting on the moves queued in front of them, in order. Each one is
+/// attached to the last planner block when it's taken off the decoded queue and runs when
+/// the step engine has finished that block.
+DecodedCommand deferred[DEFERRED_COMMAND_COUNT];
+uint8_t deferred_head = 0;
+uint8_t deferred_tail = 0;
+uint8_t deferred_count = 0;
+#endif
 
 bool outstanding_tool_command = false;
 
@@ -57,12 +138,18 @@ volatile bool firstHeatHbp;
 
 Point lastPosition;
 
+/// Filament (steps) and layers of the build being estimated
+int64_t estimateFilament = 0;
+uint16_t estimateLayerCount = 0;
+int32_t estimateLayerZ = 0;
+
+#ifdef HAS_STEPPER_ACCELERATION
+/// Build time of the moves through the planner, with acceleration
+BuildEstimator estimator;
+#endif
+
 uint16_t getRemainingCapacity() {
-	uint16_t sz;
-	ATOMIC_BLOCK(ATOMIC_FORCEON) {
-		sz = command_buffer.getRemainingCapacity();
-	}
-	return sz;
+	return command_buffer.getRemainingCapacity();
 }
 
 void pause(bool pause) {
@@ -82,13 +169,51 @@ int32_t getPauseAtZPos() {
 }
 
 bool isEmpty() {
-	return command_buffer.isEmpty();
+#ifdef HAS_STEPPER_ACCELERATION
+	if ( deferred_count > 0 )	return false;
+#endif
+	return command_buffer.isEmpty() && ( decoded_count == 0 );
+}
+
+/// Drop everything in the command buffer and the decoded commands
+void clearBuffers() {
+	command_buffer.reset();
+	decoded_head = 0;
+	decoded_tail = 0;
+	decoded_count = 0;
+	arc.abort();
+	discardDeferred();
+#if COMMAND_TRACING
+	commandtrace::reset();
+#endif
+	// A new build starts unretracted
+	retract_moves = 0;
+	retracted = false;
+}
+
+void discardDeferred() {
+#ifdef HAS_STEPPER_ACCELERATION
+#if COMMAND_TRACING
+	// Done with, so the commands traced after them can be accounted for
+	for (uint8_t i = 0; i < deferred_count; i ++) {
+		commandtrace::ran(deferred[(deferred_tail + i) & (DEFERRED_COMMAND_COUNT - 1)].trace);
+	}
+#endif
+	deferred_head = 0;
+	deferred_tail = 0;
+	deferred_count = 0;
+	st_discard_commands();
+#endif
 }
 
 void push(uint8_t byte) {
 	command_buffer.push(byte);
 }
 
+bool push(const uint8_t* bytes, uint16_t length) {
+	return command_buffer.pushN(bytes, length);
+}
+
 uint8_t pop8() {
 	return command_buffer.pop();
 }
@@ -101,8 +226,7 @@ int16_t pop16() {
 			uint8_t data[2];
 		} b;
 	} shared;
-	shared.b.data[0] = command_buffer.pop();
-	shared.b.data[1] = command_buffer.pop();
+	command_buffer.popN(shared.b.data, 2);
 	return shared.a;
 }
 
@@ -114,10 +238,7 @@ int32_t pop32() {
 			uint8_t data[4];
 		} b;
 	} shared;
-	shared.b.data[0] = command_buffer.pop();
-	shared.b.data[1] = command_buffer.pop();
-	shared.b.data[2] = command_buffer.pop();
-	shared.b.data[3] = command_buffer.pop();
+	command_buffer.popN(shared.b.data, 4);
 	return shared.a;
 }
 
@@ -133,22 +254,39 @@ enum {
 Timeout delay_timeout;
 Timeout homing_timeout;
 Timeout tool_wait_timeout;
-bool acceleration;
+
+/// Start a new build time estimate, with the current planner settings
+void resetEstimate() {
+	estimateTimeUs = 0;
+	estimateFilament = 0;
+	estimateLayerCount = 0;
+	estimateLayerZ = 0;
+#ifdef HAS_STEPPER_ACCELERATION
+	EstimatorSettings settings;
+	for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++) {
+		settings.steps_per_mm[i]	= axis_steps_per_unit[i];
+		settings.max_feedrate[i]	= max_feedrate[i];
+		settings.max_acceleration[i]	= max_acceleration_units_per_sq_second[i];
+	}
+	settings.acceleration		= p_acceleration;
+	settings.retract_acceleration	= p_retract_acceleration;
+	settings.max_xy_jerk		= max_xy_jerk;
+	settings.max_z_jerk		= max_z_jerk;
+	settings.lookahead		= ( eeprom::getEeprom8(eeprom::STEPPER_DRIVER, 0) & 0x02 ) != 0;
+	estimator.init(settings);
+#endif
+}
 
 void reset() {
 	pauseAtZPos(0.0);
 	lastPosition = Point(0,0,0,0,0);
-	command_buffer.reset();
-	estimateTimeUs = 0; 
+	clearBuffers();
+	resetEstimate();
 	filamentLength = 0;
 	lastFilamentLength = 0;
 	firstHeatTool0 = true;
 	firstHeatHbp = true;
 	mode = READY;
-
- 	uint8_t accel = eeprom::getEeprom8(eeprom::STEPPER_DRIVER, 0);
-        if ( accel & 0x01 )	acceleration = true;
-	else			acceleration = false;
 }
 
 
@@ -234,7 +372,19 @@ int64_t getLastFilamentLength() {
 }
 
 int32_t estimateSeconds() {
+#ifdef HAS_STEPPER_ACCELERATION
+	return estimator.getSeconds();
+#else
 	return estimateTimeUs / 1000000;
+#endif
+}
+
+int64_t estimateFilamentLength() {
+	return estimateFilament;
+}
+
+uint16_t estimateLayers() {
+	return estimateLayerCount;
 }
 
 //Set the estimation mode
@@ -244,11 +394,11 @@ void setEstimation(bool on) {
 	if (( estimating ) && ( ! on )) {
 		recentCommandClock = 0;
 		recentCommandTime  = 0;
-		command_buffer.reset();
+		clearBuffers();
 		sdcard::playbackRestart();
 	}
 	
-	estimateTimeUs = 0;
+	resetEstimate();
 	filamentLength = 0;
 	estimating = on;
 }
@@ -258,9 +408,9 @@ void buildAnotherCopy() {
 
 	recentCommandClock = 0;
 	recentCommandTime  = 0;
-	command_buffer.reset();
+	clearBuffers();
 	sdcard::playbackRestart();
-	estimateTimeUs = 0;
+	resetEstimate();
 	firstHeatTool0 = true;
 	firstHeatHbp = true;
 
@@ -269,11 +419,32 @@ void buildAnotherCopy() {
 }
 
 void estimateDelay(uint32_t microseconds) {
+#ifdef HAS_STEPPER_ACCELERATION
+	estimator.addDelay(microseconds);
+#else
 	estimateTimeUs += (int64_t)microseconds;
+#endif
 }
 
 void estimateDefinePosition(Point p) {
 	for ( uint8_t i = 0; i < AXIS_COUNT; i ++ )	lastPosition[i] = p[i];
+#ifdef HAS_STEPPER_ACCELERATION
+	estimator.definePosition(&p[0]);
+#endif
+}
+
+/// Count the filament of a move, and the layers both while estimating and while
+/// building, so the build can show the layer it's at. A layer starts with the first
+/// move that extrudes above the last layer, travel moves (e.g. a z hop) aren't layers.
+/// \param[in] extruded Steps extruded by the move
+/// \param[in] z Height the move is at (steps)
+void countExtrusion(int32_t extruded, int32_t z) {
+	if ( estimating )	estimateFilament += extruded;
+	else			filamentLength += (int64_t)extruded;
+	if (( extruded > 0 ) && (( estimateLayerCount == 0 ) || ( z > estimateLayerZ ))) {
+		estimateLayerCount ++;
+		estimateLayerZ = z;
+	}
 }
 
 int32_t estimateAbs(int32_t v) {
@@ -282,6 +453,9 @@ int32_t estimateAbs(int32_t v) {
 }
 
 void estimateMoveTo(Point p, int32_t dda) {
+#ifdef HAS_STEPPER_ACCELERATION
+	estimator.moveTo(&p[0], dda);
+#else
 	//Calculate deltas
 	Point delta;
 	for ( uint8_t i = 0; i < AXIS_COUNT; i ++ )	delta[i] = estimateAbs(lastPosition[i] - p[i]);
@@ -294,47 +468,622 @@ void estimateMoveTo(Point p, int32_t dda) {
 
 
 	estimateTimeUs += (int64_t)max * (int64_t)dda;
+#endif
 
-	if ( ! estimating ) {
-		filamentLength += (int64_t)(p[3] - lastPosition[3]);
-		filamentLength += (int64_t)(p[4] - lastPosition[4]);
-	}
+	countExtrusion((p[3] - lastPosition[3]) + (p[4] - lastPosition[4]), p[2]);
 
 	//Setup lastPosition as the current target
 	for ( uint8_t i = 0; i < AXIS_COUNT; i ++ )	lastPosition[i] = p[i];
 }
 
 void estimateMoveToNew(Point p, int32_t us, uint8_t relative) {
+#ifdef HAS_STEPPER_ACCELERATION
+	estimator.moveToNew(&p[0], us, relative);
+#else
 	estimateTimeUs += (int64_t)us;
+#endif
 
 	//Set last, based on if we moved relative or not on that axis
+	int32_t extruded = 0;
 	for ( uint8_t i = 0; i < AXIS_COUNT; i ++ ) {
 
 		if ( relative & (1 << i)) {
-			if (( ! estimating ) && (( i == 3 ) || ( i == 4 )))
-				filamentLength += (int64_t)p[i];
+			if (( i == 3 ) || ( i == 4 ))	extruded += p[i];
 			lastPosition[i] += p[i];
 		} else {
-			if (( ! estimating ) && (( i == 3 ) || ( i == 4 )))
-				filamentLength += (int64_t)(p[i] - lastPosition[i]);
+			if (( i == 3 ) || ( i == 4 ))	extruded += p[i] - lastPosition[i];
 			lastPosition[i]  = p[i];
 		}
 	}
+
+	countExtrusion(extruded, lastPosition[2]);
+}
+
+/// Decode the command at the front of the command buffer into cmd and remove it
+/// from the buffer. The command must be complete.
+void decodeCommand(DecodedCommand& cmd) {
+	// A compact move is decoded into the HOST_CMD_QUEUE_POINT_NEW it stands for
+	if ( command_buffer[0] == HOST_CMD_QUEUE_POINT_COMPACT ) {
+		uint8_t bytes[COMPACT_MOVE_MAX_LENGTH];
+		uint32_t us;
+		command_buffer.popN(bytes, compactmove::length(command_buffer[1], command_buffer[2]));
+		compactmove::decode(bytes, cmd.move.p, us);
+		cmd.tag = HOST_CMD_QUEUE_POINT_NEW;
+		cmd.move.dda = us;
+		cmd.move.relative = 0x1F;
+		return;
+	}
+
+	cmd.tag = command_buffer.pop(); // remove the command code
+
+	switch (cmd.tag) {
+	case HOST_CMD_QUEUE_POINT_ABS:
+	case HOST_CMD_QUEUE_POINT_EXT:
+	case HOST_CMD_QUEUE_POINT_NEW:
+	case HOST_CMD_SET_POSITION:
+	case HOST_CMD_SET_POSITION_EXT:
+		{
+			uint8_t axes = (( cmd.tag == HOST_CMD_QUEUE_POINT_ABS ) ||
+					( cmd.tag == HOST_CMD_SET_POSITION )) ? 3 : 5;
+			for (uint8_t i = 0; i < AXIS_COUNT; i ++)
+				cmd.move.p[i] = ( i < axes ) ? pop32() : 0;
+			if (( cmd.tag != HOST_CMD_SET_POSITION ) && ( cmd.tag != HOST_CMD_SET_POSITION_EXT ))
+				cmd.move.dda = pop32();
+			cmd.move.relative = ( cmd.tag == HOST_CMD_QUEUE_POINT_NEW ) ? pop8() : 0;
+		}
+		break;
+	case HOST_CMD_QUEUE_ARC:
+		for (uint8_t i = 0; i < 4; i ++)	cmd.arc.end[i] = pop32();
+		cmd.arc.center[0] = pop32();
+		cmd.arc.center[1] = pop32();
+		cmd.arc.us = pop32();
+		cmd.arc.flags = pop8();
+		break;
+	case HOST_CMD_CHANGE_TOOL:
+	case HOST_CMD_ENABLE_AXES:
+	case HOST_CMD_STORE_HOME_POSITION:
+	case HOST_CMD_RETRACT:
+	case HOST_CMD_UNRETRACT:
+	case HOST_CMD_RECALL_HOME_POSITION:
+	case HOST_CMD_BUZZER_REPEATS:
+		cmd.bytes[0] = pop8();
+		break;
+	case HOST_CMD_DELAY:
+		// parameter is in milliseconds; timeouts need microseconds
+		cmd.microseconds = pop32() * 1000;
+		break;
+	case HOST_CMD_FIND_AXES_MINIMUM:
+	case HOST_CMD_FIND_AXES_MAXIMUM:
+		cmd.homing.flags = pop8();
+		cmd.homing.feedrate = pop32(); // feedrate in us per step
+		cmd.homing.timeout_s = pop16();
+		break;
+	case HOST_CMD_WAIT_FOR_TOOL:
+	case HOST_CMD_WAIT_FOR_PLATFORM:
+		pop8();		// tool index
+		pop16();	// ping delay
+		cmd.microseconds = (uint16_t)pop16() * 1000000L;
+		break;
+	case HOST_CMD_TOOL_COMMAND:
+		cmd.tool.tool = pop8();
+		cmd.tool.code = pop8();
+		cmd.tool.length = pop8();
+		for (uint8_t i = 0; i < cmd.tool.length; i ++) {
+			uint8_t b = pop8();
+			if ( i < DECODED_TOOL_PAYLOAD )	cmd.tool.payload[i] = b;
+		}
+		if ( cmd.tool.length > DECODED_TOOL_PAYLOAD )	cmd.tool.length = DECODED_TOOL_PAYLOAD;
+		break;
+	case HOST_CMD_MOOD_LIGHT_SET_RGB:
+	case HOST_CMD_MOOD_LIGHT_SET_HSB:
+	case HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT:
+		{
+			uint8_t count = ( cmd.tag == HOST_CMD_MOOD_LIGHT_SET_RGB ) ? 5 :
+					( cmd.tag == HOST_CMD_MOOD_LIGHT_SET_HSB ) ? 4 : 2;
+			for (uint8_t i = 0; i < count; i ++)	cmd.args[i] = pop32();
+		}
+		break;
+	case HOST_CMD_BUZZER_BUZZ:
+		cmd.bytes[0] = pop8();	// buzzes
+		cmd.bytes[1] = pop8();	// duration
+		cmd.bytes[2] = pop8();	// repeats
+		break;
+	}
+}
+
+/// Decode the complete commands in the command buffer, until the decoded queue is full.
+/// An unknown command is never completed and stops the queue, as it always has.
+void decodeCommands() {
+	while (( decoded_count < DECODED_COMMAND_COUNT ) && ( command_buffer.getLength() > 0 )) {
+		uint16_t length = commandLength(command_buffer, command_buffer.getLength());
+		if (( length == 0 ) || ( command_buffer.getLength() < length ))	return;
+
+#if COMMAND_TRACING
+		decoded[decoded_head].trace = commandtrace::decoded();
+#endif
+		decodeCommand(decoded[decoded_head]);
+		decoded_head = (decoded_head + 1) & (DECODED_COMMAND_COUNT - 1);
+		decoded_count ++;
+	}
+}
+
+/// Sends a tool command to the tool
+/// \return false if the tool is busy and the command has to be retried
+bool runToolCommand(DecodedCommand& cmd) {
+	if ( ! tool::getLock() )	return false;
+
+	OutPacket& out = tool::getOutPacket();
+	out.reset();
+	out.append8(cmd.tool.tool); // copy tool index
+	uint8_t commandCode = cmd.tool.code;
+	out.append8(commandCode); // copy command code
+
+	uint16_t *temp = (uint16_t *)&cmd.tool.payload[0];
+
+	if (( commandCode == SLAVE_CMD_SET_TEMP ) && ( ! estimating ) &&
+	    ( ! sdcard::isPlaying()) ) {
+		if ( *temp == 0 ) addFilamentUsed();
+	}
+
+	uint8_t overrideTemp = 0;
+	if ( commandCode == SLAVE_CMD_SET_TEMP ) {
+		if (( *temp != 0 ) && ( firstHeatTool0 ) && ( eeprom::getEeprom8(eeprom::OVERRIDE_GCODE_TEMP, 0) )) {
+			firstHeatTool0 = false;
+			overrideTemp = eeprom::getEeprom8(eeprom::TOOL0_TEMP, 220);
+			*temp = overrideTemp;
+		}
+	}
+	if ( commandCode == SLAVE_CMD_SET_PLATFORM_TEMP ) {
+		if (( *temp != 0 ) && ( firstHeatHbp ) && ( eeprom::getEeprom8(eeprom::OVERRIDE_GCODE_TEMP, 0) )) {
+			firstHeatHbp = false;
+			overrideTemp = eeprom::getEeprom8(eeprom::PLATFORM_TEMP, 110);
+			*temp = overrideTemp;
+		}
+	}
+
+	for (uint8_t i = 0; i < cmd.tool.length; i ++)
+		out.append8(cmd.tool.payload[i]);
+
+	// we don't care about the response, so we can release
+	// the lock after we initiate the transfer
+	tool::startTransaction();
+	tool::releaseLock();
+	return true;
+}
+
+#ifdef HAS_STEPPER_ACCELERATION
+
+/// True for the tool commands that can ride along with the planner
+bool isDeferrableToolCode(uint8_t code) {
+	switch (code) {
+	case SLAVE_CMD_SET_TEMP:
+	case SLAVE_CMD_SET_PLATFORM_TEMP:
+	case SLAVE_CMD_SET_MOTOR_1_PWM:
+	case SLAVE_CMD_SET_MOTOR_2_PWM:
+	case SLAVE_CMD_SET_MOTOR_1_RPM:
+	case SLAVE_CMD_SET_MOTOR_2_RPM:
+	case SLAVE_CMD_SET_MOTOR_1_DIR:
+	case SLAVE_CMD_SET_MOTOR_2_DIR:
+	case SLAVE_CMD_TOGGLE_MOTOR_1:
+	case SLAVE_CMD_TOGGLE_MOTOR_2:
+	case SLAVE_CMD_TOGGLE_FAN:
+	case SLAVE_CMD_TOGGLE_VALVE:
+		return true;
+	}
+	return false;
+}
+
+/// True for commands that only have to keep their place between the moves around them,
+/// they can wait on the planner instead of draining it
+bool isDeferrable(const DecodedCommand& cmd) {
+	switch (cmd.tag) {
+	case HOST_CMD_TOOL_COMMAND:
+		return isDeferrableToolCode(cmd.tool.code);
+	case HOST_CMD_MOOD_LIGHT_SET_RGB:
+	case HOST_CMD_MOOD_LIGHT_SET_HSB:
+	case HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT:
+	case HOST_CMD_BUZZER_BUZZ:
+		return true;
+	}
+	return false;
+}
+
+#endif
+
+/// Read the retract settings from eeprom, every retract reads them so they can be
+/// tuned during a build
+/// \param[in] extruder 0 = A, 1 = B
+void loadRetractSettings(uint8_t extruder) {
+	retract_axis = ( extruder ) ? 4 : 3;
+
+	uint32_t length = eeprom::getEepromUInt32(eeprom::RETRACT_LENGTH, 100);
+	uint32_t feedrate = eeprom::getEepromUInt32(eeprom::RETRACT_FEEDRATE, 30);
+	if ( feedrate == 0 )	feedrate = 1;
+	retract_steps = (int32_t)((float)length * steppers::getStepsPerMM(retract_axis) / 100.0);
+	retract_us = length * 10000 / feedrate;
+
+	uint32_t hop = eeprom::getEepromUInt32(eeprom::RETRACT_Z_HOP, 0);
+	feedrate = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_Z, 10);
+	if ( feedrate == 0 )	feedrate = 1;
+	retract_hop_steps = (int32_t)((float)hop * steppers::getStepsPerMM(2) / 100.0);
+	retract_hop_us = hop * 10000 / feedrate;
+}
+
+/// Queue the moves of a retract or unretract. The extruder and the z hop are moves of
+/// their own, so the planner gives the extruder the retract acceleration. A retract
+/// pulls the filament back and then lifts z, an unretract does the opposite.
+/// \return false until all the moves are queued
+bool runRetract(DecodedCommand& cmd) {
+	bool retract = ( cmd.tag == HOST_CMD_RETRACT );
+	if ( retract_moves == 0 ) {
+		// Retracting twice, or unretracting without a retract, does nothing
+		if ( retracted == retract )	return true;
+		if ( retract )	loadRetractSettings(cmd.bytes[0]);
+	}
+
+	while ( retract_moves < 2 ) {
+		bool extruder = (( retract_moves == 0 ) == retract );
+		retract_moves ++;
+
+		int32_t delta[5] = { 0, 0, 0, 0, 0 };
+		int32_t steps = ( extruder ) ? retract_steps : retract_hop_steps;
+		if ( steps == 0 )	continue;
+		delta[( extruder ) ? retract_axis : 2] = ( extruder == retract ) ? -steps : steps;
+		uint32_t us = ( extruder ) ? retract_us : retract_hop_us;
+
+		recentCommandTime = recentCommandClock;
+		mode = MOVING;
+		Point p(delta[0], delta[1], delta[2], delta[3], delta[4]);
+		estimateMoveToNew(p,us,0x1F);
+		if ( ! estimating ) {
+			steppers::setTargetNew(p,us,0x1F);
+			// The next move once the steppers have room
+			if ( retract_moves < 2 )	return false;
+		}
+	}
+
+	retract_moves = 0;
+	retracted = retract;
+	return true;
+}
+
+/// Execute a decoded command
+/// \return false if the command couldn't be run yet, or hasn't finished (an arc), and has to be run again
+bool runCommand(DecodedCommand& cmd) {
+#ifdef HAS_STEPPER_ACCELERATION
+	// Commands that drain the planner bring the estimate to a stop as well
+	if (( cmd.tag != HOST_CMD_QUEUE_POINT_ABS ) &&
+	    ( cmd.tag != HOST_CMD_QUEUE_POINT_EXT ) &&
+	    ( cmd.tag != HOST_CMD_QUEUE_POINT_NEW ) &&
+	    ( cmd.tag != HOST_CMD_QUEUE_ARC ) && ( cmd.tag != HOST_CMD_RETRACT ) &&
+	    ( cmd.tag != HOST_CMD_UNRETRACT ) && ( ! isDeferrable(cmd) ))
+		estimator.flush();
+#endif
+
+	switch (cmd.tag) {
+	case HOST_CMD_QUEUE_POINT_ABS:
+	case HOST_CMD_QUEUE_POINT_EXT:
+		{
+			recentCommandTime = recentCommandClock;
+			mode = MOVING;
+			Point p(cmd.move.p[0], cmd.move.p[1], cmd.move.p[2], cmd.move.p[3], cmd.move.p[4]);
+			estimateMoveTo(p,cmd.move.dda);
+			if ( ! estimating )	steppers::setTarget(p,cmd.move.dda);
+		}
+		break;
+	case HOST_CMD_QUEUE_POINT_NEW:
+		{
+			recentCommandTime = recentCommandClock;
+			mode = MOVING;
+			Point p(cmd.move.p[0], cmd.move.p[1], cmd.move.p[2], cmd.move.p[3], cmd.move.p[4]);
+			estimateMoveToNew(p,cmd.move.dda,cmd.move.relative);
+			if ( ! estimating )	steppers::setTargetNew(p,cmd.move.dda,cmd.move.relative);
+		}
+		break;
+	case HOST_CMD_QUEUE_ARC:
+		{
+			recentCommandTime = recentCommandClock;
+			mode = MOVING;
+			if ( ! arc.isActive() ) {
+				int32_t end[ARC_AXIS_COUNT] = { cmd.arc.end[0], cmd.arc.end[1], cmd.arc.end[2], 0, 0 };
+				end[( cmd.arc.flags & ARC_FLAG_EXTRUDER_B ) ? 4 : 3] = cmd.arc.end[3];
+				arc.start(end, cmd.arc.center[0], cmd.arc.center[1],
+					  cmd.arc.flags & ARC_FLAG_CLOCKWISE, cmd.arc.us);
+			}
+
+			// One chord at a time as the steppers make room, all of them while estimating
+			do {
+				int32_t delta[ARC_AXIS_COUNT];
+				uint32_t us;
+				arc.next(delta, us);
+				Point p(delta[0], delta[1], delta[2], delta[3], delta[4]);
+				estimateMoveToNew(p,us,0x1F);
+				if ( ! estimating )	steppers::setTargetNew(p,us,0x1F);
+			} while (( estimating ) && ( arc.isActive() ));
+
+			if ( arc.isActive() )	return false;
+		}
+		break;
+	case HOST_CMD_RETRACT:
+	case HOST_CMD_UNRETRACT:
+		return runRetract(cmd);
+	case HOST_CMD_CHANGE_TOOL:
+		if ( ! estimating ) tool::setCurrentToolheadIndex(cmd.bytes[0]);
+		break;
+	case HOST_CMD_ENABLE_AXES:
+		{
+			recentCommandTime = recentCommandClock;
+			uint8_t axes = cmd.bytes[0];
+			bool enable = (axes & 0x80) != 0;
+			for (int i = 0; i < STEPPER_COUNT; i++) {
+				if ((axes & _BV(i)) != 0) {
+					if ( ! estimating ) steppers::enableAxis(i, enable);
+				}
+			}
+		}
+		break;
+	case HOST_CMD_SET_POSITION:
+	case HOST_CMD_SET_POSITION_EXT:
+		{
+			Point p(cmd.move.p[0], cmd.move.p[1], cmd.move.p[2], cmd.move.p[3], cmd.move.p[4]);
+			estimateDefinePosition(p);
+			if ( ! estimating )	steppers::definePosition(p);
+		}
+		break;
+	case HOST_CMD_DELAY:
+		mode = DELAY;
+		estimateDelay(cmd.microseconds);
+		if ( ! estimating )	delay_timeout.start(cmd.microseconds);
+		break;
+	case HOST_CMD_FIND_AXES_MINIMUM:
+	case HOST_CMD_FIND_AXES_MAXIMUM:
+		mode = HOMING;
+		homing_timeout.start(cmd.homing.timeout_s * 1000L * 1000L);
+		if ( ! estimating )
+			steppers::startHoming(cmd.tag==HOST_CMD_FIND_AXES_MAXIMUM,
+					      cmd.homing.flags,
+					      cmd.homing.feedrate);
+		break;
+	case HOST_CMD_WAIT_FOR_TOOL:
+	case HOST_CMD_WAIT_FOR_PLATFORM:
+		mode = ( cmd.tag == HOST_CMD_WAIT_FOR_TOOL ) ? WAIT_ON_TOOL : WAIT_ON_PLATFORM;
+		if ( ! estimating ) tool_wait_timeout.start(cmd.microseconds);
+		break;
+	case HOST_CMD_STORE_HOME_POSITION:
+		if ( ! estimating ) {
+			// Go through each axis, and if that axis is specified, read it's value,
+			// then record it to the eeprom.
+			for (uint8_t i = 0; i < STEPPER_COUNT; i++) {
+				if ( cmd.bytes[0] & (1 << i) ) {
+					uint16_t offset = eeprom::AXIS_HOME_POSITIONS + 4*i;
+					uint32_t position = steppers::getPosition()[i];
+					cli();
+					eeprom_write_block(&position, (void*) offset, 4);
+					sei();
+				}
+			}
+		}
+		break;
+	case HOST_CMD_RECALL_HOME_POSITION:
+		{
+			Point newPoint;
+			if ( estimating )	newPoint = lastPosition;
+			else			newPoint = steppers::getPosition();
+
+			for (uint8_t i = 0; i < STEPPER_COUNT; i++) {
+				if ( cmd.bytes[0] & (1 << i) ) {
+					uint16_t offset = eeprom::AXIS_HOME_POSITIONS + 4*i;
+					cli();
+					eeprom_read_block(&(newPoint[i]), (void*) offset, 4);
+					sei();
+				}
+			}
+
+			estimateDefinePosition(newPoint);
+			if ( ! estimating )	steppers::definePosition(newPoint);
+		}
+		break;
+	case HOST_CMD_TOOL_COMMAND:
+		if ( ! estimating )	return runToolCommand(cmd);
+		break;
+	case HOST_CMD_MOOD_LIGHT_SET_RGB:
+#ifdef HAS_MOOD_LIGHT
+		if ( ! estimating )
+			Motherboard::getBoard().MoodLightSetRGBColor((uint8_t)cmd.args[0], (uint8_t)cmd.args[1], (uint8_t)cmd.args[2], (uint8_t)cmd.args[3], (uint8_t)cmd.args[4]);
+#endif
+		break;
+	case HOST_CMD_MOOD_LIGHT_SET_HSB:
+#ifdef HAS_MOOD_LIGHT
+		if ( ! estimating )	Motherboard::getBoard().MoodLightSetHSBColor((uint8_t)cmd.args[0], (uint8_t)cmd.args[1], (uint8_t)cmd.args[2], (uint8_t)cmd.args[3]);
+#endif
+		break;
+	case HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT:
+#ifdef HAS_MOOD_LIGHT
+		if ( ! estimating )	Motherboard::getBoard().MoodLightPlayScript((uint8_t)cmd.args[0], (uint8_t)cmd.args[1]);
+#endif
+		break;
+	case HOST_CMD_BUZZER_REPEATS:
+		if ( ! estimating ) {
+			cli();
+			eeprom_write_byte((uint8_t*)eeprom::BUZZER_REPEATS, cmd.bytes[0]);
+			sei();
+		}
+		break;
+	case HOST_CMD_BUZZER_BUZZ:
+#ifdef HAS_BUZZER
+		if ( ! estimating ) {
+			if ( cmd.bytes[0] == 0 )	Motherboard::getBoard().stopBuzzer();
+			else 				Motherboard::getBoard().buzz(cmd.bytes[0], cmd.bytes[1], cmd.bytes[2]);
+		}
+#endif
+		break;
+	}
+	return true;
+}
+
+#ifdef HAS_STEPPER_ACCELERATION
+
+/// Move the next decoded command onto the deferred queue and attach it to the planner
+/// \return false if the deferred queue is full
+bool deferCommand() {
+	if ( deferred_count == DEFERRED_COMMAND_COUNT )	return false;
+
+#if COMMAND_TRACING
+	commandtrace::dispatched(decoded[decoded_tail].trace, decoded[decoded_tail].tag);
+#endif
+	deferred[deferred_head] = decoded[decoded_tail];
+	deferred_head = (deferred_head + 1) & (DEFERRED_COMMAND_COUNT - 1);
+	deferred_count ++;
+	st_attach_command();
+
+	decoded_tail = (decoded_tail + 1) & (DECODED_COMMAND_COUNT - 1);
+	decoded_count --;
+	return true;
+}
+
+/// Run the oldest deferred command if the step engine has reached it
+void runDeferredCommand() {
+	if (( deferred_count == 0 ) || ( st_commands_due() == 0 ))	return;
+
+	if ( runCommand(deferred[deferred_tail]) ) {
+#if COMMAND_TRACING
+		commandtrace::ran(deferred[deferred_tail].trace);
+#endif
+		deferred_tail = (deferred_tail + 1) & (DEFERRED_COMMAND_COUNT - 1);
+		deferred_count --;
+		st_command_done();
+	}
+}
+
+#endif
+
+/// Top up the command buffer from the SD card. Reads straight into the free space
+/// of the buffer, it can be in two pieces.
+void fillFromSD() {
+	for (uint8_t i = 0; ( i < 2 ) && ( sdcard::playbackHasNext() ); i ++) {
+		BufSizeType len;
+		uint8_t *span = command_buffer.writeSpan(len);
+		if ( len == 0 )	break;
+		command_buffer.commitPush(sdcard::playbackRead(span, len));
+	}
+}
+
+/// Estimate the complete command at the front of the command buffer and remove it.
+/// Only the commands that take time are decoded, the rest are skipped over in place.
+void estimateCommand(uint16_t length) {
+	uint8_t command = command_buffer[0];
+
+	switch (command) {
+	case HOST_CMD_QUEUE_POINT_ABS:
+	case HOST_CMD_QUEUE_POINT_EXT:
+	case HOST_CMD_QUEUE_POINT_NEW:
+	case HOST_CMD_QUEUE_POINT_COMPACT:
+	case HOST_CMD_QUEUE_ARC:
+	case HOST_CMD_RETRACT:
+	case HOST_CMD_UNRETRACT:
+	case HOST_CMD_SET_POSITION:
+	case HOST_CMD_SET_POSITION_EXT:
+	case HOST_CMD_DELAY:
+	case HOST_CMD_RECALL_HOME_POSITION:
+		{
+			DecodedCommand cmd;
+			decodeCommand(cmd);
+			runCommand(cmd);
+		}
+		// nothing is waited for while estimating
+		mode = READY;
+		return;
+	}
+
+#ifdef HAS_STEPPER_ACCELERATION
+	// Skipped commands that drain the planner still bring the estimate to a stop
+	bool deferrable;
+	switch (command) {
+	case HOST_CMD_TOOL_COMMAND:
+		deferrable = isDeferrableToolCode(command_buffer[2]);
+		break;
+	case HOST_CMD_MOOD_LIGHT_SET_RGB:
+	case HOST_CMD_MOOD_LIGHT_SET_HSB:
+	case HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT:
+	case HOST_CMD_BUZZER_BUZZ:
+		deferrable = true;
+		break;
+	default:
+		deferrable = false;
+		break;
+	}
+	if ( ! deferrable )	estimator.flush();
+#endif
+
+	command_buffer.popN(0, length);
+}
+
+/// Estimate from the SD card. Instead of one command per slice, the file is read in
+/// bulk and estimated in a tight loop; every ESTIMATE_SLICE_MICROS the loop returns to
+/// give the host, tool and interface slices a turn.
+void runEstimateSlice() {
+	Timeout slice;
+	slice.start(ESTIMATE_SLICE_MICROS);
+
+	do {
+		fillFromSD();
+
+		while ( command_buffer.getLength() > 0 ) {
+			uint16_t length = commandLength(command_buffer, command_buffer.getLength());
+			// An unknown command is never completed and stops the estimate, as it
+			// stops the build. So does a command cut short by the end of the file
+			// before its length is known.
+			if ( length == 0 ) {
+				if ( ! sdcard::playbackHasNext() )	command_buffer.reset();
+				return;
+			}
+			if ( command_buffer.getLength() < length )	break;
+			estimateCommand(length);
+		}
+
+		if ( ! sdcard::playbackHasNext() ) {
+			// A command cut short by the end of the file is never completed, drop
+			// it or the estimate never finishes
+			command_buffer.reset();
+			return;
+		}
+	} while ( ! slice.hasElapsed() );
+}
+
+bool isStarving() {
+	if (( estimating ) || ( paused ) || (( decoded_count == 0 ) && ( command_buffer.isEmpty() )))
+		return false;
+#ifdef HAS_STEPPER_ACCELERATION
+	return movesplanned() < BLOCK_BUFFER_SIZE / 4;
+#else
+	return ! steppers::isRunning();
+#endif
 }
 
 // A fast slice for processing commands and refilling the stepper queue, etc.
 void runCommandSlice() {
 	recentCommandClock ++;
 
+	if (( estimating ) && ( sdcard::isPlaying() )) {
+		runEstimateSlice();
+		return;
+	}
+
 #ifdef HAS_MOOD_LIGHT
 	if ( ! estimating )	updateMoodStatus();
 #endif
 
-	if (sdcard::isPlaying()) {
-		while (command_buffer.getRemainingCapacity() > 0 && sdcard::playbackHasNext()) {
-			command_buffer.push(sdcard::playbackNext());
-		}
-	}
+	if (sdcard::isPlaying())	fillFromSD();
+	decodeCommands();
+#if COMMAND_TRACING
+	commandtrace::update();
+#endif
+
+#ifdef HAS_STEPPER_ACCELERATION
+	// The moves already planned carry on while paused, so do the commands between them
+	if ( ! estimating )	runDeferredCommand();
+#endif
+
 	if ((paused) && ( ! estimating ))  { return; }
 
 	//If we've reached Pause @ ZPos, then pause
@@ -360,7 +1109,7 @@ void runCommandSlice() {
 		}
 	}
 	if (mode == MOVING) {
-		if (!steppers::isRunning()) { mode = READY; }
+		if (!steppers::isQueueFull()) { mode = READY; }
 	}
 	if (mode == DELAY) {
 		// check timers
@@ -384,325 +1133,48 @@ void runCommandSlice() {
 	}
 
 #ifdef HAS_STEPPER_ACCELERATION
-	//If we're running acceleration, we want to populate the pipeline buffer,
+	//All moves go through the planner, we want to populate the pipeline buffer,
 	//but we also need to sync (wait for the pipeline buffer to clear) on certain
 	//commands, we do that here
-	if (( acceleration ) && ( mode == READY ) && ( ! estimating )) {
-		if (command_buffer.getLength() > 0) {
-			uint8_t command = command_buffer.peek();
+	if (( mode == READY ) && ( ! estimating )) {
+		if (decoded_count > 0) {
+			uint8_t command = decoded[decoded_tail].tag;
+
+			//Commands that only need to keep their place between the moves ride
+			//along with the planner, the step engine releases them
+			if ( isDeferrable(decoded[decoded_tail]) ) {
+				deferCommand();
+				return;
+			}
 		
 			//If we're not pipeline'able command, then we sync here,
-			//by waiting for the pipeline buffer to empty before continuing
+			//by waiting for the pipeline buffer and the deferred commands
+			//to empty before continuing
 			if ((command != HOST_CMD_QUEUE_POINT_ABS) &&
 			    (command != HOST_CMD_QUEUE_POINT_EXT) &&
-			    (command != HOST_CMD_QUEUE_POINT_NEW)) {
-				if ( ! st_empty() )	return;
+			    (command != HOST_CMD_QUEUE_POINT_NEW) &&
+			    (command != HOST_CMD_QUEUE_ARC) &&
+			    (command != HOST_CMD_RETRACT) &&
+			    (command != HOST_CMD_UNRETRACT)) {
+				if (( ! st_empty() ) || ( deferred_count > 0 ))	return;
 			}
 		}
 		else return;
 	}
 #endif
 
-	Point p;
 	if (mode == READY) {
-		// process next command on the queue.
-		if (command_buffer.getLength() > 0) {
-			uint8_t command = command_buffer[0];
-			if (command == HOST_CMD_QUEUE_POINT_ABS) {
-				recentCommandTime = recentCommandClock;
-				// check for completion
-				if (command_buffer.getLength() >= 17) {
-					command_buffer.pop(); // remove the command code
-					mode = MOVING;
-					int32_t x = pop32();
-					int32_t y = pop32();
-					int32_t z = pop32();
-					int32_t dda = pop32();
-					estimateMoveTo(Point(x,y,z),dda);
-					if ( ! estimating )	steppers::setTarget(Point(x,y,z),dda);
-				}
-			} else if (command == HOST_CMD_QUEUE_POINT_EXT) {
-				recentCommandTime = recentCommandClock;
-				// check for completion
-				if (command_buffer.getLength() >= 25) {
-					command_buffer.pop(); // remove the command code
-					mode = MOVING;
-					int32_t x = pop32();
-					int32_t y = pop32();
-					int32_t z = pop32();
-					int32_t a = pop32();
-					int32_t b = pop32();
-					int32_t dda = pop32();
-					estimateMoveTo(Point(x,y,z,a,b),dda);
-					if ( ! estimating )	steppers::setTarget(Point(x,y,z,a,b),dda);
-				}
-			} else if (command == HOST_CMD_QUEUE_POINT_NEW) {
-				recentCommandTime = recentCommandClock;
-				// check for completion
-				if (command_buffer.getLength() >= 26) {
-					command_buffer.pop(); // remove the command code
-					mode = MOVING;
-					int32_t x = pop32();
-					int32_t y = pop32();
-					int32_t z = pop32();
-					int32_t a = pop32();
-					int32_t b = pop32();
-					int32_t us = pop32();
-					uint8_t relative = pop8();
-					estimateMoveToNew(Point(x,y,z,a,b),us,relative);
-					if ( ! estimating )	steppers::setTargetNew(Point(x,y,z,a,b),us,relative);
-				}
-			} else if (command == HOST_CMD_CHANGE_TOOL) {
-				if (command_buffer.getLength() >= 2) {
-					command_buffer.pop(); // remove the command code
-					uint8_t tIndex = command_buffer.pop();
-                                        if ( ! estimating ) tool::setCurrentToolheadIndex(tIndex);
-				}
-			} else if (command == HOST_CMD_ENABLE_AXES) {
-				recentCommandTime = recentCommandClock;
-				if (command_buffer.getLength() >= 2) {
-					command_buffer.pop(); // remove the command code
-					uint8_t axes = command_buffer.pop();
-					bool enable = (axes & 0x80) != 0;
-					for (int i = 0; i < STEPPER_COUNT; i++) {
-						if ((axes & _BV(i)) != 0) {
-							if ( ! estimating ) steppers::enableAxis(i, enable);
-						}
-					}
-				}
-			} else if (command == HOST_CMD_SET_POSITION) {
-				// check for completion
-				if (command_buffer.getLength() >= 13) {
-					command_buffer.pop(); // remove the command code
-					int32_t x = pop32();
-					int32_t y = pop32();
-					int32_t z = pop32();
-					estimateDefinePosition(Point(x,y,z));
-					if ( ! estimating )	steppers::definePosition(Point(x,y,z));
-				}
-			} else if (command == HOST_CMD_SET_POSITION_EXT) {
-				// check for completion
-				if (command_buffer.getLength() >= 21) {
-					command_buffer.pop(); // remove the command code
-					int32_t x = pop32();
-					int32_t y = pop32();
-					int32_t z = pop32();
-					int32_t a = pop32();
-					int32_t b = pop32();
-					estimateDefinePosition(Point(x,y,z,a,b));
-					if ( ! estimating )	steppers::definePosition(Point(x,y,z,a,b));
-				}
-			} else if (command == HOST_CMD_DELAY) {
-				if (command_buffer.getLength() >= 5) {
-					mode = DELAY;
-					command_buffer.pop(); // remove the command code
-					// parameter is in milliseconds; timeouts need microseconds
-					uint32_t microseconds = pop32() * 1000;
-					estimateDelay(microseconds);
-					if ( ! estimating )	delay_timeout.start(microseconds);
-				}
-			} else if (command == HOST_CMD_FIND_AXES_MINIMUM ||
-					command == HOST_CMD_FIND_AXES_MAXIMUM) {
-				if (command_buffer.getLength() >= 8) {
-					command_buffer.pop(); // remove the command
-					uint8_t flags = pop8();
-					uint32_t feedrate = pop32(); // feedrate in us per step
-					uint16_t timeout_s = pop16();
-					bool direction = command == HOST_CMD_FIND_AXES_MAXIMUM;
-					mode = HOMING;
-					homing_timeout.start(timeout_s * 1000L * 1000L);
-					if ( ! estimating )
-						steppers::startHoming(command==HOST_CMD_FIND_AXES_MAXIMUM,
-								      flags,
-								      feedrate);
-				}
-			} else if (command == HOST_CMD_WAIT_FOR_TOOL) {
-				if (command_buffer.getLength() >= 6) {
-					mode = WAIT_ON_TOOL;
-					command_buffer.pop();
-					uint8_t currentToolIndex = command_buffer.pop();
-					uint16_t toolPingDelay = (uint16_t)pop16();
-					uint16_t toolTimeout = (uint16_t)pop16();
-					if ( ! estimating ) tool_wait_timeout.start(toolTimeout*1000000L);
-				}
-			} else if (command == HOST_CMD_WAIT_FOR_PLATFORM) {
-				if (command_buffer.getLength() >= 6) {
-					mode = WAIT_ON_PLATFORM;
-					command_buffer.pop();
-					uint8_t currentToolIndex = command_buffer.pop();
-					uint16_t toolPingDelay = (uint16_t)pop16();
-					uint16_t toolTimeout = (uint16_t)pop16();
-					if ( ! estimating ) tool_wait_timeout.start(toolTimeout*1000000L);
-				}
-			} else if (command == HOST_CMD_STORE_HOME_POSITION) {
-				// check for completion
-				if (command_buffer.getLength() >= 2) {
-					command_buffer.pop();
-					uint8_t axes = pop8();
-
-					if ( ! estimating ) {
-						// Go through each axis, and if that axis is specified, read it's value,
-						// then record it to the eeprom.
-						for (uint8_t i = 0; i < STEPPER_COUNT; i++) {
-							if ( axes & (1 << i) ) {
-								uint16_t offset = eeprom::AXIS_HOME_POSITIONS + 4*i;
-								uint32_t position = steppers::getPosition()[i];
-								cli();
-								eeprom_write_block(&position, (void*) offset, 4);
-								sei();
-							}
-						}
-					}
-				}
-			} else if (command == HOST_CMD_RECALL_HOME_POSITION) {
-				// check for completion
-				if (command_buffer.getLength() >= 2) {
-					command_buffer.pop();
-					uint8_t axes = pop8();
-		
-					Point newPoint;
-					if ( estimating )	newPoint = lastPosition;
-					else			newPoint = steppers::getPosition();
-
-					for (uint8_t i = 0; i < STEPPER_COUNT; i++) {
-						if ( axes & (1 << i) ) {
-							uint16_t offset = eeprom::AXIS_HOME_POSITIONS + 4*i;
-							cli();
-							eeprom_read_block(&(newPoint[i]), (void*) offset, 4);
-							sei();
-						}
-					}
-
-					estimateDefinePosition(newPoint);
-					if ( ! estimating )	steppers::definePosition(newPoint);
-				}
-
-			} else if (command == HOST_CMD_TOOL_COMMAND) {
-				if (command_buffer.getLength() >= 4) { // needs a payload
-					uint8_t payload_length = command_buffer[3];
-					if (command_buffer.getLength() >= 4+payload_length) {
-						// command is ready
-						if ( estimating ) {
-							command_buffer.pop();
-							command_buffer.pop();
-							command_buffer.pop();
-							int len = pop8();
-							for (int i = 0; i < len; i++) command_buffer.pop();
-						} else {
-							if (tool::getLock()) {
-								OutPacket& out = tool::getOutPacket();
-								out.reset();
-								command_buffer.pop(); // remove the command code
-								out.append8(command_buffer.pop()); // copy tool index
-								uint8_t commandCode = command_buffer.pop();
-								out.append8(commandCode); // copy command code
-
-								int len = pop8(); // get payload length
-
-								uint8_t buf[4];
-								for (int i = 0; (i < len) && ( i < 4); i ++)
-									buf[i] = command_buffer.pop();
-
-								if (( commandCode == SLAVE_CMD_SET_TEMP ) && ( ! estimating ) &&
-								    ( ! sdcard::isPlaying()) ) {
-									uint16_t *temp = (uint16_t *)&buf[0];
-									if ( *temp == 0 ) addFilamentUsed();
-								}
-
-								uint8_t overrideTemp = 0;
-								if ( commandCode == SLAVE_CMD_SET_TEMP ) {
-									uint16_t *temp = (uint16_t *)&buf[0];
-               								if (( *temp != 0 ) && ( firstHeatTool0 ) && ( eeprom::getEeprom8(eeprom::OVERRIDE_GCODE_TEMP, 0) )) {
-										firstHeatTool0 = false;
-										overrideTemp = eeprom::getEeprom8(eeprom::TOOL0_TEMP, 220);
-										*temp = overrideTemp;
-									}
-								}
-								if ( commandCode == SLAVE_CMD_SET_PLATFORM_TEMP ) {
-									uint16_t *temp = (uint16_t *)&buf[0];
-               								if (( *temp != 0 ) && ( firstHeatHbp ) && ( eeprom::getEeprom8(eeprom::OVERRIDE_GCODE_TEMP, 0) )) {
-										firstHeatHbp = false;
-										overrideTemp = eeprom::getEeprom8(eeprom::PLATFORM_TEMP, 110);
-										*temp = overrideTemp;
-									}
-								}
-
-								for (int i = 0; (i < len) && ( i < 4); i ++)
-									out.append8(buf[i]);
-
-								for (int i = 4; i < len; i ++ )
-									out.append8(command_buffer.pop());
-
-								// we don't care about the response, so we can release
-								// the lock after we initiate the transfer
-								tool::startTransaction();
-								tool::releaseLock();
-							}
-						}
-					}
-				}
-			} else if (command == HOST_CMD_MOOD_LIGHT_SET_RGB ) {
-				// check for completion
-				if (command_buffer.getLength() >= 21) {
-					command_buffer.pop(); // remove the command code
-					int32_t r = pop32();
-					int32_t g = pop32();
-					int32_t b = pop32();
-					int32_t fadeSpeed = pop32();
-					int32_t writeToEeprom = pop32();
-#ifdef HAS_MOOD_LIGHT
-					if ( ! estimating )
-						Motherboard::getBoard().MoodLightSetRGBColor((uint8_t)r, (uint8_t)g, (uint8_t)b, (uint8_t)fadeSpeed, (uint8_t)writeToEeprom);
+		// run the next decoded command
+#if COMMAND_TRACING
+		if ( decoded_count > 0 )
+			commandtrace::dispatched(decoded[decoded_tail].trace, decoded[decoded_tail].tag);
 #endif
-				}
-			} else if (command == HOST_CMD_MOOD_LIGHT_SET_HSB ) {
-				// check for completion
-				if (command_buffer.getLength() >= 17) {
-					command_buffer.pop(); // remove the command code
-					int32_t h = pop32();
-					int32_t s = pop32();
-					int32_t b = pop32();
-					int32_t fadeSpeed = pop32();
-#ifdef HAS_MOOD_LIGHT
-					if ( ! estimating )	Motherboard::getBoard().MoodLightSetHSBColor((uint8_t)h, (uint8_t)s, (uint8_t)b, (uint8_t)fadeSpeed);
-#endif
-				}
-			} else if (command == HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT ) {
-				// check for completion
-				if (command_buffer.getLength() >= 9) {
-					command_buffer.pop(); // remove the command code
-					int32_t scriptId = pop32();
-					int32_t writeToEeprom = pop32();
-#ifdef HAS_MOOD_LIGHT
-					if ( ! estimating )	Motherboard::getBoard().MoodLightPlayScript((uint8_t)scriptId, (uint8_t)writeToEeprom);
+		if (( decoded_count > 0 ) && ( runCommand(decoded[decoded_tail]) )) {
+#if COMMAND_TRACING
+			commandtrace::ran(decoded[decoded_tail].trace);
 #endif
-				}
-			} else if (command == HOST_CMD_BUZZER_REPEATS ) {
-				// check for completion
-				if (command_buffer.getLength() >= 2) {
-					command_buffer.pop(); // remove the command code
-					if ( ! estimating ) {
-						cli();
-        					eeprom_write_byte((uint8_t*)eeprom::BUZZER_REPEATS, pop8());
-						sei();
-					}
-				}
-			} else if (command == HOST_CMD_BUZZER_BUZZ ) {
-				// check for completion
-				if (command_buffer.getLength() >= 7) {
-					command_buffer.pop(); // remove the command code
-					uint8_t buzzes   = pop8();
-					uint8_t duration = pop8();
-					uint8_t repeats  = pop8();
-#ifdef HAS_BUZZER
-					if ( ! estimating ) {
-						if ( buzzes == 0 )	Motherboard::getBoard().stopBuzzer();
-						else 			Motherboard::getBoard().buzz(buzzes, duration, repeats);
-					}
-#endif
-				}
-			} else {
-			}
+			decoded_tail = (decoded_tail + 1) & (DECODED_COMMAND_COUNT - 1);
+			decoded_count --;
 		}
 	}
 }
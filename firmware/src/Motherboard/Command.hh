@@ -34,6 +34,11 @@ void addFilamentUsed();
 /// Run the command thread slice.
 void runCommandSlice();
 
+/// Check if the steppers are about to run out of moves while there are commands
+/// waiting, and the command slice should run as often as it can
+/// \return True if the command slice is urgent
+bool isStarving();
+
 void updateMoodStatus();
 
 /// Pause the command processor
@@ -62,12 +67,25 @@ int64_t getLastFilamentLength();
 //Returns the number of seconds estimated
 int32_t estimateSeconds();
 
+/// Returns the length of filament the build being estimated uses (in steps)
+int64_t estimateFilamentLength();
+
+/// Returns the number of layers of the build being estimated, or while building
+/// the layer the build is at
+uint16_t estimateLayers();
+
 //Set the estimation mode
 void setEstimation(bool on);
 
-//Build another copy
+//Build another copy. The file isn't estimated or looked up in the estimate cache
+//again: monitor mode keeps the duration, filament and layers of the first copy, so
+//this only restarts the playback and the counts the build display runs from.
 void buildAnotherCopy();
 
+/// Throw away the commands waiting for moves, the moves were thrown away by
+/// steppers::abort()
+void discardDeferred();
+
 /// Check the remaining capacity of the command buffer
 /// \return Amount of space left in the buffer, in bytes
 uint16_t getRemainingCapacity();
@@ -81,6 +99,35 @@ bool isEmpty();
 /// \param[in] byte Byte to add to the buffer.
 void push(uint8_t byte);
 
+/// Push a whole command onto the command buffer. Nothing is pushed if it doesn't
+/// all fit.
+/// \param[in] bytes Command to add to the buffer.
+/// \param[in] length Length of the command.
+/// \return True if the command was added.
+bool push(const uint8_t* bytes, uint16_t length);
+
+/// Check that a command from the host can be run once it's queued: the payload of a
+/// tool command has to fit in a tool packet.
+/// \param[in] bytes The command.
+/// \param[in] length Length of the command.
+/// \return True if the command has to be refused with RC_PACKET_TOO_BIG.
+bool isTooBig(const uint8_t* bytes, uint16_t length);
+
+/// checkBatch() errors
+enum {
+	BATCH_INVALID	= -1,	///< A command is unknown, or the last one doesn't end with the batch
+	BATCH_TOO_BIG	= -2	///< A command is too big, see isTooBig()
+};
+
+/// Check a batch of whole commands, back to back. Every command has to be known and
+/// the last one has to end with the batch.
+/// \param[in] bytes Commands of the batch.
+/// \param[in] length Length of the batch.
+/// \param[in,out] fit Space for the commands, set to the length of the commands at
+///                    the start of the batch that fit in it.
+/// \return Number of commands that fit, #BATCH_INVALID or #BATCH_TOO_BIG.
+int8_t checkBatch(const uint8_t* bytes, uint16_t length, uint16_t& fit);
+
 }
 
 #endif // COMMAND_HH_
@@ -0,0 +1,48 @@
+/*
+ * Command Checks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "Command.hh"
+#include "CommandCheck.hh"
+
+namespace command {
+
+bool isTooBig(const uint8_t* bytes, uint16_t length) {
+	return ( bytes[0] == HOST_CMD_TOOL_COMMAND ) && ( length >= 4 ) &&
+		( bytes[3] > TOOL_COMMAND_MAX_PAYLOAD );
+}
+
+int8_t checkBatch(const uint8_t* bytes, uint16_t length, uint16_t& fit) {
+	uint16_t space = fit;
+	int8_t count = 0, fitting = 0;
+	uint16_t offset = 0;
+	fit = 0;
+	while ( offset < length ) {
+		const uint8_t *command = bytes + offset;
+		uint16_t command_length = commandLength(command, length - offset);
+		if (( command_length == 0 ) || ( offset + command_length > length ))	return BATCH_INVALID;
+		if ( isTooBig(command, command_length) )	return BATCH_TOO_BIG;
+		offset += command_length;
+		count ++;
+		if ( offset <= space ) {
+			fit = offset;
+			fitting = count;
+		}
+	}
+	return fitting;
+}
+
+}
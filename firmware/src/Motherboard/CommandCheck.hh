@@ -0,0 +1,76 @@
+/*
+ * Command Checks
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef COMMAND_CHECK_HH_
+#define COMMAND_CHECK_HH_
+
+#include <stdint.h>
+#include "Commands.hh"
+#include "Packet.hh"
+#include "CompactMove.hh"
+#include "ArcSegmenter.hh"
+
+/// Largest tool command payload, a tool command has to fit in a tool packet, which
+/// only has the 8 bit length framing
+#define TOOL_COMMAND_MAX_PAYLOAD	(LEGACY_PACKET_PAYLOAD - 4)
+
+namespace command {
+
+/// Length of a command, including the command code
+/// \param[in] bytes The command, in the command buffer or in a packet
+/// \param[in] available Number of bytes of the command there are so far
+/// \return 0 if the command is unknown or its length isn't known yet
+template <typename Bytes>
+uint16_t commandLength(Bytes& bytes, uint16_t available) {
+	switch (bytes[0]) {
+	case HOST_CMD_QUEUE_POINT_ABS:		return 17;
+	case HOST_CMD_QUEUE_POINT_EXT:		return 25;
+	case HOST_CMD_QUEUE_POINT_NEW:		return 26;
+	case HOST_CMD_CHANGE_TOOL:		return 2;
+	case HOST_CMD_ENABLE_AXES:		return 2;
+	case HOST_CMD_SET_POSITION:		return 13;
+	case HOST_CMD_SET_POSITION_EXT:		return 21;
+	case HOST_CMD_DELAY:			return 5;
+	case HOST_CMD_FIND_AXES_MINIMUM:
+	case HOST_CMD_FIND_AXES_MAXIMUM:	return 8;
+	case HOST_CMD_WAIT_FOR_TOOL:
+	case HOST_CMD_WAIT_FOR_PLATFORM:	return 6;
+	case HOST_CMD_STORE_HOME_POSITION:
+	case HOST_CMD_RECALL_HOME_POSITION:	return 2;
+	case HOST_CMD_TOOL_COMMAND:
+		// needs a payload
+		if ( available < 4 )	return 0;
+		return 4 + bytes[3];
+	case HOST_CMD_QUEUE_POINT_COMPACT:
+		// needs the headers, the shortest compact move is 4 bytes
+		if ( available < 3 )	return 0;
+		return compactmove::length(bytes[1], bytes[2]);
+	case HOST_CMD_QUEUE_ARC:		return ARC_COMMAND_LENGTH;
+	case HOST_CMD_RETRACT:
+	case HOST_CMD_UNRETRACT:		return 2;
+	case HOST_CMD_MOOD_LIGHT_SET_RGB:	return 21;
+	case HOST_CMD_MOOD_LIGHT_SET_HSB:	return 17;
+	case HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT:	return 9;
+	case HOST_CMD_BUZZER_REPEATS:		return 2;
+	case HOST_CMD_BUZZER_BUZZ:		return 7;
+	}
+	return 0;
+}
+
+}
+
+#endif // COMMAND_CHECK_HH_
@@ -0,0 +1,252 @@
+/*
+ * Command Latency Tracing
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "CommandTrace.hh"
+
+#if COMMAND_TRACING
+
+#include <string.h>
+#include <util/atomic.h>
+#include "Motherboard.hh"
+
+namespace commandtrace {
+
+/// A command being traced. The stepper interrupt only touches started, finished,
+/// started_set and in_flight, and only while in_flight isn't 0.
+struct Slot {
+	Trace trace;
+	uint16_t seq;			///< Order the command was put into the command buffer
+	volatile uint8_t in_flight;	///< Blocks queued and not stepped yet
+	bool dispatched_set;
+	volatile bool started_set;
+	bool ran;
+};
+
+/// The ring holds, from the tail: the finished records that update() has accounted
+/// for, then the decoded ones, then the ones still in the command buffer.
+Slot slots[COMMAND_TRACE_SLOTS];
+uint8_t tail;
+uint8_t count;
+uint8_t decoded_count;
+uint8_t accounted_count;
+
+/// Every command from the host takes a sequence number as it's put into the command
+/// buffer, traced or not, so that decoded() can tell which one it has.
+uint16_t arrive_seq;
+uint16_t decode_seq;
+
+/// The command runCommandSlice() is running
+uint8_t current;
+
+uint16_t lost;
+
+StageStats stats[STAGE_COUNT];
+
+inline micros_t now() {
+	return Motherboard::getBoard().getCurrentMicros();
+}
+
+inline uint8_t slotIndex(uint8_t offset) {
+	return (tail + offset) % COMMAND_TRACE_SLOTS;
+}
+
+inline void countLost() {
+	if ( lost < 0xFFFF )	lost ++;
+}
+
+/// Take the record at the tail out of the ring, it has to be accounted for
+void removeTail() {
+	tail = slotIndex(1);
+	count --;
+	decoded_count --;
+	accounted_count --;
+}
+
+void record(uint8_t stage, micros_t duration) {
+	StageStats& s = stats[stage];
+
+	if ( duration > s.max )	s.max = duration;
+
+	// Keep the mean and histogram over the recent samples by halving
+	// everything before it can overflow
+	if (( s.samples == 0xFFFF ) || ( s.sum & 0x80000000 )) {
+		s.samples >>= 1;
+		s.sum >>= 1;
+		for (uint8_t i = 0; i < COMMAND_TRACE_BUCKETS; i ++)	s.histogram[i] >>= 1;
+	}
+	s.samples ++;
+	s.sum += duration;
+
+	uint8_t bucket = 0;
+	duration /= COMMAND_TRACE_FIRST_BUCKET;
+	while (( duration ) && ( bucket < (COMMAND_TRACE_BUCKETS - 1) )) {
+		duration >>= 2;
+		bucket ++;
+	}
+	s.histogram[bucket] ++;
+}
+
+void reset() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		// Blocks still in the planner find their slot with nothing in flight
+		// and leave it alone
+		for (uint8_t i = 0; i < COMMAND_TRACE_SLOTS; i ++)	slots[i].in_flight = 0;
+	}
+	tail = count = decoded_count = accounted_count = 0;
+	arrive_seq = decode_seq = 0;
+	current = 0;
+}
+
+void resetStats() {
+	memset(stats, 0, sizeof(stats));
+	lost = 0;
+}
+
+void arrived(uint8_t commands, micros_t micros) {
+	for (; commands > 0; commands --) {
+		if ( count == COMMAND_TRACE_SLOTS ) {
+			if ( accounted_count == 0 ) {
+				// Every slot is taken by a command in flight
+				countLost();
+				arrive_seq ++;
+				continue;
+			}
+			removeTail();
+			countLost();
+		}
+		Slot& s = slots[slotIndex(count)];
+		memset(&s.trace, 0, sizeof(s.trace));
+		s.trace.arrived = micros;
+		s.seq = arrive_seq ++;
+		s.in_flight = 0;
+		s.dispatched_set = false;
+		s.started_set = false;
+		s.ran = false;
+		count ++;
+	}
+}
+
+uint8_t decoded() {
+	// Everything from the host has been decoded, this one came from the SD card
+	if ( decode_seq == arrive_seq )	return 0;
+
+	uint8_t trace = 0;
+	if ( decoded_count < count ) {
+		uint8_t index = slotIndex(decoded_count);
+		if ( slots[index].seq == decode_seq ) {
+			trace = index + 1;
+			decoded_count ++;
+		}
+	}
+	decode_seq ++;
+	return trace;
+}
+
+void dispatched(uint8_t trace, uint8_t command) {
+	current = trace;
+	if ( trace == 0 )	return;
+	Slot& s = slots[trace - 1];
+	// A command that has to be run again is dispatched again
+	if ( s.dispatched_set )	return;
+	s.trace.command = command;
+	s.trace.dispatched = now();
+	s.dispatched_set = true;
+}
+
+void ran(uint8_t trace) {
+	if ( trace == current )	current = 0;
+	if ( trace == 0 )	return;
+	Slot& s = slots[trace - 1];
+	// Otherwise the last block to finish stamps it
+	if ( s.trace.blocks == 0 )	s.trace.finished = now();
+	s.ran = true;
+}
+
+uint8_t blockQueued() {
+	if ( current == 0 )	return 0;
+	Slot& s = slots[current - 1];
+	if ( s.trace.blocks < 0xFF )	s.trace.blocks ++;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		s.in_flight ++;
+	}
+	return current;
+}
+
+// Called from the stepper interrupt, so interrupts are already off
+void blockStarted(uint8_t trace) {
+	if ( trace == 0 )	return;
+	Slot& s = slots[trace - 1];
+	if (( s.in_flight == 0 ) || ( s.started_set ))	return;
+	s.trace.started = now();
+	s.started_set = true;
+}
+
+void blockFinished(uint8_t trace) {
+	if ( trace == 0 )	return;
+	Slot& s = slots[trace - 1];
+	if ( s.in_flight == 0 )	return;
+	s.trace.finished = now();
+	s.in_flight --;
+}
+
+void update() {
+	while ( accounted_count < decoded_count ) {
+		Slot& s = slots[slotIndex(accounted_count)];
+		if (( ! s.ran ) || ( s.in_flight != 0 ))	break;
+
+		Trace& t = s.trace;
+		// Blocks taken out by an abort never started
+		if (( t.blocks > 0 ) && ( ! s.started_set ))	t.started = t.finished;
+		record(STAGE_QUEUE, t.dispatched - t.arrived);
+		if ( t.blocks > 0 ) {
+			record(STAGE_PLANNER, t.started - t.dispatched);
+			record(STAGE_MOTION, t.finished - t.started);
+		}
+		record(STAGE_TOTAL, t.finished - t.arrived);
+		accounted_count ++;
+	}
+}
+
+bool drain(Trace& trace) {
+	update();
+	if ( accounted_count == 0 )	return false;
+	memcpy(&trace, &slots[tail].trace, sizeof(trace));
+	removeTail();
+	return true;
+}
+
+uint8_t getFinishedCount() {
+	update();
+	return accounted_count;
+}
+
+uint16_t getLostCount() {
+	return lost;
+}
+
+void getStats(uint8_t stage, StageStats& out) {
+	if ( stage >= STAGE_COUNT ) {
+		memset(&out, 0, sizeof(out));
+		return;
+	}
+	update();
+	memcpy(&out, &stats[stage], sizeof(out));
+}
+
+}
+
+#endif // COMMAND_TRACING
@@ -0,0 +1,143 @@
+/*
+ * Command Latency Tracing
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef COMMANDTRACE_HH_
+#define COMMANDTRACE_HH_
+
+#include "Configuration.hh"
+#include "Types.hh"
+#include <stdint.h>
+
+/// Follows the buffered commands from the host through the board, to tell whether a
+/// slow build is held up by the link, the command queue or the planner. Each command
+/// is timestamped (microseconds) when the packet that carried it was complete, when
+/// runCommandSlice() dispatched it, when the first planner block it queued started
+/// in the stepper interrupt, and when its last block was stepped.
+///
+/// The traces go into a ring of COMMAND_TRACE_SLOTS records that the host drains
+/// with HOST_CMD_GET_COMMAND_TRACE; once every slot is taken by a finished record
+/// the oldest is dropped. The per stage histograms are kept up to date without
+/// draining, HOST_CMD_GET_COMMUNICATION_STATS reads them.
+///
+/// Only compiled in when COMMAND_TRACING is set in Configuration.hh, otherwise the
+/// COMMAND_TRACE_* macros are empty. Commands from the SD card aren't traced.
+namespace commandtrace {
+
+/// Records that can be traced at once, the commands beyond that aren't traced
+#ifndef COMMAND_TRACE_SLOTS
+#define COMMAND_TRACE_SLOTS		16
+#endif
+
+/// Histogram bucket i counts durations below (COMMAND_TRACE_FIRST_BUCKET << 2i)
+/// microseconds, the last bucket everything longer.
+#define COMMAND_TRACE_BUCKETS		8
+#define COMMAND_TRACE_FIRST_BUCKET	256
+
+enum Stage {
+	STAGE_QUEUE	= 0,	///< Packet complete to dispatched
+	STAGE_PLANNER	= 1,	///< Dispatched to the first block started (commands with blocks)
+	STAGE_MOTION	= 2,	///< First block started to the last one stepped
+	STAGE_TOTAL	= 3,	///< Packet complete to finished
+	STAGE_COUNT	= 4
+};
+
+/// A finished command
+struct Trace {
+	uint8_t command;	///< HOST_CMD_*, a compact move is HOST_CMD_QUEUE_POINT_NEW
+	uint8_t blocks;		///< Planner blocks it queued
+	micros_t arrived;
+	micros_t dispatched;
+	micros_t started;	///< 0 without blocks
+	micros_t finished;
+};
+
+struct StageStats {
+	uint16_t samples;	///< Halved with sum and the histogram before either overflows
+	uint32_t sum;
+	uint32_t max;
+	uint16_t histogram[COMMAND_TRACE_BUCKETS];
+};
+
+#if COMMAND_TRACING
+
+/// Forget the commands in flight, their blocks and commands are gone. The
+/// statistics are kept.
+void reset();
+
+/// Clear the statistics
+void resetStats();
+
+/// Commands were put into the command buffer
+/// \param[in] count How many
+/// \param[in] micros When the packet carrying them was complete
+void arrived(uint8_t count, micros_t micros);
+
+/// The command at the front of the command buffer is being decoded
+/// \return Its trace, 0 if it isn't traced
+uint8_t decoded();
+
+/// runCommandSlice() is running a command, the blocks queued from now on are its own
+/// \param[in] trace The trace decoded() gave
+/// \param[in] command HOST_CMD_* of the command
+void dispatched(uint8_t trace, uint8_t command);
+
+/// The command has been run. It's finished once its blocks have been stepped.
+void ran(uint8_t trace);
+
+/// A planner block is being queued
+/// \return The trace of the command queuing it, to pass on to blockStarted() and
+///         blockFinished()
+uint8_t blockQueued();
+
+/// Called from the stepper interrupt
+void blockStarted(uint8_t trace);
+void blockFinished(uint8_t trace);
+
+/// Account for the commands that have finished, call from the main loop
+void update();
+
+/// Take the oldest finished trace out of the ring
+/// \return False if there's none
+bool drain(Trace& trace);
+
+/// \return Finished traces waiting to be drained
+uint8_t getFinishedCount();
+
+/// \return Traces dropped before they were drained, and commands that weren't
+///         traced for want of a slot
+uint16_t getLostCount();
+
+/// Take a consistent copy of the statistics of one stage
+void getStats(uint8_t stage, StageStats& stats);
+
+#endif // COMMAND_TRACING
+
+}
+
+#if COMMAND_TRACING
+
+#define COMMAND_TRACE_BLOCK_STARTED(trace)	commandtrace::blockStarted(trace)
+#define COMMAND_TRACE_BLOCK_FINISHED(trace)	commandtrace::blockFinished(trace)
+
+#else
+
+#define COMMAND_TRACE_BLOCK_STARTED(trace)
+#define COMMAND_TRACE_BLOCK_FINISHED(trace)
+
+#endif // COMMAND_TRACING
+
+#endif // COMMANDTRACE_HH_
@@ -0,0 +1,107 @@
+/*
+ * Compact Move Encoding
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "CompactMove.hh"
+#include "Commands.hh"
+
+#define HEADER_ZB		0x40
+#define HEADER_DURATION_24	0x80
+
+namespace compactmove {
+
+/// Size codes of the axes, in X, Y, Z, A, B order
+void sizeCodes(uint8_t header, uint8_t zb_header, uint8_t codes[COMPACT_MOVE_AXIS_COUNT]) {
+	if ( ! ( header & HEADER_ZB ))	zb_header = 0;
+	codes[0] = header & 0x03;
+	codes[1] = (header >> 2) & 0x03;
+	codes[2] = zb_header & 0x03;
+	codes[3] = (header >> 4) & 0x03;
+	codes[4] = (zb_header >> 2) & 0x03;
+}
+
+uint8_t length(uint8_t header, uint8_t zb_header) {
+	uint8_t codes[COMPACT_MOVE_AXIS_COUNT];
+	sizeCodes(header, zb_header, codes);
+
+	uint8_t len = 2 + (( header & HEADER_ZB ) ? 1 : 0) + (( header & HEADER_DURATION_24 ) ? 3 : 2);
+	for (uint8_t i = 0; i < COMPACT_MOVE_AXIS_COUNT; i ++)	len += codes[i];
+	return len;
+}
+
+/// \return Bytes needed for a delta, 4 if it doesn't fit in 24 bits
+uint8_t sizeCode(int32_t delta) {
+	if ( delta == 0 )				return 0;
+	if (( delta >= -128L ) && ( delta <= 127L ))	return 1;
+	if (( delta >= -32768L ) && ( delta <= 32767L ))	return 2;
+	if (( delta >= -8388608L ) && ( delta <= 8388607L ))	return 3;
+	return 4;
+}
+
+uint8_t encode(const int32_t delta[COMPACT_MOVE_AXIS_COUNT], uint32_t us, uint8_t* out) {
+	uint8_t codes[COMPACT_MOVE_AXIS_COUNT];
+	for (uint8_t i = 0; i < COMPACT_MOVE_AXIS_COUNT; i ++) {
+		codes[i] = sizeCode(delta[i]);
+		if ( codes[i] > 3 )	return 0;
+	}
+	if ( us > 0xFFFFFFL )	return 0;
+
+	uint8_t header = codes[0] | (codes[1] << 2) | (codes[3] << 4);
+	uint8_t zb_header = codes[2] | (codes[4] << 2);
+	if ( zb_header )	header |= HEADER_ZB;
+	if ( us > 0xFFFFL )	header |= HEADER_DURATION_24;
+
+	uint8_t len = 0;
+	out[len ++] = HOST_CMD_QUEUE_POINT_COMPACT;
+	out[len ++] = header;
+	if ( zb_header )	out[len ++] = zb_header;
+
+	out[len ++] = us & 0xFF;
+	out[len ++] = (us >> 8) & 0xFF;
+	if ( header & HEADER_DURATION_24 )	out[len ++] = (us >> 16) & 0xFF;
+
+	for (uint8_t i = 0; i < COMPACT_MOVE_AXIS_COUNT; i ++) {
+		uint32_t value = (uint32_t)delta[i];
+		for (uint8_t b = 0; b < codes[i]; b ++) {
+			out[len ++] = value & 0xFF;
+			value >>= 8;
+		}
+	}
+	return len;
+}
+
+void decode(const uint8_t* in, int32_t delta[COMPACT_MOVE_AXIS_COUNT], uint32_t& us) {
+	uint8_t header = in[1];
+	uint8_t codes[COMPACT_MOVE_AXIS_COUNT];
+	sizeCodes(header, in[2], codes);
+
+	const uint8_t* p = in + (( header & HEADER_ZB ) ? 3 : 2);
+	us = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+	p += 2;
+	if ( header & HEADER_DURATION_24 )	us |= (uint32_t)(*p ++) << 16;
+
+	for (uint8_t i = 0; i < COMPACT_MOVE_AXIS_COUNT; i ++) {
+		uint32_t value = 0;
+		for (uint8_t b = 0; b < codes[i]; b ++)	value |= (uint32_t)(*p ++) << (8 * b);
+
+		// Sign extend from the top byte
+		if (( codes[i] ) && ( value & (0x80UL << (8 * (codes[i] - 1))) ))
+			value |= 0xFFFFFFFFUL << (8 * codes[i]);
+		delta[i] = (int32_t)value;
+	}
+}
+
+}
@@ -0,0 +1,68 @@
+/*
+ * Compact Move Encoding
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef COMPACT_MOVE_HH_
+#define COMPACT_MOVE_HH_
+
+#include <stdint.h>
+
+#define COMPACT_MOVE_AXIS_COUNT		5
+
+/// Longest compact move: command code, 2 header bytes, 24 bit duration and a 24 bit
+/// delta for every axis
+#define COMPACT_MOVE_MAX_LENGTH		(1 + 2 + 3 + 3 * COMPACT_MOVE_AXIS_COUNT)
+
+/// HOST_CMD_QUEUE_POINT_COMPACT is HOST_CMD_QUEUE_POINT_NEW with every axis relative,
+/// in as few bytes as the move needs:
+///
+///	uint8	HOST_CMD_QUEUE_POINT_COMPACT
+///	uint8	header: bits 0-1 size of the X delta, bits 2-3 Y, bits 4-5 A,
+///		bit 6 the Z / B header follows, bit 7 the duration is 24 bit
+///	uint8	Z / B header, if bit 6 is set: bits 0-1 size of the Z delta, bits 2-3 B
+///	uint16 / uint24	duration (us)
+///	int8 / int16 / int24 delta (steps) of each axis with a size, in X, Y, Z, A, B order
+///
+/// A size is 0 for an axis that doesn't move, then 1, 2 or 3 bytes. Everything is
+/// little endian like the rest of the protocol. A short printing move in X, Y and A
+/// is 7 to 10 bytes, against 26.
+///
+/// Has no hardware dependencies, so the host tools use the same encoder and decoder.
+namespace compactmove {
+
+/// Length of a compact move
+/// \param[in] header The byte after the command code
+/// \param[in] zb_header The byte after that, only read if the header says so
+/// \return Length including the command code
+uint8_t length(uint8_t header, uint8_t zb_header);
+
+/// Encode a move
+/// \param[in] delta Steps to move each axis by
+/// \param[in] us Duration of the move
+/// \param[out] out At least COMPACT_MOVE_MAX_LENGTH bytes
+/// \return Length of the command, 0 if the move doesn't fit in a compact move and has to
+/// be sent as HOST_CMD_QUEUE_POINT_NEW (a delta beyond 24 bits or a move over 16.7s)
+uint8_t encode(const int32_t delta[COMPACT_MOVE_AXIS_COUNT], uint32_t us, uint8_t* out);
+
+/// Decode a complete compact move
+/// \param[in] in The command, starting with the command code
+/// \param[out] delta Steps to move each axis by
+/// \param[out] us Duration of the move
+void decode(const uint8_t* in, int32_t delta[COMPACT_MOVE_AXIS_COUNT], uint32_t& us);
+
+}
+
+#endif // COMPACT_MOVE_HH_
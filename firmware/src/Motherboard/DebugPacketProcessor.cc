@@ -93,14 +93,10 @@ bool processDebugPacket(const InPacket& from_host, OutPacket& to_host) {
 					out.append8(from_host.read8(i));
 				}
 
-				Timeout acquire_lock_timeout;
-				acquire_lock_timeout.start(50000); // 50 ms timeout
-				while (!tool::getLock()) {
-					if (acquire_lock_timeout.hasElapsed()) {
-						to_host.append8(RC_TOOL_LOCK_TIMEOUT);
-						Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
-						return true;
-					}
+				if (!tool::waitForLock()) {
+					to_host.append8(RC_TOOL_LOCK_TIMEOUT);
+					Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
+					return true;
 				}
 				Timeout t;
 				t.start(50000); // 50 ms timeout
@@ -68,8 +68,15 @@ void setDefaults() {
     putEepromUInt32(eeprom::ACCEL_MIN_TRAVEL_FEED_RATE,0);	//Multiplied by 10
     putEepromUInt32(eeprom::ACCEL_MAX_XY_JERK,2);		//30mm/s Multiplied by 10
     putEepromUInt32(eeprom::ACCEL_MAX_Z_JERK,100);		//10mm/s Multiplied by 10
-    putEepromUInt32(eeprom::ACCEL_ADVANCE_K,50);		//0.00001 Multiplied by 100000
     putEepromUInt32(eeprom::ACCEL_FILAMENT_DIAMETER,175);	//1.75 Multiplied by 100
+    putEepromUInt32(eeprom::RETRACT_LENGTH,100);		//1.00mm Multiplied by 100
+    putEepromUInt32(eeprom::RETRACT_FEEDRATE,30);		//30mm/s
+    putEepromUInt32(eeprom::RETRACT_Z_HOP,0);			//0.00mm (off) Multiplied by 100
+    putEepromUInt32(eeprom::ACCEL_ADVANCE_K,0);		//0.0s (off) Multiplied by 100000
+    putEepromUInt32(eeprom::ACCEL_ADVANCE_K2,0);		//0.0s (off) Multiplied by 100000
+    eeprom_write_byte((uint8_t*)eeprom::ESTIMATE_CACHE_NEXT,0);
+    for (uint8_t i = 0; i < ESTIMATE_CACHE_ENTRIES; i ++)		//File size 0 is an empty entry
+	putEepromUInt32(eeprom::ESTIMATE_CACHE + i * ESTIMATE_CACHE_ENTRY_SIZE,0);
 }
 
 }
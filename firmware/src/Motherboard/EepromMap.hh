@@ -136,8 +136,31 @@ const static uint16_t ACCEL_MIN_FEED_RATE	= 0x0157;
 const static uint16_t ACCEL_MIN_TRAVEL_FEED_RATE= 0x015B;
 const static uint16_t ACCEL_MAX_XY_JERK		= 0x015F;
 const static uint16_t ACCEL_MAX_Z_JERK		= 0x0163;
-const static uint16_t ACCEL_ADVANCE_K		= 0x0167;
+const static uint16_t ACCEL_OLD_ADVANCE_K	= 0x0167;	//Quadratic advance K, no longer used
 const static uint16_t ACCEL_FILAMENT_DIAMETER	= 0x016B;
+const static uint16_t ACCEL_OLD_ADVANCE_K2	= 0x016F;	//Quadratic advance K for the B extruder, no longer used
+
+//Estimates of the last few SD builds, so the same file isn't estimated again
+//uint8_t next entry to replace, then ESTIMATE_CACHE_ENTRIES entries of
+//ESTIMATE_CACHE_ENTRY_SIZE: file size (uint32_t), file hash (uint16_t), seconds (uint32_t),
+//filament in steps (int32_t), layers (uint16_t)
+#define ESTIMATE_CACHE_ENTRIES			4
+#define ESTIMATE_CACHE_ENTRY_SIZE		16
+const static uint16_t ESTIMATE_CACHE_NEXT	= 0x0173;
+const static uint16_t ESTIMATE_CACHE		= 0x0174;	//to 0x01B3
+
+//Firmware retraction, HOST_CMD_RETRACT / HOST_CMD_UNRETRACT
+//uint32_t (4 bytes)
+const static uint16_t RETRACT_LENGTH		= 0x01B4;	//mm Multiplied by 100
+const static uint16_t RETRACT_FEEDRATE		= 0x01B8;	//mm/s
+const static uint16_t RETRACT_Z_HOP		= 0x01BC;	//mm Multiplied by 100, 0 = no z hop
+
+//Linear advance K, s Multiplied by 100000. New addresses rather than the ones of the
+//quadratic advance, whose K meant something else: on a board that had it they're
+//still unwritten, so the advance starts off.
+//uint32_t (4 bytes)
+const static uint16_t ACCEL_ADVANCE_K		= 0x01C0;	//A extruder
+const static uint16_t ACCEL_ADVANCE_K2		= 0x01C4;	//B extruder
 
 /// Reset all data in the EEPROM to a default.
 void setDefaults();
@@ -0,0 +1,104 @@
+/*
+ * Build Estimate Cache
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "EstimateCache.hh"
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+#include "EepromMap.hh"
+#include "SDCard.hh"
+
+namespace estimatecache {
+
+/// An entry as it's laid out in eeprom
+struct Entry {
+	uint32_t size;		///< File size, 0 if the entry is empty
+	uint16_t hash;		///< File hash, combined with the settings hash
+	Estimate estimate;
+};
+
+/// Add a range of eeprom to the hash
+uint16_t hashEeprom(uint16_t hash, uint16_t start, uint16_t end) {
+	for (uint16_t i = start; i < end; i ++)
+		hash = _crc_ccitt_update(hash, eeprom_read_byte((uint8_t*)i));
+	return hash;
+}
+
+/// The hash an entry for the file being played back has: the file hash, and the
+/// settings that go into an estimate
+uint16_t currentHash() {
+	uint16_t hash = sdcard::getFileHash();
+	hash = hashEeprom(hash, eeprom::STEPS_PER_MM_X, eeprom::FILAMENT_USED);
+	hash = hashEeprom(hash, eeprom::STEPPER_DRIVER, eeprom::ESTIMATE_CACHE_NEXT);
+	hash = hashEeprom(hash, eeprom::RETRACT_LENGTH, eeprom::RETRACT_Z_HOP + 4);
+	return hash;
+}
+
+void readEntry(uint8_t index, Entry& entry) {
+	cli();
+	eeprom_read_block(&entry, (void*)(eeprom::ESTIMATE_CACHE + index * ESTIMATE_CACHE_ENTRY_SIZE),
+			  sizeof(Entry));
+	sei();
+}
+
+/// \return The index of the entry for the file being played back, or ESTIMATE_CACHE_ENTRIES
+uint8_t find(uint16_t hash) {
+	uint32_t size = sdcard::getFileSize();
+	if ( size == 0 )	return ESTIMATE_CACHE_ENTRIES;
+
+	Entry entry;
+	for (uint8_t i = 0; i < ESTIMATE_CACHE_ENTRIES; i ++) {
+		readEntry(i, entry);
+		if (( entry.size == size ) && ( entry.hash == hash ))	return i;
+	}
+	return ESTIMATE_CACHE_ENTRIES;
+}
+
+bool lookup(Estimate& estimate) {
+	uint8_t index = find(currentHash());
+	if ( index == ESTIMATE_CACHE_ENTRIES )	return false;
+
+	Entry entry;
+	readEntry(index, entry);
+	estimate = entry.estimate;
+	return true;
+}
+
+void store(const Estimate& estimate) {
+	Entry entry;
+	entry.size = sdcard::getFileSize();
+	entry.hash = currentHash();
+	entry.estimate = estimate;
+	if ( entry.size == 0 )	return;
+
+	// Replace the file's own entry if it has one, otherwise the oldest
+	uint8_t index = find(entry.hash);
+	if ( index == ESTIMATE_CACHE_ENTRIES ) {
+		index = eeprom_read_byte((uint8_t*)eeprom::ESTIMATE_CACHE_NEXT);
+		if ( index >= ESTIMATE_CACHE_ENTRIES )	index = 0;
+		cli();
+		eeprom_write_byte((uint8_t*)eeprom::ESTIMATE_CACHE_NEXT, (index + 1) % ESTIMATE_CACHE_ENTRIES);
+		sei();
+	}
+
+	cli();
+	eeprom_write_block(&entry, (void*)(eeprom::ESTIMATE_CACHE + index * ESTIMATE_CACHE_ENTRY_SIZE),
+			   sizeof(Entry));
+	sei();
+}
+
+}
@@ -0,0 +1,47 @@
+/*
+ * Build Estimate Cache
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef ESTIMATECACHE_HH_
+#define ESTIMATECACHE_HH_
+
+#include <stdint.h>
+
+/// Keeps the estimates of the last few SD builds in eeprom, so a file that's built
+/// again starts straight away. Entries are keyed on the size and hash of the playback
+/// file (see sdcard::getFileHash()), and the machine settings the estimate was made
+/// with; changing the steps per mm or the acceleration settings misses the cache.
+namespace estimatecache {
+
+/// The result of an estimate
+struct Estimate {
+	uint32_t seconds;	///< Build duration
+	int32_t filament;	///< Filament used (steps)
+	uint16_t layers;	///< Number of layers
+};
+
+/// Look up the estimate of the file being played back
+/// \param[out] estimate The cached estimate
+/// \return True if the file was found
+bool lookup(Estimate& estimate);
+
+/// Store the estimate of the file being played back, replacing the oldest entry
+/// \param[in] estimate The estimate
+void store(const Estimate& estimate);
+
+}
+
+#endif // ESTIMATECACHE_HH_
@@ -20,21 +20,14 @@
 #include "ExtruderControl.hh"
 
 
-#define HOST_TOOL_RESPONSE_TIMEOUT_MS 50
-
-
 /// Send a packet to the extruder.  If cmdType == EXTDR_CMD_SET, then "val" should
 /// contain the value to be written otherwise val is ignored.
 /// responsePacket is filled with the returned value
 bool extruderControl(uint8_t command, enum extruderCommandType cmdType,
 		     OutPacket& responsePacket, uint16_t val) {
 
-	Timeout acquire_lock_timeout;
-	acquire_lock_timeout.start(HOST_TOOL_RESPONSE_TIMEOUT_MS);
-	while (!tool::getLock()) {
-		if (acquire_lock_timeout.hasElapsed()) {
-			return false;
-		}
+	if (!tool::waitForLock()) {
+		return false;
 	}
 	OutPacket& out = tool::getOutPacket();
 	InPacket& in = tool::getInPacket();
@@ -30,6 +30,11 @@
 #include "Errors.hh"
 #include "Eeprom.hh"
 #include "EepromMap.hh"
+#include "IsrProfile.hh"
+#include "CommandTrace.hh"
+#include "StatusSnapshot.hh"
+#include "Scheduler.hh"
+#include "BaudRate.hh"
 
 namespace host {
 
@@ -46,8 +51,17 @@ Timeout packet_in_timeout;
 #define HOST_PACKET_TIMEOUT_MS 20
 #define HOST_PACKET_TIMEOUT_MICROS (1000L*HOST_PACKET_TIMEOUT_MS)
 
-#define HOST_TOOL_RESPONSE_TIMEOUT_MS 50
-#define HOST_TOOL_RESPONSE_TIMEOUT_MICROS (1000L*HOST_TOOL_RESPONSE_TIMEOUT_MS)
+// Time the host has to send a packet at a new baud rate before both ends go back
+#define HOST_BAUD_RATE_TIMEOUT_MICROS 1000000L
+
+BaudRateNegotiator baud_rate(HOST_BAUD_RATE, F_CPU);
+Timeout baud_rate_timeout;
+
+// Shortest time between telemetry frames, about 30 bytes each
+#define HOST_TELEMETRY_MIN_INTERVAL_MS 20
+
+uint16_t telemetry_interval_ms;		///< Time between telemetry frames, 0 when off
+Timeout telemetry_timeout;
 
 char machineName[MAX_MACHINE_NAME_LEN];
 
@@ -59,13 +73,209 @@ HostState currentState;
 
 bool do_host_reset = true;
 
-void runHostSlice() {
-        InPacket& in = UART::getHostUART().in;
+/// Pipelined protocol. Packets framed with PIPELINED_START_BYTE carry consecutive
+/// sequence numbers, and the host sends them without waiting for the responses, up to
+/// HOST_PACKET_WINDOW ahead.
+/// - Queued commands aren't answered one by one. When no more packets are waiting, a
+///   cumulative ack is sent: RC_OK and the free buffer space (uint16), with the
+///   sequence number of the next packet expected.
+/// - Queries are answered as they're handled, with the next sequence number expected.
+/// - A packet received with an error or out of sequence, or a command that didn't fit
+///   in the buffer, is answered once with a NAK: the error code (and for a command the
+///   free buffer space), with the sequence number expected. The packets after it are
+///   dropped until the host goes back and resends from there.
+/// The host resends on a NAK, or when the ack doesn't come in time. A legacy packet
+/// (stop-and-wait) or a reset restarts the sequence at 0.
+uint8_t expected_sequence;	///< Sequence number of the next pipelined packet
+bool ack_pending;		///< Packets were handled since the last ack
+bool nak_sent;			///< The packet expected was NAKed, the ones after it are dropped
+bool pipelining;		///< The last packet was a pipelined one
+bool extended_framing;		///< The last packet had a 16 bit length, the acks are sent that way
+
+void restartSequence() {
+	expected_sequence = 0;
+	ack_pending = false;
+	nak_sent = false;
+}
+
+/// Handle a packet, the response goes in to_host
+void processPacket(const InPacket& from_host, OutPacket& to_host) {
+#if defined(HONOR_DEBUG_PACKETS) && (HONOR_DEBUG_PACKETS == 1)
+	if (processDebugPacket(from_host, to_host)) {
+		// okay, processed
+	} else
+#endif
+	if (processCommandPacket(from_host, to_host)) {
+		// okay, processed
+	} else if (processQueryPacket(from_host, to_host)) {
+		// okay, processed
+	} else {
+		// Unrecognized command
+		to_host.append8(RC_CMD_UNSUPPORTED);
+	}
+}
+
+/// NAK the packet expected, once
+void sendNak(OutPacket& to_host, uint8_t code) {
+	if (nak_sent) return;
+	to_host.reset();
+	to_host.append8(code);
+	to_host.setSequence(expected_sequence);
+	nak_sent = true;
+	ack_pending = false;
+}
+
+/// Handle a pipelined packet. The response, if there's one to send now, goes in to_host.
+void processPipelinedPacket(const InPacket& from_host, OutPacket& to_host) {
+	int8_t ahead = from_host.getSequence() - expected_sequence;
+	if (ahead < 0) {
+		// Handled already, the ack went missing
+		ack_pending = true;
+		return;
+	}
+	if (ahead > 0) {
+		// A packet in front of it went missing
+		sendNak(to_host, RC_CRC_MISMATCH);
+		return;
+	}
+
+	processPacket(from_host, to_host);
+
+	uint8_t command = from_host.read8(0);
+	bool queued = ((command & 0x80) != 0) || (command == HOST_CMD_BATCH);
+	if (queued && (to_host.read8(0) == RC_BUFFER_OVERFLOW)) {
+		// Resent once the buffer has room, a batch without the commands it queued
+		to_host.setSequence(expected_sequence);
+		nak_sent = true;
+		ack_pending = false;
+		return;
+	}
+
+	expected_sequence++;
+	nak_sent = false;
+	if (queued && (to_host.read8(0) == RC_OK)) {
+		to_host.reset();
+		ack_pending = true;
+	} else {
+		// Answered now, which acks everything before it as well
+		to_host.setSequence(expected_sequence);
+		ack_pending = false;
+	}
+}
+
+void setHostBaudRate(uint32_t baud) {
+	uint16_t ubrr;
+	if (getBaudRateDivisor(baud, F_CPU, ubrr)) {
+		UART::getHostUART().setBaudDivisor(ubrr);
+	}
+	// Whatever came in around the switch is noise
+	UART::getHostUART().getInPacket().reset();
+}
+
+/// Status frame, see HOST_CMD_SET_TELEMETRY
+void appendTelemetry(OutPacket& to_host) {
+	statussnapshot::Status status;
+	statussnapshot::update();
+	statussnapshot::get(status);
+	to_host.append8(RC_TELEMETRY);
+	to_host.append8(currentState);
+	to_host.append8(status.flags);
+	for (uint8_t i = 0; i < 5; i++) {
+		to_host.append32(( i < STEPPER_COUNT ) ? status.position[i] : 0);
+	}
+	to_host.append8(status.queue_depth);
+	to_host.append16(status.buffer_free);
+	to_host.append16(status.tool_temperature);
+	to_host.append16(status.platform_temperature);
+}
+
+/// Answer a query that only needs the status snapshot: HOST_CMD_GET_BUFFER_SIZE,
+/// HOST_CMD_GET_POSITION, HOST_CMD_GET_POSITION_EXT and HOST_CMD_IS_FINISHED.
+/// \param[in] query The command byte of the packet
+/// \return False if it's another command, to_host is left alone
+bool appendStatusQuery(uint8_t query, OutPacket& to_host,
+		const statussnapshot::Status& status) {
+	switch (query) {
+	case HOST_CMD_GET_BUFFER_SIZE:
+		to_host.append8(RC_OK);
+		to_host.append32(status.buffer_free);
+		return true;
+	case HOST_CMD_GET_POSITION:
+		to_host.append8(RC_OK);
+		to_host.append32(status.position[0]);
+		to_host.append32(status.position[1]);
+		to_host.append32(status.position[2]);
+		// From spec:
+		// endstop status bits: (7-0) : | N/A | N/A | z max | z min | y max | y min | x max | x min |
+		to_host.append8(status.endstops & 0x3F);
+		return true;
+	case HOST_CMD_GET_POSITION_EXT:
+		to_host.append8(RC_OK);
+		for (uint8_t i = 0; i < 5; i++) {
+			to_host.append32(( i < STEPPER_COUNT ) ? status.position[i] : 0);
+		}
+		// From spec:
+		// endstop status bits: (15-0) : | b max | b min | a max | a min | z max | z min | y max | y min | x max | x min |
+		to_host.append16(status.endstops);
+		return true;
+	case HOST_CMD_IS_FINISHED:
+		to_host.append8(RC_OK);
+		to_host.append8(( status.flags & (statussnapshot::STATUS_RUNNING |
+				statussnapshot::STATUS_EMPTY) ) == statussnapshot::STATUS_EMPTY ? 1 : 0);
+		return true;
+	}
+	return false;
+}
+
+#if HOST_FAST_QUERIES
+
+/// The receive interrupt may answer the status queries while this is set. runHostSlice()
+/// opens it when it's done and nothing it has to do comes first; it's closed while the
+/// slice runs and by any bytes the interrupt leaves to the slice, so the responses
+/// still go out in the order the packets came in.
+volatile bool fast_queries_open = false;
+
+void runFastQueries() {
+	if (!fast_queries_open) return;
+	UART& uart = UART::getHostUART();
+	uint8_t query;
+	uint8_t found = uart.peekQuery(query);
+	if (found == UART::QUERY_PARTIAL) return;
+
+	fast_queries_open = false;
+	if (found != UART::QUERY_READY || uart.out.isSending()) return;
+	statussnapshot::Status status;
+	statussnapshot::get(status);
+	OutPacket& out = uart.out;
+	out.reset();
+	if (!appendStatusQuery(query, out, status)) return;
+
+	uart.dropQuery();
+	// Framed with START_BYTE, the response is too
+	extended_framing = false;
+	uart.beginSend();
+	fast_queries_open = true;
+}
+
+#endif
+
+/// Handle the packets, the slice proper
+void handleHostSlice() {
+	UART::getHostUART().processReceived();
+	// After processReceived(), which may have moved it on to the next slot
+        InPacket& in = UART::getHostUART().getInPacket();
         OutPacket& out = UART::getHostUART().out;
 	if (out.isSending()) {
 		// still sending; wait until send is complete before reading new host packets.
 		return;
 	}
+	if (baud_rate.isSwitching()) {
+		// The acceptance went out at the old rate
+		setHostBaudRate(baud_rate.switchRate());
+		baud_rate_timeout.start(HOST_BAUD_RATE_TIMEOUT_MICROS);
+	} else if (baud_rate.isConfirming() && baud_rate_timeout.hasElapsed()) {
+		setHostBaudRate(baud_rate.revert());
+	}
 	if (do_host_reset) {
 		do_host_reset = false;
                 // Then, reset local board
@@ -76,6 +286,8 @@ void runHostSlice() {
 		machineName[0] = 0;
 		buildName[0] = 0;
 		currentState = HOST_STATE_READY;
+		restartSequence();
+		telemetry_interval_ms = 0;
 
 		return;
 	}
@@ -96,26 +308,90 @@ void runHostSlice() {
                         Motherboard::getBoard().indicateError(ERR_HOST_PACKET_MISC);
 		}
 		in.reset();
+		// A pipelining host resends from the packet expected
+		if (pipelining && !nak_sent) {
+			sendNak(out, RC_CRC_MISMATCH);
+			if (extended_framing)	out.setExtended();
+			UART::getHostUART().beginSend();
+			return;
+		}
 	}
-	if (in.isFinished()) {
+	InPacket* packet = UART::getHostUART().receivedPacket();
+	if (packet != 0) {
 		packet_in_timeout.abort();
+		baud_rate.packetReceived();
 		out.reset();
-#if defined(HONOR_DEBUG_PACKETS) && (HONOR_DEBUG_PACKETS == 1)
-		if (processDebugPacket(in, out)) {
-			// okay, processed
-		} else
-#endif
-		if (processCommandPacket(in, out)) {
-			// okay, processed
-		} else if (processQueryPacket(in, out)) {
-			// okay, processed
+		pipelining = packet->isPipelined();
+		extended_framing = packet->isExtended();
+		if (pipelining) {
+			processPipelinedPacket(*packet, out);
 		} else {
-			// Unrecognized command
-			out.append8(RC_CMD_UNSUPPORTED);
+			restartSequence();
+			processPacket(*packet, out);
 		}
-		in.reset();
+		UART::getHostUART().releasePacket();
+		if (extended_framing)	out.setExtended();
+		if (out.getLength() > 0) {
+	                UART::getHostUART().beginSend();
+		}
+	} else if (ack_pending) {
+		// Nothing more waiting, ack the packets so far
+		out.reset();
+		out.append8(RC_OK);
+		out.append16(command::getRemainingCapacity());
+		out.setSequence(expected_sequence);
+		if (extended_framing)	out.setExtended();
+		ack_pending = false;
                 UART::getHostUART().beginSend();
+	} else if (telemetry_interval_ms != 0 && telemetry_timeout.hasElapsed()) {
+		out.reset();
+		appendTelemetry(out);
+		telemetry_timeout.start(telemetry_interval_ms * 1000L);
+		// The temperatures for the next frame, when the tool is free
+		tool::requestTemperatures();
+                UART::getHostUART().beginSend();
+	}
+}
+
+void runHostSlice() {
+#if HOST_FAST_QUERIES
+	fast_queries_open = false;
+#endif
+	handleHostSlice();
+	statussnapshot::update();
+#if HOST_FAST_QUERIES
+	fast_queries_open = !do_host_reset && !pipelining && !ack_pending && !nak_sent &&
+		!baud_rate.isSwitching() && !baud_rate.isConfirming();
+#endif
+}
+
+/// Queue the commands of a HOST_CMD_BATCH packet. The batch is checked as a whole
+/// before any of it is queued, then as many commands as fit are queued in one go.
+void handleBatch(const InPacket& from_host, OutPacket& to_host) {
+	// Casting away volatile is OK, the packet isn't received into while it's handled
+	const uint8_t* commands = (const uint8_t*)from_host.getData() + 1;
+	uint16_t length = from_host.getLength() - 1;
+
+	// Captured as the commands it carries, so the file plays back without batches
+	bool capturing = sdcard::isCapturing();
+	uint16_t fit = ( capturing ) ? length : command::getRemainingCapacity();
+	int8_t queued = command::checkBatch(commands, length, fit);
+	if (queued < 0) {
+		to_host.append8(( queued == command::BATCH_TOO_BIG ) ? RC_PACKET_TOO_BIG : RC_GENERIC_ERROR);
+		return;
 	}
+	if (capturing) {
+		sdcard::captureBytes(commands, fit);
+	} else {
+		command::push(commands, fit);
+#if COMMAND_TRACING
+		commandtrace::arrived(queued, from_host.getFinishedMicros());
+#endif
+	}
+
+	to_host.append8(( fit == length ) ? RC_OK : RC_BUFFER_OVERFLOW);
+	to_host.append8(queued);
+	to_host.append16(command::getRemainingCapacity());
 }
 
 /// Identify a command packet, and process it.  If the packet is a command
@@ -125,7 +401,16 @@ void runHostSlice() {
 bool processCommandPacket(const InPacket& from_host, OutPacket& to_host) {
 	if (from_host.getLength() >= 1) {
 		uint8_t command = from_host.read8(0);
+		if (command == HOST_CMD_BATCH) {
+			handleBatch(from_host, to_host);
+			return true;
+		}
 		if ((command & 0x80) != 0) {
+			// Cut short as it's run otherwise
+			if (command::isTooBig((const uint8_t*)from_host.getData(), from_host.getLength())) {
+				to_host.append8(RC_PACKET_TOO_BIG);
+				return true;
+			}
 			// If we're capturing a file to an SD card, we send it to the sdcard module
 			// for processing.
 			if (sdcard::isCapturing()) {
@@ -134,18 +419,13 @@ bool processCommandPacket(const InPacket& from_host, OutPacket& to_host) {
 				return true;
                         }
 			// Queue command, if there's room.
-			// Turn off interrupts while querying or manipulating the queue!
-			ATOMIC_BLOCK(ATOMIC_FORCEON) {
-				const uint8_t command_length = from_host.getLength();
-				if (command::getRemainingCapacity() >= command_length) {
-					// Append command to buffer
-					for (int i = 0; i < command_length; i++) {
-						command::push(from_host.read8(i));
-					}
-					to_host.append8(RC_OK);
-				} else {
-					to_host.append8(RC_BUFFER_OVERFLOW);
-				}
+			if (command::push((const uint8_t*)from_host.getData(), from_host.getLength())) {
+#if COMMAND_TRACING
+				commandtrace::arrived(1, from_host.getFinishedMicros());
+#endif
+				to_host.append8(RC_OK);
+			} else {
+				to_host.append8(RC_BUFFER_OVERFLOW);
 			}
 			return true;
 		}
@@ -190,56 +470,13 @@ inline void handleGetBuildName(const InPacket& from_host, OutPacket& to_host) {
 	}
 }
 
-inline void handleGetBufferSize(const InPacket& from_host, OutPacket& to_host) {
-	to_host.append8(RC_OK);
-	to_host.append32(command::getRemainingCapacity());
-}
-
-inline void handleGetPosition(const InPacket& from_host, OutPacket& to_host) {
-	ATOMIC_BLOCK(ATOMIC_FORCEON) {
-		const Point p = steppers::getPosition();
-		to_host.append8(RC_OK);
-		to_host.append32(p[0]);
-		to_host.append32(p[1]);
-		to_host.append32(p[2]);
-		// From spec:
-		// endstop status bits: (7-0) : | N/A | N/A | z max | z min | y max | y min | x max | x min |
-		Motherboard& board = Motherboard::getBoard();
-		uint8_t endstop_status = 0;
-		for (int i = 3; i > 0; i--) {
-			StepperInterface& si = board.getStepperInterface(i-1);
-			endstop_status <<= 2;
-			endstop_status |= (si.isAtMaximum()?2:0) | (si.isAtMinimum()?1:0);
-		}
-		to_host.append8(endstop_status);
-	}
-}
-
-inline void handleGetPositionExt(const InPacket& from_host, OutPacket& to_host) {
-	ATOMIC_BLOCK(ATOMIC_FORCEON) {
-		const Point p = steppers::getPosition();
-		to_host.append8(RC_OK);
-		to_host.append32(p[0]);
-		to_host.append32(p[1]);
-		to_host.append32(p[2]);
-#if STEPPER_COUNT > 3
-		to_host.append32(p[3]);
-		to_host.append32(p[4]);
-#else
-		to_host.append32(0);
-		to_host.append32(0);
-#endif
-		// From spec:
-		// endstop status bits: (15-0) : | b max | b min | a max | a min | z max | z min | y max | y min | x max | x min |
-		Motherboard& board = Motherboard::getBoard();
-		uint8_t endstop_status = 0;
-		for (int i = STEPPER_COUNT; i > 0; i--) {
-			StepperInterface& si = board.getStepperInterface(i-1);
-			endstop_status <<= 2;
-			endstop_status |= (si.isAtMaximum()?2:0) | (si.isAtMinimum()?1:0);
-		}
-		to_host.append16(endstop_status);
-	}
+/// HOST_CMD_GET_BUFFER_SIZE, HOST_CMD_GET_POSITION, HOST_CMD_GET_POSITION_EXT and
+/// HOST_CMD_IS_FINISHED, from a fresh snapshot
+inline void handleStatusQuery(const InPacket& from_host, OutPacket& to_host) {
+	statussnapshot::Status status;
+	statussnapshot::update();
+	statussnapshot::get(status);
+	appendStatusQuery(from_host.read8(0), to_host, status);
 }
 
 inline void handleCaptureToFile(const InPacket& from_host, OutPacket& to_host) {
@@ -275,7 +512,6 @@ inline void handleNextFilename(const InPacket& from_host, OutPacket& to_host) {
 			return;
 		}
 	}
-	const int MAX_FILE_LEN = MAX_PACKET_PAYLOAD-1;
 	char fnbuf[MAX_FILE_LEN];
 	sdcard::SdErrorCode e;
 	// Ignore dot-files
@@ -292,14 +528,10 @@ inline void handleNextFilename(const InPacket& from_host, OutPacket& to_host) {
 }
 
 void doToolPause(OutPacket& to_host) {
-	Timeout acquire_lock_timeout;
-	acquire_lock_timeout.start(HOST_TOOL_RESPONSE_TIMEOUT_MS);
-	while (!tool::getLock()) {
-		if (acquire_lock_timeout.hasElapsed()) {
-			to_host.append8(RC_DOWNSTREAM_TIMEOUT);
-                        Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
-			return;
-		}
+	if (!tool::waitForLock()) {
+		to_host.append8(RC_DOWNSTREAM_TIMEOUT);
+                Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
+		return;
 	}
 	OutPacket& out = tool::getOutPacket();
 	InPacket& in = tool::getInPacket();
@@ -332,14 +564,15 @@ inline void handleToolQuery(const InPacket& from_host, OutPacket& to_host) {
                 Motherboard::getBoard().indicateError(ERR_HOST_TRUNCATED_CMD);
 		return;
 	}
-	Timeout acquire_lock_timeout;
-	acquire_lock_timeout.start(HOST_TOOL_RESPONSE_TIMEOUT_MS);
-	while (!tool::getLock()) {
-		if (acquire_lock_timeout.hasElapsed()) {
-			to_host.append8(RC_DOWNSTREAM_TIMEOUT);
-                        Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
-			return;
-		}
+	// The tools only take packets of the 8 bit length framing
+	if (from_host.getLength() > LEGACY_PACKET_PAYLOAD) {
+		to_host.append8(RC_PACKET_TOO_BIG);
+		return;
+	}
+	if (!tool::waitForLock()) {
+		to_host.append8(RC_DOWNSTREAM_TIMEOUT);
+                Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
+		return;
 	}
 	OutPacket& out = tool::getOutPacket();
 	InPacket& in = tool::getInPacket();
@@ -371,34 +604,31 @@ inline void handlePause(const InPacket& from_host, OutPacket& to_host) {
 	to_host.append8(RC_OK);
 }
 
-inline void handleIsFinished(const InPacket& from_host, OutPacket& to_host) {
-	to_host.append8(RC_OK);
-	ATOMIC_BLOCK(ATOMIC_FORCEON) {
-		bool done = !steppers::isRunning() && command::isEmpty();
-		to_host.append8(done?1:0);
-	}
-}
-
+/// Payload: offset (uint16), length (uint8). Reads as much as fits in the response,
+/// which is more if the request was an extended packet.
 inline void handleReadEeprom(const InPacket& from_host, OutPacket& to_host) {
 	uint16_t offset = from_host.read16(1);
-	uint8_t length = from_host.read8(3);
-	uint8_t data[16];
-	eeprom_read_block(data, (const void*) offset, length);
+	uint16_t length = from_host.read8(3);
+	if (length > from_host.getPayloadLimit() - 1) {
+		length = from_host.getPayloadLimit() - 1;
+	}
 	to_host.append8(RC_OK);
-	for (int i = 0; i < length; i++) {
-		to_host.append8(data[i]);
+	for (uint16_t i = 0; i < length; i++) {
+		to_host.append8(eeprom_read_byte((const uint8_t*)(offset + i)));
 	}
 }
 
+/// Payload: offset (uint16), length (uint8), data. Answered with the number of
+/// bytes written, no more than the packet carries.
 inline void handleWriteEeprom(const InPacket& from_host, OutPacket& to_host) {
 	uint16_t offset = from_host.read16(1);
-	uint8_t length = from_host.read8(3);
-	uint8_t data[16];
-	eeprom_read_block(data, (const void*) offset, length);
-	for (int i = 0; i < length; i++) {
-		data[i] = from_host.read8(i + 4);
+	uint16_t length = from_host.read8(3);
+	if (length + 4 > from_host.getLength()) {
+		length = ( from_host.getLength() > 4 ) ? from_host.getLength() - 4 : 0;
+	}
+	for (uint16_t i = 0; i < length; i++) {
+		eeprom_write_byte((uint8_t*)(offset + i), from_host.read8(i + 4));
 	}
-	eeprom_write_block(data, (void*) offset, length);
 	to_host.append8(RC_OK);
 	to_host.append8(length);
 }
@@ -436,7 +666,70 @@ inline void handleExtendedStop(const InPacket& from_host, OutPacket& to_host) {
 //}
 
 
+#if COMMAND_TRACING
+/// Payload: stage + 1 (see commandtrace::Stage), flags (bit 0: clear the statistics of
+/// every stage after reading).
+/// Response: samples (uint16), mean and max (uint32, us) followed by the
+/// COMMAND_TRACE_BUCKETS histogram counts (uint16).
+inline void handleGetCommandLatency(const InPacket& from_host, OutPacket& to_host) {
+	uint8_t stage = from_host.read8(1) - 1;
+	uint8_t flags = ( from_host.getLength() > 2 ) ? from_host.read8(2) : 0;
+	if ( stage >= commandtrace::STAGE_COUNT ) {
+		to_host.append8(RC_GENERIC_ERROR);
+		return;
+	}
+
+	commandtrace::StageStats stats;
+	commandtrace::getStats(stage, stats);
+	if ( flags & 0x01 )	commandtrace::resetStats();
+
+	to_host.append8(RC_OK);
+	to_host.append16(stats.samples);
+	to_host.append32(( stats.samples ) ? stats.sum / stats.samples : 0);
+	to_host.append32(stats.max);
+	for (uint8_t i = 0; i < COMMAND_TRACE_BUCKETS; i ++)
+		to_host.append16(stats.histogram[i]);
+}
+
+/// Response: finished traces left after this response (uint8), traces lost (uint16),
+/// then as many traces as fit: command (uint8), packet complete (uint32, us), then the
+/// time to dispatch, from dispatch to the first block started and from there to the
+/// last block stepped (uint32, us; the last two 0 without blocks).
+inline void handleGetCommandTrace(const InPacket& from_host, OutPacket& to_host) {
+	const uint8_t trace_size = 17;
+	uint8_t count = ( to_host.getPayloadLimit() - 4 ) / trace_size;
+	uint8_t finished = commandtrace::getFinishedCount();
+	if ( count > finished )	count = finished;
+
+	to_host.append8(RC_OK);
+	to_host.append8(finished - count);
+	to_host.append16(commandtrace::getLostCount());
+	commandtrace::Trace trace;
+	for (uint8_t i = 0; i < count; i ++) {
+		commandtrace::drain(trace);
+		to_host.append8(trace.command);
+		to_host.append32(trace.arrived);
+		to_host.append32(trace.dispatched - trace.arrived);
+		if ( trace.blocks > 0 ) {
+			to_host.append32(trace.started - trace.dispatched);
+			to_host.append32(trace.finished - trace.started);
+		} else {
+			to_host.append32(0);
+			to_host.append32(0);
+		}
+	}
+}
+#endif
+
 inline void handleGetCommunicationStats(const InPacket& from_host, OutPacket& to_host) {
+	if ( from_host.getLength() > 1 ) {
+#if COMMAND_TRACING
+		handleGetCommandLatency(from_host, to_host);
+#else
+		to_host.append8(RC_GENERIC_ERROR);
+#endif
+		return;
+	}
         to_host.append8(RC_OK);
         to_host.append32(0);
         to_host.append32(tool::getSentPacketCount());
@@ -445,6 +738,79 @@ inline void handleGetCommunicationStats(const InPacket& from_host, OutPacket& to
         to_host.append32(tool::getNoiseByteCount());
 }
 
+#if ISR_PROFILING
+/// Payload: interrupt (0 = steppers, 1 = interface, 2 = advance), flags (bit 0: clear
+/// the statistics of every interrupt after reading).
+/// Response: samples, mean, max and missed deadlines (uint16, cycles) followed by
+/// the ISR_PROFILE_BUCKETS histogram counts (uint16).
+inline void handleGetIsrProfile(const InPacket& from_host, OutPacket& to_host) {
+	uint8_t isr = from_host.read8(1);
+	uint8_t flags = from_host.read8(2);
+	if ( isr >= isrprofile::ISR_COUNT ) {
+		to_host.append8(RC_GENERIC_ERROR);
+		return;
+	}
+
+	isrprofile::IsrStats stats;
+	isrprofile::getStats(isr, stats);
+	if ( flags & 0x01 )	isrprofile::reset();
+
+	to_host.append8(RC_OK);
+	to_host.append16(stats.samples);
+	to_host.append16(( stats.samples ) ? stats.sum / stats.samples : 0);
+	to_host.append16(stats.max);
+	to_host.append16(stats.missed);
+	for (uint8_t i = 0; i < ISR_PROFILE_BUCKETS; i ++)
+		to_host.append16(stats.histogram[i]);
+}
+#endif
+
+/// Payload: task, flags (bit 0: clear the statistics of every task after reading).
+/// Response: number of tasks (uint8), then for the task: budget, runs, mean run time,
+/// max run time (uint32, us) and the overruns (uint16). The task name isn't sent,
+/// the tasks are Tool, Host, Cmd and Brd in that order.
+inline void handleGetSchedulerStats(const InPacket& from_host, OutPacket& to_host) {
+	uint8_t task = from_host.read8(1);
+	uint8_t flags = from_host.read8(2);
+	if ( task >= scheduler::getTaskCount() ) {
+		to_host.append8(RC_GENERIC_ERROR);
+		return;
+	}
+
+	scheduler::TaskStats stats;
+	scheduler::getStats(task, stats);
+	if ( flags & 0x01 )	scheduler::resetStats();
+
+	to_host.append8(RC_OK);
+	to_host.append8(scheduler::getTaskCount());
+	to_host.append32(stats.budget);
+	to_host.append32(stats.runs);
+	to_host.append32(( stats.runs ) ? stats.total / stats.runs : 0);
+	to_host.append32(stats.max);
+	to_host.append16(stats.overruns);
+}
+
+/// Payload: interval (uint16, ms), 0 to stop
+inline void handleSetTelemetry(const InPacket& from_host, OutPacket& to_host) {
+	telemetry_interval_ms = from_host.read16(1);
+	if (telemetry_interval_ms != 0 && telemetry_interval_ms < HOST_TELEMETRY_MIN_INTERVAL_MS) {
+		telemetry_interval_ms = HOST_TELEMETRY_MIN_INTERVAL_MS;
+	}
+	telemetry_timeout.start(telemetry_interval_ms * 1000L);
+	to_host.append8(RC_OK);
+}
+
+/// Payload: baud rate (uint32)
+inline void handleSetBaudRate(const InPacket& from_host, OutPacket& to_host) {
+	to_host.append8(baud_rate.propose(from_host.read32(1)) ? RC_OK : RC_GENERIC_ERROR);
+}
+
+inline void handleGetPacketLimits(const InPacket& from_host, OutPacket& to_host) {
+	to_host.append8(RC_OK);
+	to_host.append16(MAX_PACKET_PAYLOAD);
+	to_host.append8(HOST_PACKET_WINDOW);
+}
+
 bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 	if (from_host.getLength() >= 1) {
 		uint8_t command = from_host.read8(0);
@@ -477,13 +843,10 @@ bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 				to_host.append8(RC_OK);
 				return true;
 			case HOST_CMD_GET_BUFFER_SIZE:
-				handleGetBufferSize(from_host,to_host);
-				return true;
 			case HOST_CMD_GET_POSITION:
-				handleGetPosition(from_host,to_host);
-				return true;
 			case HOST_CMD_GET_POSITION_EXT:
-				handleGetPositionExt(from_host,to_host);
+			case HOST_CMD_IS_FINISHED:
+				handleStatusQuery(from_host,to_host);
 				return true;
 			case HOST_CMD_CAPTURE_TO_FILE:
 				handleCaptureToFile(from_host,to_host);
@@ -506,9 +869,6 @@ bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 			case HOST_CMD_TOOL_QUERY:
 				handleToolQuery(from_host,to_host);
 				return true;
-			case HOST_CMD_IS_FINISHED:
-				handleIsFinished(from_host,to_host);
-				return true;
 			case HOST_CMD_READ_EEPROM:
 				handleReadEeprom(from_host,to_host);
 				return true;
@@ -527,6 +887,28 @@ bool processQueryPacket(const InPacket& from_host, OutPacket& to_host) {
 			case HOST_CMD_GET_COMMUNICATION_STATS:
 				handleGetCommunicationStats(from_host,to_host);
 				return true;
+#if ISR_PROFILING
+			case HOST_CMD_GET_ISR_PROFILE:
+				handleGetIsrProfile(from_host,to_host);
+				return true;
+#endif
+			case HOST_CMD_GET_SCHEDULER_STATS:
+				handleGetSchedulerStats(from_host,to_host);
+				return true;
+			case HOST_CMD_GET_PACKET_LIMITS:
+				handleGetPacketLimits(from_host,to_host);
+				return true;
+			case HOST_CMD_SET_BAUD_RATE:
+				handleSetBaudRate(from_host,to_host);
+				return true;
+			case HOST_CMD_SET_TELEMETRY:
+				handleSetTelemetry(from_host,to_host);
+				return true;
+#if COMMAND_TRACING
+			case HOST_CMD_GET_COMMAND_TRACE:
+				handleGetCommandTrace(from_host,to_host);
+				return true;
+#endif
 			}
 		}
 	}
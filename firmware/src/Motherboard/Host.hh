@@ -18,6 +18,7 @@
 #ifndef HOST_HH_
 #define HOST_HH_
 
+#include "Configuration.hh"
 #include "Packet.hh"
 #include "SDCard.hh"
 
@@ -28,7 +29,7 @@
 namespace host {
 
 const int MAX_MACHINE_NAME_LEN = 32;
-const int MAX_FILE_LEN = MAX_PACKET_PAYLOAD-1;
+const int MAX_FILE_LEN = LEGACY_PACKET_PAYLOAD-1;
 
 /// The host can be in any of these four states.
 enum HostState {
@@ -42,6 +43,12 @@ enum HostState {
 /// Run the host slice. This function handles incoming packets and host resets.
 void runHostSlice();
 
+#if HOST_FAST_QUERIES
+/// Answer the status queries from the snapshot as soon as their packet is in, called
+/// from the receive interrupt of the host UART. Anything else waits for the slice.
+void runFastQueries();
+#endif
+
 /// Returns the name of the current machine
 /// \return Pointer to a character string containing the machine name.
 char* getMachineName();
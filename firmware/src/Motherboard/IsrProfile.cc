@@ -0,0 +1,84 @@
+/*
+ * Interrupt Latency and Load Profiler
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "IsrProfile.hh"
+
+#if ISR_PROFILING
+
+#include <avr/io.h>
+#include <string.h>
+#include <util/atomic.h>
+
+namespace isrprofile {
+
+volatile IsrStats stats[ISR_COUNT];
+
+void init() {
+	// Timer 5, normal mode, no prescaler
+	TCCR5A = 0x00;
+	TCCR5B = 0x01;
+	TCCR5C = 0x00;
+	TIMSK5 = 0x00;
+	reset();
+}
+
+void reset() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memset((void *)stats, 0, sizeof(stats));
+	}
+}
+
+void getStats(uint8_t isr, IsrStats& out) {
+	if ( isr >= ISR_COUNT ) {
+		memset(&out, 0, sizeof(out));
+		return;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy(&out, (void *)&stats[isr], sizeof(out));
+	}
+}
+
+// Called from the interrupt itself, so interrupts are already off
+void record(uint8_t isr, uint16_t start, bool missed) {
+	uint16_t duration = TCNT5 - start;
+	volatile IsrStats& s = stats[isr];
+
+	if ( duration > s.max )	s.max = duration;
+	if (( missed ) && ( s.missed < 0xFFFF ))	s.missed ++;
+
+	// Keep the mean and histogram over the recent samples by halving
+	// everything before it can overflow
+	if (( s.samples == 0xFFFF ) || ( s.sum & 0x80000000 )) {
+		s.samples >>= 1;
+		s.sum >>= 1;
+		for (uint8_t i = 0; i < ISR_PROFILE_BUCKETS; i ++)	s.histogram[i] >>= 1;
+	}
+	s.samples ++;
+	s.sum += duration;
+
+	uint8_t bucket = 0;
+	duration /= ISR_PROFILE_FIRST_BUCKET;
+	while (( duration ) && ( bucket < (ISR_PROFILE_BUCKETS - 1) )) {
+		duration >>= 1;
+		bucket ++;
+	}
+	s.histogram[bucket] ++;
+}
+
+}
+
+#endif // ISR_PROFILING
@@ -0,0 +1,92 @@
+/*
+ * Interrupt Latency and Load Profiler
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef ISRPROFILE_HH_
+#define ISRPROFILE_HH_
+
+#include "Configuration.hh"
+#include <stdint.h>
+
+/// Times the stepper, interface and advance interrupts against timer 5, which free runs
+/// at F_CPU, so all durations are in cpu cycles. Only compiled in when ISR_PROFILING is
+/// set in Configuration.hh, otherwise the ISR_PROFILE_* macros are empty.
+///
+/// The time taken by the compiler generated register save / restore around the
+/// handler isn't included.
+namespace isrprofile {
+
+enum IsrId {
+	ISR_STEPPER	= 0,	///< TIMER1_COMPA, steppers
+	ISR_INTERFACE	= 1,	///< TIMER3_COMPA, interface board and micros
+	ISR_ADVANCE	= 2,	///< TIMER4_COMPA, extruder advance
+	ISR_COUNT	= 3
+};
+
+/// Histogram bucket i counts durations below (ISR_PROFILE_FIRST_BUCKET << i) cycles,
+/// the last bucket everything longer.
+#define ISR_PROFILE_BUCKETS		8
+#define ISR_PROFILE_FIRST_BUCKET	128
+
+struct IsrStats {
+	uint16_t samples;	///< Samples in sum, halved with sum and the histogram before either overflows
+	uint32_t sum;		///< Sum of the durations
+	uint16_t max;		///< Longest duration
+	uint16_t missed;	///< Times the handler was still running when it was due again
+	uint16_t histogram[ISR_PROFILE_BUCKETS];
+};
+
+#if ISR_PROFILING
+
+/// Start timer 5 and clear the statistics
+void init();
+
+/// Clear the statistics
+void reset();
+
+/// Take a consistent copy of the statistics of one interrupt
+void getStats(uint8_t isr, IsrStats& stats);
+
+/// Record one run of an interrupt
+/// \param[in] isr Interrupt that ran
+/// \param[in] start Value of TCNT5 on entry
+/// \param[in] missed True if the interrupt is already due again
+void record(uint8_t isr, uint16_t start, bool missed);
+
+#endif // ISR_PROFILING
+
+}
+
+#if ISR_PROFILING
+
+/// Place at the start of the ISR
+#define ISR_PROFILE_ENTER()	uint16_t isr_profile_start = TCNT5
+
+/// Place at the end of the ISR. The interrupt missed its deadline if its compare match
+/// has already fired again, or if OCRnA was set behind the counter and the timer has
+/// to wrap before it fires.
+#define ISR_PROFILE_EXIT(isr, n) \
+	isrprofile::record(isr, isr_profile_start, \
+		(TIFR##n & _BV(OCF##n##A)) || (TCNT##n >= OCR##n##A))
+
+#else
+
+#define ISR_PROFILE_ENTER()
+#define ISR_PROFILE_EXIT(isr, n)
+
+#endif // ISR_PROFILING
+
+#endif // ISRPROFILE_HH_
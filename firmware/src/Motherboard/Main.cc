@@ -21,6 +21,7 @@
 #include "Tool.hh"
 #include "Command.hh"
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/atomic.h>
 #include "Timeout.hh"
 #include "Steppers.hh"
@@ -29,6 +30,8 @@
 #include "Eeprom.hh"
 #include "EepromMap.hh"
 #include "Errors.hh"
+#include "Scheduler.hh"
+#include "StatusSnapshot.hh"
 
 
 #ifdef HAS_ATX_POWER_GOOD
@@ -81,21 +84,37 @@ void reset(bool hard_reset) {
 	}
 }
 
+void runMotherboardSlice() {
+	Motherboard::getBoard().runMotherboardSlice();
+}
+
+/// The command slice, then a new status snapshot so the queries answered from it
+/// see the moves it queued (the host slice takes one too). The steppers pick up the
+/// end of homing first, so the commands after it see the homed position.
+void runCommandSlice() {
+	steppers::runSteppersSlice();
+	command::runCommandSlice();
+	statussnapshot::update();
+}
+
 int main() {
 
-	Motherboard& board = Motherboard::getBoard();
 	steppers::init(Motherboard::getBoard());
 	reset(true);
 	sei();
+
+	// Toolhead interaction thread.
+	scheduler::addTask(PSTR("Tool"), tool::runToolSlice, 2000L);
+	// Host interaction thread.
+	scheduler::addTask(PSTR("Host"), host::runHostSlice, 2000L);
+	// Command handling thread. It also runs between the others while the planner
+	// is running low, and for ESTIMATE_SLICE_MICROS at a time while estimating.
+	scheduler::addTask(PSTR("Cmd"), runCommandSlice, 20000L, command::isStarving);
+	// Motherboard slice, which redraws the LCD
+	scheduler::addTask(PSTR("Brd"), runMotherboardSlice, 20000L);
+
 	while (1) {
-		// Toolhead interaction thread.
-		tool::runToolSlice();
-		// Host interaction thread.
-		host::runHostSlice();
-		// Command handling thread.
-		command::runCommandSlice();
-		// Motherboard slice
-		board.runMotherboardSlice();
+		scheduler::runCycle();
 
 #ifdef HAS_ATX_POWER_GOOD
 		/// Workaround for hardware issue, where powering on with USB connected
@@ -48,7 +48,13 @@ public:
         /// \return Reference to the variable containing the axis' position.
         int32_t& operator[](unsigned int index);
 
-} __attribute__ ((__packed__));
+}
+#if defined(__AVR__)
+// Everything is byte aligned on the AVR anyway; elsewhere references to the
+// coordinates would be misaligned
+__attribute__ ((__packed__))
+#endif
+;
 
 
 #endif // POINT_HH
@@ -19,6 +19,7 @@
 
 #include <avr/io.h>
 #include <string.h>
+#include <util/crc16.h>
 #include "lib_sd/sd-reader_config.h"
 #include "lib_sd/fat.h"
 #include "lib_sd/sd_raw.h"
@@ -195,6 +196,7 @@ bool capturing = false;
 bool playing = false;
 int32_t	 fileSizeBytes = 0L;
 int32_t  playedBytes = 0L;
+uint16_t fileHash = 0;
 uint32_t capturedBytes = 0L;
 
 bool isPlaying() {
@@ -234,11 +236,16 @@ SdErrorCode startCapture(char* filename)
 
 void capturePacket(const Packet& packet)
 {
-	if (file == 0) return;
 	// Casting away volatile is OK in this instance; we know where the
 	// data is located and that fat_write_file isn't caching
-	fat_write_file(file, (uint8_t*)packet.getData(), packet.getLength());
-	capturedBytes += packet.getLength();
+	captureBytes((const uint8_t*)packet.getData(), packet.getLength());
+}
+
+void captureBytes(const uint8_t* bytes, uint16_t length)
+{
+	if (file == 0) return;
+	fat_write_file(file, bytes, length);
+	capturedBytes += length;
 }
 
 
@@ -275,6 +282,32 @@ uint8_t playbackNext() {
   return rv;
 }
 
+uint16_t playbackRead(uint8_t* dest, uint16_t len) {
+  if ( ( ! has_more ) || ( len == 0 ) ) return 0;
+
+  // The first byte has already been fetched, the rest is read in one go
+  dest[0] = next_byte;
+  uint16_t count = 1;
+  if ( len > 1 ) {
+    int16_t read = fat_read_file(file, dest + 1, len - 1);
+    if ( read > 0 ) count += read;
+  }
+  playedBytes += count - 1;
+  fetchNextByte();
+  return count;
+}
+
+/// Add FILE_HASH_BYTES of the playback file, from offset on, to fileHash
+void hashFileBytes(int32_t offset) {
+  uint8_t chunk[32];
+  fat_seek_file(file, &offset, FAT_SEEK_SET);
+  for (uint16_t i = 0; i < FILE_HASH_BYTES; i += sizeof(chunk)) {
+    int16_t read = fat_read_file(file, chunk, sizeof(chunk));
+    if (read <= 0) break;
+    for (int16_t j = 0; j < read; j ++) fileHash = _crc_ccitt_update(fileHash, chunk[j]);
+  }
+}
+
 SdErrorCode startPlayback(char* filename) {
   reset();
   SdErrorCode result = initCard();
@@ -295,6 +328,12 @@ SdErrorCode startPlayback(char* filename) {
   int32_t off = 0L;
   fat_seek_file(file, &off, FAT_SEEK_END);
   fileSizeBytes = off;
+
+  fileHash = 0xffff;
+  for (char* c = filename; *c != 0; c ++)	fileHash = _crc_ccitt_update(fileHash, *c);
+  hashFileBytes(0);
+  if ( fileSizeBytes > FILE_HASH_BYTES )	hashFileBytes(fileSizeBytes - FILE_HASH_BYTES);
+
   off = 0L;
   fat_seek_file(file, &off, FAT_SEEK_SET);
 
@@ -312,6 +351,14 @@ float getPercentPlayed() {
   else					return percentPlayed;
 }
 
+uint32_t getFileSize() {
+  return fileSizeBytes;
+}
+
+uint16_t getFileHash() {
+  return fileHash;
+}
+
 void playbackRestart() {
   capturedBytes = 0L;
   playedBytes = 0L;
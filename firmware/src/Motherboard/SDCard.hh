@@ -22,6 +22,9 @@
 #include <stdint.h>
 #include "Packet.hh"
 
+/// Bytes from each end of the playback file that go into its hash
+#define FILE_HASH_BYTES 512
+
 /// Interface to the SD card library. Provides straightforward functions for
 /// listing directory contents, and reading and writing jobs to files.
 namespace sdcard {
@@ -69,6 +72,12 @@ namespace sdcard {
     void capturePacket(const Packet& packet);
 
 
+    /// Capture commands to the currently open file.
+    /// \param[in] bytes Commands to write to file.
+    /// \param[in] length Number of bytes to write.
+    void captureBytes(const uint8_t* bytes, uint16_t length);
+
+
     /// Complete the capture, and flush buffers.  Return the number of bytes
     /// written to the card.
     /// \return Number of bytes written to the card.
@@ -90,6 +99,15 @@ namespace sdcard {
     /// Return the percentage of the file printed.
     float getPercentPlayed();
 
+    /// Size of the playback file
+    /// \return Size in bytes
+    uint32_t getFileSize();
+
+    /// A cheap fingerprint of the playback file, taken when playback starts: a CRC of the
+    /// file name and the first and last FILE_HASH_BYTES bytes.
+    /// \return The CRC
+    uint16_t getFileHash();
+
     /// See if there is more data available in the playback file.
     /// \return True if there is more data in the file
     bool playbackHasNext();
@@ -99,6 +117,13 @@ namespace sdcard {
     /// \return The next byre in the file.
     uint8_t playbackNext();
 
+    /// Read up to len bytes from the currently open file, this is a lot
+    /// cheaper than calling playbackNext() for each byte.
+    /// \param[out] dest Where to put the bytes
+    /// \param[in] len Maximum number of bytes to read
+    /// \return Number of bytes read
+    uint16_t playbackRead(uint8_t* dest, uint16_t len);
+
     /// Rewinds a play back to the beginning
     void playbackRestart();
 
@@ -0,0 +1,67 @@
+/*
+ * Machine Status Snapshot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "StatusSnapshot.hh"
+#include <string.h>
+#include <util/atomic.h>
+#include "Motherboard.hh"
+#include "Steppers.hh"
+#include "Command.hh"
+#include "Tool.hh"
+
+namespace statussnapshot {
+
+volatile Status snapshot;
+
+void update() {
+	Status s;
+
+	Point p;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		p = steppers::getPosition();
+	}
+	for (uint8_t i = 0; i < STEPPER_COUNT; i ++)	s.position[i] = p[i];
+
+	Motherboard& board = Motherboard::getBoard();
+	s.endstops = 0;
+	for (uint8_t i = STEPPER_COUNT; i > 0; i --) {
+		StepperInterface& si = board.getStepperInterface(i - 1);
+		s.endstops <<= 2;
+		s.endstops |= (si.isAtMaximum() ? 2 : 0) | (si.isAtMinimum() ? 1 : 0);
+	}
+
+	s.flags = 0;
+	if ( steppers::isRunning() )	s.flags |= STATUS_RUNNING;
+	if ( command::isEmpty() )	s.flags |= STATUS_EMPTY;
+	if ( command::isPaused() )	s.flags |= STATUS_PAUSED;
+	s.queue_depth = steppers::getQueueDepth();
+	s.buffer_free = command::getRemainingCapacity();
+	s.tool_temperature = tool::getCachedTemperature(tool::getCurrentToolheadIndex());
+	s.platform_temperature = tool::getCachedPlatformTemperature();
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy((void *)&snapshot, &s, sizeof(s));
+	}
+}
+
+void get(Status& status) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy(&status, (void *)&snapshot, sizeof(status));
+	}
+}
+
+}
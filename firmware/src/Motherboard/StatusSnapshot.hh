@@ -0,0 +1,55 @@
+/*
+ * Machine Status Snapshot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef STATUSSNAPSHOT_HH_
+#define STATUSSNAPSHOT_HH_
+
+#include "Configuration.hh"
+#include <stdint.h>
+
+/// A copy of the machine state the host asks about most, taken by the main loop
+/// and readable from an interrupt. The cheap queries (see host::runFastQueries())
+/// are answered from it as soon as their packet is in, the telemetry frames and
+/// the position screen are built from it too.
+namespace statussnapshot {
+
+/// Status::flags
+enum {
+	STATUS_RUNNING		= 0x01,	///< Steppers running
+	STATUS_EMPTY		= 0x02,	///< Command buffer empty
+	STATUS_PAUSED		= 0x04
+};
+
+struct Status {
+	int32_t position[STEPPER_COUNT];	///< Steps
+	uint16_t endstops;		///< Bit 2i at the minimum of axis i, 2i+1 at its maximum
+	uint8_t flags;
+	uint8_t queue_depth;		///< Moves in the planner
+	uint16_t buffer_free;		///< Bytes free in the command buffer
+	uint16_t tool_temperature;	///< The last ones the tool reported
+	uint16_t platform_temperature;
+};
+
+/// Take a new snapshot, call from the main loop
+void update();
+
+/// Copy the last snapshot, interrupts may be on or off
+void get(Status& status);
+
+}
+
+#endif // STATUSSNAPSHOT_HH_
@@ -27,6 +27,10 @@
 
 #ifdef HAS_STEPPER_ACCELERATION
 #include "StepperAccel.hh"
+#include "Command.hh"
+#else
+#include <util/atomic.h>
+#include "CommandTrace.hh"
 #endif
 
 namespace steppers {
@@ -38,25 +42,87 @@ volatile int32_t intervals_remaining;
 StepperAxis axes[STEPPER_COUNT];
 volatile bool is_homing;
 
+#if COMMAND_TRACING && !defined(HAS_STEPPER_ACCELERATION)
+/// The command the move or homing under way belongs to. Without a planner a move
+/// starts as soon as it's set, and replaces the one before.
+volatile uint8_t move_trace = 0;
+
+void traceMoveStarted() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		COMMAND_TRACE_BLOCK_FINISHED(move_trace);
+		move_trace = commandtrace::blockQueued();
+		COMMAND_TRACE_BLOCK_STARTED(move_trace);
+	}
+}
+
+/// Interrupts have to be off
+void traceMoveFinished() {
+	COMMAND_TRACE_BLOCK_FINISHED(move_trace);
+	move_trace = 0;
+}
+#endif
+
 #ifdef HAS_STEPPER_ACCELERATION
 	bool acceleration = false;
 	bool planner = false;
 	uint8_t plannerMaxBufferSize;
-	volatile bool force_acceleration_off = false;
 
 	Point lastTarget;
 #endif
 
 bool holdZ = false;
 
-bool isRunning() {
-	return is_running || is_homing;
+#ifdef HAS_STEPPER_ACCELERATION
+
+/// Read back where the steppers actually are, and make that the
+/// position everything else is planned from
+static void syncPosition() {
+	lastTarget = Point(st_get_position(X_AXIS), st_get_position(Y_AXIS), st_get_position(Z_AXIS),
+			   st_get_position(E_AXIS), st_get_position(B_AXIS));
+	plan_set_position(lastTarget[0], lastTarget[1], lastTarget[2], lastTarget[3], lastTarget[4]);
+}
+
+#endif
+
+void runSteppersSlice() {
+#ifdef HAS_STEPPER_ACCELERATION
+	//The homing block leaves the planner once every axis has found its endstop,
+	//we then pick up the position the steppers reached
+	if (( is_homing ) && ( st_empty() )) {
+		syncPosition();
+		is_homing = false;
+	}
+#endif
 }
 
 bool isHoming() {
 	return is_homing;
 }
 
+bool isRunning() {
+#ifdef HAS_STEPPER_ACCELERATION
+	return isHoming() || ( ! st_empty() );
+#else
+	return is_running || is_homing;
+#endif
+}
+
+bool isQueueFull() {
+#ifdef HAS_STEPPER_ACCELERATION
+	return isHoming() || ( movesplanned() >= plannerMaxBufferSize );
+#else
+	return isRunning();
+#endif
+}
+
+uint8_t getQueueDepth() {
+#ifdef HAS_STEPPER_ACCELERATION
+	return movesplanned();
+#else
+	return ( isRunning() ) ? 1 : 0;
+#endif
+}
+
 //public:
 void init(Motherboard& motherboard) {
 	is_running = false;
@@ -69,7 +135,16 @@ void init(Motherboard& motherboard) {
 
 void abort() {
 #ifdef HAS_STEPPER_ACCELERATION
-	if ( acceleration )	quickStop();
+	quickStop();
+	//Whatever was queued never happened, so carry on from where we stopped
+	syncPosition();
+	is_homing = false;
+	//Nor do the temperature, motor, fan and valve commands waiting for it
+	command::discardDeferred();
+#elif COMMAND_TRACING
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		traceMoveFinished();
+	}
 #endif
 	is_running = false;
 	is_homing = false;
@@ -82,6 +157,22 @@ float convertAxisMMToFloat(int64_t st ) {
 	return aspmf;
 }
 
+float getStepsPerMM(uint8_t index) {
+#ifdef HAS_STEPPER_ACCELERATION
+	return axis_steps_per_unit[index];
+#else
+	int64_t fallback;
+	switch (index) {
+	case 0:		fallback = STEPS_PER_MM_X_DEFAULT;	break;
+	case 1:		fallback = STEPS_PER_MM_Y_DEFAULT;	break;
+	case 2:		fallback = STEPS_PER_MM_Z_DEFAULT;	break;
+	case 3:		fallback = STEPS_PER_MM_A_DEFAULT;	break;
+	default:	fallback = STEPS_PER_MM_B_DEFAULT;	break;
+	}
+	return convertAxisMMToFloat(eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_X + 8 * index, fallback));
+#endif
+}
+
 void reset() {
 #ifdef HAS_STEPPER_ACCELERATION
 	//Get the acceleration settings
@@ -90,113 +181,109 @@ void reset() {
 	acceleration = accel & 0x01;
 	planner = (accel & 0x02)?true:false;
 
-	if ( acceleration ) {
-		//Good description of the settings can be found here:
-		//http://wiki.ultimaker.com/Marlin_firmware_for_the_Ultimaker
-		//and here:  https://github.com/ErikZalm/Marlin
-
-		//Here's more documentation on the various settings / features
-		//http://wiki.ultimaker.com/Marlin_firmware_for_the_Ultimaker
-		//https://github.com/ErikZalm/Marlin/commits/Marlin_v1
-		//http://forums.reprap.org/read.php?147,94689,94689
-		//http://reprap.org/pipermail/reprap-dev/2011-May/003323.html
-		//http://www.brokentoaster.com/blog/?p=358
-
-		//Same as axis steps:mm in the firmware
-		//Temporarily placed here, should be read from eeprom
-		axis_steps_per_unit[X_AXIS] = convertAxisMMToFloat(eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_X, STEPS_PER_MM_X_DEFAULT));
-		axis_steps_per_unit[Y_AXIS] = convertAxisMMToFloat(eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_Y, STEPS_PER_MM_Y_DEFAULT));
-		axis_steps_per_unit[Z_AXIS] = convertAxisMMToFloat(eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_Z, STEPS_PER_MM_Z_DEFAULT));
-		axis_steps_per_unit[E_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_E_STEPS_PER_MM,44) / 10.0;
+	//There's only the one stepper driver, with acceleration switched off it runs
+	//the same planner with zero acceleration, i.e. every block at its nominal rate
+
+	//Good description of the settings can be found here:
+	//http://wiki.ultimaker.com/Marlin_firmware_for_the_Ultimaker
+	//and here:  https://github.com/ErikZalm/Marlin
+
+	//Here's more documentation on the various settings / features
+	//http://wiki.ultimaker.com/Marlin_firmware_for_the_Ultimaker
+	//https://github.com/ErikZalm/Marlin/commits/Marlin_v1
+	//http://forums.reprap.org/read.php?147,94689,94689
+	//http://reprap.org/pipermail/reprap-dev/2011-May/003323.html
+	//http://www.brokentoaster.com/blog/?p=358
+
+	//Same as axis steps:mm in the firmware
+	//Temporarily placed here, should be read from eeprom
+	axis_steps_per_unit[X_AXIS] = convertAxisMMToFloat(eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_X, STEPS_PER_MM_X_DEFAULT));
+	axis_steps_per_unit[Y_AXIS] = convertAxisMMToFloat(eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_Y, STEPS_PER_MM_Y_DEFAULT));
+	axis_steps_per_unit[Z_AXIS] = convertAxisMMToFloat(eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_Z, STEPS_PER_MM_Z_DEFAULT));
+	axis_steps_per_unit[E_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_E_STEPS_PER_MM,44) / 10.0;
+	axis_steps_per_unit[B_AXIS] = axis_steps_per_unit[E_AXIS];
  
-		//M201 - Set max acceleration in units/s^2 for print moves
-		// X, Y, Z, E maximum start speed for accelerated moves. E default values are good for skeinforge 40+, for older versions raise them a lot.
-		max_acceleration_units_per_sq_second[X_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_X, 2000);
-		max_acceleration_units_per_sq_second[Y_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_Y, 2000);
-		max_acceleration_units_per_sq_second[Z_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_Z, 150);
-		max_acceleration_units_per_sq_second[E_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_A, 60000);
-
-		for (uint8_t i = 0; i < NUM_AXIS; i ++)
-			axis_steps_per_sqr_second[i] = max_acceleration_units_per_sq_second[i] * axis_steps_per_unit[i];
-		
-		//M203 - Set maximum feedrate that your machine can sustain in mm/sec
-		max_feedrate[X_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_X, 160);
-		max_feedrate[Y_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_Y, 160);
-		max_feedrate[Z_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_Z, 10);
-		max_feedrate[E_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_A, 100);
+	//M201 - Set max acceleration in units/s^2 for print moves
+	// X, Y, Z, E maximum start speed for accelerated moves. E default values are good for skeinforge 40+, for older versions raise them a lot.
+	max_acceleration_units_per_sq_second[X_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_X, 2000);
+	max_acceleration_units_per_sq_second[Y_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_Y, 2000);
+	max_acceleration_units_per_sq_second[Z_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_Z, 150);
+	max_acceleration_units_per_sq_second[E_AXIS] = eeprom::getEepromUInt32(eeprom::ACCEL_MAX_ACCELERATION_A, 60000);
+	max_acceleration_units_per_sq_second[B_AXIS] = max_acceleration_units_per_sq_second[E_AXIS];
+
+	for (uint8_t i = 0; i < NUM_AXIS; i ++)
+		axis_steps_per_sqr_second[i] = max_acceleration_units_per_sq_second[i] * axis_steps_per_unit[i];
+	
+	//M203 - Set maximum feedrate that your machine can sustain in mm/sec
+	max_feedrate[X_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_X, 160);
+	max_feedrate[Y_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_Y, 160);
+	max_feedrate[Z_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_Z, 10);
+	max_feedrate[E_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_A, 100);
+	max_feedrate[B_AXIS] = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_B, 100);
 
-		//M204 - Set default accelerationm for "Normal Moves (acceleration)" and "filament only moves (retraction)" in mm/sec^2
+	//M204 - Set default accelerationm for "Normal Moves (acceleration)" and "filament only moves (retraction)" in mm/sec^2
 
-		// X, Y, Z and E max acceleration in mm/s^2 for printing moves 
-		p_acceleration		= (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_EXTRUDER_NORM, 5000);
+	// X, Y, Z and E max acceleration in mm/s^2 for printing moves 
+	p_acceleration		= (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_EXTRUDER_NORM, 5000);
 
-		// X, Y, Z and E max acceleration in mm/s^2 for r retracts
-		p_retract_acceleration	= (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_EXTRUDER_RETRACT, 3000);
+	// X, Y, Z and E max acceleration in mm/s^2 for r retracts
+	p_retract_acceleration	= (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_EXTRUDER_RETRACT, 3000);
 
-		//M205 - Advanced Settings
-		//minimumfeedrate   - minimum travel speed while printing
-		minimumfeedrate	  = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MIN_FEED_RATE,0)	 / 10.0;
+	if ( ! acceleration ) {
+		p_acceleration		= 0.0;
+		p_retract_acceleration	= 0.0;
+	}
 
-		//mintravelfeedrate - minimum travel speed while travelling
-    		mintravelfeedrate = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MIN_TRAVEL_FEED_RATE,0) / 10.0;
+	//M205 - Advanced Settings
+	//minimumfeedrate   - minimum travel speed while printing
+	minimumfeedrate	  = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MIN_FEED_RATE,0)	 / 10.0;
 
-		//max_xy_jerk     - maximum xy jerk (mm/sec)
-    		max_xy_jerk	  = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_XY_JERK,2)	 / 10.0;
-		max_xy_jerk_squared = max_xy_jerk * max_xy_jerk;
+	//mintravelfeedrate - minimum travel speed while travelling
+    	mintravelfeedrate = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MIN_TRAVEL_FEED_RATE,0) / 10.0;
 
-		//max_z_jerk        - maximum z jerk (mm/sec)
-    		max_z_jerk	  = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_Z_JERK,100)	 / 10.0;
+	//max_xy_jerk     - maximum xy jerk (mm/sec)
+    	max_xy_jerk	  = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_XY_JERK,2)	 / 10.0;
+	max_xy_jerk_squared = max_xy_jerk * max_xy_jerk;
 
-    		float advanceK	 	= (float)eeprom::getEepromUInt32(eeprom::ACCEL_ADVANCE_K,50)		/ 100000.0;
-    		float filamentDiameter  = (float)eeprom::getEepromUInt32(eeprom::ACCEL_FILAMENT_DIAMETER,175)	/ 100.0;
+	//max_z_jerk        - maximum z jerk (mm/sec)
+    	max_z_jerk	  = (float)eeprom::getEepromUInt32(eeprom::ACCEL_MAX_Z_JERK,100)	 / 10.0;
 
-		force_acceleration_off = false;
+	//advanceK, advanceK2 - linear advance constants of the A and B extruders (s)
+    	float advanceK	 	= (float)eeprom::getEepromUInt32(eeprom::ACCEL_ADVANCE_K,0)		/ 100000.0;
+    	float advanceK2	 	= (float)eeprom::getEepromUInt32(eeprom::ACCEL_ADVANCE_K2,0)		/ 100000.0;
 
-		if ( planner ) 	plannerMaxBufferSize = BLOCK_BUFFER_SIZE - 1;
-		else		plannerMaxBufferSize = 1;
+	if ( planner ) 	plannerMaxBufferSize = BLOCK_BUFFER_SIZE - 1;
+	else		plannerMaxBufferSize = 1;
 
-		plan_init(advanceK, filamentDiameter, axis_steps_per_unit[E_AXIS]);	//Initialize planner
-  		st_init();								//Initialize stepper
+	plan_init(advanceK, advanceK2);	//Initialize planner
+  	st_init();									//Initialize stepper
 
-		lastTarget = Point(st_get_position(X_AXIS), st_get_position(Y_AXIS), st_get_position(Z_AXIS), st_get_position(E_AXIS), 0);
-	}
-	else lastTarget = getPosition();
+	syncPosition();
 #endif
 }
 
 /// Define current position as given point
 void definePosition(const Point& position) {
 #ifdef HAS_STEPPER_ACCELERATION
-	if (( acceleration ) && ( ! force_acceleration_off )) {
-		plan_set_position(position[0], position[1], position[2], position[3]);
-	}
-	else {
-#endif
-		for (int i = 0; i < STEPPER_COUNT; i++) {
-			axes[i].definePosition(position[i]);
-		}
-#ifdef HAS_STEPPER_ACCELERATION
-	}
+	plan_set_position(position[0], position[1], position[2], position[3], position[4]);
 	lastTarget = position;
+#else
+	for (int i = 0; i < STEPPER_COUNT; i++) {
+		axes[i].definePosition(position[i]);
+	}
 #endif
 }
 
 /// Get current position
 const Point getPosition() {
-#if STEPPER_COUNT > 3
 #ifdef HAS_STEPPER_ACCELERATION
-	if (( acceleration ) && ( ! force_acceleration_off ))
-			    return lastTarget;
-	else		    
-#endif
-		  	    return Point(axes[0].position,axes[1].position,axes[2].position,axes[3].position,axes[4].position);
+	return lastTarget;
 #else
-#ifdef HAS_STEPPER_ACCELERATION
-	if (( acceleration ) && ( ! force_acceleration_off ))
-			    return Point(lastTarget[0], lastTarget[1], lastTarget[2]);
-	else		    
+#if STEPPER_COUNT > 3
+	return Point(axes[0].position,axes[1].position,axes[2].position,axes[3].position,axes[4].position);
+#else
+	return Point(axes[0].position,axes[1].position,axes[2].position);
 #endif
-			    return Point(axes[0].position,axes[1].position,axes[2].position);
 #endif
 }
 
@@ -206,7 +293,7 @@ void setHoldZ(bool holdZ_in) {
 
 #ifdef HAS_STEPPER_ACCELERATION
 
-//Calculates the feedrate based on moving from "from" to "to"
+//Calculates the feedrate (mm/s) based on moving from "from" to "to" at interval us per step
 
 float calcFeedRate(const Point& from, const Point& to, int32_t interval ) {
 
@@ -232,20 +319,29 @@ float calcFeedRate(const Point& from, const Point& to, int32_t interval ) {
 	}
 	distance = sqrt(distance);
 
-	return (distance * 60000000.0) / ((float)interval * (float)master_steps);
+	return (distance * 1000000.0) / ((float)interval * (float)master_steps);
+}
+
+//Returns the extruder (0 = A, 1 = B) doing the extruding when moving from "from" to "to"
+
+uint8_t activeExtruder(const Point& from, const Point& to) {
+	int32_t deltaA = to[3] - from[3];
+	int32_t deltaB = to[4] - from[4];
+	if ( deltaA < 0 ) deltaA *= -1;
+	if ( deltaB < 0 ) deltaB *= -1;
+
+	return ( deltaB > deltaA ) ? 1 : 0;
 }
 
 #endif
 
 void setTarget(const Point& target, int32_t dda_interval) {
 #ifdef HAS_STEPPER_ACCELERATION
-	if (( acceleration ) && ( ! force_acceleration_off )) {
-		float feedRate = calcFeedRate(lastTarget, target, dda_interval );
+	float feedRate = calcFeedRate(lastTarget, target, dda_interval );
 
-		//Figure out the distance between x1,y1 and x2,y2 using pythagoras
-		plan_buffer_line(target[0], target[1], target[2], target[3], feedRate, 0);
-	} else {
-#endif
+	plan_buffer_line(target[0], target[1], target[2], target[3], target[4], feedRate, activeExtruder(lastTarget, target));
+	lastTarget = target;
+#else
 		int32_t max_delta = 0;
 		for (int i = 0; i < AXIS_COUNT; i++) {
 			axes[i].setTarget(target[i], false);
@@ -264,39 +360,37 @@ void setTarget(const Point& target, int32_t dda_interval) {
 		for (int i = 0; i < AXIS_COUNT; i++) {
 			axes[i].counter = negative_half_interval;
 		}
+#if COMMAND_TRACING
+		traceMoveStarted();
+#endif
 		is_running = true;
-
-#ifdef HAS_STEPPER_ACCELERATION
-	}
-
-	lastTarget = target;
 #endif
 }
 
 void setTargetNew(const Point& target, int32_t us, uint8_t relative) {
 #ifdef HAS_STEPPER_ACCELERATION
-	if (( acceleration ) && ( ! force_acceleration_off )) {
-		Point newPosition = target;
-		for (uint8_t i = 0; i < AXIS_COUNT; i ++)  {
-			if ((relative & (1 << i)) != 0)
-				newPosition[i] = lastTarget[i] + target[i];
-		}
+	Point newPosition = target;
+	for (uint8_t i = 0; i < AXIS_COUNT; i ++)  {
+		if ((relative & (1 << i)) != 0)
+			newPosition[i] = lastTarget[i] + target[i];
+	}
 
-		int32_t max_delta = 0;
-		for (int i = 0; i < AXIS_COUNT; i++) {
-			int32_t delta = newPosition[i] - lastTarget[i];
-			if ( delta < 0 ) delta *= -1;
-			if (delta > max_delta) {
-				max_delta = delta;
-			}
+	int32_t max_delta = 0;
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		int32_t delta = newPosition[i] - lastTarget[i];
+		if ( delta < 0 ) delta *= -1;
+		if (delta > max_delta) {
+			max_delta = delta;
 		}
-		int32_t dda_interval = us / max_delta;
-		float feedRate = calcFeedRate(lastTarget, newPosition, dda_interval);
+	}
+	if ( max_delta == 0 )	return;
 
-		plan_buffer_line(newPosition[0], newPosition[1], newPosition[2], newPosition[3], feedRate, 0);
-		lastTarget = newPosition;
-	} else {
-#endif
+	int32_t dda_interval = us / max_delta;
+	float feedRate = calcFeedRate(lastTarget, newPosition, dda_interval);
+
+	plan_buffer_line(newPosition[0], newPosition[1], newPosition[2], newPosition[3], newPosition[4], feedRate, activeExtruder(lastTarget, newPosition));
+	lastTarget = newPosition;
+#else
 		for (int i = 0; i < AXIS_COUNT; i++) {
 			axes[i].setTarget(target[i], (relative & (1 << i)) != 0);
 			// Only shut z axis on inactivity
@@ -306,10 +400,6 @@ void setTargetNew(const Point& target, int32_t us, uint8_t relative) {
 			} else if (delta != 0) {
 				axes[i].enableStepper(true);
 			}
-
-#ifdef HAS_STEPPER_ACCELERATION
-			lastTarget[i] = axes[i].absoluteTarget;
-#endif
 		}
 		// compute number of intervals for this move
 		intervals = us / INTERVAL_IN_MICROSECONDS;
@@ -318,61 +408,19 @@ void setTargetNew(const Point& target, int32_t us, uint8_t relative) {
 		for (int i = 0; i < AXIS_COUNT; i++) {
 			axes[i].counter = negative_half_interval;
 		}
+#if COMMAND_TRACING
+		traceMoveStarted();
+#endif
 		is_running = true;
-
-#ifdef HAS_STEPPER_ACCELERATION
-	}
 #endif
 }
 
-#ifdef HAS_STEPPER_ACCELERATION
-void switchToRegularDriver() {
-	if ( ! acceleration )	return;
-
-	cli();
-
-	//Get the current position of the accelerated driver and
-	//store it in the regular driver
-	Point currentPosition = getPosition();
-	for (int i = 0; i < STEPPER_COUNT; i++) {
-		axes[i].definePosition(currentPosition[i]);
-	}
-
-	force_acceleration_off = true;
-
-	//Change the interrupt frequency to the regular driver
-	Motherboard::getBoard().setupFixedStepperTimer();
-
-	sei();
-}
-
-void switchToAcceleratedDriver() {
-	if ( ! acceleration )	return;
-
-	//Get the current position of the regular driver and
-	//store it in the accelerated driver
-
-	cli();
-
-	force_acceleration_off = false;
-
-	Point currentPosition = Point(axes[0].position, axes[1].position, axes[2].position, axes[3].position, axes[4].position);
-	definePosition(currentPosition);
-
-	//Change the interrupt frequency to the accelerated driver
-	Motherboard::getBoard().setupAccelStepperTimer();
-	
-	sei();
-}
-#endif
-
 /// Start homing
 void startHoming(const bool maximums, const uint8_t axes_enabled, const uint32_t us_per_step) {
-
 #ifdef HAS_STEPPER_ACCELERATION
-	if ( acceleration ) switchToRegularDriver();
-#endif
-
+	is_homing = true;
+	plan_buffer_homing(axes_enabled, maximums, us_per_step);
+#else
 	intervals_remaining = INT32_MAX;
 	intervals = us_per_step / INTERVAL_IN_MICROSECONDS;
 	const int32_t negative_half_interval = -intervals / 2;
@@ -384,7 +432,11 @@ void startHoming(const bool maximums, const uint8_t axes_enabled, const uint32_t
 			axes[i].delta = 0;
 		}
 	}
+#if COMMAND_TRACING
+	traceMoveStarted();
+#endif
 	is_homing = true;
+#endif
 }
 
 /// Enable/disable the given axis.
@@ -424,21 +476,18 @@ void doLcd() {
 
 bool doInterrupt() {
 #ifdef HAS_STEPPER_ACCELERATION
-	if (( acceleration ) && ( ! force_acceleration_off )) {
-		//st_interrupt runs all the time, is_running reflects if we have space in the buffer or not,
-		//i.e. it enables us to add more commands if it's false
-
-		if ( movesplanned() >=  plannerMaxBufferSize)	is_running = true;
-		else						is_running = false;
+	//st_interrupt runs all the time, it executes accelerated, unaccelerated
+	//and homing blocks alike
+	st_interrupt();
 
-		st_interrupt();
-	
-		return is_running;
-	} else {
-#endif
+	return blocks_queued();
+#else
 		if (is_running) {
 			if (intervals_remaining-- == 0) {
 				is_running = false;
+#if COMMAND_TRACING
+				traceMoveFinished();
+#endif
 			} else {
 				for (int i = 0; i < STEPPER_COUNT; i++) {
 					axes[i].doInterrupt(intervals);
@@ -451,25 +500,21 @@ bool doInterrupt() {
 				bool still_homing = axes[i].doHoming(intervals);
 				is_homing = still_homing || is_homing;
 			}
-
-#ifdef HAS_STEPPER_ACCELERATION
-			//If homing has finished and we're accelerated, switch back to the accelerated drived
-			if (( ! is_homing ) && ( acceleration )) switchToAcceleratedDriver();
+#if COMMAND_TRACING
+			if (!is_homing) traceMoveFinished();
 #endif
 
 			return is_homing;
 		}
-#ifdef HAS_STEPPER_ACCELERATION
-	}
-#endif
 	return false;
+#endif
 }
 
 #ifdef HAS_STEPPER_ACCELERATION
 
 bool doAdvanceInterrupt() {
 #ifdef ADVANCE
-	if ( acceleration ) st_advance_interrupt();
+	st_advance_interrupt();
 #endif
 }
 
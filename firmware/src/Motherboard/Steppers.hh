@@ -37,13 +37,28 @@ namespace steppers {
     void reset();
 
     /// Check if the stepper subsystem is running
-    /// \return True if the stepper subsystem is running or paused. False
-    ///         otherwise.
+    /// \return True if the stepper subsystem is running or paused, or has
+    ///         moves queued. False otherwise.
     bool isRunning();
 
-    /// Returns true if the stepper subsystem is homing
+    /// Check if the stepper subsystem can accept another move
+    /// \return True if the move queue is full (or, if there's no queue, a
+    ///         move is still running). False otherwise.
+    bool isQueueFull();
+
+    /// Get the number of moves waiting in the planner
+    /// \return Moves planned, 1 while a move runs without acceleration
+    uint8_t getQueueDepth();
+
+    /// Returns true if the stepper subsystem is homing. With acceleration it
+    /// stays true until runSteppersSlice() has picked up the homed position.
     bool isHoming();
 
+    /// Run the stepper subsystem slice from the main loop. Once a homing block
+    /// has finished, the position the steppers reached becomes the position the
+    /// planner continues from.
+    void runSteppersSlice();
+
     /// Abort the current motion and set the stepper subsystem to
     /// the not-running state.
     void abort();
@@ -87,12 +102,6 @@ namespace steppers {
     /// \param[in] position New system position
     void definePosition(const Point& position);
 
-    /// Switch to the regular driver
-    void switchToRegularDriver();
-
-    ///Switch to the accelerated driver
-    void switchToAcceleratedDriver();
-
 //Debugging
 void doLcd();
 
@@ -107,6 +116,10 @@ void doLcd();
     /// \return The current machine position.
     const Point getPosition();
 
+    /// Get the steps per mm of an axis the moves are planned with
+    /// \param[in] index Index of the axis
+    float getStepsPerMM(uint8_t index);
+
     /// Control whether the Z axis should stay enabled during the entire
     /// build (defaults to off). This is useful for machines that have
     /// a z-axis that might slip if the motor does not stay enagaged.
@@ -26,6 +26,9 @@
 #define TOOL_PACKET_TIMEOUT_MS 50L
 #define TOOL_PACKET_TIMEOUT_MICROS (1000L*TOOL_PACKET_TIMEOUT_MS)
 
+/// Longest a transaction can take, every try timing out
+#define TOOL_LOCK_TIMEOUT_MICROS ((RETRIES + 1)*TOOL_PACKET_TIMEOUT_MICROS)
+
 #define DELAY_BETWEEN_TRANSMISSIONS_MICROS (500L)
 
 namespace tool {
@@ -39,6 +42,12 @@ Timeout timeout;                        ///< Tool resposnse timeout counter
 
 uint8_t tool_index = 0;
 
+/// Temperatures from the last responses to SLAVE_CMD_GET_TEMP of tool 0 and 1, and
+/// SLAVE_CMD_GET_PLATFORM_TEMP
+uint16_t cached_temperature[2];
+uint16_t cached_platform_temperature;
+bool request_platform;			///< The next requestTemperatures() is for the platform
+
 uint32_t sent_packet_count;
 uint32_t packet_failure_count;
 uint32_t packet_retry_count;
@@ -77,15 +86,10 @@ uint32_t getNoiseByteCount() {
 bool getToolVersion() {
     // This code is very lightly modified from handleToolQuery in Host.cc.
     // We don't give up if we fail to get a lock; we force it instead.
-    Timeout acquire_lock_timeout;
-    acquire_lock_timeout.start(TOOL_PACKET_TIMEOUT_MICROS*2);
-    while (!tool::getLock()) {
-            if (acquire_lock_timeout.hasElapsed()) {
-                    locked = true; // grant ourselves the lock
-                    transaction_active = false; // abort transaction!
-                    Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
-                    break;
-            }
+    if (!waitForLock()) {
+            locked = true; // grant ourselves the lock
+            transaction_active = false; // abort transaction!
+            Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
     }
 
     OutPacket& out = getOutPacket();
@@ -124,15 +128,10 @@ bool getToolVersion() {
 void setToolIndicatorLED() {
     // This code is very lightly modified from handleToolQuery in Host.cc.
     // We don't give up if we fail to get a lock; we force it instead.
-    Timeout acquire_lock_timeout;
-    acquire_lock_timeout.start(TOOL_PACKET_TIMEOUT_MICROS*2);
-    while (!tool::getLock()) {
-            if (acquire_lock_timeout.hasElapsed()) {
-                    locked = true; // grant ourselves the lock
-                    transaction_active = false; // abort transaction!
-                    Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
-                    break;
-            }
+    if (!waitForLock()) {
+            locked = true; // grant ourselves the lock
+            transaction_active = false; // abort transaction!
+            Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
     }
     OutPacket& out = getOutPacket();
     InPacket& in = getInPacket();
@@ -152,15 +151,10 @@ void setToolIndicatorLED() {
 bool reset() {
 	// This code is very lightly modified from handleToolQuery in Host.cc.
 	// We don't give up if we fail to get a lock; we force it instead.
-	Timeout acquire_lock_timeout;
-	acquire_lock_timeout.start(TOOL_PACKET_TIMEOUT_MICROS*2);
-	while (!tool::getLock()) {
-		if (acquire_lock_timeout.hasElapsed()) {
-			locked = true; // grant ourselves the lock
-			transaction_active = false; // abort transaction!
-                        Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
-			break;
-		}
+	if (!waitForLock()) {
+		locked = true; // grant ourselves the lock
+		transaction_active = false; // abort transaction!
+		Motherboard::getBoard().indicateError(ERR_SLAVE_LOCK_TIMEOUT);
 	}
 	OutPacket& out = getOutPacket();
 	InPacket& in = getInPacket();
@@ -215,6 +209,18 @@ void releaseLock() {
 	locked = false;
 }
 
+bool waitForLock() {
+	Timeout acquire_lock_timeout;
+	acquire_lock_timeout.start(TOOL_LOCK_TIMEOUT_MICROS);
+	while (!getLock()) {
+		if (acquire_lock_timeout.hasElapsed()) {
+			return false;
+		}
+		runToolSlice();
+	}
+	return true;
+}
+
 void startTransaction() {
         sent_packet_count++;
 
@@ -228,6 +234,7 @@ void startTransaction() {
 	timeout.start(TOOL_PACKET_TIMEOUT_MICROS); // 50 ms timeout
 	retries = RETRIES;
         UART::getSlaveUART().in.reset();
+        UART::getSlaveUART().flushReceived();
         UART::getSlaveUART().beginSend();
 }
 
@@ -235,12 +242,49 @@ bool isTransactionDone() {
 	return !transaction_active;
 }
 
+/// Keep the temperature from a response, so telemetry needn't ask the tool itself
+void cacheTemperature(const OutPacket& out, const InPacket& in) {
+	if (out.getLength() < 2 || in.getLength() < 3 || !rcCompare(in.read8(0), RC_OK)) {
+		return;
+	}
+	uint8_t index = out.read8(0);
+	if (out.read8(1) == SLAVE_CMD_GET_TEMP && index < 2) {
+		cached_temperature[index] = in.read16(1);
+	} else if (out.read8(1) == SLAVE_CMD_GET_PLATFORM_TEMP) {
+		cached_platform_temperature = in.read16(1);
+	}
+}
+
+uint16_t getCachedTemperature(uint8_t index) {
+	return ( index < 2 ) ? cached_temperature[index] : 0;
+}
+
+uint16_t getCachedPlatformTemperature() {
+	return cached_platform_temperature;
+}
+
+bool requestTemperatures() {
+	if (!getLock()) {
+		return false;
+	}
+	OutPacket& out = getOutPacket();
+	out.reset();
+	out.append8(tool_index);
+	out.append8(( request_platform ) ? SLAVE_CMD_GET_PLATFORM_TEMP : SLAVE_CMD_GET_TEMP);
+	request_platform = !request_platform;
+	startTransaction();
+	releaseLock();
+	return true;
+}
+
 void runToolSlice() {
         UART& uart = UART::getSlaveUART();
+	uart.processReceived();
 	if (transaction_active) {
 		if (uart.in.isFinished())
 		{
 			transaction_active = false;
+			cacheTemperature(uart.out, uart.in);
 		} else if (uart.in.hasError()) {
 		  if (uart.in.getErrorCode() == PacketError::NOISE_BYTE) {
                     noise_byte_count++;
@@ -252,6 +296,7 @@ void runToolSlice() {
 				timeout.start(TOOL_PACKET_TIMEOUT_MICROS); // 50 ms timeout
 				uart.out.prepareForResend();
 				uart.in.reset();
+				uart.flushReceived();
 				uart.reset();
 				uart.beginSend();
 			} else {
@@ -266,6 +311,7 @@ void runToolSlice() {
 				timeout.start(TOOL_PACKET_TIMEOUT_MICROS); // 50 ms timeout
 				uart.out.prepareForResend();
 				uart.in.reset();
+				uart.flushReceived();
 				uart.reset();
 				uart.beginSend();
 			} else {
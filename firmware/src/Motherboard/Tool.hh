@@ -45,6 +45,12 @@ void runToolSlice();
 /// \return True if the lock has been successfully acquired, false otherwise.
 bool getLock();
 
+/// Wait for the tool interaction lock. The transaction in progress, such as a
+/// requestTemperatures() nobody waits on, is run meanwhile so the lock comes free.
+/// The wait covers a transaction with all its retries.
+/// \return True if the lock has been acquired, false if it timed out.
+bool waitForLock();
+
 /// Release the tool interaction lock, letting some other part of the system
 /// interact with the toolheads.
 void releaseLock();
@@ -102,6 +108,20 @@ void setCurrentToolheadIndex(uint8_t index);
 /// \return Index of the current toolhead.
 uint8_t getCurrentToolheadIndex();
 
+/// Get the last temperature a tool reported, from whichever transaction asked for it
+/// \param[in] index Toolhead index (0 or 1)
+/// \return Temperature, 0 if it was never read
+uint16_t getCachedTemperature(uint8_t index);
+
+/// Get the last platform temperature the current tool reported
+/// \return Temperature, 0 if it was never read
+uint16_t getCachedPlatformTemperature();
+
+/// Ask the current tool for its temperature, or its platform temperature, in turn,
+/// without waiting for the answer; it updates the cached temperatures.
+/// \return False if the tool is busy, nothing was asked
+bool requestTemperatures();
+
 }
 
 #endif // TOOL_HH_
@@ -28,6 +28,7 @@
 #include "Commands.hh"
 #include "Eeprom.hh"
 #include "EepromMap.hh"
+#include "IsrProfile.hh"
 #include <avr/eeprom.h>
 
 /// Instantiate static motherboard instance
@@ -94,15 +95,7 @@ Motherboard::Motherboard() :
 #endif
 }
 
-void Motherboard::setupFixedStepperTimer() {
-	TCCR1A = 0x00;
-	TCCR1B = 0x09;
-	TCCR1C = 0x00;
-	OCR1A = INTERVAL_IN_MICROSECONDS * 16;
-	TIMSK1 = 0x02; // turn on OCR1A match interrupt
-}
-
-void Motherboard::setupAccelStepperTimer() {
+void Motherboard::setupStepperTimer() {
   // waveform generation = 0100 = CTC
   TCCR1B &= ~(1<<WGM13);
   TCCR1B |=  (1<<WGM12);
@@ -144,13 +137,13 @@ void Motherboard::reset(bool hard_reset) {
 	}
 	// Initialize the host and slave UARTs
         UART::getHostUART().enable(true);
-        UART::getHostUART().in.reset();
+        UART::getHostUART().getInPacket().reset();
         UART::getSlaveUART().enable(true);
         UART::getSlaveUART().in.reset();
 
 	// Reset and configure timer 1, the stepper
 	// interrupt timer.
-	setupFixedStepperTimer();
+	setupStepperTimer();
 
 	// Reset and configure timer 2, the debug LED flasher timer.
 	TCCR2A = 0x00;
@@ -166,12 +159,18 @@ void Motherboard::reset(bool hard_reset) {
 	TIMSK3 = 0x02; // turn on OCR3A match interrupt
 
 	// Reset and configure timer 4, the accelerated "ADVANCE" timer
-	// interrupt timer.
+	// interrupt timer. The OCR4A match interrupt is left off, the
+	// stepper driver turns it on while there are extruder steps to do.
 	TCCR4A = 0x00;
 	TCCR4B = 0x09;
 	TCCR4C = 0x00;
 	OCR4A = 100 * 16;
-	TIMSK4 = 0x02; // turn on OCR4A match interrupt
+	TIMSK4 = 0x00;
+
+#if ISR_PROFILING
+	// Timer 5 free runs to time the interrupts
+	isrprofile::init();
+#endif
 
         buzzerRepeats  = 0;
         buzzerDuration = 0.0;
@@ -209,11 +208,18 @@ void Motherboard::reset(bool hard_reset) {
 }
 
 /// Get the number of microseconds that have passed since
-/// the board was booted.
+/// the board was booted. The interface interrupt only counts
+/// every 8ms, so the count of timer 3 (4us a tick) is added.
 micros_t Motherboard::getCurrentMicros() {
 	micros_t micros_snapshot;
 	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
 		micros_snapshot = micros;
+		uint16_t count = TCNT3;
+		// The compare match hasn't been serviced yet, and the timer
+		// had started again when it was read
+		if (( TIFR3 & _BV(OCF3A) ) && ( count < INTERVAL_IN_MICROSECONDS * 8 ))
+			micros_snapshot += INTERVAL_IN_MICROSECONDS * 64;
+		micros_snapshot += (micros_t)count * 4;
 	}
 	return micros_snapshot;
 }
@@ -281,17 +287,23 @@ MoodLightController Motherboard::getMoodLightController() {
 
 /// Timer one comparator match interrupt
 ISR(TIMER1_COMPA_vect) {
+	ISR_PROFILE_ENTER();
 	Motherboard::getBoard().doStepperInterrupt();
+	ISR_PROFILE_EXIT(isrprofile::ISR_STEPPER, 1);
 }
 
 /// Timer one comparator match interrupt
 ISR(TIMER3_COMPA_vect) {
+	ISR_PROFILE_ENTER();
 	Motherboard::getBoard().doInterfaceInterrupt();
+	ISR_PROFILE_EXIT(isrprofile::ISR_INTERFACE, 3);
 }
 
 /// Timer one comparator match interrupt
 ISR(TIMER4_COMPA_vect) {
+	ISR_PROFILE_ENTER();
 	Motherboard::getBoard().doAdvanceInterrupt();
+	ISR_PROFILE_EXIT(isrprofile::ISR_ADVANCE, 4);
 }
 
 /// Number of times to blink the debug LED on each cycle
@@ -95,9 +95,9 @@ private:
 	void serviceBuzzer();
 
 public:
-	//2 types of stepper timers depending on if we're using accelerated or not
-	void setupFixedStepperTimer();
-	void setupAccelStepperTimer();
+	/// Configure timer 1 for the stepper driver, it's reprogrammed
+	/// on every interrupt with the interval to the next step
+	void setupStepperTimer();
 
 	/// Reset the motherboard to its initial state.
 	/// This only resets the board, and does not send a reset
@@ -61,6 +61,25 @@
 
 // --- Host UART configuration ---
 // The host UART is presumed to always be present on the RX/TX lines.
+// Baud rate the host UART starts at, and goes back to after a failed
+// HOST_CMD_SET_BAUD_RATE.
+#define HOST_BAUD_RATE          38400
+// Number of pipelined host packets that can wait to be handled, each one takes
+// MAX_PACKET_PAYLOAD + 9 bytes of RAM (73 here).
+#define HOST_PACKET_WINDOW      2
+// Bytes each UART can receive before the main loop puts them into packets, a
+// power of 2, so back-to-back packets aren't lost while the main loop is busy.
+#define UART_RX_BUFFER_SIZE     32
+// Biggest payload of an extended host packet (HOST_CMD_GET_PACKET_LIMITS). Every
+// packet buffer is this big, the host and slave UARTs and the window.
+#define MAX_PACKET_PAYLOAD      64
+// Packet CRC from a 256 byte table in flash, cheaper in the UART interrupts
+#define PACKET_CRC_TABLE        1
+// Define as 1 to answer the status queries (buffer size, position, is finished)
+// from the receive interrupt as soon as their packet is in, 0 to leave them to
+// the host slice. Parses the received bytes in the interrupt while the host is
+// only asking those.
+#define HOST_FAST_QUERIES       1
 
 // --- Axis configuration ---
 // Define the number of stepper axes supported by the board.  The axes are
@@ -152,4 +171,8 @@
 // Define as 1 if debugging packets are honored; 0 if not.
 #define HONOR_DEBUG_PACKETS     1
 
+// Define as 1 to trace the buffered commands from packet arrival to the last
+// step (see CommandTrace.hh), 0 if not. Takes about 500 bytes of RAM.
+#define COMMAND_TRACING         0
+
 #endif // BOARDS_RRMBV12_CONFIGURATION_HH_
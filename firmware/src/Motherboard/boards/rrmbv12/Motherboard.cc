@@ -103,7 +103,7 @@ void Motherboard::reset(bool hard_reset) {
 	}
 	// Initialize the host and slave UARTs
         UART::getHostUART().enable(true);
-        UART::getHostUART().in.reset();
+        UART::getHostUART().getInPacket().reset();
 
         // TODO: These aren't done on other platforms, are they necessary?
         UART::getHostUART().reset();
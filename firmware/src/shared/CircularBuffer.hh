@@ -20,6 +20,14 @@
 #define SHARED_CIRCULAR_BUFFER_HH_
 
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#else
+#include <atomic>
+#endif
 
 typedef uint16_t BufSizeType;
 
@@ -131,4 +139,210 @@ typedef CircularBufferTempl<uint8_t> CircularBuffer;
 dtype name##_data[size]; \
 CircularBufferTempl<dtype> name(size,name##_data);
 
+/// A circular buffer for power of 2 sizes, indices are masked instead of taken modulo
+/// the size. It's safe without locking for one producer (push*, writeSpan, commitPush)
+/// and one consumer (pop*, peek*, operator[]), e.g. an interrupt and the main loop:
+/// head is only written by the producer and tail only by the consumer. Both run freely
+/// and are masked on access, so a full buffer uses every element.
+///
+/// A 16 bit store isn't atomic on the AVR, so the indices are stored with interrupts
+/// off for the 2 instructions it takes, and the other side's index is read until two
+/// reads agree. On a host the indices are std::atomic, the producer publishes head
+/// with release and the consumer tail, and each side reads the other's with acquire.
+/// reset() must not run concurrently with either side.
+template<typename T, BufSizeType SIZE>
+class MaskedCircularBufferTempl {
+public:
+	typedef T BufDataType;
+private:
+	static const BufSizeType MASK = SIZE - 1;
+	/// Fails to compile if SIZE isn't a power of 2 that fits the indices
+	typedef char size_must_be_a_power_of_2[(( SIZE & MASK ) == 0 && SIZE <= 0x8000 ) ? 1 : -1];
+
+#if defined(__AVR__)
+	typedef volatile BufSizeType Index;
+#else
+	typedef std::atomic<BufSizeType> Index;
+#endif
+
+	Index head; /// Next element to write, written by the producer
+	Index tail; /// Next element to read, written by the consumer
+	BufDataType data[SIZE]; /// Buffer data
+	volatile bool overflow; /// Overflow indicator
+	volatile bool underflow; /// Underflow indicator
+
+	/// Read the index written by the other side
+	static inline BufSizeType load(const Index& index) {
+#if defined(__AVR__)
+		BufSizeType value;
+		do {
+			value = index;
+		} while (value != index);
+		return value;
+#else
+		return index.load(std::memory_order_acquire);
+#endif
+	}
+
+	/// Read the index written by this side
+	static inline BufSizeType own(const Index& index) {
+#if defined(__AVR__)
+		return index;
+#else
+		return index.load(std::memory_order_relaxed);
+#endif
+	}
+
+	static inline void store(Index& index, BufSizeType value) {
+#if defined(__AVR__)
+		uint8_t sreg = SREG;
+		cli();
+		index = value;
+		SREG = sreg;
+#else
+		index.store(value, std::memory_order_release);
+#endif
+	}
+
+public:
+	MaskedCircularBufferTempl() :
+		head(0), tail(0), overflow(false), underflow(false) {
+	}
+
+	/// Reset the buffer to its empty state.  All data in
+	/// the buffer will be (effectively) lost.
+	inline void reset() {
+		store(head, 0);
+		store(tail, 0);
+		overflow = false;
+		underflow = false;
+	}
+
+	/// Append an element to the tail of the buffer
+	inline void push(BufDataType b) {
+		BufSizeType h = own(head);
+		if ((BufSizeType)(h - load(tail)) < SIZE) {
+			data[h & MASK] = b;
+			store(head, h + 1);
+		} else {
+			overflow = true;
+		}
+	}
+
+	/// Append count elements to the tail of the buffer. Nothing is appended
+	/// and the overflow flag is set if they don't all fit.
+	/// \return True if the elements were appended
+	inline bool pushN(const BufDataType* src, BufSizeType count) {
+		BufSizeType h = own(head);
+		if ((BufSizeType)(SIZE - (BufSizeType)(h - load(tail))) < count) {
+			overflow = true;
+			return false;
+		}
+		BufSizeType first = SIZE - (h & MASK);
+		if ( first > count )	first = count;
+		memcpy(&data[h & MASK], src, first * sizeof(BufDataType));
+		memcpy(&data[0], src + first, (count - first) * sizeof(BufDataType));
+		store(head, h + count);
+		return true;
+	}
+
+	/// Get the contiguous free space at the tail of the buffer, to be filled
+	/// directly and appended with commitPush()
+	/// \param[out] len Number of elements that can be written
+	/// \return Where to write them
+	inline BufDataType* writeSpan(BufSizeType& len) {
+		BufSizeType h = own(head);
+		BufSizeType free = SIZE - (BufSizeType)(h - load(tail));
+		BufSizeType contiguous = SIZE - (h & MASK);
+		len = ( free < contiguous ) ? free : contiguous;
+		return &data[h & MASK];
+	}
+
+	/// Append count elements written to a writeSpan()
+	inline void commitPush(BufSizeType count) {
+		store(head, own(head) + count);
+	}
+
+	/// Pop an element off the head of the buffer
+	inline BufDataType pop() {
+		BufSizeType t = own(tail);
+		if (load(head) == t) {
+			underflow = true;
+			return BufDataType();
+		}
+		BufDataType popped = data[t & MASK];
+		store(tail, t + 1);
+		return popped;
+	}
+
+	/// Pop count elements off the head of the buffer into dst, or drop them if
+	/// dst is 0. If there are not enough elements to complete the pop, pop what
+	/// we can and set the underflow flag.
+	/// \return Number of elements popped
+	inline BufSizeType popN(BufDataType* dst, BufSizeType count) {
+		BufSizeType t = own(tail);
+		BufSizeType length = load(head) - t;
+		if (length < count) {
+			underflow = true;
+			count = length;
+		}
+		if ( dst ) {
+			BufSizeType first = SIZE - (t & MASK);
+			if ( first > count )	first = count;
+			memcpy(dst, &data[t & MASK], first * sizeof(BufDataType));
+			memcpy(dst + first, &data[0], (count - first) * sizeof(BufDataType));
+		}
+		store(tail, t + count);
+		return count;
+	}
+
+	/// Peek at an element at the head of the buffer
+	inline BufDataType peek() {
+		if (isEmpty()) {
+			underflow = true;
+			return BufDataType();
+		}
+		return data[own(tail) & MASK];
+	}
+
+	/// Get the contiguous run of elements at the head of the buffer, to be read
+	/// in place and removed with popN(0, count)
+	/// \param[out] len Number of elements that can be read
+	/// \return Where to read them
+	inline const BufDataType* peekSpan(BufSizeType& len) {
+		BufSizeType t = own(tail);
+		BufSizeType length = load(head) - t;
+		BufSizeType contiguous = SIZE - (t & MASK);
+		len = ( length < contiguous ) ? length : contiguous;
+		return &data[t & MASK];
+	}
+
+	/// Get the length of the buffer
+	inline BufSizeType getLength() const {
+		return load(head) - load(tail);
+	}
+
+	/// Get the remaining capacity of this buffer
+	inline BufSizeType getRemainingCapacity() const {
+		return SIZE - getLength();
+	}
+
+	/// Check if the buffer is empty
+	inline bool isEmpty() const {
+		return load(head) == load(tail);
+	}
+	/// Read the buffer directly
+	inline BufDataType& operator[](BufSizeType index) {
+		return data[(own(tail) + index) & MASK];
+	}
+	/// Check the overflow flag
+	inline bool hasOverflow() const {
+		return overflow;
+	}
+	/// Check the underflow flag
+	inline bool hasUnderflow() const {
+		return underflow;
+	}
+};
+
 #endif // SHARED_CIRCULAR_BUFFER_HH_
@@ -83,8 +83,49 @@
 //#define HOST_CMD_BUILD_START_NOTIFICATION 24
 //#define HOST_CMD_BUILD_END_NOTIFICATION 25
 
+// Without a payload the slave packet counts. With a stage (1 queue, 2 planner,
+// 3 motion, 4 total) and flags (bit 0 clears every stage) the latency of the
+// buffered commands in that stage, only answered when the firmware is built
+// with COMMAND_TRACING (see CommandTrace.hh)
 #define HOST_CMD_GET_COMMUNICATION_STATS 25
 
+// Retrieve the timing of one interrupt, only answered when the
+// firmware is built with ISR_PROFILING (see IsrProfile.hh)
+#define HOST_CMD_GET_ISR_PROFILE   26
+
+// Retrieve the run time statistics of one task of the main loop
+// (see Scheduler.hh)
+#define HOST_CMD_GET_SCHEDULER_STATS 27
+
+// Queue several buffered commands at once, the payload is the commands back to
+// back. Answered with the number of commands queued (uint8) and the remaining
+// buffer capacity (uint16); RC_BUFFER_OVERFLOW if the rest didn't fit and have
+// to be sent again.
+#define HOST_CMD_BATCH             28
+
+// Get the packet limits: the biggest payload of an extended packet (uint16) and the
+// number of pipelined packets that can wait to be handled (uint8). A host that wants
+// bigger packets than LEGACY_PACKET_PAYLOAD sends them framed with a 16 bit length
+// (see Packet.hh), and gets its responses framed that way as well.
+#define HOST_CMD_GET_PACKET_LIMITS 29
+
+// Propose a host baud rate (uint32). Answered at the old rate with RC_OK if the
+// board can run at it, then both ends switch. The host has to send a packet at the
+// new rate within a second, or both go back to the rate they had.
+#define HOST_CMD_SET_BAUD_RATE     30
+
+// Send status frames every so many ms (uint16), 0 to stop. They come between the
+// responses, starting with RC_TELEMETRY instead of a response code:
+// build state (uint8, HostState), flags (uint8: bit 0 steppers running, bit 1
+// command buffer empty, bit 2 paused), position x, y, z, a, b (int32), moves in
+// the planner (uint8), command buffer free (uint16), tool temperature and platform
+// temperature (uint16, the last ones the tool reported).
+#define HOST_CMD_SET_TELEMETRY     31
+
+// Drain the finished command traces, only answered when the firmware is built
+// with COMMAND_TRACING (see CommandTrace.hh)
+#define HOST_CMD_GET_COMMAND_TRACE 32
+
 // These are our bufferable commands from the host
 // #define HOST_CMD_QUEUE_POINT_INC   128  // deprecated
 #define HOST_CMD_QUEUE_POINT_ABS   129
@@ -104,6 +145,15 @@
 #define HOST_CMD_QUEUE_POINT_NEW   142
 #define HOST_CMD_STORE_HOME_POSITION  143
 #define HOST_CMD_RECALL_HOME_POSITION 144
+// HOST_CMD_QUEUE_POINT_NEW with every axis relative, in as few bytes as the
+// move needs (see CompactMove.hh)
+#define HOST_CMD_QUEUE_POINT_COMPACT  145
+// Circular arc in the XY plane, cut into chords by the firmware (see ArcSegmenter.hh)
+#define HOST_CMD_QUEUE_ARC            146
+// Firmware retraction of the extruder (0 = A, 1 = B), with the length, speed
+// and z hop in eeprom
+#define HOST_CMD_RETRACT              147
+#define HOST_CMD_UNRETRACT            148
 #define HOST_CMD_MOOD_LIGHT_SET_RGB     210
 #define HOST_CMD_MOOD_LIGHT_SET_HSB     211
 #define HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT 212
@@ -21,6 +21,12 @@
 #include "Eeprom.hh"
 #include <avr/eeprom.h>
 #include "ExtruderControl.hh"
+#include "EstimateCache.hh"
+#include "Scheduler.hh"
+#include "StatusSnapshot.hh"
+#if ISR_PROFILING
+#include "IsrProfile.hh"
+#endif
 
 
 #define HOST_PACKET_TIMEOUT_MS 20
@@ -34,6 +40,7 @@
 int16_t overrideExtrudeSeconds = 0;
 
 bool estimatingBuild = false;
+bool checkEstimateCache = false;	//Look for the build in the estimate cache before estimating it
 
 Point pausedPosition, homePosition;
 
@@ -385,8 +392,6 @@ void JogMode::reset() {
 
 	userViewMode = jogModeSettings & 0x01;
 	userViewModeChanged = false;
-
-	steppers::switchToRegularDriver();
 }
 
 void JogMode::update(LiquidCrystal& lcd, bool forceRedraw) {
@@ -452,6 +457,9 @@ void JogMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 }
 
 void JogMode::jog(ButtonArray::ButtonName direction) {
+	//Holding a button down jogs continuously, don't queue more than the steppers can take
+	if ( steppers::isQueueFull() )	return;
+
 	Point position = steppers::getPosition();
 
 	int32_t interval = 2000;
@@ -540,7 +548,6 @@ void JogMode::notifyButtonPressed(ButtonArray::ButtonName button) {
 		steppers::enableAxis(1, false);
 		steppers::enableAxis(2, false);
                 interface::popScreen();
-		steppers::switchToAcceleratedDriver();
 		break;
 	}
 }
@@ -551,7 +558,6 @@ void ExtruderMode::reset() {
 	timeChanged = false;
 	lastDirection = 1;
 	overrideExtrudeSeconds = 0;
-	steppers::switchToRegularDriver();
 }
 
 void ExtruderMode::update(LiquidCrystal& lcd, bool forceRedraw) {
@@ -637,8 +643,6 @@ void ExtruderMode::extrude(seconds_t seconds, bool overrideTempCheck) {
 		}
 	}
 
-	Point position = steppers::getPosition();
-
 	float rpm = (float)eeprom::getEeprom8(eeprom::EXTRUDE_RPM, 19) / 10.0;
 
 	//60 * 1000000 = # uS in a minute
@@ -649,8 +653,11 @@ void ExtruderMode::extrude(seconds_t seconds, bool overrideTempCheck) {
 	//50.235479 is ToM stepper extruder speed, we use this as a baseline
 	stepsPerSecond = (int16_t)((float)stepsPerSecond * stepsToMM((int32_t)50.235479, AXIS_A));
 
-	if ( seconds == 0 )	steppers::abort();
-	else {
+	//A new extrude replaces the one that's running, rather than queueing up behind it
+	steppers::abort();
+
+	if ( seconds != 0 ) {
+		Point position = steppers::getPosition();
 		position[3] += seconds * stepsPerSecond;
 		steppers::setTarget(position, interval);
 	}
@@ -725,7 +732,6 @@ void ExtruderMode::notifyButtonPressed(ButtonArray::ButtonName button) {
 			steppers::abort();
 			steppers::enableAxis(3, false);
                		interface::popScreen();
-    			steppers::switchToAcceleratedDriver();
 			break;
 	}
 }
@@ -1182,9 +1188,28 @@ void MonitorMode::reset() {
 	overrideForceRedraw = false;
 	copiesPrinted = 0;
 	timeLeftDisplayed = false;
+	buildFilament = 0;
+	buildLayers = 0;
 }
 
 
+//Write a length of filament, in m or in mm's when it's short
+void writeFilament(LiquidCrystal& lcd, float filamentUsed) {
+	uint8_t precision;
+
+	filamentUsed /= 1000.0;	//convert to meters
+	if	( filamentUsed < 0.1 )	{
+		 filamentUsed *= 1000.0;	//Back to mm's
+		precision = 1;
+	}
+	else if ( filamentUsed < 10.0 )	 precision = 4;
+	else if ( filamentUsed < 100.0 ) precision = 3;
+	else				 precision = 2;
+	lcd.writeFloat(filamentUsed, precision);
+	if ( precision == 1 ) lcd.write('m');
+	lcd.write('m');
+}
+
 void MonitorMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 	const static PROGMEM prog_uchar extruder_temp[]      =   "Tool: ---/---C";
 	const static PROGMEM prog_uchar platform_temp[]      =   "Bed:  ---/---C";
@@ -1199,6 +1224,8 @@ void MonitorMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 	const static PROGMEM prog_uchar estimate2[]          =   "Estimating:   0%";
 	const static PROGMEM prog_uchar estimate3[]          =   "          (skip)";
 	const static PROGMEM prog_uchar filament[]           =   "Filament:0.00m  ";
+	const static PROGMEM prog_uchar filament_left[]      =   "Fil Left:0.00m  ";
+	const static PROGMEM prog_uchar layer[]	     =   "Layer:          ";
 	const static PROGMEM prog_uchar copies[]	     =   "Copy:           ";
 	const static PROGMEM prog_uchar of[]		     =   " of ";
 	char buf[17];
@@ -1294,10 +1321,35 @@ void MonitorMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 		appendTime(buf, sizeof(buf), (uint32_t)command::estimateSeconds());
 		lcd.writeString(buf);
 
+		//A file that's been estimated before starts building straight away
+		estimatecache::Estimate cached;
+		if (( checkEstimateCache ) && ( estimatecache::lookup(cached) )) {
+			buildDuration = cached.seconds;
+			buildFilament = cached.filament;
+			buildLayers   = cached.layers;
+			host::setHostStateBuildingFromSD();
+			command::setEstimation(false);
+			overrideForceRedraw = true;
+			estimatingBuild = false;
+			checkEstimateCache = false;
+			return;
+		}
+		checkEstimateCache = false;
+
 		//Check for estimate finished, and switch states to building
 		if ( host::isBuildComplete() ) {
-			//Store the estimate seconds
+			//Store the estimate
 			buildDuration = command::estimateSeconds();
+			buildFilament = (int32_t)command::estimateFilamentLength();
+			buildLayers   = command::estimateLayers();
+
+			//Keep it, so the file isn't estimated again next time
+			estimatecache::Estimate estimate;
+			estimate.seconds  = buildDuration;
+			estimate.filament = buildFilament;
+			estimate.layers   = buildLayers;
+			estimatecache::store(estimate);
+
 			host::setHostStateBuildingFromSD();
 			command::setEstimation(false);
 			overrideForceRedraw = true;
@@ -1373,7 +1425,6 @@ void MonitorMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 		float secs;
 		int32_t tsecs;
 		Point position;
-		uint8_t precision;
 		float completedPercent;
 		float filamentUsed, lastFilamentUsed;
 
@@ -1448,17 +1499,23 @@ void MonitorMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 				lastFilamentUsed = stepsToMM(command::getLastFilamentLength(), AXIS_A);
 				if ( lastFilamentUsed != 0.0 )	filamentUsed = lastFilamentUsed;
 				else				filamentUsed = stepsToMM(command::getFilamentLength(), AXIS_A);
-				filamentUsed /= 1000.0;	//convert to meters
-				if	( filamentUsed < 0.1 )	{
-					 filamentUsed *= 1000.0;	//Back to mm's
-					precision = 1;
-				}
-				else if ( filamentUsed < 10.0 )	 precision = 4;
-				else if ( filamentUsed < 100.0 ) precision = 3;
-				else				 precision = 2;
-				lcd.writeFloat(filamentUsed, precision);
-				if ( precision == 1 ) lcd.write('m');
-				lcd.write('m');
+				writeFilament(lcd, filamentUsed);
+				break;
+			case BUILD_TIME_PHASE_FILAMENT_LEFT:
+				lcd.setCursor(0,1);
+				lcd.writeFromPgmspace(filament_left);
+				lcd.setCursor(9,1);
+				filamentUsed = stepsToMM(buildFilament, AXIS_A) - stepsToMM(command::getFilamentLength(), AXIS_A);
+				if ( filamentUsed < 0.0 )	filamentUsed = 0.0;
+				writeFilament(lcd, filamentUsed);
+				break;
+			case BUILD_TIME_PHASE_LAYER:
+				lcd.setCursor(0,1);
+				lcd.writeFromPgmspace(layer);
+				lcd.setCursor(7,1);
+				lcd.writeFloat((float)command::estimateLayers(), 0);
+				lcd.writeFromPgmspace(of);
+				lcd.writeFloat((float)buildLayers, 0);
 				break;
 			case BUILD_TIME_PHASE_COPIES_PRINTED:
 				uint8_t totalCopies = eeprom::getEeprom8(eeprom::ABP_COPIES, 1);
@@ -1480,6 +1537,12 @@ void MonitorMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 			if (( buildTimePhase == BUILD_TIME_PHASE_TIME_LEFT ) && ( buildDuration == 0 ))
 				buildTimePhase = (enum BuildTimePhase)((uint8_t)buildTimePhase + 1);
 
+			//Same for the layers and filament left, which come from the estimate
+			if (( buildTimePhase == BUILD_TIME_PHASE_LAYER ) && ( buildLayers == 0 ))
+				buildTimePhase = (enum BuildTimePhase)((uint8_t)buildTimePhase + 1);
+			if (( buildTimePhase == BUILD_TIME_PHASE_FILAMENT_LEFT ) && ( buildFilament == 0 ))
+				buildTimePhase = (enum BuildTimePhase)((uint8_t)buildTimePhase + 1);
+
 			//If we're setup to print more than one copy, then show that build phase,
 			//otherwise skip it
 			if ( buildTimePhase == BUILD_TIME_PHASE_COPIES_PRINTED ) {
@@ -1523,6 +1586,8 @@ void MonitorMode::notifyButtonPressed(ButtonArray::ButtonName button) {
 		//Skip build if user hit the button during the estimation phase
 		if (( host::getHostState() == host::HOST_STATE_ESTIMATING_FROM_SD ) && ( estimatingBuild )) {
 			buildDuration = 0;
+			buildFilament = 0;
+			buildLayers   = 0;
 			host::setHostStateBuildingFromSD();
 			command::setEstimation(false);
 			overrideForceRedraw = true;
@@ -1801,7 +1866,11 @@ void CancelBuildMenu::handleSelect(uint8_t index) {
 }
 
 MainMenu::MainMenu() {
-	itemCount = 21;
+#if ISR_PROFILING
+	itemCount = 23;
+#else
+	itemCount = 22;
+#endif
 	reset();
 
 	//Read in the axisStepsPerMM, we'll need these for various firmware functions later on
@@ -1836,6 +1905,10 @@ void MainMenu::drawItem(uint8_t index, LiquidCrystal& lcd) {
 	const static PROGMEM prog_uchar stepsPerMm[]	= "Axis Steps:mm";
 	const static PROGMEM prog_uchar versions[]	= "Version";
 	const static PROGMEM prog_uchar snake[]		= "Snake Game";
+	const static PROGMEM prog_uchar mainLoop[]	= "Main Loop";
+#if ISR_PROFILING
+	const static PROGMEM prog_uchar isrProfile[]	= "ISR Profile";
+#endif
 
 	switch (index) {
 	case 0:
@@ -1901,6 +1974,14 @@ void MainMenu::drawItem(uint8_t index, LiquidCrystal& lcd) {
 	case 20:
 		lcd.writeFromPgmspace(snake);
 		break;
+	case 21:
+		lcd.writeFromPgmspace(mainLoop);
+		break;
+#if ISR_PROFILING
+	case 22:
+		lcd.writeFromPgmspace(isrProfile);
+		break;
+#endif
 	}
 }
 
@@ -1991,6 +2072,16 @@ void MainMenu::handleSelect(uint8_t index) {
 			// Show build from SD screen
                         interface::pushScreen(&snake);
 			break;
+		case 21:
+			// Show the run times of the main loop tasks
+			interface::pushScreen(&schedulerStatsMode);
+			break;
+#if ISR_PROFILING
+		case 22:
+			// Show interrupt timing
+			interface::pushScreen(&isrProfileMode);
+			break;
+#endif
 		}
 }
 
@@ -2147,6 +2238,7 @@ void SDMenu::handleSelect(uint8_t index) {
 	}
 
 	estimatingBuild = true;
+	checkEstimateCache = false;
 	command::setEstimation(true);
         sdcard::SdErrorCode e;
 	e = host::startBuildFromSD(true);
@@ -2155,6 +2247,8 @@ void SDMenu::handleSelect(uint8_t index) {
 		interface::pushScreen(&unableToOpenFileMenu);
 		return;
 	}
+
+	checkEstimateCache = true;
 }
 
 
@@ -2571,6 +2665,8 @@ void PauseMode::reset() {
 }
 
 void PauseMode::jog(ButtonArray::ButtonName direction) {
+	if ( steppers::isQueueFull() )	return;
+
 	bool extrude = false;
 	int32_t interval = 1000;
 	float	speed = 1.5;	//In mm's
@@ -2644,8 +2740,6 @@ void PauseMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 		case 0:	//Entered pause, waiting for steppers to finish last command
 			lcd.writeFromPgmspace(waitForCurrentCommand);
 
-			steppers::switchToRegularDriver();
-
 			if ( ! steppers::isRunning()) pauseState ++;
 			break;
 
@@ -2751,7 +2845,6 @@ void PauseMode::update(LiquidCrystal& lcd, bool forceRedraw) {
                 		interface::popScreen();
 				command::pause(false);
 				if ( ! autoPause ) interface::popScreen();
-				steppers::switchToAcceleratedDriver();
 			}
 			break;
 	}
@@ -4185,6 +4278,131 @@ void ProfileDisplaySettingsMenu::drawItem(uint8_t index, LiquidCrystal& lcd) {
 void ProfileDisplaySettingsMenu::handleSelect(uint8_t index) {
 }
 
+void SchedulerStatsMode::reset() {
+	page = 0;
+	overrideForceRedraw = false;
+}
+
+/// Mean and max run time (us) and overruns of each task, 3 tasks a page
+void SchedulerStatsMode::update(LiquidCrystal& lcd, bool forceRedraw) {
+	const static PROGMEM prog_uchar header[] = "Task Mean  MaxOv";
+
+	uint8_t first = page * 3;
+
+	if ((forceRedraw) || (overrideForceRedraw)) {
+		overrideForceRedraw = false;
+		lcd.clear();
+
+		lcd.setCursor(0,0);
+		lcd.writeFromPgmspace(header);
+	}
+
+	scheduler::TaskStats stats;
+
+	for (uint8_t i = first; ( i < first + 3 ) && ( i < scheduler::getTaskCount() ); i ++) {
+		scheduler::getStats(i, stats);
+		uint32_t mean = ( stats.runs ) ? stats.total / stats.runs : 0;
+
+		lcd.setCursor(0, i - first + 1);
+		lcd.writeFromPgmspace((const prog_uchar *)stats.name);
+		lcd.setCursor(5, i - first + 1);
+		lcd.writeInt(( mean > 9999 ) ? 9999 : mean, 4);
+		lcd.setCursor(10, i - first + 1);
+		lcd.writeInt(( stats.max > 9999 ) ? 9999 : stats.max, 4);
+		lcd.setCursor(14, i - first + 1);
+		lcd.writeInt(( stats.overruns > 99 ) ? 99 : stats.overruns, 2);
+	}
+}
+
+void SchedulerStatsMode::notifyButtonPressed(ButtonArray::ButtonName button) {
+	switch (button) {
+		case ButtonArray::YPLUS:
+		case ButtonArray::YMINUS:
+			page ++;
+			if ( page * 3 >= scheduler::getTaskCount() )	page = 0;
+			overrideForceRedraw = true;
+			break;
+		case ButtonArray::ZERO:
+			scheduler::resetStats();
+			break;
+		default:
+			interface::popScreen();
+			break;
+	}
+}
+
+#if ISR_PROFILING
+
+void IsrProfileMode::reset() {
+	page = 0;
+	overrideForceRedraw = false;
+}
+
+/// Page 0 has the mean and max duration (us) and missed deadlines of each interrupt,
+/// page 1 the histogram of each interrupt, scaled to a digit per bucket.
+void IsrProfileMode::update(LiquidCrystal& lcd, bool forceRedraw) {
+	const static PROGMEM prog_uchar summary[] = "us Mean  Max Mis";
+	const static PROGMEM prog_uchar histogram[] = "Hist 8us..>512us";
+	const static PROGMEM prog_uchar names[] = "StIfAd";
+
+	if ((forceRedraw) || (overrideForceRedraw)) {
+		overrideForceRedraw = false;
+		lcd.clear();
+
+		lcd.setCursor(0,0);
+		if ( page == 0 )	lcd.writeFromPgmspace(summary);
+		else			lcd.writeFromPgmspace(histogram);
+
+		for (uint8_t i = 0; i < isrprofile::ISR_COUNT; i ++) {
+			lcd.setCursor(0, i + 1);
+			lcd.write(pgm_read_byte_near(names + i * 2));
+			lcd.write(pgm_read_byte_near(names + i * 2 + 1));
+		}
+	}
+
+	isrprofile::IsrStats stats;
+
+	for (uint8_t i = 0; i < isrprofile::ISR_COUNT; i ++) {
+		isrprofile::getStats(i, stats);
+
+		lcd.setCursor(3, i + 1);
+		if ( page == 0 ) {
+			uint32_t mean = ( stats.samples ) ? stats.sum / stats.samples : 0;
+			lcd.writeInt((uint16_t)(mean / (F_CPU / 1000000L)), 4);
+			lcd.setCursor(8, i + 1);
+			lcd.writeInt(stats.max / (F_CPU / 1000000L), 4);
+			lcd.setCursor(13, i + 1);
+			lcd.writeInt(( stats.missed > 999 ) ? 999 : stats.missed, 3);
+		} else {
+			uint16_t most = 1;
+			for (uint8_t b = 0; b < ISR_PROFILE_BUCKETS; b ++)
+				if ( stats.histogram[b] > most )	most = stats.histogram[b];
+
+			// Anything in a bucket shows at least a 1
+			for (uint8_t b = 0; b < ISR_PROFILE_BUCKETS; b ++)
+				lcd.write('0' + (uint8_t)(((uint32_t)stats.histogram[b] * 9 + most - 1) / most));
+		}
+	}
+}
+
+void IsrProfileMode::notifyButtonPressed(ButtonArray::ButtonName button) {
+	switch (button) {
+		case ButtonArray::YPLUS:
+		case ButtonArray::YMINUS:
+			page = ( page ) ? 0 : 1;
+			overrideForceRedraw = true;
+			break;
+		case ButtonArray::ZERO:
+			isrprofile::reset();
+			break;
+		default:
+			interface::popScreen();
+			break;
+	}
+}
+
+#endif
+
 void CurrentPositionMode::reset() {
 }
 
@@ -4211,7 +4429,10 @@ void CurrentPositionMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 		lcd.writeFromPgmspace(msg4);
 	}
 
-	Point position = steppers::getPosition();
+	// The position the host slice last took, the same the host sees
+	statussnapshot::Status status;
+	statussnapshot::get(status);
+	const int32_t* position = status.position;
 
 	lcd.setCursor(3, 0);
 	lcd.writeFloat(stepsToMM(position[0], AXIS_X), 3);
@@ -4287,8 +4508,12 @@ void AcceleratedSettingsMode::reset() {
 	values[11]	= eeprom::getEepromUInt32(eeprom::ACCEL_MIN_TRAVEL_FEED_RATE,0);
 	values[12]	= eeprom::getEepromUInt32(eeprom::ACCEL_MAX_XY_JERK,2);
 	values[13]	= eeprom::getEepromUInt32(eeprom::ACCEL_MAX_Z_JERK,100);
-	values[14]	= eeprom::getEepromUInt32(eeprom::ACCEL_ADVANCE_K,50);
-	values[15]	= eeprom::getEepromUInt32(eeprom::ACCEL_FILAMENT_DIAMETER,175);
+	values[14]	= eeprom::getEepromUInt32(eeprom::ACCEL_ADVANCE_K,0);
+	values[15]	= eeprom::getEepromUInt32(eeprom::ACCEL_ADVANCE_K2,0);
+	values[16]	= eeprom::getEepromUInt32(eeprom::ACCEL_FILAMENT_DIAMETER,175);
+	values[17]	= eeprom::getEepromUInt32(eeprom::RETRACT_LENGTH,100);
+	values[18]	= eeprom::getEepromUInt32(eeprom::RETRACT_FEEDRATE,30);
+	values[19]	= eeprom::getEepromUInt32(eeprom::RETRACT_Z_HOP,0);
 	sei();
 
 	lastAccelerateSettingsState= AS_NONE;
@@ -4311,7 +4536,11 @@ void AcceleratedSettingsMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 	const static PROGMEM prog_uchar message1MaxXYJerk[]		= "Max XY Jerk:";
 	const static PROGMEM prog_uchar message1MaxZJerk[]		= "Max Z Jerk:";
 	const static PROGMEM prog_uchar message1AdvanceK[]		= "Advance K:";
+	const static PROGMEM prog_uchar message1AdvanceK2[]		= "Advance K B:";
 	const static PROGMEM prog_uchar message1FilamentDiameter[]	= "Filament Dia:";
+	const static PROGMEM prog_uchar message1RetractLength[]	= "Retract Length:";
+	const static PROGMEM prog_uchar message1RetractFeedRate[]	= "Retract Speed:";
+	const static PROGMEM prog_uchar message1RetractZHop[]		= "Retract Z Hop:";
 	const static PROGMEM prog_uchar message4[]  = "Up/Dn/Ent to Set";
 	const static PROGMEM prog_uchar blank[]     = "    ";
 
@@ -4367,9 +4596,21 @@ void AcceleratedSettingsMode::update(LiquidCrystal& lcd, bool forceRedraw) {
                 	case AS_ADVANCE_K:
 				lcd.writeFromPgmspace(message1AdvanceK);
 				break;
+                	case AS_ADVANCE_K2:
+				lcd.writeFromPgmspace(message1AdvanceK2);
+				break;
                 	case AS_FILAMENT_DIAMETER:
 				lcd.writeFromPgmspace(message1FilamentDiameter);
 				break;
+                	case AS_RETRACT_LENGTH:
+				lcd.writeFromPgmspace(message1RetractLength);
+				break;
+                	case AS_RETRACT_FEEDRATE:
+				lcd.writeFromPgmspace(message1RetractFeedRate);
+				break;
+                	case AS_RETRACT_Z_HOP:
+				lcd.writeFromPgmspace(message1RetractZHop);
+				break;
 		}
 
 		lcd.setCursor(0,3);
@@ -4392,9 +4633,12 @@ void AcceleratedSettingsMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 					lcd.writeFloat((float)value / 10.0, 1);
 					break;
 		case AS_ADVANCE_K:
+		case AS_ADVANCE_K2:
 					lcd.writeFloat((float)value / 100000.0, 5);
 					break;
 		case AS_FILAMENT_DIAMETER:
+		case AS_RETRACT_LENGTH:
+		case AS_RETRACT_Z_HOP:
 					lcd.writeFloat((float)value / 100.0, 2);
 					break;
 		default:
@@ -4408,7 +4652,7 @@ void AcceleratedSettingsMode::update(LiquidCrystal& lcd, bool forceRedraw) {
 }
 
 void AcceleratedSettingsMode::notifyButtonPressed(ButtonArray::ButtonName button) {
-	if (( accelerateSettingsState == AS_FILAMENT_DIAMETER ) && (button == ButtonArray::OK )) {
+	if (( accelerateSettingsState == AS_RETRACT_Z_HOP ) && (button == ButtonArray::OK )) {
 		//Write the data
 		cli();
 		eeprom::putEepromUInt32(eeprom::ACCEL_MAX_FEEDRATE_X,		values[0]);
@@ -4426,7 +4670,11 @@ void AcceleratedSettingsMode::notifyButtonPressed(ButtonArray::ButtonName button
 		eeprom::putEepromUInt32(eeprom::ACCEL_MAX_XY_JERK,		values[12]);
 		eeprom::putEepromUInt32(eeprom::ACCEL_MAX_Z_JERK,		values[13]);
 		eeprom::putEepromUInt32(eeprom::ACCEL_ADVANCE_K,		values[14]);
-		eeprom::putEepromUInt32(eeprom::ACCEL_FILAMENT_DIAMETER,	values[15]);
+		eeprom::putEepromUInt32(eeprom::ACCEL_ADVANCE_K2,		values[15]);
+		eeprom::putEepromUInt32(eeprom::ACCEL_FILAMENT_DIAMETER,	values[16]);
+		eeprom::putEepromUInt32(eeprom::RETRACT_LENGTH,		values[17]);
+		eeprom::putEepromUInt32(eeprom::RETRACT_FEEDRATE,		values[18]);
+		eeprom::putEepromUInt32(eeprom::RETRACT_Z_HOP,		values[19]);
 		sei();
 
 		host::stopBuild();
@@ -4468,7 +4716,9 @@ void AcceleratedSettingsMode::notifyButtonPressed(ButtonArray::ButtonName button
 			break;
 	}
 
-	if (!(( accelerateSettingsState == AS_MIN_FEED_RATE ) || ( accelerateSettingsState == AS_MIN_TRAVEL_FEED_RATE ) || ( accelerateSettingsState == AS_ADVANCE_K ))) {
+	if (!(( accelerateSettingsState == AS_MIN_FEED_RATE ) || ( accelerateSettingsState == AS_MIN_TRAVEL_FEED_RATE ) ||
+	      ( accelerateSettingsState == AS_ADVANCE_K ) || ( accelerateSettingsState == AS_ADVANCE_K2 ) ||
+	      ( accelerateSettingsState == AS_RETRACT_Z_HOP ))) {
 		if ( values[currentIndex] < 1 )	values[currentIndex] = 1;
 	}
 
@@ -4603,7 +4853,6 @@ void EStepsPerMMMode::notifyButtonPressed(ButtonArray::ButtonName button) {
 
 void EStepsPerMMStepsMode::reset() {
 	value = 200;
-	steppers::switchToRegularDriver();
 	overrideExtrudeSeconds = 0;
 }
 
@@ -4669,13 +4918,11 @@ void EStepsPerMMStepsMode::extrude(bool overrideTempCheck) {
 void EStepsPerMMStepsMode::notifyButtonPressed(ButtonArray::ButtonName button) {
 	switch (button) {
         case ButtonArray::CANCEL:
-    		steppers::switchToAcceleratedDriver();
 		interface::popScreen();
 		break;
         case ButtonArray::ZERO:
 		break;
         case ButtonArray::OK:
-    		steppers::switchToAcceleratedDriver();
 		eStepsPerMMLengthMode.steps = value;
 		interface::pushScreen(&eStepsPerMMLengthMode);
 		break;
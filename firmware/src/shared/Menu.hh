@@ -1,6 +1,7 @@
 #ifndef MENU_HH_
 #define MENU_HH_
 
+#include "Configuration.hh"
 #include "Types.hh"
 #include "ButtonArray.hh"
 #include "LiquidCrystal.hh"
@@ -284,7 +285,9 @@ private:
 		BUILD_TIME_PHASE_ELAPSED_TIME,
 		BUILD_TIME_PHASE_TIME_LEFT,
 		BUILD_TIME_PHASE_ZPOS,
+		BUILD_TIME_PHASE_LAYER,
 		BUILD_TIME_PHASE_FILAMENT,
+		BUILD_TIME_PHASE_FILAMENT_LEFT,
 		BUILD_TIME_PHASE_COPIES_PRINTED,
 		BUILD_TIME_PHASE_LAST	//Not counted, just an end marker
 	};
@@ -296,6 +299,8 @@ private:
 	bool	pausePushLockout;
 	bool buildCompleteBuzzPlayed;
 	int32_t buildDuration;
+	int32_t buildFilament;		//Filament the build uses (steps), 0 if it wasn't estimated
+	uint16_t buildLayers;		//Layers of the build, 0 if it wasn't estimated
 	bool	overrideForceRedraw;
 	uint8_t	copiesPrinted;
 	bool	timeLeftDisplayed;
@@ -718,12 +723,16 @@ private:
 		AS_MAX_XY_JERK,
 		AS_MAX_Z_JERK,
 		AS_ADVANCE_K,
+		AS_ADVANCE_K2,
 		AS_FILAMENT_DIAMETER,
+		AS_RETRACT_LENGTH,
+		AS_RETRACT_FEEDRATE,
+		AS_RETRACT_Z_HOP,
 	};
 
 	enum accelerateSettingsState accelerateSettingsState, lastAccelerateSettingsState;
 
-	uint32_t values[16];
+	uint32_t values[20];
 
 public:
 	micros_t getUpdateRate() {return 50L * 1000L;}
@@ -894,6 +903,36 @@ public:
         void notifyButtonPressed(ButtonArray::ButtonName button);
 };
 
+class SchedulerStatsMode: public Screen {
+private:
+	uint8_t page;
+	bool	overrideForceRedraw;
+
+public:
+	micros_t getUpdateRate() {return 500L * 1000L;}
+
+	void update(LiquidCrystal& lcd, bool forceRedraw);
+
+	void reset();
+
+        void notifyButtonPressed(ButtonArray::ButtonName button);
+};
+
+class IsrProfileMode: public Screen {
+private:
+	uint8_t page;
+	bool	overrideForceRedraw;
+
+public:
+	micros_t getUpdateRate() {return 500L * 1000L;}
+
+	void update(LiquidCrystal& lcd, bool forceRedraw);
+
+	void reset();
+
+        void notifyButtonPressed(ButtonArray::ButtonName button);
+};
+
 class MainMenu: public Menu {
 public:
 	MainMenu();
@@ -926,6 +965,10 @@ private:
         VersionMode versionMode;
 	MoodLightMode	moodLightMode;
         SnakeMode snake;
+	SchedulerStatsMode schedulerStatsMode;
+#if ISR_PROFILING
+	IsrProfileMode isrProfileMode;
+#endif
 
 	int64_t checkAndGetEepromDefault(const uint16_t location, const int64_t default_value);
 };
@@ -16,12 +16,12 @@
  */
 
 #include "Packet.hh"
-#include <util/crc16.h>
+#include "PacketCrc.hh"
 
 /// Append a byte and update the CRC
 void Packet::appendByte(uint8_t data) {
 	if (length < MAX_PACKET_PAYLOAD) {
-		crc = _crc_ibutton_update(crc, data);
+		crc = packetCrcUpdate(crc, data);
 		payload[length] = data;
 		length++;
 	}
@@ -31,12 +31,15 @@ void Packet::reset() {
 	crc = 0;
 	length = 0;
 #ifdef PARANOID
-	for (uint8_t i = 0; i < MAX_PACKET_PAYLOAD; i++) {
+	for (PacketSizeType i = 0; i < MAX_PACKET_PAYLOAD; i++) {
 		payload[i] = 0;
 	}
 #endif // PARANOID
 	error_code = PacketError::NO_ERROR;
 	state = PS_START;
+	sequence = 0;
+	pipelined = false;
+	extended = false;
 }
 
 InPacket::InPacket() {
@@ -53,21 +56,43 @@ void InPacket::processByte(uint8_t b) {
 	if (state == PS_START) {
 		if (b == START_BYTE) {
 			state = PS_LEN;
+		} else if (b == PIPELINED_START_BYTE) {
+			pipelined = true;
+			state = PS_LEN;
+		} else if (b == EXTENDED_START_BYTE || b == EXTENDED_PIPELINED_START_BYTE) {
+			pipelined = (b == EXTENDED_PIPELINED_START_BYTE);
+			extended = true;
+			state = PS_LEN;
 		} else {
 			error(PacketError::NOISE_BYTE);
 		}
 	} else if (state == PS_LEN) {
-		if (b < MAX_PACKET_PAYLOAD) {
+		if (extended) {
+			expected_length = b;
+			state = PS_LEN_HIGH;
+		} else if (b < LEGACY_PACKET_PAYLOAD) {
 			expected_length = b;
-			state = (expected_length == 0) ? PS_CRC : PS_PAYLOAD;
+			state = (expected_length != 0) ? PS_PAYLOAD : (pipelined ? PS_SEQUENCE : PS_CRC);
+		} else {
+			error(PacketError::EXCEEDED_MAX_LENGTH);
+		}
+	} else if (state == PS_LEN_HIGH) {
+		uint16_t extended_length = expected_length | ((uint16_t)b << 8);
+		if (extended_length <= MAX_PACKET_PAYLOAD) {
+			expected_length = extended_length;
+			state = (expected_length != 0) ? PS_PAYLOAD : (pipelined ? PS_SEQUENCE : PS_CRC);
 		} else {
 			error(PacketError::EXCEEDED_MAX_LENGTH);
 		}
 	} else if (state == PS_PAYLOAD) {
 		appendByte(b);
 		if (length >= expected_length) {
-			state = PS_CRC;
+			state = pipelined ? PS_SEQUENCE : PS_CRC;
 		}
+	} else if (state == PS_SEQUENCE) {
+		sequence = b;
+		crc = packetCrcUpdate(crc, b);
+		state = PS_CRC;
 	} else if (state == PS_CRC) {
 		if (crc == b) {
 			state = PS_LAST;
@@ -77,14 +102,18 @@ void InPacket::processByte(uint8_t b) {
 	}
 }
 
+uint8_t InPacket::singleByteCrc(uint8_t b) {
+	return packetCrcUpdate(0, b);
+}
+
 // Reads an 8-bit byte from the specified index of the payload
-uint8_t Packet::read8(uint8_t index) const {
+uint8_t Packet::read8(PacketSizeType index) const {
 	return payload[index];
 }
-uint16_t Packet::read16(uint8_t index) const {
+uint16_t Packet::read16(PacketSizeType index) const {
 	return payload[index] | (payload[index + 1] << 8);
 }
-uint32_t Packet::read32(uint8_t index) const {
+uint32_t Packet::read32(PacketSizeType index) const {
 	union {
 		// AVR is little-endian
 		int32_t a;
@@ -118,18 +147,33 @@ void OutPacket::prepareForResend() {
 uint8_t OutPacket::getNextByteToSend() {
 	uint8_t next_byte = 0;
 	if (state == PS_START) {
-		next_byte = START_BYTE;
+		if (extended) {
+			next_byte = pipelined ? EXTENDED_PIPELINED_START_BYTE : EXTENDED_START_BYTE;
+		} else {
+			next_byte = pipelined ? PIPELINED_START_BYTE : START_BYTE;
+		}
 		state = PS_LEN;
 	} else if (state == PS_LEN) {
-		next_byte = length;
-		state = (length==0)?PS_CRC:PS_PAYLOAD;
+		next_byte = length & 0xff;
+		if (extended) {
+			state = PS_LEN_HIGH;
+		} else {
+			state = (length!=0)?PS_PAYLOAD:(pipelined?PS_SEQUENCE:PS_CRC);
+		}
+	} else if (state == PS_LEN_HIGH) {
+		next_byte = length >> 8;
+		state = (length!=0)?PS_PAYLOAD:(pipelined?PS_SEQUENCE:PS_CRC);
 	} else if (state == PS_PAYLOAD) {
 		next_byte= payload[send_payload_index++];
 		if (send_payload_index >= length) {
-			state = PS_CRC;
+			state = pipelined?PS_SEQUENCE:PS_CRC;
 		}
+	} else if (state == PS_SEQUENCE) {
+		next_byte = sequence;
+		state = PS_CRC;
 	} else if (state == PS_CRC) {
-		next_byte = crc;
+		// The sequence number is added to the CRC as it's sent, so the packet can be resent
+		next_byte = pipelined ? packetCrcUpdate(crc, sequence) : crc;
 		state = PS_LAST;
 	}
 	return next_byte;
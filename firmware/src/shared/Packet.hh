@@ -19,9 +19,36 @@
 #define SHARED_PACKET_HH_
 
 #include <stdint.h>
+#include "Configuration.hh"
+#if COMMAND_TRACING
+#include "Types.hh"
+#endif
 
 #define START_BYTE 0xD5
-#define MAX_PACKET_PAYLOAD 32
+/// Start of a pipelined packet, it carries a sequence number between the payload
+/// and the CRC, and the CRC covers it too
+#define PIPELINED_START_BYTE 0xD6
+/// Start of an extended packet, the length is 16 bits (low byte first)
+#define EXTENDED_START_BYTE 0xD7
+/// Start of an extended, pipelined packet
+#define EXTENDED_PIPELINED_START_BYTE 0xD8
+
+/// Payload of the 8 bit length framing. A response to a packet framed that way
+/// doesn't get any bigger, so old hosts see the packets they always did.
+#define LEGACY_PACKET_PAYLOAD 32
+
+/// Payload of the packet buffers, the most an extended packet carries. Each UART
+/// holds two packets and the host window HOST_PACKET_WINDOW more, so it's set per
+/// board in Configuration.hh.
+#ifndef MAX_PACKET_PAYLOAD
+#define MAX_PACKET_PAYLOAD LEGACY_PACKET_PAYLOAD
+#endif
+
+#if MAX_PACKET_PAYLOAD > 255
+typedef uint16_t PacketSizeType;
+#else
+typedef uint8_t PacketSizeType;
+#endif
 
 #define SLAVE_ID_BROADCAST 127
 
@@ -49,7 +76,8 @@ typedef enum {
         RC_CMD_UNSUPPORTED  = 0x85,
         RC_EXPECT_MORE      = 0x86,
         RC_DOWNSTREAM_TIMEOUT = 0x87,
-        RC_TOOL_LOCK_TIMEOUT = 0x88
+        RC_TOOL_LOCK_TIMEOUT = 0x88,
+        RC_TELEMETRY        = 0x89  /* Status frame nobody asked for, see HOST_CMD_SET_TELEMETRY */
 } ResponseCode;
 
 /// Convenience function to accept old response codes
@@ -64,16 +92,21 @@ protected:
 	typedef enum {
 		PS_START,
 		PS_LEN,
+		PS_LEN_HIGH,
 		PS_PAYLOAD,
+		PS_SEQUENCE,
 		PS_CRC,
 		PS_LAST
 	} PacketState;
 
-        volatile uint8_t length; /// The current length of the payload (data[0] if raw packets)
+        volatile PacketSizeType length; /// The current length of the payload (data[0] if raw packets)
         volatile uint8_t crc; /// The CRC of the current contents of the payload (data[-1] of raw packets)
         volatile uint8_t payload[MAX_PACKET_PAYLOAD]; /// Data payload (starts at data[2] of raw packet)
 	volatile uint8_t error_code; // Have any errors cropped up during processing?
 	volatile PacketState state;
+	volatile uint8_t sequence; /// Sequence number of a pipelined packet
+	volatile bool pipelined; /// Framed with PIPELINED_START_BYTE
+	volatile bool extended; /// Framed with a 16 bit length
 
 
 	/// Append a byte and update the CRC
@@ -86,7 +119,7 @@ protected:
 		error_code = error_code_in;
 	}
 public:
-	uint8_t getLength() const { return length; }
+	PacketSizeType getLength() const { return length; }
 
 	bool hasError() const {
 		return error_code != PacketError::NO_ERROR;
@@ -94,10 +127,21 @@ public:
 
 	uint8_t getErrorCode() const { return error_code; }
 
+	bool isPipelined() const { return pipelined; }
+
+	uint8_t getSequence() const { return sequence; }
+
+	bool isExtended() const { return extended; }
+
+	/// Biggest payload a response to this packet can carry
+	PacketSizeType getPayloadLimit() const {
+		return extended ? MAX_PACKET_PAYLOAD : LEGACY_PACKET_PAYLOAD;
+	}
+
 	// Reads an 8-bit byte from the specified index of the payload
-	uint8_t read8(uint8_t idx) const;
-	uint16_t read16(uint8_t idx) const;
-	uint32_t read32(uint8_t idx) const;
+	uint8_t read8(PacketSizeType idx) const;
+	uint16_t read16(PacketSizeType idx) const;
+	uint32_t read32(PacketSizeType idx) const;
 
 	uint8_t debugGetState() const { return state; }
 
@@ -107,7 +151,10 @@ public:
 /// Input Packet.
 class InPacket: public Packet {
 private:
-	volatile uint8_t expected_length;
+	volatile PacketSizeType expected_length;
+#if COMMAND_TRACING
+	micros_t finished_micros;
+#endif
 public:
 	InPacket();
 
@@ -125,18 +172,27 @@ public:
 		return state != PS_START;
 	}
 
+	/// The CRC of a packet with the one byte payload b
+	static uint8_t singleByteCrc(uint8_t b);
+
 	/// Indicate that this packet has timed out.  This means:
 	/// * setting the PACKET_TIMEOUT error on the packet
 	/// * the packet gets reset
 	void timeout() {
 		error(PacketError::PACKET_TIMEOUT);
 	}
+
+#if COMMAND_TRACING
+	/// When the last byte came in, for commandtrace
+	void setFinishedMicros(micros_t micros) { finished_micros = micros; }
+	micros_t getFinishedMicros() const { return finished_micros; }
+#endif
 };
 
 /// Output Packet.
 class OutPacket: public Packet {
 private:
-	uint8_t send_payload_index;
+	PacketSizeType send_payload_index;
 public:
 	OutPacket();
 
@@ -153,6 +209,17 @@ public:
 
 	uint8_t getNextByteToSend();
 
+	/// Send as a pipelined packet with the given sequence number
+	void setSequence(uint8_t sequence_in) {
+		sequence = sequence_in;
+		pipelined = true;
+	}
+
+	/// Send with the 16 bit length framing
+	void setExtended() {
+		extended = true;
+	}
+
 	// Prepare the output packet for resending with the current data
 	void prepareForResend();
 
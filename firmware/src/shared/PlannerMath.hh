@@ -0,0 +1,334 @@
+/*
+  PlannerMath.hh - the junction, look-ahead and trapezoid math of the motion planner
+  Part of Grbl
+
+  Copyright (c) 2009-2011 Simen Svale Skogsrud
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The planner (StepperAccelPlanner.cc) and the build estimator (BuildEstimator.cc) plan the
+// same moves, the estimator just doesn't step them. Both use these functions so that they
+// can't plan differently. There are no hardware dependencies, it also builds on the host.
+//
+// The functions are templates on the block type, a block needs the fields they use:
+//   step_event_count, nominal_rate, acceleration_st, nominal_speed, entry_speed,
+//   max_entry_speed, millimeters, acceleration, recalculate_flag, nominal_length_flag
+// block_t is one.
+
+#ifndef PLANNERMATH_HH
+#define PLANNERMATH_HH
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <math.h>
+#include "StepperAccel.hh"
+
+// Lowest step rate of a trapezoid. (Otherwise the timer will overflow.)
+#define PLANNER_MIN_STEP_RATE 120
+
+#define PLANNER_VEPSILON 1.0e-5
+
+// v1 != v2
+inline bool planner_vneq(float v1, float v2) {
+  return fabs(v1 - v2) > PLANNER_VEPSILON;
+}
+
+inline float planner_min(float a, float b) {
+  return (a < b) ? a : b;
+}
+
+// Calculates the distance (not time) it takes to accelerate from initial_rate to target_rate using the
+// given acceleration:
+inline float estimate_acceleration_distance(float initial_rate, float target_rate, float acceleration)
+{
+  if (acceleration!=0) {
+  return((target_rate*target_rate-initial_rate*initial_rate)/
+         (2.0*acceleration));
+  }
+  else {
+    return 0.0;  // acceleration was 0, set acceleration distance to 0
+  }
+}
+
+// This function gives you the point at which you must start braking (at the rate of -acceleration) if
+// you started at speed initial_rate and accelerated until this point and want to end at the final_rate after
+// a total travel of distance. This can be used to compute the intersection point between acceleration and
+// deceleration in the cases where the trapezoid has no plateau (i.e. never reaches maximum speed)
+inline float intersection_distance(float initial_rate, float final_rate, float acceleration, float distance)
+{
+ if (acceleration!=0) {
+  return((2.0*acceleration*distance-initial_rate*initial_rate+final_rate*final_rate)/
+         (4.0*acceleration) );
+  }
+  else {
+    return 0.0;  // acceleration was 0, set intersection distance to 0
+  }
+}
+
+// Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the
+// acceleration within the allotted distance.
+inline float max_allowable_speed(float acceleration, float target_velocity, float distance) {
+  return  sqrt(target_velocity*target_velocity-2*acceleration*distance);
+}
+
+// The settings of the trapezoid generator for a block
+typedef struct {
+  uint32_t initial_rate;                        // The jerk-adjusted step rate at start of block
+  uint32_t final_rate;                          // The minimal rate at exit
+  int32_t accelerate_until;                     // The index of the step event on which to stop acceleration
+  int32_t decelerate_after;                     // The index of the step event on which to start decelerating
+} trapezoid_t;
+
+// Calculates trapezoid parameters so that the entry- and exit-speed is compensated by the provided factors.
+template <class Block>
+void calculate_trapezoid(const Block *block, float entry_factor, float exit_factor, trapezoid_t *trapezoid) {
+  uint32_t initial_rate = ceil(block->nominal_rate*entry_factor); // (step/min)
+  uint32_t final_rate = ceil(block->nominal_rate*exit_factor); // (step/min)
+
+  // Limit minimal step rate (Otherwise the timer will overflow.)
+  if(initial_rate < PLANNER_MIN_STEP_RATE) {initial_rate = PLANNER_MIN_STEP_RATE; }
+  if(final_rate < PLANNER_MIN_STEP_RATE) {final_rate = PLANNER_MIN_STEP_RATE; }
+
+  int32_t acceleration = block->acceleration_st;
+  int32_t accelerate_steps =
+    ceil(estimate_acceleration_distance(initial_rate, block->nominal_rate, acceleration));
+  int32_t decelerate_steps =
+    floor(estimate_acceleration_distance(block->nominal_rate, final_rate, -acceleration));
+
+  // Calculate the size of Plateau of Nominal Rate.
+  int32_t plateau_steps = (int32_t)block->step_event_count-accelerate_steps-decelerate_steps;
+
+  // Is the Plateau of Nominal Rate smaller than nothing? That means no cruising, and we will
+  // have to use intersection_distance() to calculate when to abort acceleration and start braking
+  // in order to reach the final_rate exactly at the end of this block.
+  if (plateau_steps < 0) {
+    accelerate_steps = ceil(
+      intersection_distance(initial_rate, final_rate, acceleration, block->step_event_count));
+    if (accelerate_steps < 0) accelerate_steps = 0; // Check limits due to numerical round-off
+    if (accelerate_steps > (int32_t)block->step_event_count) accelerate_steps = block->step_event_count;
+    plateau_steps = 0;
+  }
+
+  trapezoid->initial_rate = initial_rate;
+  trapezoid->final_rate = final_rate;
+  trapezoid->accelerate_until = accelerate_steps;
+  trapezoid->decelerate_after = accelerate_steps+plateau_steps;
+}
+
+// The kernel called by planner_reverse_pass() when scanning the plan from last to first entry.
+template <class Block>
+void planner_reverse_pass_kernel(Block *current, Block *next) {
+  // If entry speed is already at the maximum entry speed, no need to recheck. Block is cruising.
+  // If not, block in state of acceleration or deceleration. Reset entry speed to maximum and
+  // check for maximum allowable speed reductions to ensure maximum possible planned speed.
+  if (planner_vneq(current->entry_speed, current->max_entry_speed)) {
+
+    // If nominal length true, max junction speed is guaranteed to be reached. Only compute
+    // for max allowable speed if block is decelerating and nominal length is false.
+    if ((!current->nominal_length_flag) && (current->max_entry_speed > next->entry_speed)) {
+      current->entry_speed = planner_min( current->max_entry_speed,
+        max_allowable_speed(-current->acceleration,next->entry_speed,current->millimeters));
+    } else {
+      current->entry_speed = current->max_entry_speed;
+    }
+    current->recalculate_flag = true;
+  }
+}
+
+// The plan needs to be gone over twice. Once in reverse and once forward. This implements the
+// reverse pass over the blocks from tail up to head of a ring of size blocks (a power of 2).
+// The newest three blocks are left alone, as is the oldest, which may already be stepped.
+template <class Block>
+void planner_reverse_pass(Block *blocks, uint8_t head, uint8_t tail, uint8_t size) {
+  const uint8_t mask = size - 1;
+  if(((head-tail + size) & mask) > 3) {
+    uint8_t block_index = (head - 3) & mask;
+    Block *block[3] = { NULL, NULL, NULL };
+    while(block_index != tail) {
+      block_index = (block_index - 1) & mask;
+      block[2]= block[1];
+      block[1]= block[0];
+      block[0] = &blocks[block_index];
+      if (block[1] && block[2]) planner_reverse_pass_kernel(block[1], block[2]);
+    }
+  }
+}
+
+// The kernel called by planner_forward_pass() when scanning the plan from first to last entry.
+template <class Block>
+void planner_forward_pass_kernel(Block *previous, Block *current) {
+  // If the previous block is an acceleration block, but it is not long enough to complete the
+  // full speed change within the block, we need to adjust the entry speed accordingly. Entry
+  // speeds have already been reset, maximized, and reverse planned by reverse planner.
+  // If nominal length is true, max junction speed is guaranteed to be reached. No need to recheck.
+  if (!previous->nominal_length_flag) {
+    if (planner_vneq(previous->entry_speed, current->entry_speed)) {
+      float entry_speed = planner_min( current->entry_speed,
+        max_allowable_speed(-previous->acceleration,previous->entry_speed,previous->millimeters) );
+
+      // Check for junction speed change
+      if (planner_vneq(current->entry_speed, entry_speed)) {
+        current->entry_speed = entry_speed;
+        current->recalculate_flag = true;
+      }
+    }
+  }
+}
+
+// The forward pass over the blocks from tail up to head, see planner_reverse_pass()
+template <class Block>
+void planner_forward_pass(Block *blocks, uint8_t head, uint8_t tail, uint8_t size) {
+  const uint8_t mask = size - 1;
+  Block *previous = NULL;
+
+  for (uint8_t block_index = tail; block_index != head; block_index = (block_index + 1) & mask) {
+    Block *current = &blocks[block_index];
+    if (previous) planner_forward_pass_kernel(previous, current);
+    previous = current;
+  }
+}
+
+// Length of a block (mm) from the move of each axis in steps and mm. An extruder only move is as
+// long as its filament.
+template <class Block>
+void planner_set_length(Block *block, const int32_t steps[NUM_AXIS], const float delta_mm[NUM_AXIS]) {
+  if ( steps[X_AXIS] == 0 && steps[Y_AXIS] == 0 && steps[Z_AXIS] == 0 && steps[B_AXIS] == 0 ) {
+    block->millimeters = fabs(delta_mm[E_AXIS]);
+  } else {
+    float sum = 0.0;
+    for(uint8_t i=0; i < NUM_AXIS; i++) sum += delta_mm[i]*delta_mm[i];
+    block->millimeters = sqrt(sum);
+  }
+}
+
+// Nominal speed (mm/s) and rate (step/s) of a block at feed_rate (mm/s), and the speed of each
+// axis (mm/s) in current_speed. The speed is lowered until no axis runs faster than its max_feedrate.
+template <class Block>
+void planner_set_speed(Block *block, const float delta_mm[NUM_AXIS], float feed_rate,
+                       const float max_feedrate[NUM_AXIS], float current_speed[NUM_AXIS]) {
+  float inverse_millimeters = 1.0/block->millimeters;  // Inverse millimeters to remove multiple divides
+
+  // Calculate speed in mm/second for each axis. No divide by zero due to previous checks.
+  float inverse_second = feed_rate * inverse_millimeters;
+
+  block->nominal_speed = block->millimeters * inverse_second; // (mm/sec) Always > 0
+  block->nominal_rate = ceil(block->step_event_count * inverse_second); // (step/sec) Always > 0
+
+  // Calculate speed in mm/sec for each axis
+  for(uint8_t i=0; i < NUM_AXIS; i++) {
+    current_speed[i] = delta_mm[i] * inverse_second;
+  }
+
+  // Limit speed per axis
+  float speed_factor = 1.0; //factor <=1 do decrease speed
+  for(uint8_t i=0; i < NUM_AXIS; i++) {
+    if(fabs(current_speed[i]) > max_feedrate[i])
+      speed_factor = planner_min(speed_factor, max_feedrate[i] / fabs(current_speed[i]));
+  }
+
+  // Correct the speed
+  if( speed_factor < 1.0) {
+    for(uint8_t i=0; i < NUM_AXIS; i++) {
+      current_speed[i] *= speed_factor;
+    }
+    block->nominal_speed *= speed_factor;
+    block->nominal_rate *= speed_factor;
+  }
+}
+
+// Acceleration of a block in steps/s^2 (acceleration_st) and mm/s^2, limited per axis by
+// axis_steps_per_sqr_second. Extruder only moves use the retract acceleration.
+template <class Block>
+void planner_set_acceleration(Block *block, const int32_t steps[NUM_AXIS], float acceleration,
+                              float retract_acceleration, const uint32_t axis_steps_per_sqr_second[NUM_AXIS]) {
+  // Compute and limit the acceleration rate for the trapezoid generator.
+  float steps_per_mm = block->step_event_count/block->millimeters;
+  if(steps[X_AXIS] == 0 && steps[Y_AXIS] == 0 && steps[Z_AXIS] == 0) {
+    block->acceleration_st = ceil(retract_acceleration * steps_per_mm); // convert to: acceleration steps/sec^2
+  }
+  else {
+    static const uint8_t order[NUM_AXIS] = { X_AXIS, Y_AXIS, E_AXIS, B_AXIS, Z_AXIS };
+    block->acceleration_st = ceil(acceleration * steps_per_mm); // convert to: acceleration steps/sec^2
+    // Limit acceleration per axis
+    for(uint8_t i=0; i < NUM_AXIS; i++) {
+      uint8_t axis = order[i];
+      if(((float)block->acceleration_st * (float)steps[axis] / (float)block->step_event_count) > axis_steps_per_sqr_second[axis])
+        block->acceleration_st = axis_steps_per_sqr_second[axis];
+    }
+  }
+  block->acceleration = block->acceleration_st / steps_per_mm;
+}
+
+// Maximum speed (mm/s) at the junction with the previous block, from the jerk limits (mm/s).
+// moves_queued is the number of blocks queued before this one.
+inline float planner_junction_speed(const float current_speed[NUM_AXIS], const float previous_speed[NUM_AXIS],
+                                    float nominal_speed, float previous_nominal_speed, uint8_t moves_queued,
+                                    float max_xy_jerk, float max_z_jerk) {
+  // Start with a safe speed
+  float vmax_junction = max_xy_jerk/2;
+  if(fabs(current_speed[Z_AXIS]) > max_z_jerk/2)
+    vmax_junction = max_z_jerk/2;
+  vmax_junction = planner_min(vmax_junction, nominal_speed);
+
+  if ((moves_queued > 1) && (previous_nominal_speed > 0.0)) {
+    float dx = current_speed[X_AXIS]-previous_speed[X_AXIS];
+    float dy = current_speed[Y_AXIS]-previous_speed[Y_AXIS];
+    float jerk_squared = dx*dx + dy*dy;
+    float max_xy_jerk_squared = max_xy_jerk*max_xy_jerk;
+
+    if((previous_speed[X_AXIS] != 0.0) || (previous_speed[Y_AXIS] != 0.0)) {
+      vmax_junction = nominal_speed;
+    }
+    if (jerk_squared > max_xy_jerk_squared) {
+         vmax_junction *= sqrt((max_xy_jerk_squared/jerk_squared));
+    }
+    float dz = fabs(current_speed[Z_AXIS] - previous_speed[Z_AXIS]);
+    if(dz > max_z_jerk) {
+      vmax_junction *= (max_z_jerk/dz);
+    }
+  }
+  return vmax_junction;
+}
+
+// Entry speed of a new block, the newest in the plan, which has to stop at its end
+template <class Block>
+void planner_set_entry_speed(Block *block, float vmax_junction) {
+  block->max_entry_speed = vmax_junction;
+
+  // Initialize block entry speed. Compute based on deceleration to user-defined MINIMUM_PLANNER_SPEED.
+  float v_allowable = max_allowable_speed(-block->acceleration,MINIMUM_PLANNER_SPEED,block->millimeters);
+  block->entry_speed = planner_min(vmax_junction, v_allowable);
+
+  // Initialize planner efficiency flags
+  // Set flag if block will always reach maximum junction speed regardless of entry/exit speeds.
+  // If a block can de/ac-celerate from nominal speed to zero within the length of the block, then
+  // the current block and next block junction speeds are guaranteed to always be at their maximum
+  // junction speeds in deceleration and acceleration, respectively. This is due to how the current
+  // block nominal speed limits both the current and next maximum junction speeds. Hence, in both
+  // the reverse and forward planners, the corresponding block junction speed will always be at the
+  // the maximum junction speed and may always be ignored for any speed reduction checks.
+  if (block->nominal_speed <= v_allowable) { block->nominal_length_flag = true; }
+  else { block->nominal_length_flag = false; }
+
+  // Without acceleration there is no ramp, the block starts and finishes at its nominal speed
+  if (block->acceleration_st == 0) {
+    block->max_entry_speed = block->nominal_speed;
+    block->entry_speed = block->nominal_speed;
+    block->nominal_length_flag = true;
+  }
+  block->recalculate_flag = true; // Always calculate trapezoid for new block
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Main Loop Scheduler
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "Scheduler.hh"
+#include "Configuration.hh"
+
+#if defined IS_EXTRUDER_BOARD
+	#include "ExtruderBoard.hh"
+
+	inline micros_t getMicros() { return ExtruderBoard::getBoard().getCurrentMicros(); }
+#else
+	#include "Motherboard.hh"
+
+	inline micros_t getMicros() { return Motherboard::getBoard().getCurrentMicros(); }
+#endif
+
+namespace scheduler {
+
+struct Task {
+	TaskFunction run;
+	UrgentFunction urgent;
+	TaskStats stats;
+};
+
+Task tasks[SCHEDULER_MAX_TASKS];
+uint8_t task_count = 0;
+
+uint8_t addTask(const char* name, TaskFunction run, micros_t budget, UrgentFunction urgent) {
+	if ( task_count == SCHEDULER_MAX_TASKS )	return SCHEDULER_MAX_TASKS;
+
+	Task& task = tasks[task_count];
+	task.run = run;
+	task.urgent = urgent;
+	task.stats.name = name;
+	task.stats.budget = budget;
+	return task_count ++;
+}
+
+/// Run a task and time it
+void runTask(Task& task) {
+	micros_t start = getMicros();
+	task.run();
+	micros_t time = getMicros() - start;
+
+	TaskStats& stats = task.stats;
+	// Keep the mean, but make room
+	if ( stats.total > 0x80000000 - time ) {
+		stats.total >>= 1;
+		stats.runs >>= 1;
+	}
+	stats.runs ++;
+	stats.total += time;
+	if ( time > stats.max )	stats.max = time;
+	if (( stats.budget ) && ( time > stats.budget ) && ( stats.overruns != 0xFFFF ))
+		stats.overruns ++;
+}
+
+void runCycle() {
+	for (uint8_t i = 0; i < task_count; i ++) {
+		runTask(tasks[i]);
+
+		// Urgent tasks don't wait for the rest of the cycle
+		for (uint8_t u = 0; u < task_count; u ++) {
+			if (( u != i ) && ( tasks[u].urgent ) && ( tasks[u].urgent() ))
+				runTask(tasks[u]);
+		}
+	}
+}
+
+uint8_t getTaskCount() {
+	return task_count;
+}
+
+void getStats(uint8_t task, TaskStats& stats) {
+	stats = tasks[task].stats;
+}
+
+void resetStats() {
+	for (uint8_t i = 0; i < task_count; i ++) {
+		TaskStats& stats = tasks[i].stats;
+		stats.runs = 0;
+		stats.total = 0;
+		stats.max = 0;
+		stats.overruns = 0;
+	}
+}
+
+}
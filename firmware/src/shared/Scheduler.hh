@@ -0,0 +1,80 @@
+/*
+ * Main Loop Scheduler
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef SCHEDULER_HH_
+#define SCHEDULER_HH_
+
+#include <stdint.h>
+#include "Types.hh"
+#include "Configuration.hh"
+
+/// Most tasks the main loop can have, boards short of RAM can set fewer
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS	4
+#endif
+
+/// Runs the slices of the main loop. Each task is a function that does a little work
+/// and returns; every cycle the tasks run in turn, in the order they were added, so the
+/// first one added has the highest priority.
+///
+/// A task can have an urgency check. While it returns true the task is run again after
+/// each of the other tasks, instead of waiting for the next cycle, e.g. the command task
+/// when the planner is running low.
+///
+/// Nothing is preempted, a task that runs for longer than its budget is only counted.
+/// The run time statistics show which task holds the loop up. Times are taken with the
+/// board's microsecond clock, so they're only as fine as its resolution.
+namespace scheduler {
+
+typedef void (*TaskFunction)();
+typedef bool (*UrgentFunction)();
+
+/// Run time statistics of a task (microseconds)
+struct TaskStats {
+	const char* name;	///< In program memory
+	micros_t budget;
+	uint32_t runs;		///< Halved along with total before total can overflow
+	uint32_t total;
+	uint32_t max;
+	uint16_t overruns;	///< Runs longer than the budget
+};
+
+/// Add a task to the end of the cycle
+/// \param[in] name Short name, in program memory (PSTR)
+/// \param[in] run The slice function
+/// \param[in] budget Longest the slice should take (microseconds), 0 for no budget
+/// \param[in] urgent Urgency check, or 0
+/// \return Index of the task, or SCHEDULER_MAX_TASKS if there's no room
+uint8_t addTask(const char* name, TaskFunction run, micros_t budget, UrgentFunction urgent = 0);
+
+/// Run each task once, and the urgent ones more often
+void runCycle();
+
+/// \return Number of tasks added
+uint8_t getTaskCount();
+
+/// Get the run time statistics of a task
+/// \param[in] task Index of the task
+/// \param[out] stats The statistics
+void getStats(uint8_t task, TaskStats& stats);
+
+/// Clear the run time statistics of every task
+void resetStats();
+
+}
+
+#endif // SCHEDULER_HH_
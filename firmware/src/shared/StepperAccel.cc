@@ -31,6 +31,7 @@
 #include "StepperAccelSpeedTable.hh"
 #include "StepperInterface.hh"
 #include "Motherboard.hh"
+#include "CommandTrace.hh"
 
 #include  <avr/interrupt.h>
 
@@ -53,22 +54,27 @@ static unsigned char out_bits;        // The next stepping-bits to be output
 static int32_t counter_x,       // Counter variables for the bresenham line tracer
             counter_y, 
             counter_z,       
-            counter_e;
+            counter_e,
+            counter_b;
 volatile static uint32_t step_events_completed; // The number of step events executed in the current block
 #ifdef ADVANCE
-  static int32_t advance_rate = 0, advance, final_advance = 0;
-  static int32_t old_advance = 0;
+  static uint16_t advance_rate = 0;
+  static int32_t advance;
+  static int32_t old_advance[EXTRUDERS];    // Advance steps currently applied to each extruder
 #endif
-volatile static int32_t e_steps[3];
+volatile static int32_t e_steps[EXTRUDERS];
 volatile static unsigned char busy = false; // TRUE when SIG_OUTPUT_COMPARE1A is being serviced. Used to avoid retriggering that handler.
 static int32_t acceleration_time, deceleration_time;
 //static uint32_t accelerate_until, decelerate_after, acceleration_rate, initial_rate, final_rate, nominal_rate;
 static unsigned short acc_step_rate; // needed for deccelaration start point
 static char step_loops;
 static unsigned short OCR1A_nominal;
+static unsigned char nominal_interrupts;  // Interrupts per step event at the nominal rate, more than 1 below 31 steps/s
+static unsigned char nominal_countdown;   // Interrupts until the next step event at the nominal rate
 
-volatile int32_t count_position[NUM_AXIS] = { 0, 0, 0, 0};
-volatile char count_direction[NUM_AXIS] = { 1, 1, 1, 1};
+volatile static uint8_t commands_due;  // Attached commands whose block has been stepped
+volatile int32_t count_position[NUM_AXIS] = { 0, 0, 0, 0, 0};
+volatile char count_direction[NUM_AXIS] = { 1, 1, 1, 1, 1};
 
 static StepperInterface *stepperInterface;
 
@@ -151,6 +157,15 @@ asm volatile ( \
 #define ENABLE_STEPPER_DRIVER_INTERRUPT()  TIMSK1 |= (1<<OCIE1A)
 #define DISABLE_STEPPER_DRIVER_INTERRUPT() TIMSK1 &= ~(1<<OCIE1A)
 
+#ifdef ADVANCE
+  // The advance interrupt only runs while there are extruder steps pending
+  #define ADVANCE_INTERRUPT_ENABLED()        (TIMSK4 & (1<<OCIE4A))
+  #define DISABLE_ADVANCE_INTERRUPT()        TIMSK4 &= ~(1<<OCIE4A)
+
+  // Timer 4 runs at 16MHz. The shortest period is 25us (40kHz, MAX_STEP_FREQUENCY)
+  #define ADVANCE_MIN_PERIOD                 (16000000L / MAX_STEP_FREQUENCY)
+#endif
+
 
 //         __________________________
 //        /|                        |\     _________________         ^
@@ -213,6 +228,21 @@ FORCE_INLINE unsigned short calc_timer(unsigned short step_rate) {
   return timer;
 }
 
+// Timer interval for the constant rate part of a block. Unlike calc_timer() this isn't
+// limited to 1kHz, so slow unaccelerated moves and homing run at the rate they asked for.
+// Below 31 steps/s a step event takes longer than the 16 bit timer can count, it's split
+// over nominal_interrupts interrupts.
+FORCE_INLINE unsigned short calc_nominal_timer(uint32_t step_rate) {
+  if(step_rate > MAX_STEP_FREQUENCY) step_rate = MAX_STEP_FREQUENCY;
+  nominal_interrupts = 1;
+  if(step_rate >= 1000) return calc_timer(step_rate);
+  step_loops = 1;
+  if(step_rate == 0) step_rate = 1;
+  uint32_t timer = 2000000L / step_rate;
+  nominal_interrupts = (timer >> 16) + 1;
+  return (unsigned short)(timer / nominal_interrupts);
+}
+
 
 //DEBUGGING
 float zadvance;
@@ -222,18 +252,30 @@ float zadvance;
 FORCE_INLINE void trapezoid_generator_reset() {
   #ifdef ADVANCE
     advance = current_block->initial_advance;
-    final_advance = current_block->final_advance;
-    // Do E steps + advance steps
-    e_steps[current_block->active_extruder] += ((advance >>8) - old_advance);
-    old_advance = advance >>8;  
+    advance_rate = current_block->advance_rate;
+    // Do E steps + advance steps. An extruder that isn't active in this block
+    // gives back the advance it was left with.
+    for(uint8_t i=0; i < EXTRUDERS; i++) {
+      if(i == current_block->active_extruder) {
+        e_steps[i] += ((advance >>8) - old_advance[i]);
+        old_advance[i] = advance >>8;
+      }
+      else if(old_advance[i] != 0) {
+        e_steps[i] -= old_advance[i];
+        old_advance[i] = 0;
+      }
+    }
     zadvance = advance;
   #endif
   deceleration_time = 0;
   // step_rate to timer interval
   acc_step_rate = current_block->initial_rate;
   acceleration_time = calc_timer(acc_step_rate);
-  OCR1A = acceleration_time;
-  OCR1A_nominal = calc_timer(current_block->nominal_rate);
+  OCR1A_nominal = calc_nominal_timer(current_block->nominal_rate);
+  nominal_countdown = 1;
+  // Blocks without acceleration (or that enter at full speed) start straight at the nominal rate
+  if(current_block->accelerate_until == 0) OCR1A = OCR1A_nominal;
+  else                                     OCR1A = acceleration_time;
   #ifdef Z_LATE_ENABLE
     if(current_block->steps_z > 0) stepperInterface[Z_AXIS].setEnabled(true);
   #endif
@@ -248,11 +290,13 @@ void st_interrupt()
     // Anything in the buffer?
     current_block = plan_get_current_block();
     if (current_block != NULL) {
+      COMMAND_TRACE_BLOCK_STARTED(current_block->trace);
       trapezoid_generator_reset();
       counter_x = -(current_block->step_event_count >> 1);
       counter_y = counter_x;
       counter_z = counter_x;
       counter_e = counter_x;
+      counter_b = counter_x;
       step_events_completed = 0;
 //      #ifdef ADVANCE
 //      e_steps[current_block->active_extruder] = 0;
@@ -302,22 +346,91 @@ void st_interrupt()
       }
       else { // +direction
 	stepperInterface[E_AXIS].setDirection(true);
-        count_direction[E_AXIS]=-1;
+        count_direction[E_AXIS]=1;
+      }
+
+      if ((out_bits & (1<<B_AXIS)) != 0) {   // -direction
+        stepperInterface[B_AXIS].setDirection(false);
+        count_direction[B_AXIS]=-1;
+      }
+      else { // +direction
+        stepperInterface[B_AXIS].setDirection(true);
+        count_direction[B_AXIS]=1;
       }
     #endif //!ADVANCE
-    
 
-    
+    // A slow nominal rate step event spans several interrupts, wait for the last one
+    if (nominal_countdown > 1) {
+      nominal_countdown--;
+      return;
+    }
+
+    // Homing blocks step every homing axis at the nominal rate until its endstop triggers.
+    // Like any other block they take step_loops steps per interrupt above 10k steps/s.
+    if (current_block->homing_axes) {
+      for(int8_t s=0; s < step_loops; s++) {
+        for(uint8_t i=0; i < NUM_AXIS; i++) {
+          if ((current_block->homing_axes & (1<<i)) == 0) continue;
+
+          bool hit_endstop;
+          if ((out_bits & (1<<i)) != 0) {
+            stepperInterface[i].setDirection(false);
+            hit_endstop = stepperInterface[i].isAtMinimum();
+          }
+          else {
+            stepperInterface[i].setDirection(true);
+            hit_endstop = stepperInterface[i].isAtMaximum();
+          }
+
+          if (hit_endstop) {
+            current_block->homing_axes &= ~(1<<i);
+          }
+          else {
+            stepperInterface[i].step(true);
+            count_position[i] += ((out_bits & (1<<i)) != 0) ? -1 : 1;
+            stepperInterface[i].step(false);
+          }
+        }
+      }
+
+      OCR1A = OCR1A_nominal;
+      nominal_countdown = nominal_interrupts;
+
+      if (current_block->homing_axes == 0) {
+        commands_due += current_block->sync_commands;
+        COMMAND_TRACE_BLOCK_FINISHED(current_block->trace);
+        current_block = NULL;
+        plan_discard_current_block();
+      }
+      return;
+    }
+
     for(int8_t i=0; i < step_loops; i++) { // Take multiple steps per interrupt (For high speed moves) 
       #ifdef ADVANCE
+      // Extruder A is e_steps[0], extruder B is e_steps[1]
       counter_e += current_block->steps_e;
       if (counter_e > 0) {
         counter_e -= current_block->step_event_count;
         if ((out_bits & (1<<E_AXIS)) != 0) { // - direction
-          e_steps[current_block->active_extruder]--;
+          e_steps[0]--;
+          count_position[E_AXIS]--;
+        }
+        else {
+          e_steps[0]++;
+          count_position[E_AXIS]++;
+        }
+      }    
+
+      counter_b += current_block->steps_b;
+      if (counter_b > 0) {
+        counter_b -= current_block->step_event_count;
+        if ((out_bits & (1<<B_AXIS)) != 0) { // - direction
+          e_steps[1]--;
+          count_position[B_AXIS]--;
         }
         else {
-          e_steps[current_block->active_extruder]++;
+          e_steps[1]++;
+          count_position[B_AXIS]++;
         }
       }    
       #endif //ADVANCE
@@ -354,6 +467,14 @@ void st_interrupt()
 	  stepperInterface[E_AXIS].step(false);
           count_position[E_AXIS]+=count_direction[E_AXIS];
         }
+
+        counter_b += current_block->steps_b;
+        if (counter_b > 0) {
+	  stepperInterface[B_AXIS].step(true);
+          counter_b -= current_block->step_event_count;
+	  stepperInterface[B_AXIS].step(false);
+          count_position[B_AXIS]+=count_direction[B_AXIS];
+        }
       #endif //!ADVANCE
       step_events_completed += 1;  
       if(step_events_completed >= current_block->step_event_count) break;
@@ -375,13 +496,11 @@ void st_interrupt()
       OCR1A = timer;
       acceleration_time += timer;
       #ifdef ADVANCE
-        for(int8_t i=0; i < step_loops; i++) {
-          advance += advance_rate;
-        }
-        //if(advance > current_block->advance) advance = current_block->advance;
+        // Linear advance follows the step rate
+        advance = ((uint32_t)acc_step_rate * advance_rate) >> 8;
         // Do E steps + advance steps
-        e_steps[current_block->active_extruder] += ((advance >>8) - old_advance);
-        old_advance = advance >>8;  
+        e_steps[current_block->active_extruder] += ((advance >>8) - old_advance[current_block->active_extruder]);
+        old_advance[current_block->active_extruder] = advance >>8;  
         
       #endif
     } 
@@ -404,78 +523,93 @@ void st_interrupt()
       OCR1A = timer;
       deceleration_time += timer;
       #ifdef ADVANCE
-        for(int8_t i=0; i < step_loops; i++) {
-          advance -= advance_rate;
-        }
-        if(advance < final_advance) advance = final_advance;
+        advance = ((uint32_t)step_rate * advance_rate) >> 8;
         // Do E steps + advance steps
-        e_steps[current_block->active_extruder] += ((advance >>8) - old_advance);
-        old_advance = advance >>8;  
+        e_steps[current_block->active_extruder] += ((advance >>8) - old_advance[current_block->active_extruder]);
+        old_advance[current_block->active_extruder] = advance >>8;  
       #endif //ADVANCE
     }
     else {
       OCR1A = OCR1A_nominal;
+      nominal_countdown = nominal_interrupts;
     }
 
     // If current block is finished, reset pointer 
     if (step_events_completed >= current_block->step_event_count) {
+      commands_due += current_block->sync_commands;
+      COMMAND_TRACE_BLOCK_FINISHED(current_block->trace);
       current_block = NULL;
       plan_discard_current_block();
     }   
+
+    #ifdef ADVANCE
+      // Hand any extruder steps to the advance interrupt, waking it up if it's idle
+      if ((e_steps[0] != 0) || (e_steps[1] != 0)) st_advance_wake();
+    #endif //ADVANCE
   } 
 }
 
 #ifdef ADVANCE
+// Steps one extruder towards its pending e_steps, direction depends on E direction + advance.
+// Returns the number of steps still pending.
+FORCE_INLINE uint32_t st_advance_step(StepperInterface &extruder, volatile int32_t &pending)
+{
+  int32_t steps = pending;
+  if (steps == 0) return 0;
+
+  if (steps < 0) {
+    extruder.setDirection(false);
+    steps++;
+  } 
+  else {
+    extruder.setDirection(true);
+    steps--;
+  }
+  extruder.step(true);
+  pending = steps;
+  extruder.step(false);
+
+  return (steps < 0) ? -steps : steps;
+}
+
+// Starts the advance interrupt if it's idle, the first step is taken straight away
+void st_advance_wake()
+{
+  if (ADVANCE_INTERRUPT_ENABLED()) return;
+
+  TCNT4 = 0;
+  OCR4A = ADVANCE_MIN_PERIOD;
+  TIFR4 = (1<<OCF4A);
+  TIMSK4 |= (1<<OCIE4A);
+}
+
+// One step per interrupt on each extruder with steps pending. The next interrupt is scheduled so
+// that whatever is left is spread over the stepper interrupt's current interval, i.e. it follows
+// the current extrusion rate. With nothing left the interrupt switches itself off until
+// st_interrupt() hands it more steps.
 void st_advance_interrupt()
   {
-    OCR4A = 100 * 16;
-	
-    // Set E direction (Depends on E direction + advance)
-    for(unsigned char i=0; i<4;i++) {
-      if (e_steps[0] != 0) {
-	stepperInterface[E_AXIS].step(false);
-        if (e_steps[0] < 0) {
-      	  stepperInterface[E_AXIS].setDirection(false);
-          e_steps[0]++;
-	  stepperInterface[E_AXIS].step(true);
-        } 
-        else if (e_steps[0] > 0) {
-      	  stepperInterface[E_AXIS].setDirection(true);
-          e_steps[0]--;
-	  stepperInterface[E_AXIS].step(true);
-        }
-      }
+    uint32_t pending = st_advance_step(stepperInterface[E_AXIS], e_steps[0]);
  #if EXTRUDERS > 1
-      if (e_steps[1] != 0) {
-	//stepperInterface[?].step(false);
-        if (e_steps[1] < 0) {
-      	  stepperInterface[?].setDirection(false);
-          e_steps[1]++;
-	  //stepperInterface[?].step(true);
-        } 
-        else if (e_steps[1] > 0) {
-      	  stepperInterface[?].setDirection(true);
-          e_steps[1]--;
-	  //stepperInterface[?].step(true);
-        }
-      }
- #endif
- #if EXTRUDERS > 2
-      if (e_steps[2] != 0) {
-	//stepperInterface[?].step(false);
-        if (e_steps[2] < 0) {
-      	  //stepperInterface[?].setDirection(false);
-          e_steps[2]++;
-	  //stepperInterface[?].step(true);
-        } 
-        else if (e_steps[2] > 0) {
-      	  //stepperInterface[?].setDirection(true);
-          e_steps[2]--;
-	  //stepperInterface[?].step(true);
-        }
-      }
+    uint32_t pending_b = st_advance_step(stepperInterface[B_AXIS], e_steps[1]);
+    if (pending_b > pending) pending = pending_b;
  #endif
+
+    if (pending == 0) {
+      DISABLE_ADVANCE_INTERRUPT();
+      return;
+    }
+
+    // Timer 1 runs at 2MHz, timer 4 at 16MHz. Divide by the pending count with shifts, an
+    // approximate period is fine and a real divide is too slow in here.
+    uint32_t period = (uint32_t)OCR1A << 3;
+    while ((pending > 1) && (period > ADVANCE_MIN_PERIOD)) {
+      period >>= 1;
+      pending >>= 1;
     }
+    if (period < ADVANCE_MIN_PERIOD) period = ADVANCE_MIN_PERIOD;
+    if (period > 0xFFFF)             period = 0xFFFF;
+    OCR4A = period;
   }
 #endif // ADVANCE
 
@@ -484,12 +618,15 @@ void st_init()
   //Grab the stepper interfaces
   stepperInterface = Motherboard::getBoard().getStepperAllInterfaces();
 
-  Motherboard::getBoard().setupAccelStepperTimer();
+  Motherboard::getBoard().setupStepperTimer();
+
+  commands_due = 0;
 
   #ifdef ADVANCE
-    e_steps[0] = 0;
-    e_steps[1] = 0;
-    e_steps[2] = 0;
+    for(uint8_t i=0; i < EXTRUDERS; i++) {
+      e_steps[i] = 0;
+      old_advance[i] = 0;
+    }
   #endif //ADVANCE
 }
 
@@ -500,13 +637,14 @@ bool st_empty()
     return true;
 }
 
-void st_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e)
+void st_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, const int32_t &b)
 {
   CRITICAL_SECTION_START;
   count_position[X_AXIS] = x;
   count_position[Y_AXIS] = y;
   count_position[Z_AXIS] = z;
   count_position[E_AXIS] = e;
+  count_position[B_AXIS] = b;
   CRITICAL_SECTION_END;
 }
 
@@ -526,11 +664,55 @@ int32_t st_get_position(uint8_t axis)
   return count_pos;
 }
 
+void st_attach_command()
+{
+  CRITICAL_SECTION_START;
+  if (blocks_queued())
+    block_buffer[(block_buffer_head - 1) & (BLOCK_BUFFER_SIZE - 1)].sync_commands ++;
+  else
+    commands_due ++;
+  CRITICAL_SECTION_END;
+}
+
+uint8_t st_commands_due()
+{
+  return commands_due;
+}
+
+void st_command_done()
+{
+  CRITICAL_SECTION_START;
+  if (commands_due) commands_due --;
+  CRITICAL_SECTION_END;
+}
+
+void st_discard_commands()
+{
+  CRITICAL_SECTION_START;
+  for(uint8_t i=0; i < BLOCK_BUFFER_SIZE; i++)
+    block_buffer[i].sync_commands = 0;
+  commands_due = 0;
+  CRITICAL_SECTION_END;
+}
+
 void quickStop()
 {
   DISABLE_STEPPER_DRIVER_INTERRUPT();
-  while(blocks_queued())
+  while(blocks_queued()) {
+    COMMAND_TRACE_BLOCK_FINISHED(block_buffer[block_buffer_tail].trace);
     plan_discard_current_block();
+  }
+  // The block being traced has just been discarded too, don't carry on stepping it
+  current_block = NULL;
+  // The moves the attached commands were waiting for never ran
+  st_discard_commands();
+  #ifdef ADVANCE
+    for(uint8_t i=0; i < EXTRUDERS; i++) {
+      e_steps[i] = 0;
+      old_advance[i] = 0;
+    }
+    advance = 0;
+  #endif //ADVANCE
   ENABLE_STEPPER_DRIVER_INTERRUPT();
 }
 
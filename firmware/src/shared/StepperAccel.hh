@@ -31,7 +31,7 @@
   #define CRITICAL_SECTION_END    SREG = _sreg;
 #endif //CRITICAL_SECTION_START
 
-enum AxisEnum {X_AXIS=0, Y_AXIS=1, Z_AXIS=2, E_AXIS=3};
+enum AxisEnum {X_AXIS=0, Y_AXIS=1, Z_AXIS=2, E_AXIS=3, B_AXIS=4};
 
 
 // of the buffer and all stops. This should not be much greater than zero and should only be changed
@@ -40,7 +40,7 @@ enum AxisEnum {X_AXIS=0, Y_AXIS=1, Z_AXIS=2, E_AXIS=3};
 
 const int dropsegments=5; //everything with less than this number of steps will be ignored as move and joined with the next movement
 
-#define EXTRUDERS 1
+#define EXTRUDERS 2 // Extruder 0 is the A axis, extruder 1 the B axis
 
 // Initialize and start the stepper motor subsystem
 void st_init();
@@ -49,7 +49,7 @@ void st_init();
 bool st_empty();
 
 // Set current position in steps
-void st_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e);
+void st_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, const int32_t &b);
 void st_set_e_position(const int32_t &e);
 
 // Get current position in steps
@@ -61,10 +61,29 @@ void st_wake_up();
 
 void st_interrupt();
 
+// Runs from the advance timer (timer 4), steps the extruders. It only runs while extruder steps are
+// pending, st_advance_wake() starts it again.
 void st_advance_interrupt();
+void st_advance_wake();
   
+// Non-motion commands that only need ordering with the moves are attached to the last queued
+// block instead of waiting for the buffer to empty. They become due when the step engine has
+// finished that block, i.e. as the next block starts, or straight away if nothing is queued.
+void st_attach_command();
+
+// Number of attached commands that are due, the caller runs them in the order they were attached
+uint8_t st_commands_due();
+
+// Call after running a due command
+void st_command_done();
+
+// Forget all attached commands, due or not
+void st_discard_commands();
+
 extern block_t *current_block;  // A pointer to the block currently being traced
 
+// Stops immediately and discards everything that's buffered, the stepper position is left
+// wherever the steppers stopped. The attached commands are discarded, due or not.
 void quickStop();
 
 //DEBUGGING
@@ -62,32 +62,21 @@
 #include <string.h>
 #include  <avr/interrupt.h>
 #include "StepperAccel.hh"
+#include "PlannerMath.hh"
 #include "StepperInterface.hh"
 #include "Motherboard.hh"
+#include "CommandTrace.hh"
 
-#ifdef abs
-#undef abs
-#endif
-
-#define min(a,b) ((a)<(b)?(a):(b))
 #define max(a,b) ((a)>(b)?(a):(b))
-#define abs(x) ((x)>0?(x):-(x))
-
-#define ZSQUARE(x) ((x)*(x))
-
-#define VEPSILON 1.0e-5
-
-// v1 != v2
-#define VNEQ(v1,v2) (abs((v1)-(v2)) > VEPSILON)
 
 //===========================================================================
 //=============================public variables ============================
 //===========================================================================
 
 uint32_t minsegmenttime;
-float max_feedrate[4]; // set the max speeds
-float axis_steps_per_unit[4];
-uint32_t max_acceleration_units_per_sq_second[4]; // Use M201 to override by software
+float max_feedrate[NUM_AXIS]; // set the max speeds
+float axis_steps_per_unit[NUM_AXIS];
+uint32_t max_acceleration_units_per_sq_second[NUM_AXIS]; // Use M201 to override by software
 float minimumfeedrate;
 float p_acceleration;         // Normal acceleration mm/s^2  THIS IS THE DEFAULT ACCELERATION for all moves. M204 SXXXX
 float p_retract_acceleration; //  mm/s^2   filament pull-pack and push-forward  while standing still in the other axis M204 TXXXX
@@ -96,11 +85,11 @@ float max_xy_jerk_squared; // max_xy_jerk * max_xy_jerk
 float max_z_jerk;
 float mintravelfeedrate;
 uint32_t axis_steps_per_sqr_second[NUM_AXIS];
-float extrution_area, extruder_advance_k, steps_per_cubic_mm_e;
+float extruder_advance_k[EXTRUDERS];
 
 // The current position of the tool in absolute steps
-int32_t position[4];   //rescaled from extern when axis_steps_per_unit are changed by gcode
-static float previous_speed[4]; // Speed of previous path line segment
+int32_t position[NUM_AXIS];   //rescaled from extern when axis_steps_per_unit are changed by gcode
+static float previous_speed[NUM_AXIS]; // Speed of previous path line segment
 static float previous_nominal_speed; // Nominal speed of previous path line segment
 
 static StepperInterface *stepperInterface;
@@ -122,182 +111,34 @@ static int8_t next_block_index(int8_t block_index) {
 }
 
 
-// Returns the index of the previous block in the ring buffer
-static int8_t prev_block_index(int8_t block_index) {
-  if (block_index == 0) { block_index = BLOCK_BUFFER_SIZE; }
-  block_index--;
-  return(block_index);
-}
-
 //===========================================================================
 //=============================functions         ============================
 //===========================================================================
 
-// Calculates the distance (not time) it takes to accelerate from initial_rate to target_rate using the 
-// given acceleration:
-FORCE_INLINE float estimate_acceleration_distance(float initial_rate, float target_rate, float acceleration)
-{
-  if (acceleration!=0) {
-  return((target_rate*target_rate-initial_rate*initial_rate)/
-         (2.0*acceleration));
-  }
-  else {
-    return 0.0;  // acceleration was 0, set acceleration distance to 0
-  }
-}
-
-// This function gives you the point at which you must start braking (at the rate of -acceleration) if 
-// you started at speed initial_rate and accelerated until this point and want to end at the final_rate after
-// a total travel of distance. This can be used to compute the intersection point between acceleration and
-// deceleration in the cases where the trapezoid has no plateau (i.e. never reaches maximum speed)
-
-FORCE_INLINE float intersection_distance(float initial_rate, float final_rate, float acceleration, float distance) 
-{
- if (acceleration!=0) {
-  return((2.0*acceleration*distance-initial_rate*initial_rate+final_rate*final_rate)/
-         (4.0*acceleration) );
-  }
-  else {
-    return 0.0;  // acceleration was 0, set intersection distance to 0
-  }
-}
-
 // Calculates trapezoid parameters so that the entry- and exit-speed is compensated by the provided factors.
 
 void calculate_trapezoid_for_block(block_t *block, float entry_factor, float exit_factor) {
-  uint32_t initial_rate = ceil(block->nominal_rate*entry_factor); // (step/min)
-  uint32_t final_rate = ceil(block->nominal_rate*exit_factor); // (step/min)
-
-  // Limit minimal step rate (Otherwise the timer will overflow.)
-  if(initial_rate <120) {initial_rate=120; }
-  if(final_rate < 120) {final_rate=120;  }
-  
-  int32_t acceleration = block->acceleration_st;
-  int32_t accelerate_steps =
-    ceil(estimate_acceleration_distance(block->initial_rate, block->nominal_rate, acceleration));
-  int32_t decelerate_steps =
-    floor(estimate_acceleration_distance(block->nominal_rate, block->final_rate, -acceleration));
-    
-  // Calculate the size of Plateau of Nominal Rate.
-  int32_t plateau_steps = block->step_event_count-accelerate_steps-decelerate_steps;
-  
-  // Is the Plateau of Nominal Rate smaller than nothing? That means no cruising, and we will
-  // have to use intersection_distance() to calculate when to abort acceleration and start braking
-  // in order to reach the final_rate exactly at the end of this block.
-  if (plateau_steps < 0) {
-    accelerate_steps = ceil(
-      intersection_distance(block->initial_rate, block->final_rate, acceleration, block->step_event_count));
-    accelerate_steps = max(accelerate_steps,0); // Check limits due to numerical round-off
-    accelerate_steps = min(accelerate_steps,block->step_event_count);
-    plateau_steps = 0;
-  }
+  trapezoid_t trapezoid;
+  calculate_trapezoid(block, entry_factor, exit_factor, &trapezoid);
 
   #ifdef ADVANCE
-    volatile int32_t initial_advance = block->advance*entry_factor*entry_factor; 
-    volatile int32_t final_advance = block->advance*exit_factor*exit_factor;
+    // Advance is linear in the step rate, it falls back with the rate while decelerating
+    volatile int32_t initial_advance = ((uint32_t)trapezoid.initial_rate * block->advance_rate) >> 8;
   #endif // ADVANCE
   
- // block->accelerate_until = accelerate_steps;
- // block->decelerate_after = accelerate_steps+plateau_steps;
   CRITICAL_SECTION_START;  // Fill variables used by the stepper in a critical section
   if(block->busy == false) { // Don't update variables if block is busy.
-    block->accelerate_until = accelerate_steps;
-    block->decelerate_after = accelerate_steps+plateau_steps;
-    block->initial_rate = initial_rate;
-    block->final_rate = final_rate;
+    block->accelerate_until = trapezoid.accelerate_until;
+    block->decelerate_after = trapezoid.decelerate_after;
+    block->initial_rate = trapezoid.initial_rate;
+    block->final_rate = trapezoid.final_rate;
   #ifdef ADVANCE
       block->initial_advance = initial_advance;
-      block->final_advance = final_advance;
   #endif //ADVANCE
   }
   CRITICAL_SECTION_END;
 }                    
 
-// Calculates the maximum allowable speed at this point when you must be able to reach target_velocity using the 
-// acceleration within the allotted distance.
-FORCE_INLINE float max_allowable_speed(float acceleration, float target_velocity, float distance) {
-  return  sqrt(target_velocity*target_velocity-2*acceleration*distance);
-}
-
-// The kernel called by planner_recalculate() when scanning the plan from last to first entry.
-void planner_reverse_pass_kernel(block_t *previous, block_t *current, block_t *next) {
-  if(!current) { return; }
-  
-    if (next) {
-    // If entry speed is already at the maximum entry speed, no need to recheck. Block is cruising.
-    // If not, block in state of acceleration or deceleration. Reset entry speed to maximum and
-    // check for maximum allowable speed reductions to ensure maximum possible planned speed.
-      if (VNEQ(current->entry_speed, current->max_entry_speed)) {
-    
-      // If nominal length true, max junction speed is guaranteed to be reached. Only compute
-      // for max allowable speed if block is decelerating and nominal length is false.
-      if ((!current->nominal_length_flag) && (current->max_entry_speed > next->entry_speed)) {
-        current->entry_speed = min( current->max_entry_speed,
-          max_allowable_speed(-current->acceleration,next->entry_speed,current->millimeters));
-      } else {
-        current->entry_speed = current->max_entry_speed;
-      }
-      current->recalculate_flag = true;
-    
-    }
-  } // Skip last block. Already initialized and set for recalculation.
-}
-
-// planner_recalculate() needs to go over the current plan twice. Once in reverse and once forward. This 
-// implements the reverse pass.
-void planner_reverse_pass() {
-  uint8_t block_index = block_buffer_head;
-  if(((block_buffer_head-block_buffer_tail + BLOCK_BUFFER_SIZE) & (BLOCK_BUFFER_SIZE - 1)) > 3) {
-    block_index = (block_buffer_head - 3) & (BLOCK_BUFFER_SIZE - 1);
-    block_t *block[3] = { NULL, NULL, NULL };
-    while(block_index != block_buffer_tail) { 
-      block_index = prev_block_index(block_index); 
-      block[2]= block[1];
-      block[1]= block[0];
-      block[0] = &block_buffer[block_index];
-      planner_reverse_pass_kernel(block[0], block[1], block[2]);
-    }
-  }
-}
-
-// The kernel called by planner_recalculate() when scanning the plan from first to last entry.
-void planner_forward_pass_kernel(block_t *previous, block_t *current, block_t *next) {
-  if(!previous) { return; }
-  
-  // If the previous block is an acceleration block, but it is not long enough to complete the
-  // full speed change within the block, we need to adjust the entry speed accordingly. Entry
-  // speeds have already been reset, maximized, and reverse planned by reverse planner.
-  // If nominal length is true, max junction speed is guaranteed to be reached. No need to recheck.
-  if (!previous->nominal_length_flag) {
-    if (VNEQ(previous->entry_speed, current->entry_speed)) {
-      double entry_speed = min( current->entry_speed,
-        max_allowable_speed(-previous->acceleration,previous->entry_speed,previous->millimeters) );
-
-      // Check for junction speed change
-      if (VNEQ(current->entry_speed, entry_speed)) {
-        current->entry_speed = entry_speed;
-        current->recalculate_flag = true;
-      }
-    }
-  }
-}
-
-// planner_recalculate() needs to go over the current plan twice. Once in reverse and once forward. This 
-// implements the forward pass.
-void planner_forward_pass() {
-  uint8_t block_index = block_buffer_tail;
-  block_t *block[3] = { NULL, NULL, NULL };
-
-  while(block_index != block_buffer_head) {
-    block[0] = block[1];
-    block[1] = block[2];
-    block[2] = &block_buffer[block_index];
-    planner_forward_pass_kernel(block[0],block[1],block[2]);
-    block_index = next_block_index(block_index);
-  }
-  planner_forward_pass_kernel(block[1], block[2], NULL);
-}
-
 // Recalculates the trapezoid speed profiles for all blocks in the plan according to the 
 // entry_factor for each junction. Must be called by planner_recalculate() after 
 // updating the blocks.
@@ -346,26 +187,22 @@ void planner_recalculate_trapezoids() {
 //   3. Recalculate trapezoids for all blocks.
 
 void planner_recalculate() {   
-  planner_reverse_pass();
-  planner_forward_pass();
+  planner_reverse_pass(block_buffer, block_buffer_head, block_buffer_tail, BLOCK_BUFFER_SIZE);
+  planner_forward_pass(block_buffer, block_buffer_head, block_buffer_tail, BLOCK_BUFFER_SIZE);
   planner_recalculate_trapezoids();
 }
 
 
-void plan_init(float extruderAdvanceK, float filamentDiameter, float axis_steps_per_unit_e) {
+void plan_init(float extruderAdvanceKA, float extruderAdvanceKB) {
   stepperInterface = Motherboard::getBoard().getStepperAllInterfaces();
   block_buffer_head = 0;
   block_buffer_tail = 0;
   memset(position, 0, sizeof(position)); // clear position
-  previous_speed[0] = 0.0;
-  previous_speed[1] = 0.0;
-  previous_speed[2] = 0.0;
-  previous_speed[3] = 0.0;
+  memset(previous_speed, 0, sizeof(previous_speed));
   previous_nominal_speed = 0.0;
 
-  extruder_advance_k = extruderAdvanceK;
-  extrution_area = 0.25 * filamentDiameter * filamentDiameter * 3.14159;
-  steps_per_cubic_mm_e = axis_steps_per_unit_e / extrution_area;
+  extruder_advance_k[0] = extruderAdvanceKA;
+  extruder_advance_k[1] = extruderAdvanceKB;
 }
 
 
@@ -374,32 +211,40 @@ float junction_deviation = 0.1;
 // Add a new linear movement to the buffer. steps x, y and z is the absolute position in 
 // steps. Microseconds specify how many microseconds the move should take to perform. To aid acceleration
 // calculation the caller must also provide the physical length of the line in millimeters.
-void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e,  float feed_rate, const uint8_t &extruder)
+void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, const int32_t &b, float feed_rate, const uint8_t &extruder)
 {
   // Calculate the buffer head after we push this byte
   int next_buffer_head = next_block_index(block_buffer_head);
 
+  // If the buffer is full: good! That means we are well ahead of the robot. 
+  // Rest here until there is room in the buffer.
+  while(block_buffer_tail == next_buffer_head) ;
+
   // The target position of the tool in absolute steps
   // Calculate target position in absolute steps
   //this should be done after the wait, because otherwise a M92 code within the gcode disrupts this calculation somehow
-  int32_t target[4];
+  int32_t target[NUM_AXIS];
   target[X_AXIS] = x;
   target[Y_AXIS] = y;
   target[Z_AXIS] = z;
   target[E_AXIS] = e;
+  target[B_AXIS] = b;
   
   // Prepare to set up new block
   block_t *block = &block_buffer[block_buffer_head];
   
   // Mark block as not busy (Not executed by the stepper interrupt)
   block->busy = false;
+  block->homing_axes = 0;
+  block->sync_commands = 0;
 
   // Number of steps for each axis
   block->steps_x = labs(target[X_AXIS]-position[X_AXIS]);
   block->steps_y = labs(target[Y_AXIS]-position[Y_AXIS]);
   block->steps_z = labs(target[Z_AXIS]-position[Z_AXIS]);
   block->steps_e = labs(target[E_AXIS]-position[E_AXIS]);
-  block->step_event_count = max(block->steps_x, max(block->steps_y, max(block->steps_z, block->steps_e)));
+  block->steps_b = labs(target[B_AXIS]-position[B_AXIS]);
+  block->step_event_count = max(block->steps_x, max(block->steps_y, max(block->steps_z, max(block->steps_e, block->steps_b))));
 
   // Bail if this is a zero-length block
   if (block->step_event_count <=dropsegments) { return; };
@@ -410,8 +255,9 @@ void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, cons
   if (target[Y_AXIS] < position[Y_AXIS]) { block->direction_bits |= (1<<Y_AXIS); }
   if (target[Z_AXIS] < position[Z_AXIS]) { block->direction_bits |= (1<<Z_AXIS); }
   if (target[E_AXIS] < position[E_AXIS]) { block->direction_bits |= (1<<E_AXIS); }
+  if (target[B_AXIS] < position[B_AXIS]) { block->direction_bits |= (1<<B_AXIS); }
   
-  block->active_extruder = extruder;
+  block->active_extruder = ( extruder < EXTRUDERS ) ? extruder : 0;
   
   //enable active axes
   if(block->steps_x != 0) stepperInterface[X_AXIS].setEnabled(true);
@@ -422,87 +268,27 @@ void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, cons
   if(block->steps_e != 0) {
 	stepperInterface[E_AXIS].setEnabled(true);
  }
-
-  float delta_mm[4];
-  delta_mm[X_AXIS] = (target[X_AXIS]-position[X_AXIS])/axis_steps_per_unit[X_AXIS];
-  delta_mm[Y_AXIS] = (target[Y_AXIS]-position[Y_AXIS])/axis_steps_per_unit[Y_AXIS];
-  delta_mm[Z_AXIS] = (target[Z_AXIS]-position[Z_AXIS])/axis_steps_per_unit[Z_AXIS];
-  delta_mm[E_AXIS] = (target[E_AXIS]-position[E_AXIS])/axis_steps_per_unit[E_AXIS];
- if ( block->steps_x == 0 && block->steps_y == 0 && block->steps_z == 0 ) {
-	block->millimeters = abs(delta_mm[E_AXIS]);
-  } else {
-  	block->millimeters = sqrt(ZSQUARE(delta_mm[X_AXIS]) + ZSQUARE(delta_mm[Y_AXIS]) +
-       		                  ZSQUARE(delta_mm[Z_AXIS]) + ZSQUARE(delta_mm[E_AXIS]));
-  }
-  float inverse_millimeters = 1.0/block->millimeters;  // Inverse millimeters to remove multiple divides 
-  
-  // Calculate speed in mm/second for each axis. No divide by zero due to previous checks.
-  float inverse_second = feed_rate * inverse_millimeters;
-  
-  block->nominal_speed = block->millimeters * inverse_second; // (mm/sec) Always > 0
-  block->nominal_rate = ceil(block->step_event_count * inverse_second); // (step/sec) Always > 0
-
-  
- 
-
-  if (block->steps_e == 0) {
-        if(feed_rate<mintravelfeedrate) feed_rate=mintravelfeedrate;
+  if(block->steps_b != 0) stepperInterface[B_AXIS].setEnabled(true);
+
+  int32_t steps[NUM_AXIS];
+  steps[X_AXIS] = block->steps_x;
+  steps[Y_AXIS] = block->steps_y;
+  steps[Z_AXIS] = block->steps_z;
+  steps[E_AXIS] = block->steps_e;
+  steps[B_AXIS] = block->steps_b;
+
+  float delta_mm[NUM_AXIS];
+  for(uint8_t i=0; i < NUM_AXIS; i++) {
+    delta_mm[i] = (target[i]-position[i])/axis_steps_per_unit[i];
   }
-  else {
-    	if(feed_rate<minimumfeedrate) feed_rate=minimumfeedrate;
-  } 
+  planner_set_length(block, steps, delta_mm);
 
+  float current_speed[NUM_AXIS];
+  planner_set_speed(block, delta_mm, feed_rate, max_feedrate, current_speed);
 
-  // slow down when de buffer starts to empty, rather than wait at the corner for a buffer refill
   int moves_queued=(block_buffer_head-block_buffer_tail + BLOCK_BUFFER_SIZE) & (BLOCK_BUFFER_SIZE - 1);
-#ifdef SLOWDOWN
-  if(moves_queued < (BLOCK_BUFFER_SIZE * 0.5) && moves_queued > 1) feed_rate = feed_rate*moves_queued / (BLOCK_BUFFER_SIZE * 0.5); 
-#endif
 
- // Calculate speed in mm/sec for each axis
-  float current_speed[4];
-  for(int i=0; i < 4; i++) {
-    current_speed[i] = delta_mm[i] * inverse_second;
-  }
-
-  // Limit speed per axis
-  float speed_factor = 1.0; //factor <=1 do decrease speed
-  for(int i=0; i < 4; i++) {
-    if(abs(current_speed[i]) > max_feedrate[i])
-      speed_factor = min(speed_factor, max_feedrate[i] / abs(current_speed[i]));
-  }
-
-  // Correct the speed  
-  if( speed_factor < 1.0) {
-    for(int i=0; i < 4; i++) {
-    if(abs(current_speed[i]) > max_feedrate[i])
-      speed_factor = min(speed_factor, max_feedrate[i] / abs(current_speed[i]));
-  }
-    for(unsigned char i=0; i < 4; i++) {
-      current_speed[i] *= speed_factor;
-    }
-    block->nominal_speed *= speed_factor;
-    block->nominal_rate *= speed_factor;
-  }
-
-  // Compute and limit the acceleration rate for the trapezoid generator.  
-  float steps_per_mm = block->step_event_count/block->millimeters;
-  if(block->steps_x == 0 && block->steps_y == 0 && block->steps_z == 0) {
-    block->acceleration_st = ceil(p_retract_acceleration * steps_per_mm); // convert to: acceleration steps/sec^2
-  }
-  else {
-    block->acceleration_st = ceil(p_acceleration * steps_per_mm); // convert to: acceleration steps/sec^2
-    // Limit acceleration per axis
-    if(((float)block->acceleration_st * (float)block->steps_x / (float)block->step_event_count) > axis_steps_per_sqr_second[X_AXIS])
-      block->acceleration_st = axis_steps_per_sqr_second[X_AXIS];
-    if(((float)block->acceleration_st * (float)block->steps_y / (float)block->step_event_count) > axis_steps_per_sqr_second[Y_AXIS])
-      block->acceleration_st = axis_steps_per_sqr_second[Y_AXIS];
-    if(((float)block->acceleration_st * (float)block->steps_e / (float)block->step_event_count) > axis_steps_per_sqr_second[E_AXIS])
-      block->acceleration_st = axis_steps_per_sqr_second[E_AXIS];
-    if(((float)block->acceleration_st * (float)block->steps_z / (float)block->step_event_count ) > axis_steps_per_sqr_second[Z_AXIS])
-      block->acceleration_st = axis_steps_per_sqr_second[Z_AXIS];
-  }
-  block->acceleration = block->acceleration_st / steps_per_mm;
+  planner_set_acceleration(block, steps, p_acceleration, p_retract_acceleration, axis_steps_per_sqr_second);
   block->acceleration_rate = (int32_t)((float)block->acceleration_st * 8.388608);
   
 #if 0  // Use old jerk for now
@@ -545,42 +331,8 @@ void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, cons
     }
   }
 #endif
-  // Start with a safe speed
-  float vmax_junction = max_xy_jerk/2;  
-  if(abs(current_speed[Z_AXIS]) > max_z_jerk/2) 
-    vmax_junction = max_z_jerk/2;
-  vmax_junction = min(vmax_junction, block->nominal_speed);
-
-  if ((moves_queued > 1) && (previous_nominal_speed > 0.0)) {
-    float jerk_squared = ZSQUARE(current_speed[X_AXIS]-previous_speed[X_AXIS]) + ZSQUARE(current_speed[Y_AXIS]-previous_speed[Y_AXIS]);
-
-    if((previous_speed[X_AXIS] != 0.0) || (previous_speed[Y_AXIS] != 0.0)) {
-      vmax_junction = block->nominal_speed;
-    }
-    if (jerk_squared > max_xy_jerk_squared) {
-         vmax_junction *= sqrt((max_xy_jerk_squared/jerk_squared));
-    } 
-    if(abs(current_speed[Z_AXIS] - previous_speed[Z_AXIS]) > max_z_jerk) {
-      vmax_junction *= (max_z_jerk/abs(current_speed[Z_AXIS] - previous_speed[Z_AXIS]));
-    } 
-  }
-  block->max_entry_speed = vmax_junction;
-    
-  // Initialize block entry speed. Compute based on deceleration to user-defined MINIMUM_PLANNER_SPEED.
-  double v_allowable = max_allowable_speed(-block->acceleration,MINIMUM_PLANNER_SPEED,block->millimeters);
-  block->entry_speed = min(vmax_junction, v_allowable);
-
-  // Initialize planner efficiency flags
-  // Set flag if block will always reach maximum junction speed regardless of entry/exit speeds.
-  // If a block can de/ac-celerate from nominal speed to zero within the length of the block, then
-  // the current block and next block junction speeds are guaranteed to always be at their maximum
-  // junction speeds in deceleration and acceleration, respectively. This is due to how the current
-  // block nominal speed limits both the current and next maximum junction speeds. Hence, in both
-  // the reverse and forward planners, the corresponding block junction speed will always be at the
-  // the maximum junction speed and may always be ignored for any speed reduction checks.
-  if (block->nominal_speed <= v_allowable) { block->nominal_length_flag = true; }
-  else { block->nominal_length_flag = false; }
-  block->recalculate_flag = true; // Always calculate trapezoid for new block
+  planner_set_entry_speed(block, planner_junction_speed(current_speed, previous_speed, block->nominal_speed,
+    previous_nominal_speed, moves_queued, max_xy_jerk, max_z_jerk));
   
   // Update previous path unit_vector and nominal speed
   memcpy(previous_speed, current_speed, sizeof(previous_speed)); // previous_speed[] = current_speed[]
@@ -588,21 +340,25 @@ void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, cons
   
   #ifdef ADVANCE
     // Calculate advance rate
-    if((block->steps_e == 0) || (block->steps_x == 0 && block->steps_y == 0 && block->steps_z == 0) || ( extruder_advance_k == 0.0 )) {
+    // Advance is applied to the active extruder, using its own K. The extruder step rate is
+    // e_block_steps / step_event_count of the block step rate, so the advance (steps << 8) at
+    // step rate r is (r * advance_rate) >> 8 with advance_rate = K * e_block_steps / step_event_count << 16.
+    // Pure extruder moves and retracts (extruder running backwards) get no advance, the advance
+    // that's still applied is given back when they start.
+    uint8_t e_axis = ( block->active_extruder == 0 ) ? E_AXIS : B_AXIS;
+    int32_t e_block_steps = ( block->active_extruder == 0 ) ? block->steps_e : block->steps_b;
+    if((e_block_steps == 0) || (block->steps_x == 0 && block->steps_y == 0 && block->steps_z == 0) ||
+       ( block->direction_bits & (1 << e_axis) ) ||
+       ( extruder_advance_k[block->active_extruder] == 0.0 ) ||
+       (block->acceleration_st == 0)) {
       block->advance_rate = 0;
-      block->advance = 0;
     }
     else {
-      int32_t acc_dist = estimate_acceleration_distance(0, block->nominal_rate, block->acceleration_st);
-      float advance = (steps_per_cubic_mm_e * extruder_advance_k) * 
-        (current_speed[E_AXIS] * current_speed[E_AXIS] * extrution_area * extrution_area)*256;
-      block->advance = advance;
-      if(acc_dist == 0) {
-        block->advance_rate = 0;
-      } 
-      else {
-        block->advance_rate = advance / (float)acc_dist;
-      }
+      float advance_rate = extruder_advance_k[block->active_extruder] * 65536.0 *
+        (float)e_block_steps / (float)block->step_event_count;
+      // Clamped so that step rate * advance_rate fits in 32 bits
+      if ( advance_rate > 65535.0 )	advance_rate = 65535.0;
+      block->advance_rate = (uint16_t)advance_rate;
     }
   #endif // ADVANCE
 
@@ -612,6 +368,10 @@ void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, cons
   calculate_trapezoid_for_block(block, block->entry_speed/block->nominal_speed,
     MINIMUM_PLANNER_SPEED/block->nominal_speed);
     
+  #if COMMAND_TRACING
+    block->trace = commandtrace::blockQueued();
+  #endif
+
   // Move buffer head
   block_buffer_head = next_buffer_head;
   
@@ -622,18 +382,76 @@ void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, cons
   st_wake_up();
 }
 
-void plan_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e)
+void plan_buffer_homing(const uint8_t &axes, const bool &maximums, const uint32_t &us_per_step)
+{
+  int next_buffer_head = next_block_index(block_buffer_head);
+  while(block_buffer_tail == next_buffer_head) ;
+
+  block_t *block = &block_buffer[block_buffer_head];
+  block->busy = false;
+  block->sync_commands = 0;
+
+  // Bresenham isn't used, the stepper interrupt steps every axis in homing_axes on each
+  // step event until its endstop triggers
+  block->homing_axes = axes & ((1 << NUM_AXIS) - 1);
+  if ( ! block->homing_axes )	return;
+
+  block->steps_x = 0;
+  block->steps_y = 0;
+  block->steps_z = 0;
+  block->steps_e = 0;
+  block->steps_b = 0;
+  block->step_event_count = 0;
+  block->direction_bits = maximums ? 0 : block->homing_axes;
+  block->active_extruder = 0;
+
+  for (uint8_t i = 0; i < NUM_AXIS; i ++) {
+    if ( block->homing_axes & (1 << i) )	stepperInterface[i].setEnabled(true);
+  }
+
+  // Constant rate, no ramp
+  block->nominal_rate = ( us_per_step ) ? 1000000 / us_per_step : MAX_STEP_FREQUENCY;
+  if ( block->nominal_rate == 0 )	block->nominal_rate = 1;
+  block->initial_rate = block->nominal_rate;
+  block->final_rate = block->nominal_rate;
+  block->acceleration_st = 0;
+  block->acceleration_rate = 0;
+  block->accelerate_until = 0;
+  block->decelerate_after = 0;
+  block->acceleration = 0.0;
+  block->millimeters = 0.0;
+  block->nominal_speed = MINIMUM_PLANNER_SPEED;
+  block->entry_speed = block->nominal_speed;
+  block->max_entry_speed = block->nominal_speed;
+  block->nominal_length_flag = true;
+  block->recalculate_flag = false;
+  #ifdef ADVANCE
+    block->advance_rate = 0;
+    block->initial_advance = 0;
+  #endif
+  #if COMMAND_TRACING
+    block->trace = commandtrace::blockQueued();
+  #endif
+
+  block_buffer_head = next_buffer_head;
+
+  // Nothing may be planned against the homing block, junction speeds restart from rest
+  previous_nominal_speed = 0.0;
+  memset(previous_speed, 0, sizeof(previous_speed));
+
+  st_wake_up();
+}
+
+void plan_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, const int32_t &b)
 {
   position[X_AXIS] = x;
   position[Y_AXIS] = y;
   position[Z_AXIS] = z;
   position[E_AXIS] = e;
-  st_set_position(position[X_AXIS], position[Y_AXIS], position[Z_AXIS], position[E_AXIS]);
+  position[B_AXIS] = b;
+  st_set_position(position[X_AXIS], position[Y_AXIS], position[Z_AXIS], position[E_AXIS], position[B_AXIS]);
   previous_nominal_speed = 0.0; // Resets planner junction speeds. Assumes start from rest.
-  previous_speed[0] = 0.0;
-  previous_speed[1] = 0.0;
-  previous_speed[2] = 0.0;
-  previous_speed[3] = 0.0;
+  memset(previous_speed, 0, sizeof(previous_speed));
 }
 
 void plan_set_e_position(const int32_t &e)
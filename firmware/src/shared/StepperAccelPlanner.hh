@@ -25,19 +25,20 @@
 #define STEPPERACCELPLANNER_HH
 
 #include <stdio.h>
+#include <inttypes.h>
 
-// extruder advance constant (s2/mm3)
+// extruder advance constant (s)
 //
-// advance (steps) = STEPS_PER_CUBIC_MM_E * EXTUDER_ADVANCE_K * cubic mm per second ^ 2
+// advance (steps) = EXTRUDER_ADVANCE_K * extruder steps per second
 //
-// hooke's law says:            force = k * distance
-// bernoulli's priniciple says: v ^ 2 / 2 + g . h + pressure / density = constant
-// so: v ^ 2 is proportional to number of steps we advance the extruder
+// the pressure in the nozzle builds up linearly with the flow rate, the filament between
+// the drive gear and the nozzle acts as a spring that has to be compressed first.
+// so: the extruder speed is proportional to number of steps we advance the extruder
 #define ADVANCE
 
 #define SLOWDOWN
 
-#define NUM_AXIS 4 // The axis order in all axis related arrays is X, Y, Z, E
+#define NUM_AXIS 5 // The axis order in all axis related arrays is X, Y, Z, E, B
 
 // The number of linear motions that can be in the plan at any give time.
 // THE BLOCK_BUFFER_SIZE NEEDS TO BE A POWER OF 2, i.g. 8,16,32 because shifts and ors are used to do the ringbuffering.
@@ -51,18 +52,21 @@
 // the source g-code and may never actually be reached if acceleration management is active.
 typedef struct {
   // Fields used by the bresenham algorithm for tracing the line
-  int32_t steps_x, steps_y, steps_z, steps_e;  // Step count along each axis
+  int32_t steps_x, steps_y, steps_z, steps_e, steps_b;  // Step count along each axis
   uint32_t step_event_count;           // The number of step events required to complete this block
   int32_t accelerate_until;                    // The index of the step event on which to stop acceleration
   int32_t decelerate_after;                    // The index of the step event on which to start decelerating
   int32_t acceleration_rate;                   // The acceleration rate used for acceleration calculation
   unsigned char direction_bits;             // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
   unsigned char active_extruder;            // Selects the active extruder
+  volatile unsigned char homing_axes;       // Non-zero for a homing block, the axes still seeking their endstop
+  unsigned char sync_commands;              // Commands attached to this block, they're due once it's been stepped
+  #if COMMAND_TRACING
+    unsigned char trace;                    // The command that queued it, see commandtrace::blockQueued()
+  #endif
   #ifdef ADVANCE
-    int32_t advance_rate;
+    uint16_t advance_rate;                  // Advance (steps << 8) per 256 step events/sec
     volatile int32_t initial_advance;
-    volatile int32_t final_advance;
-    float advance;
   #endif
 
   // Fields used by the motion planner to manage acceleration
@@ -84,24 +88,32 @@ typedef struct {
 } block_t;
 
 // Initialize the motion plan subsystem      
-void plan_init(float extruderAdvanceK, float filamentDiameter, float axis_steps_per_unit_e);
+// extruderAdvanceKA and extruderAdvanceKB are the linear advance constants (s) of the A and B extruders
+void plan_init(float extruderAdvanceKA, float extruderAdvanceKB);
 
 // Add a new linear movement to the buffer. x, y and z is the signed, absolute target position in 
-// steps. Feed rate specifies the speed of the motion.
-void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, float feed_rate, const uint8_t &extruder);
+// steps. Feed rate specifies the speed of the motion. Extruder is the extruder (0 = A, 1 = B) that
+// advance is applied to.
+void plan_buffer_line(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, const int32_t &b, float feed_rate, const uint8_t &extruder);
+
+// Add a homing block to the buffer. The axes in the axes bitfield move at a constant us_per_step
+// towards their maximum or minimum endstop, the block completes when they have all reached it.
+// The planner position is undefined afterwards, call plan_set_position() once the block is done.
+void plan_buffer_homing(const uint8_t &axes, const bool &maximums, const uint32_t &us_per_step);
 
 // Set position. Used for G92 instructions.
-void plan_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e);
+void plan_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, const int32_t &b);
 void plan_set_e_position(const int32_t &e);
 
 uint8_t movesplanned(); //return the nr of buffered moves
 
 extern uint32_t minsegmenttime;
-extern float max_feedrate[4]; // set the max speeds
-extern float axis_steps_per_unit[4];
-extern uint32_t max_acceleration_units_per_sq_second[4]; // Use M201 to override by software
+extern float max_feedrate[NUM_AXIS]; // set the max speeds
+extern float axis_steps_per_unit[NUM_AXIS];
+extern uint32_t max_acceleration_units_per_sq_second[NUM_AXIS]; // Use M201 to override by software
 extern float minimumfeedrate;
 extern float p_acceleration;         // Normal acceleration mm/s^2  THIS IS THE DEFAULT ACCELERATION for all moves. M204 SXXXX
+                                     // 0 disables acceleration, every block then runs at its nominal rate
 extern float p_retract_acceleration; //  mm/s^2   filament pull-pack and push-forward  while standing still in the other axis M204 TXXXX
 extern float max_xy_jerk; //speed than can be stopped at once, if i understand correctly.
 extern float max_xy_jerk_squared; // max_xy_jerk * max_xy_jerk
@@ -23,6 +23,7 @@
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <util/delay.h>
+#include <util/atomic.h>
 #include <avr/io.h>
 
 
@@ -31,6 +32,14 @@
 #include "ExtruderBoard.hh"
 #endif
 
+#if COMMAND_TRACING
+#include "Motherboard.hh"
+#endif
+
+#if HOST_FAST_QUERIES
+#include "Host.hh"
+#endif
+
 // We have to track the number of bytes that have been sent, so that we can filter
 // them from our receive buffer later.This is only used for RS485 mode.
 volatile uint8_t loopback_bytes = 0;
@@ -163,7 +172,11 @@ inline void speak() {
 UART::UART(uint8_t index, communication_mode mode) :
     index_(index),
     mode_(mode),
-    enabled_(false) {
+    enabled_(false)
+#if HOST_PACKET_WINDOW > 0
+    , receiving_(&in)
+#endif
+    {
 
         init_serial();
 
@@ -184,6 +197,11 @@ void UART::beginSend() {
 
 void UART::enable(bool enabled) {
         enabled_ = enabled;
+#if UART_RX_BUFFER_SIZE > 0
+        if (enabled) {
+                rx_buffer.reset();
+        }
+#endif
         if (index_ == 0) {
                 if (enabled) { ENABLE_SERIAL_INTERRUPTS(0); }
                 else { DISABLE_SERIAL_INTERRUPTS(0); }
@@ -215,6 +233,163 @@ void UART::reset() {
         }
 }
 
+void UART::setBaudDivisor(uint16_t ubrr) {
+        // Long enough for the last byte at 9600 baud
+        _delay_ms(2);
+        if (index_ == 0) {
+                UBRR0H = ubrr >> 8;
+                UBRR0L = ubrr & 0xff;
+                UCSR0A = _BV(U2X0);
+        }
+#if HAS_SLAVE_UART
+        else {
+                UBRR1H = ubrr >> 8;
+                UBRR1L = ubrr & 0xff;
+                UCSR1A = _BV(U2X1);
+        }
+#endif
+}
+
+#if HOST_PACKET_WINDOW > 0
+
+InPacket UART::window[HOST_PACKET_WINDOW];
+volatile uint8_t UART::window_tail = 0;
+volatile uint8_t UART::window_count = 0;
+
+// Only the slot index moves, the packet isn't copied with interrupts off
+void UART::queueFinished() {
+        if (receiving_->isFinished() && window_count < HOST_PACKET_WINDOW) {
+                window_count++;
+                InPacket& next = windowSlot((window_tail + window_count) % (HOST_PACKET_WINDOW + 1));
+                next.reset();
+                receiving_ = &next;
+        }
+}
+
+#endif
+
+#if COMMAND_TRACING
+
+void UART::processByte(uint8_t b) {
+        InPacket& packet = getInPacket();
+        bool was_finished = packet.isFinished();
+        packet.processByte(b);
+        if (this == &hostUART && !was_finished && packet.isFinished()) {
+                packet.setFinishedMicros(Motherboard::getBoard().getCurrentMicros());
+        }
+}
+
+#endif
+
+void UART::receiveByte(uint8_t b) {
+#if UART_RX_BUFFER_SIZE > 0
+        // With the buffer full the byte is dropped, the packet fails its CRC
+        rx_buffer.push(b);
+#if HOST_FAST_QUERIES
+        if (this == &hostUART) {
+                host::runFastQueries();
+        }
+#endif
+#else
+#if HOST_PACKET_WINDOW > 0
+        // With the window full the byte is dropped, the host resends the packet
+        if (this == &hostUART) {
+                queueFinished();
+        }
+#endif
+#if COMMAND_TRACING
+        processByte(b);
+#else
+        getInPacket().processByte(b);
+#endif
+#endif
+}
+
+void UART::processReceived() {
+#if UART_RX_BUFFER_SIZE > 0
+        while (true) {
+#if HOST_PACKET_WINDOW > 0
+                if (this == &hostUART) {
+                        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                                queueFinished();
+                        }
+                }
+#endif
+                InPacket& packet = getInPacket();
+                if (rx_buffer.isEmpty() || packet.isFinished() || packet.hasError()) {
+                        break;
+                }
+#if COMMAND_TRACING
+                processByte(rx_buffer.pop());
+#else
+                packet.processByte(rx_buffer.pop());
+#endif
+        }
+#endif
+}
+
+void UART::flushReceived() {
+#if UART_RX_BUFFER_SIZE > 0
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                rx_buffer.reset();
+        }
+#endif
+}
+
+// The packets are handled from the window, only queueFinished() adds to it
+InPacket* UART::receivedPacket() {
+#if HOST_PACKET_WINDOW > 0
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                queueFinished();
+        }
+        return (window_count > 0) ? &windowSlot(window_tail) : 0;
+#else
+        return in.isFinished() ? &in : 0;
+#endif
+}
+
+void UART::releasePacket() {
+#if HOST_PACKET_WINDOW > 0
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                window_tail = (window_tail + 1) % (HOST_PACKET_WINDOW + 1);
+                window_count--;
+        }
+#else
+        in.reset();
+#endif
+}
+
+#if HOST_FAST_QUERIES
+
+uint8_t UART::peekQuery(uint8_t& query) {
+        // Bytes in front of it are a packet the main loop hasn't handled yet
+        if (getInPacket().isStarted()
+#if HOST_PACKET_WINDOW > 0
+                        || window_count > 0
+#endif
+                        ) {
+                return QUERY_NONE;
+        }
+        BufSizeType length = rx_buffer.getLength();
+        if (length == 0 || length > 4 || rx_buffer[0] != START_BYTE) {
+                return QUERY_NONE;
+        }
+        if (length < 2) {
+                return QUERY_PARTIAL;
+        }
+        if (rx_buffer[1] != 1) {
+                return QUERY_NONE;
+        }
+        if (length < 4) {
+                return QUERY_PARTIAL;
+        }
+        query = rx_buffer[2];
+        // A bad CRC is the main loop's to report
+        return (rx_buffer[3] == InPacket::singleByteCrc(query)) ? QUERY_READY : QUERY_NONE;
+}
+
+#endif
+
 #if defined (__AVR_ATmega168__) || defined (__AVR_ATmega328__)
 
     // Send and receive interrupts
@@ -254,7 +429,7 @@ void UART::reset() {
     // Send and receive interrupts
     ISR(USART0_RX_vect)
     {
-            UART::getHostUART().in.processByte( UDR0 );
+            UART::getHostUART().receiveByte( UDR0 );
     }
 
     ISR(USART0_TX_vect)
@@ -273,7 +448,7 @@ void UART::reset() {
                 if (loopback_bytes > 0) {
                         loopback_bytes--;
                 } else {
-                        UART::getSlaveUART().in.processByte( byte_in );
+                        UART::getSlaveUART().receiveByte( byte_in );
                 }
         }
 
@@ -21,6 +21,26 @@
 #include "Packet.hh"
 #include "Configuration.hh"
 #include <stdint.h>
+#if UART_RX_BUFFER_SIZE > 0
+#include "CircularBuffer.hh"
+#endif
+
+/// Number of finished host packets that can wait to be handled, so a pipelining
+/// host can send more packets before the last one is handled. 0 for stop-and-wait.
+#ifndef HOST_PACKET_WINDOW
+#define HOST_PACKET_WINDOW 0
+#endif
+
+/// Bytes received by the interrupt and waiting for the main loop to put them
+/// together into packets, a power of 2. With 0 the interrupt builds the packets
+/// itself, and bytes that come in while one is finished are lost.
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 0
+#endif
+
+#if HOST_FAST_QUERIES && UART_RX_BUFFER_SIZE == 0
+#error HOST_FAST_QUERIES needs a receive buffer (UART_RX_BUFFER_SIZE)
+#endif
 
 // TODO: Move to UART class
 /// Communication mode selection
@@ -51,6 +71,27 @@ private:
     static UART slaveUART;      ///< The controller can forward commands to the slave UART
 #endif
 
+#if HOST_PACKET_WINDOW > 0
+    /// The host packets are received into a ring of HOST_PACKET_WINDOW + 1 slots,
+    /// #in and these: the finished ones from window_tail, oldest first, then the
+    /// one being received. A finished packet is handled in the slot it came into.
+    static InPacket window[HOST_PACKET_WINDOW];
+    static volatile uint8_t window_tail;
+    static volatile uint8_t window_count;
+
+    /// Slot of the ring
+    InPacket& windowSlot(uint8_t slot) { return (slot == 0) ? in : window[slot - 1]; }
+
+    /// Take a finished packet into the window and go on receiving into the next
+    /// slot, if there's room. Interrupts have to be off.
+    void queueFinished();
+#endif
+
+#if COMMAND_TRACING
+    /// Hand a byte to getInPacket(), and timestamp a host packet it finishes
+    void processByte(uint8_t b);
+#endif
+
 public:
     /// Get a reference to the host UART
     /// \return hostUART instance, which should act as a slave to a computer (or motherboard)
@@ -78,11 +119,28 @@ private:
         const communication_mode mode_;     ///< Communication mode we are speaking
         const uint8_t index_;               ///< Hardware UART index
         volatile bool enabled_;             ///< True if the hardware is currently enabled
+#if HOST_PACKET_WINDOW > 0
+        InPacket* volatile receiving_;      ///< #in, or the slot of the ring the host UART receives into
+#endif
+#if UART_RX_BUFFER_SIZE > 0
+        /// Filled by the receive interrupt, emptied by processReceived()
+        MaskedCircularBufferTempl<uint8_t, UART_RX_BUFFER_SIZE> rx_buffer;
+#endif
 
 public:
-        InPacket in;                        ///< Input packet
+        InPacket in;                        ///< Input packet, see getInPacket()
         OutPacket out;                      ///< Output packet
 
+        /// Get the packet being received. It's #in, but with a window the host
+        /// UART moves on to the next slot when a packet is finished.
+        InPacket& getInPacket() {
+#if HOST_PACKET_WINDOW > 0
+                return *receiving_;
+#else
+                return in;
+#endif
+        }
+
         /// Begin sending the data located in the #out packet.
         void beginSend();
 
@@ -93,6 +151,57 @@ public:
         /// Reset the UART to a listening state.  This is important for
         /// RS485-based comms.
         void reset();
+
+        /// Change the baud rate, the UART runs at double speed (U2X) from then on.
+        /// The byte being sent goes out at the old rate first.
+        /// \param[in] ubrr Baud rate register value
+        void setBaudDivisor(uint16_t ubrr);
+
+        /// Called by the receive interrupt. The byte goes into the receive buffer,
+        /// or without one into the getInPacket() packet (on the host UART, a
+        /// finished packet is taken into the window first).
+        /// \param[in] b Byte received
+        void receiveByte(uint8_t b);
+
+        /// Put the bytes waiting in the receive buffer into the getInPacket()
+        /// packet, until it's finished or has an error. On the host UART finished
+        /// packets are taken into the window while there's room. Called from the
+        /// main loop before the packet is looked at; does nothing without a
+        /// receive buffer.
+        void processReceived();
+
+        /// Throw away the bytes waiting in the receive buffer, such as a late reply
+        /// or the rest of a bad one, so they aren't taken for the reply to the next
+        /// packet. Call before sending a packet that starts over; does nothing
+        /// without a receive buffer.
+        void flushReceived();
+
+        /// Get the oldest finished packet from the host.
+        /// \return The packet, 0 if there's none
+        InPacket* receivedPacket();
+
+        /// Done with the packet receivedPacket() returned
+        void releasePacket();
+
+#if HOST_FAST_QUERIES
+        /// What peekQuery() found
+        enum {
+                QUERY_NONE,             ///< Something else, leave it to the main loop
+                QUERY_PARTIAL,          ///< The start of a query so far
+                QUERY_READY             ///< A whole query with a good CRC
+        };
+
+        /// Check whether the receive buffer holds a packet with a one byte payload
+        /// (START_BYTE, 1, the query, its CRC), or the start of one, with nothing
+        /// received before it. Only those four bytes are looked at, so it's cheap
+        /// enough for the receive interrupt. Interrupts have to be off.
+        /// \param[out] query The payload, with #QUERY_READY
+        /// \return #QUERY_NONE, #QUERY_PARTIAL or #QUERY_READY
+        uint8_t peekQuery(uint8_t& query);
+
+        /// Drop the packet peekQuery() found, it has been answered
+        void dropQuery() { rx_buffer.popN(0, 4); }
+#endif
 };
 
 #endif // UART_HH_
@@ -3,5 +3,8 @@
 
 #define UART_COUNT 0
 #define HAS_COMMAND_QUEUE 0
+#define PACKET_CRC_TABLE 1
+#define COMMAND_TRACING 1
+#define HAS_STEPPER_ACCELERATION
 
 #endif // MB_PLATFORM_POSIX_PLATFORM_HH_
@@ -0,0 +1,29 @@
+#ifndef MB_PLATFORM_POSIX_MOTHERBOARD_HH_
+#define MB_PLATFORM_POSIX_MOTHERBOARD_HH_
+
+/*
+ * Motherboard.hh
+ *
+ * Only the clock of the motherboard, set by the tests, and the stepper
+ * interfaces the planner enables.
+ */
+#include "Types.hh"
+#include "StepperInterface.hh"
+
+class Motherboard {
+public:
+	micros_t micros;
+
+	static Motherboard& getBoard() {
+		static Motherboard board;
+		return board;
+	}
+
+	micros_t getCurrentMicros() { return micros; }
+
+	StepperInterface steppers[5];
+
+	StepperInterface* getStepperAllInterfaces() { return steppers; }
+};
+
+#endif // MB_PLATFORM_POSIX_MOTHERBOARD_HH_
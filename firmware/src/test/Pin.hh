@@ -0,0 +1,14 @@
+#ifndef MB_PLATFORM_POSIX_PIN_HH_
+#define MB_PLATFORM_POSIX_PIN_HH_
+
+/*
+ * Pin.hh
+ *
+ * There are no pins on the host, the stepper interfaces hold these.
+ */
+#include <stdint.h>
+
+class Pin {
+};
+
+#endif // MB_PLATFORM_POSIX_PIN_HH_
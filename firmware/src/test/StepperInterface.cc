@@ -0,0 +1,9 @@
+/*
+ * StepperInterface.cc
+ *
+ * The stepper interfaces of the host do nothing, the planner only enables them.
+ */
+#include "StepperInterface.hh"
+
+void StepperInterface::setEnabled(bool enabled) {
+}
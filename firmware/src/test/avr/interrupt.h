@@ -0,0 +1,15 @@
+#ifndef MB_PLATFORM_POSIX_AVR_INTERRUPT_H_
+#define MB_PLATFORM_POSIX_AVR_INTERRUPT_H_
+
+/*
+ * interrupt.h
+ *
+ * There are no interrupts on the host, the status register is a plain variable.
+ */
+
+static volatile unsigned char SREG;
+
+#define cli()
+#define sei()
+
+#endif // MB_PLATFORM_POSIX_AVR_INTERRUPT_H_
@@ -0,0 +1,14 @@
+#ifndef MB_PLATFORM_POSIX_AVR_PGMSPACE_H_
+#define MB_PLATFORM_POSIX_AVR_PGMSPACE_H_
+
+/*
+ * pgmspace.h
+ *
+ * Program memory is ordinary memory on the host.
+ */
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+
+#endif // MB_PLATFORM_POSIX_AVR_PGMSPACE_H_
@@ -0,0 +1,14 @@
+#ifndef MB_PLATFORM_POSIX_UTIL_ATOMIC_H_
+#define MB_PLATFORM_POSIX_UTIL_ATOMIC_H_
+
+/*
+ * atomic.h
+ *
+ * There are no interrupts on the host, the block runs once as it is.
+ */
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (int atomic_once_ = 1; atomic_once_; atomic_once_ = 0)
+
+#endif // MB_PLATFORM_POSIX_UTIL_ATOMIC_H_
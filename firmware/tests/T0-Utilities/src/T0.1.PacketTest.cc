@@ -10,7 +10,7 @@ TEST(PacketTest, InPacket)
 {
 	InPacket packet;
 	// Test all valid packet sizes
-	for (int packet_size = MAX_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
+	for (int packet_size = LEGACY_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
 		uint8_t payload[packet_size];
 		uint8_t expected_crc = 0;
 		for (int i = 0; i < packet_size; i++) {
@@ -41,7 +41,7 @@ TEST(PacketTest, InBadCRC)
 {
 	InPacket packet;
 	// Test all valid packet sizes
-	for (int packet_size = MAX_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
+	for (int packet_size = LEGACY_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
 		uint8_t payload[packet_size];
 		uint8_t expected_crc = 0;
 		for (int i = 0; i < packet_size; i++) {
@@ -69,7 +69,7 @@ TEST(PacketTest, InMissingStart)
 {
 	InPacket packet;
 	// Test all valid packet sizes
-	for (int packet_size = MAX_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
+	for (int packet_size = LEGACY_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
 		uint8_t payload[packet_size];
 		uint8_t expected_crc = 0;
 		for (int i = 0; i < packet_size; i++) {
@@ -102,7 +102,7 @@ TEST(PacketTest, OutPacket)
 	OutPacket packet;
 	srand(time(0));
 	// Test all valid packet sizes
-	for (int packet_size = MAX_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
+	for (int packet_size = LEGACY_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
 		uint8_t payload[packet_size];
 		uint8_t expected_crc = 0;
 		for (int i = 0; i < packet_size; i++) {
@@ -140,7 +140,7 @@ TEST(PacketTest, PacketTrip)
 	OutPacket out_packet;
 	InPacket in_packet;
 	// Test all valid packet sizes
-	for (int packet_size = MAX_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
+	for (int packet_size = LEGACY_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
 		uint8_t payload[packet_size];
 		uint8_t expected_crc = 0;
 		for (int i = 0; i < packet_size; i++) {
@@ -203,3 +203,123 @@ TEST(PacketTest, PacketSizes)
 	ASSERT_EQ(in_packet.read32(7),p32);
 	ASSERT_EQ(in_packet.read16(11),p16);
 }
+
+// Pipelined packets carry a sequence number, covered by the CRC
+TEST(PacketTest, PipelinedPacketTrip)
+{
+	OutPacket out_packet;
+	InPacket in_packet;
+	for (int packet_size = LEGACY_PACKET_PAYLOAD - 1; packet_size >= 0; packet_size--) {
+		uint8_t sequence = random();
+		for (int i = 0; i < packet_size; i++) {
+			out_packet.append8(random());
+		}
+		out_packet.setSequence(sequence);
+		// send it twice, a resend has to be the same
+		for (int send = 0; send < 2; send++) {
+			ASSERT_EQ(out_packet.getNextByteToSend(), PIPELINED_START_BYTE);
+			in_packet.processByte(PIPELINED_START_BYTE);
+			while (!out_packet.isFinished()) {
+				in_packet.processByte(out_packet.getNextByteToSend());
+			}
+			ASSERT_FALSE(in_packet.hasError()) << "In error code: " << hex << in_packet.getErrorCode();
+			ASSERT_TRUE(in_packet.isFinished());
+			ASSERT_TRUE(in_packet.isPipelined());
+			ASSERT_EQ(in_packet.getSequence(), sequence);
+			ASSERT_EQ(in_packet.getLength(), packet_size);
+			for (int i = 0; i < packet_size; i++) {
+				ASSERT_EQ(in_packet.read8(i), out_packet.read8(i));
+			}
+			in_packet.reset();
+			out_packet.prepareForResend();
+		}
+		out_packet.reset();
+		ASSERT_FALSE(out_packet.isPipelined());
+	}
+}
+
+TEST(PacketTest, PipelinedBadSequence)
+{
+	InPacket packet;
+	uint8_t payload[3] = { 1, 2, 3 };
+	uint8_t crc = 0;
+	for (int i = 0; i < 3; i++) {
+		crc = _crc_ibutton_update(crc, payload[i]);
+	}
+	crc = _crc_ibutton_update(crc, 7);
+	packet.processByte(PIPELINED_START_BYTE);
+	packet.processByte(3);
+	for (int i = 0; i < 3; i++) {
+		packet.processByte(payload[i]);
+	}
+	// a damaged sequence number fails the CRC
+	packet.processByte(8);
+	packet.processByte(crc);
+	ASSERT_TRUE(packet.hasError());
+	ASSERT_EQ(packet.getErrorCode(),PacketError::BAD_CRC);
+}
+
+TEST(PacketTest, ExtendedPacketTrip)
+{
+	OutPacket out_packet;
+	InPacket in_packet;
+	for (int packet_size = MAX_PACKET_PAYLOAD; packet_size >= 0; packet_size--) {
+		bool pipelined = packet_size & 1;
+		for (int i = 0; i < packet_size; i++) {
+			out_packet.append8(random());
+		}
+		out_packet.setExtended();
+		if (pipelined) {
+			out_packet.setSequence(packet_size);
+		}
+		uint8_t start = out_packet.getNextByteToSend();
+		ASSERT_EQ(start, pipelined ? EXTENDED_PIPELINED_START_BYTE : EXTENDED_START_BYTE);
+		in_packet.processByte(start);
+		// 16 bit length, low byte first
+		uint8_t length_low = out_packet.getNextByteToSend();
+		uint8_t length_high = out_packet.getNextByteToSend();
+		ASSERT_EQ(length_low | (length_high << 8), packet_size);
+		in_packet.processByte(length_low);
+		in_packet.processByte(length_high);
+		while (!out_packet.isFinished()) {
+			in_packet.processByte(out_packet.getNextByteToSend());
+		}
+		ASSERT_FALSE(in_packet.hasError()) << "In error code: " << hex << in_packet.getErrorCode();
+		ASSERT_TRUE(in_packet.isFinished());
+		ASSERT_TRUE(in_packet.isExtended());
+		ASSERT_EQ(in_packet.isPipelined(), pipelined);
+		ASSERT_EQ(in_packet.getPayloadLimit(), MAX_PACKET_PAYLOAD);
+		ASSERT_EQ(in_packet.getLength(), packet_size);
+		for (int i = 0; i < packet_size; i++) {
+			ASSERT_EQ(in_packet.read8(i), out_packet.read8(i));
+		}
+		in_packet.reset();
+		out_packet.reset();
+		ASSERT_FALSE(out_packet.isExtended());
+		ASSERT_EQ(in_packet.getPayloadLimit(), LEGACY_PACKET_PAYLOAD);
+	}
+}
+
+TEST(PacketTest, ExtendedPacketTooLong)
+{
+	InPacket packet;
+	packet.processByte(EXTENDED_START_BYTE);
+	packet.processByte((MAX_PACKET_PAYLOAD + 1) & 0xff);
+	packet.processByte((MAX_PACKET_PAYLOAD + 1) >> 8);
+	ASSERT_TRUE(packet.hasError());
+	ASSERT_EQ(packet.getErrorCode(),PacketError::EXCEEDED_MAX_LENGTH);
+}
+
+TEST(PacketTest, LegacyPacketTooLong)
+{
+	// The 8 bit length framing is held to its own limit, whatever the buffers take
+	InPacket packet;
+	packet.processByte(START_BYTE);
+	packet.processByte(LEGACY_PACKET_PAYLOAD);
+	ASSERT_TRUE(packet.hasError());
+	ASSERT_EQ(packet.getErrorCode(),PacketError::EXCEEDED_MAX_LENGTH);
+	packet.reset();
+	packet.processByte(PIPELINED_START_BYTE);
+	packet.processByte(LEGACY_PACKET_PAYLOAD);
+	ASSERT_TRUE(packet.hasError());
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "Command.hh"
+#include "CommandCheck.hh"
+
+using namespace command;
+
+// A HOST_CMD_TOOL_COMMAND with a payload of the given length, returns its length
+uint16_t toolCommand(uint8_t* bytes, uint8_t payload) {
+    bytes[0] = HOST_CMD_TOOL_COMMAND;
+    bytes[1] = 0;       // tool
+    bytes[2] = 3;       // SLAVE_CMD_SET_TEMP
+    bytes[3] = payload;
+    memset(bytes + 4, 0x55, payload);
+    return 4 + payload;
+}
+
+TEST(CommandCheckTest, ToolPayload) {
+    uint8_t bytes[300];
+    uint16_t length = toolCommand(bytes, TOOL_COMMAND_MAX_PAYLOAD);
+    ASSERT_EQ(commandLength(bytes, length), length);
+    ASSERT_FALSE(isTooBig(bytes, length));
+    // Only the extended framing carries these, the tool packet can't
+    length = toolCommand(bytes, TOOL_COMMAND_MAX_PAYLOAD + 1);
+    ASSERT_TRUE(isTooBig(bytes, length));
+    length = toolCommand(bytes, 200);
+    ASSERT_TRUE(isTooBig(bytes, length));
+
+    // Other commands aren't looked at
+    uint8_t delay[] = { HOST_CMD_DELAY, 0xFF, 0xFF, 0xFF, 0xFF };
+    ASSERT_FALSE(isTooBig(delay, sizeof(delay)));
+}
+
+TEST(CommandCheckTest, Batch) {
+    uint8_t bytes[300];
+    uint16_t length = 0;
+    uint8_t delay[] = { HOST_CMD_DELAY, 100, 0, 0, 0 };
+    memcpy(bytes, delay, sizeof(delay));
+    length += sizeof(delay);
+    length += toolCommand(bytes + length, 2);
+
+    uint16_t fit = sizeof(bytes);
+    ASSERT_EQ(checkBatch(bytes, length, fit), 2);
+    ASSERT_EQ(fit, length);
+
+    // Only the first one fits
+    fit = sizeof(delay) + 3;
+    ASSERT_EQ(checkBatch(bytes, length, fit), 1);
+    ASSERT_EQ(fit, sizeof(delay));
+
+    // Cut short
+    fit = sizeof(bytes);
+    ASSERT_EQ(checkBatch(bytes, length - 1, fit), BATCH_INVALID);
+}
+
+TEST(CommandCheckTest, BatchTooBig) {
+    uint8_t bytes[300];
+    uint16_t length = 0;
+    uint8_t delay[] = { HOST_CMD_DELAY, 100, 0, 0, 0 };
+    memcpy(bytes, delay, sizeof(delay));
+    length += sizeof(delay);
+    length += toolCommand(bytes + length, TOOL_COMMAND_MAX_PAYLOAD + 1);
+
+    // Refused as a whole, even with no room for the command that's too big
+    uint16_t fit = sizeof(bytes);
+    ASSERT_EQ(checkBatch(bytes, length, fit), BATCH_TOO_BIG);
+    fit = sizeof(delay);
+    ASSERT_EQ(checkBatch(bytes, length, fit), BATCH_TOO_BIG);
+}
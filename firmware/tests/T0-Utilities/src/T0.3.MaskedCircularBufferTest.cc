@@ -0,0 +1,231 @@
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include "CircularBuffer.hh"
+
+const BufSizeType masked_size = 32;
+typedef MaskedCircularBufferTempl<uint8_t, masked_size> TestBuffer;
+
+TEST(MaskedCircularBufferTest, WalkAround) {
+    TestBuffer cb;
+    for (int offset = 0; offset < masked_size*3; offset++) {
+        ASSERT_EQ(cb.getLength(),0);
+        cb.push(offset);
+        ASSERT_EQ(cb.getLength(),1);
+        ASSERT_EQ(cb[0],offset);
+        ASSERT_EQ(cb.peek(),offset);
+        ASSERT_EQ(cb.pop(),offset);
+    }
+    ASSERT_FALSE(cb.hasOverflow());
+    ASSERT_FALSE(cb.hasUnderflow());
+}
+
+TEST(MaskedCircularBufferTest, FillEveryElement) {
+    TestBuffer cb;
+    // Advance the start each time round, a full buffer uses every element
+    for (int offset = 0; offset < masked_size*2; offset++) {
+        for (int i = 0; i < masked_size; i++) {
+            cb.push(i);
+            ASSERT_EQ(cb.getLength(),i+1);
+        }
+        ASSERT_FALSE(cb.hasOverflow());
+        ASSERT_EQ(cb.getRemainingCapacity(),0);
+        for (int i = 0; i < masked_size; i++) {
+            ASSERT_EQ(cb[i],i);
+        }
+        cb.push(0xff);
+        ASSERT_TRUE(cb.hasOverflow());
+        for (int i = 0; i < masked_size; i++) {
+            ASSERT_EQ(cb.pop(),i);
+        }
+        ASSERT_TRUE(cb.isEmpty());
+        cb.pop();
+        ASSERT_TRUE(cb.hasUnderflow());
+        cb.reset();
+        cb.push(0xff);
+        ASSERT_EQ(cb.pop(),0xff);
+        for (int i = 0; i <= offset; i++) {
+            cb.push(0);
+            cb.pop();
+        }
+        ASSERT_FALSE(cb.hasOverflow());
+        ASSERT_FALSE(cb.hasUnderflow());
+    }
+}
+
+TEST(MaskedCircularBufferTest, BulkWrapAround) {
+    TestBuffer cb;
+    uint8_t in[masked_size], out[masked_size];
+    uint8_t next_in = 0, next_out = 0;
+    // Every chunk size at every start position
+    for (int count = 1; count <= masked_size; count++) {
+        for (int offset = 0; offset < masked_size; offset++) {
+            for (int i = 0; i < count; i++)	in[i] = next_in++;
+            ASSERT_TRUE(cb.pushN(in, count));
+            ASSERT_EQ(cb.getLength(),count);
+            ASSERT_EQ(cb.popN(out, count),count);
+            for (int i = 0; i < count; i++)	ASSERT_EQ(out[i],next_out++);
+            // move the start on by one
+            cb.push(0);
+            cb.popN(0, 1);
+        }
+    }
+    ASSERT_FALSE(cb.hasOverflow());
+    ASSERT_FALSE(cb.hasUnderflow());
+}
+
+TEST(MaskedCircularBufferTest, BulkOverflowUnderflow) {
+    TestBuffer cb;
+    uint8_t in[masked_size+1], out[masked_size+1];
+    for (int i = 0; i <= masked_size; i++)	in[i] = i;
+
+    // Too much for the buffer, nothing is pushed
+    ASSERT_FALSE(cb.pushN(in, masked_size+1));
+    ASSERT_TRUE(cb.hasOverflow());
+    ASSERT_EQ(cb.getLength(),0);
+
+    cb.reset();
+    ASSERT_TRUE(cb.pushN(in, masked_size - 4));
+    ASSERT_FALSE(cb.pushN(in, 5));
+    ASSERT_TRUE(cb.pushN(in, 4));
+    ASSERT_EQ(cb.getRemainingCapacity(),0);
+
+    // Popping more than there is pops what's there
+    cb.reset();
+    cb.pushN(in, 3);
+    ASSERT_EQ(cb.popN(out, 5),3);
+    ASSERT_TRUE(cb.hasUnderflow());
+    ASSERT_EQ(out[2],2);
+    ASSERT_TRUE(cb.isEmpty());
+}
+
+TEST(MaskedCircularBufferTest, Spans) {
+    TestBuffer cb;
+    BufSizeType len;
+
+    // Empty buffer, the free space runs to the end of the data
+    uint8_t *w = cb.writeSpan(len);
+    ASSERT_EQ(len,masked_size);
+    for (int i = 0; i < 20; i++)	w[i] = i;
+    cb.commitPush(20);
+    cb.popN(0, 12);
+
+    // Free space is now in two pieces, 12 at the end and 12 at the start
+    w = cb.writeSpan(len);
+    ASSERT_EQ(len,12);
+    for (int i = 0; i < 12; i++)	w[i] = 20 + i;
+    cb.commitPush(12);
+    w = cb.writeSpan(len);
+    ASSERT_EQ(len,12);
+    for (int i = 0; i < 12; i++)	w[i] = 32 + i;
+    cb.commitPush(12);
+    w = cb.writeSpan(len);
+    ASSERT_EQ(len,0);
+
+    // Read back in place, also in two pieces
+    const uint8_t *r = cb.peekSpan(len);
+    ASSERT_EQ(len,20);
+    for (int i = 0; i < 20; i++)	ASSERT_EQ(r[i],12 + i);
+    cb.popN(0, len);
+    r = cb.peekSpan(len);
+    ASSERT_EQ(len,12);
+    for (int i = 0; i < 12; i++)	ASSERT_EQ(r[i],32 + i);
+    cb.popN(0, len);
+    r = cb.peekSpan(len);
+    ASSERT_EQ(len,0);
+    ASSERT_FALSE(cb.hasOverflow());
+    ASSERT_FALSE(cb.hasUnderflow());
+}
+
+// One producer and one consumer thread, bytes must come out in order without locking,
+// the buffer hands them over through its acquire/release indices alone
+const uint32_t spsc_bytes = 200000;
+MaskedCircularBufferTempl<uint8_t, 512> spsc_buffer;
+
+void* spscProducer(void*) {
+    uint8_t chunk[26];
+    uint32_t sent = 0;
+    while (sent < spsc_bytes) {
+        if ((sent & 1) == 0) {
+            for (int i = 0; i < 26; i++)	chunk[i] = (uint8_t)(sent + i);
+            if (spsc_buffer.pushN(chunk, 26))	sent += 26;
+            else	sched_yield();
+        } else if (spsc_buffer.getRemainingCapacity() > 0) {
+            spsc_buffer.push((uint8_t)sent);
+            sent ++;
+        } else {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+TEST(MaskedCircularBufferTest, SingleProducerSingleConsumer) {
+    pthread_t producer;
+    pthread_create(&producer, 0, spscProducer, 0);
+
+    uint32_t received = 0;
+    uint32_t errors = 0;
+    uint8_t out[64];
+    while (received < spsc_bytes) {
+        BufSizeType count = spsc_buffer.getLength();
+        if (count == 0)	sched_yield();
+        if (count > sizeof(out))	count = sizeof(out);
+        spsc_buffer.popN(out, count);
+        for (BufSizeType i = 0; i < count; i++) {
+            if (out[i] != (uint8_t)received)	errors ++;
+            received ++;
+        }
+    }
+    pthread_join(producer, 0);
+    ASSERT_EQ(errors,0);
+    ASSERT_TRUE(spsc_buffer.isEmpty());
+    ASSERT_FALSE(spsc_buffer.hasUnderflow());
+}
+
+// Throughput of the command buffer pattern: a 26 byte move pushed in and taken out again
+const int bench_rounds = 2000000;
+
+double benchSeconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+TEST(MaskedCircularBufferTest, Throughput) {
+    DEFINE_BUFFER(modulo,uint8_t,512);
+    MaskedCircularBufferTempl<uint8_t, 512> masked;
+    uint8_t move[26], out[26];
+    uint32_t sum_modulo = 0, sum_masked = 0, sum_bulk = 0;
+    for (int i = 0; i < 26; i++)	move[i] = i * 7;
+
+    clock_t start = clock();
+    for (int r = 0; r < bench_rounds; r++) {
+        for (int i = 0; i < 26; i++)	modulo.push(move[i]);
+        for (int i = 0; i < 26; i++)	sum_modulo += modulo.pop();
+    }
+    double t_modulo = benchSeconds(start);
+
+    start = clock();
+    for (int r = 0; r < bench_rounds; r++) {
+        for (int i = 0; i < 26; i++)	masked.push(move[i]);
+        for (int i = 0; i < 26; i++)	sum_masked += masked.pop();
+    }
+    double t_masked = benchSeconds(start);
+
+    start = clock();
+    for (int r = 0; r < bench_rounds; r++) {
+        masked.pushN(move, 26);
+        masked.popN(out, 26);
+        for (int i = 0; i < 26; i++)	sum_bulk += out[i];
+    }
+    double t_bulk = benchSeconds(start);
+
+    double mbytes = (double)bench_rounds * 26 / 1000000.0;
+    printf("CircularBuffer (modulo):      %8.1f MB/s\n", mbytes / t_modulo);
+    printf("MaskedCircularBuffer:         %8.1f MB/s\n", mbytes / t_masked);
+    printf("MaskedCircularBuffer pushN/popN: %5.1f MB/s\n", mbytes / t_bulk);
+
+    ASSERT_EQ(sum_modulo,sum_masked);
+    ASSERT_EQ(sum_modulo,sum_bulk);
+}
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include "BuildEstimator.hh"
+#include "StepperAccel.hh"
+
+const float steps_per_mm = 100.0;
+
+EstimatorSettings testSettings(float acceleration) {
+    EstimatorSettings settings;
+    for (int i = 0; i < ESTIMATOR_AXIS_COUNT; i++) {
+        settings.steps_per_mm[i] = steps_per_mm;
+        settings.max_feedrate[i] = 500;
+        settings.max_acceleration[i] = 100000;
+    }
+    settings.acceleration = acceleration;
+    settings.retract_acceleration = acceleration;
+    settings.max_xy_jerk = 20;
+    settings.max_z_jerk = 10;
+    settings.lookahead = true;
+    return settings;
+}
+
+// dda (us per step) for a move along one axis at feedrate mm/s
+int32_t dda(float feedrate) {
+    return (int32_t)(1000000.0 / (feedrate * steps_per_mm) + 0.5);
+}
+
+TEST(BuildEstimatorTest, ConstantRate) {
+    BuildEstimator estimator;
+    estimator.init(testSettings(0));
+    int32_t target[ESTIMATOR_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+    // 10 moves of 100mm at 50mm/s, 20s
+    for (int i = 1; i <= 10; i++) {
+        target[0] = i * 100 * steps_per_mm;
+        estimator.moveTo(target, dda(50));
+    }
+    estimator.flush();
+    ASSERT_EQ(estimator.getSeconds(),20);
+}
+
+TEST(BuildEstimatorTest, StraightLineTrapezoid) {
+    BuildEstimator estimator;
+    estimator.init(testSettings(100));
+    int32_t target[ESTIMATOR_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+    // 1000mm at 50mm/s with 100mm/s^2, the ramps add 0.5s to the 20s at constant
+    // rate, a little less as the planner starts at half the jerk speed
+    target[0] = 1000 * steps_per_mm;
+    estimator.moveTo(target, dda(50));
+    estimator.flush();
+    ASSERT_EQ(estimator.getSeconds(),20);
+
+    // The same line in 100 pieces runs through the junctions at full speed
+    estimator.reset();
+    for (int i = 1; i <= 100; i++) {
+        target[0] = i * 10 * steps_per_mm;
+        estimator.moveTo(target, dda(50));
+    }
+    estimator.flush();
+    uint32_t pieces = estimator.getSeconds();
+    ASSERT_EQ(pieces,20);
+
+    // Delays drain the planner, each one adds a stop and a start. A 100mm move
+    // enters at 10mm/s and finishes at 2mm/s: 0.4s + 1.51s + 0.48s, plus 1s of delay
+    estimator.reset();
+    for (int i = 1; i <= 10; i++) {
+        target[0] = i * 100 * steps_per_mm;
+        estimator.moveTo(target, dda(50));
+        estimator.addDelay(1000000);
+    }
+    estimator.flush();
+    ASSERT_EQ(estimator.getSeconds(),33);
+}
+
+TEST(BuildEstimatorTest, ShortMovesAreDropped) {
+    BuildEstimator estimator;
+    estimator.init(testSettings(0));
+    int32_t target[ESTIMATOR_AXIS_COUNT] = { 3, 0, 0, 0, 0 };
+    estimator.moveTo(target, 1000000);
+    // The planner drops moves of 5 steps or less and keeps its position
+    ASSERT_EQ(estimator.getPosition()[0],0);
+    target[0] = 1000;
+    estimator.moveTo(target, 1000);
+    estimator.flush();
+    ASSERT_EQ(estimator.getPosition()[0],1000);
+    ASSERT_EQ(estimator.getSeconds(),1);
+}
+
+TEST(BuildEstimatorTest, SharpCornersSlowDown) {
+    BuildEstimator estimator;
+    estimator.init(testSettings(1000));
+    int32_t target[ESTIMATOR_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+    // Zig-zag of 200 x 5mm at 100mm/s, 10s at constant rate. Every corner
+    // is a full reversal of x
+    for (int i = 1; i <= 200; i++) {
+        target[0] = ( i & 1 ) ? 5 * steps_per_mm : 0;
+        estimator.moveTo(target, dda(100));
+    }
+    estimator.flush();
+    // The junctions are limited to 10mm/s, too slow to reach 100mm/s in 5mm: each
+    // move peaks at 71mm/s and takes 2 x 0.061s
+    ASSERT_EQ(estimator.getSeconds(),24);
+}
+
+// The test is the stepper driver of the planner
+void st_wake_up() {}
+void st_set_position(const int32_t &x, const int32_t &y, const int32_t &z, const int32_t &e, const int32_t &b) {}
+void st_set_e_position(const int32_t &e) {}
+
+// Time (s) the stepper interrupt takes for a block, one step event at a time
+double stepBlock(const block_t *block) {
+    double rate = ( block->accelerate_until == 0 ) ? block->nominal_rate : block->initial_rate;
+    double acc_step_rate = block->initial_rate;
+    double acceleration_time = 1.0 / rate;
+    double deceleration_time = 0.0;
+    double seconds = 0.0;
+
+    for (uint32_t step = 1; step <= block->step_event_count; step++) {
+        seconds += 1.0 / rate;
+        if (step <= (uint32_t)block->accelerate_until) {
+            acc_step_rate = block->initial_rate + block->acceleration_st * acceleration_time;
+            if (acc_step_rate > block->nominal_rate) acc_step_rate = block->nominal_rate;
+            rate = acc_step_rate;
+            acceleration_time += 1.0 / rate;
+        } else if (step > (uint32_t)block->decelerate_after) {
+            rate = acc_step_rate - block->acceleration_st * deceleration_time;
+            if (rate < block->final_rate) rate = block->final_rate;
+            deceleration_time += 1.0 / rate;
+        } else {
+            rate = block->nominal_rate;
+        }
+    }
+    return seconds;
+}
+
+// Runs moves through the planner, the oldest block is stepped when the buffer is full
+class PlannerRun {
+public:
+    double seconds;
+    int32_t position[NUM_AXIS];
+
+    PlannerRun(const EstimatorSettings& settings) : seconds(0.0) {
+        for (int i = 0; i < NUM_AXIS; i++) {
+            axis_steps_per_unit[i] = settings.steps_per_mm[i];
+            max_feedrate[i] = settings.max_feedrate[i];
+            axis_steps_per_sqr_second[i] = settings.max_acceleration[i] * settings.steps_per_mm[i];
+            position[i] = 0;
+        }
+        p_acceleration = settings.acceleration;
+        p_retract_acceleration = settings.retract_acceleration;
+        max_xy_jerk = settings.max_xy_jerk;
+        max_xy_jerk_squared = max_xy_jerk * max_xy_jerk;
+        max_z_jerk = settings.max_z_jerk;
+        plan_init(0.0, 0.0);
+    }
+
+    // As steppers::setTarget() hands a move with an interval (us) per step to the planner
+    void moveTo(const int32_t target[NUM_AXIS], int32_t dda) {
+        int32_t master_steps = 0;
+        float distance = 0.0;
+        for (int i = 0; i < NUM_AXIS; i++) {
+            int32_t delta = labs(target[i] - position[i]);
+            if (delta > master_steps) master_steps = delta;
+            float delta_mm = (float)delta / axis_steps_per_unit[i];
+            distance += delta_mm * delta_mm;
+        }
+        if (master_steps == 0) return;
+        float feed_rate = (sqrt(distance) * 1000000.0) / ((float)dda * (float)master_steps);
+
+        if (movesplanned() == BLOCK_BUFFER_SIZE - 1) stepOldest();
+        plan_buffer_line(target[0], target[1], target[2], target[3], target[4], feed_rate, 0);
+        for (int i = 0; i < NUM_AXIS; i++) position[i] = target[i];
+    }
+
+    void finish() {
+        while (blocks_queued()) stepOldest();
+    }
+
+private:
+    void stepOldest() {
+        seconds += stepBlock(plan_get_current_block());
+        plan_discard_current_block();
+    }
+};
+
+TEST(BuildEstimatorTest, SameAsPlanner) {
+    EstimatorSettings settings = testSettings(1000);
+    settings.steps_per_mm[2] = 400;
+    settings.max_feedrate[2] = 10;
+    settings.max_acceleration[2] = 200;
+    settings.retract_acceleration = 2000;
+    BuildEstimator estimator;
+    estimator.init(settings);
+    PlannerRun planner(settings);
+
+    int32_t target[ESTIMATOR_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+    for (int layer = 1; layer <= 10; layer++) {
+        // Layer change: retract, lift, prime
+        target[3] -= 200;
+        estimator.moveTo(target, dda(40));
+        planner.moveTo(target, dda(40));
+        target[2] = layer * 0.3 * 400;
+        estimator.moveTo(target, 1000);
+        planner.moveTo(target, 1000);
+        target[3] += 200;
+        estimator.moveTo(target, dda(40));
+        planner.moveTo(target, dda(40));
+
+        // A circle of 72 x 1.7mm segments around (30,30), more moves than the planner holds
+        for (int i = 0; i <= 72; i++) {
+            float angle = i * 2.0 * M_PI / 72.0;
+            target[0] = (30 + 20 * cos(angle)) * steps_per_mm;
+            target[1] = (30 + 20 * sin(angle)) * steps_per_mm;
+            target[3] += 17;
+            int32_t interval = dda(( i == 0 ) ? 150 : 60);
+            estimator.moveTo(target, interval);
+            planner.moveTo(target, interval);
+        }
+
+        // A straight edge of 0.5mm segments at 150mm/s, it takes more than 8 of them to stop
+        for (int i = 1; i <= 80; i++) {
+            target[1] = (10 + 0.5 * i) * steps_per_mm;
+            target[3] += 5;
+            estimator.moveTo(target, dda(150));
+            planner.moveTo(target, dda(150));
+        }
+
+        // Infill zig-zag, long moves with sharp corners and some tiny ones
+        for (int i = 1; i <= 20; i++) {
+            target[0] = (( i & 1 ) ? 50 : 10) * steps_per_mm;
+            target[1] = (10 + i) * steps_per_mm;
+            target[3] += 120;
+            estimator.moveTo(target, dda(80));
+            planner.moveTo(target, dda(80));
+            target[1] += 8;
+            estimator.moveTo(target, dda(80));
+            planner.moveTo(target, dda(80));
+        }
+    }
+    estimator.flush();
+    planner.finish();
+
+    ASSERT_GT(planner.seconds, 100.0);
+    ASSERT_NEAR(estimator.getSeconds(), planner.seconds, 0.005 * planner.seconds);
+}
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include "CompactMove.hh"
+#include "Commands.hh"
+
+// Small deterministic generator, so failures can be reproduced
+uint32_t seed = 12345;
+int32_t randomRange(int32_t low, int32_t high) {
+    seed = seed * 1103515245 + 12345;
+    return low + (int32_t)((seed >> 8) % (uint32_t)(high - low + 1));
+}
+
+void roundTrip(const int32_t delta[COMPACT_MOVE_AXIS_COUNT], uint32_t us) {
+    uint8_t bytes[COMPACT_MOVE_MAX_LENGTH];
+    uint8_t len = compactmove::encode(delta, us, bytes);
+    ASSERT_GT(len,0);
+    ASSERT_LE(len,COMPACT_MOVE_MAX_LENGTH);
+    ASSERT_EQ(bytes[0],HOST_CMD_QUEUE_POINT_COMPACT);
+    ASSERT_EQ(compactmove::length(bytes[1], bytes[2]),len);
+
+    int32_t out[COMPACT_MOVE_AXIS_COUNT];
+    uint32_t out_us;
+    compactmove::decode(bytes, out, out_us);
+    ASSERT_EQ(out_us,us);
+    for (int i = 0; i < COMPACT_MOVE_AXIS_COUNT; i++)	ASSERT_EQ(out[i],delta[i]);
+}
+
+TEST(CompactMoveTest, Boundaries) {
+    const int32_t values[] = { 0, 1, -1, 127, -128, 128, -129, 32767, -32768, 32768, -32769,
+                               8388607, -8388608 };
+    const uint32_t durations[] = { 0, 1, 65535, 65536, 0xFFFFFF };
+    const int count = sizeof(values) / sizeof(values[0]);
+
+    // Every value on every axis, with the others still or moving
+    for (int axis = 0; axis < COMPACT_MOVE_AXIS_COUNT; axis++) {
+        for (int v = 0; v < count; v++) {
+            for (int d = 0; d < 5; d++) {
+                int32_t delta[COMPACT_MOVE_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+                delta[axis] = values[v];
+                roundTrip(delta, durations[d]);
+                for (int i = 0; i < COMPACT_MOVE_AXIS_COUNT; i++)
+                    if ( i != axis )	delta[i] = values[(v + i) % count];
+                roundTrip(delta, durations[d]);
+            }
+        }
+    }
+}
+
+TEST(CompactMoveTest, Random) {
+    for (int n = 0; n < 100000; n++) {
+        int32_t delta[COMPACT_MOVE_AXIS_COUNT];
+        // Mix the sizes, so every combination of headers comes up
+        for (int i = 0; i < COMPACT_MOVE_AXIS_COUNT; i++) {
+            switch (randomRange(0, 3)) {
+            case 0:  delta[i] = 0;                                break;
+            case 1:  delta[i] = randomRange(-128, 127);           break;
+            case 2:  delta[i] = randomRange(-32768, 32767);       break;
+            default: delta[i] = randomRange(-8388608, 8388607);   break;
+            }
+        }
+        roundTrip(delta, (uint32_t)randomRange(0, 0xFFFFFF));
+        if ( HasFatalFailure() )	return;
+    }
+}
+
+TEST(CompactMoveTest, TooBigForCompact) {
+    uint8_t bytes[COMPACT_MOVE_MAX_LENGTH];
+    int32_t delta[COMPACT_MOVE_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+
+    delta[2] = 8388608;
+    ASSERT_EQ(compactmove::encode(delta, 1000, bytes),0);
+    delta[2] = -8388609;
+    ASSERT_EQ(compactmove::encode(delta, 1000, bytes),0);
+
+    // Over 16.7s
+    delta[2] = 100;
+    ASSERT_EQ(compactmove::encode(delta, 0x1000000, bytes),0);
+}
+
+TEST(CompactMoveTest, Sizes) {
+    uint8_t bytes[COMPACT_MOVE_MAX_LENGTH];
+
+    // Short printing move in X, Y and A
+    int32_t print[COMPACT_MOVE_AXIS_COUNT] = { 40, -25, 0, 3, 0 };
+    ASSERT_EQ(compactmove::encode(print, 20000, bytes),7);
+
+    // Longer move, 16 bit deltas and a 24 bit duration
+    int32_t travel[COMPACT_MOVE_AXIS_COUNT] = { 4000, -2500, 0, 0, 0 };
+    ASSERT_EQ(compactmove::encode(travel, 500000, bytes),9);
+
+    // Layer change, Z needs the second header
+    int32_t layer[COMPACT_MOVE_AXIS_COUNT] = { 0, 0, 40, 0, 0 };
+    ASSERT_EQ(compactmove::encode(layer, 30000, bytes),6);
+}
+
+TEST(CompactMoveTest, MovesPerByte) {
+    // Dense curved perimeters: 0.1 - 1mm segments at 94 steps per mm in X and Y,
+    // with the extruder at 4.4 steps per mm, 40mm/s
+    const int moves = 10000;
+    uint32_t bytes_used = 0;
+    uint8_t bytes[COMPACT_MOVE_MAX_LENGTH];
+    for (int n = 0; n < moves; n++) {
+        int32_t delta[COMPACT_MOVE_AXIS_COUNT] = { randomRange(-94, 94), randomRange(-94, 94), 0,
+                                                   randomRange(0, 6), 0 };
+        int32_t longest = ( abs(delta[0]) > abs(delta[1]) ) ? abs(delta[0]) : abs(delta[1]);
+        uint8_t len = compactmove::encode(delta, longest * 1000000 / (94 * 40), bytes);
+        ASSERT_GT(len,0);
+        bytes_used += len;
+    }
+
+    // HOST_CMD_QUEUE_POINT_NEW is 26 bytes
+    double ratio = (double)moves * 26 / bytes_used;
+    printf("Compact moves: %.1f bytes a move, %.1fx HOST_CMD_QUEUE_POINT_NEW\n",
+           (double)bytes_used / moves, ratio);
+    ASSERT_GE(ratio,3.0);
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <string.h>
+#include "ArcSegmenter.hh"
+
+struct ArcResult {
+    int32_t end[ARC_AXIS_COUNT];    // where the chords finish
+    uint64_t us;
+    int segments;
+    double max_error;               // furthest a chord midpoint is from the arc (steps)
+    double min_chord;               // shortest chord (steps)
+    double turned;                  // angle swept by the chords, negative clockwise
+};
+
+// Run an arc through the segmenter and measure the chords against the real arc
+ArcResult runArc(const int32_t end[ARC_AXIS_COUNT], int32_t cx, int32_t cy, bool clockwise, uint32_t us) {
+    ArcSegmenter arc;
+    arc.start(end, cx, cy, clockwise, us);
+    double radius = sqrt((double)cx * cx + (double)cy * cy);
+
+    ArcResult result;
+    memset(&result, 0, sizeof(result));
+    result.min_chord = 1e9;
+    int32_t delta[ARC_AXIS_COUNT];
+    uint32_t chord_us;
+    double angle = atan2(-cy, -cx);
+    while (arc.next(delta, chord_us)) {
+        double x0 = result.end[0], y0 = result.end[1];
+        for (int i = 0; i < ARC_AXIS_COUNT; i++) result.end[i] += delta[i];
+        double mx = (x0 + result.end[0]) / 2 - cx, my = (y0 + result.end[1]) / 2 - cy;
+        double error = radius - sqrt(mx * mx + my * my);
+        if (fabs(error) > result.max_error) result.max_error = fabs(error);
+        double chord = sqrt((double)delta[0] * delta[0] + (double)delta[1] * delta[1]);
+        if (chord < result.min_chord) result.min_chord = chord;
+
+        double next = atan2(result.end[1] - cy, result.end[0] - cx);
+        double step = next - angle;
+        if (step > M_PI) step -= 2 * M_PI;
+        if (step < -M_PI) step += 2 * M_PI;
+        result.turned += step;
+        angle = next;
+
+        result.us += chord_us;
+        result.segments++;
+    }
+    EXPECT_EQ(result.segments, arc.getSegmentCount());
+    return result;
+}
+
+TEST(ArcSegmenterTest, EndsExactly) {
+    // Quarter circle of radius 10000 steps, with z and the extruder along for the ride
+    int32_t end[ARC_AXIS_COUNT] = { 10000, 10000, 333, 12345, 0 };
+    ArcResult r = runArc(end, 0, 10000, false, 1234567);
+    for (int i = 0; i < ARC_AXIS_COUNT; i++) ASSERT_EQ(r.end[i], end[i]);
+    ASSERT_EQ(r.us, 1234567);
+    ASSERT_NEAR(r.turned, M_PI / 2, 0.001);
+}
+
+TEST(ArcSegmenterTest, ChordError) {
+    // Every chord is within the tolerance of the arc, give or take the rounding of its
+    // ends to whole steps
+    int32_t radii[] = { 200, 1000, 5000, 20000, 100000 };
+    for (int i = 0; i < 5; i++) {
+        int32_t end[ARC_AXIS_COUNT] = { 2 * radii[i], 0, 0, 0, 0 };
+        ArcResult r = runArc(end, radii[i], 0, true, 1000000);
+        ASSERT_LE(r.max_error, ARC_TOLERANCE_STEPS + 0.75) << "radius " << radii[i];
+        ASSERT_EQ(r.end[0], end[0]);
+        ASSERT_EQ(r.end[1], 0);
+        ASSERT_NEAR(r.turned, -M_PI, 0.001);
+        // No more chords than the tolerance needs
+        double needed = M_PI / (2 * acos(1.0 - ARC_TOLERANCE_STEPS / radii[i]));
+        ASSERT_LE(r.segments, ceil(needed));
+    }
+}
+
+TEST(ArcSegmenterTest, FullCircle) {
+    int32_t end[ARC_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+    ArcResult ccw = runArc(end, 3000, 4000, false, 1000);
+    ASSERT_NEAR(ccw.turned, 2 * M_PI, 0.001);
+    ArcResult cw = runArc(end, 3000, 4000, true, 1000);
+    ASSERT_NEAR(cw.turned, -2 * M_PI, 0.001);
+    for (int i = 0; i < ARC_AXIS_COUNT; i++) ASSERT_EQ(cw.end[i], 0);
+    ASSERT_EQ(cw.us, 1000);
+}
+
+TEST(ArcSegmenterTest, OffCenterEnd) {
+    // An end point a few steps off the circle, as rounded host coordinates are; the
+    // radius changes gradually and the arc still ends on the end point
+    int32_t end[ARC_AXIS_COUNT] = { 5003, -4998, 0, 0, 0 };
+    ArcResult r = runArc(end, 0, -5000, true, 500000);
+    ASSERT_EQ(r.end[0], end[0]);
+    ASSERT_EQ(r.end[1], end[1]);
+    ASSERT_LE(r.max_error, ARC_TOLERANCE_STEPS + 4);
+}
+
+TEST(ArcSegmenterTest, SmallArcs) {
+    // Chords of tiny arcs are kept long enough for the planner to take them
+    int32_t end[ARC_AXIS_COUNT] = { 60, 60, 0, 0, 0 };
+    ArcResult r = runArc(end, 60, 0, false, 10000);
+    ASSERT_GE(r.min_chord, ARC_MIN_CHORD_STEPS - 1);
+    ASSERT_EQ(r.end[0], 60);
+    ASSERT_EQ(r.end[1], 60);
+
+    // An arc shorter than a chord is a single move
+    int32_t tiny[ARC_AXIS_COUNT] = { 2, 2, 0, 0, 0 };
+    r = runArc(tiny, 2, 0, false, 100);
+    ASSERT_EQ(r.segments, 1);
+    ASSERT_EQ(r.end[0], 2);
+    ASSERT_EQ(r.us, 100);
+}
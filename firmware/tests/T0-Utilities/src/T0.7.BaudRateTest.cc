@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include "Packet.hh"
+#include "Commands.hh"
+#include "BaudRate.hh"
+
+const uint32_t clock_hz = 16000000;
+const uint32_t start_baud = 115200;
+
+speed_t termiosSpeed(uint32_t baud) {
+    switch (baud) {
+    case 115200:  return B115200;
+    case 500000:  return B500000;
+    case 1000000: return B1000000;
+    }
+    return B0;
+}
+
+void setSpeed(int fd, uint32_t baud) {
+    struct termios tio;
+    ASSERT_EQ(tcgetattr(fd, &tio), 0);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, termiosSpeed(baud));
+    cfsetospeed(&tio, termiosSpeed(baud));
+    ASSERT_EQ(tcsetattr(fd, TCSANOW, &tio), 0);
+}
+
+void writePacket(int fd, OutPacket& packet) {
+    while (!packet.isFinished()) {
+        uint8_t b = packet.getNextByteToSend();
+        ASSERT_EQ(write(fd, &b, 1), 1);
+    }
+}
+
+// Read a packet, false if none finished within timeout_ms
+bool readPacket(int fd, InPacket& packet, int timeout_ms) {
+    packet.reset();
+    struct pollfd p = { fd, POLLIN, 0 };
+    while (!packet.isFinished() && !packet.hasError()) {
+        if (poll(&p, 1, timeout_ms) <= 0) return false;
+        uint8_t b;
+        if (read(fd, &b, 1) != 1) return false;
+        packet.processByte(b);
+    }
+    return packet.isFinished();
+}
+
+// The board end of the link, handled as runHostSlice() does: the new rate is
+// switched to once the acceptance is written, and a packet at it confirms it
+struct Board {
+    int fd;
+    BaudRateNegotiator baud_rate;
+    InPacket in;
+    OutPacket out;
+
+    Board(int fd_in) : fd(fd_in), baud_rate(start_baud, clock_hz) {}
+
+    // Answer a packet, or go back to the old rate if none comes in time
+    bool service(int timeout_ms) {
+        if (!readPacket(fd, in, timeout_ms)) {
+            if (baud_rate.isConfirming()) setSpeed(fd, baud_rate.revert());
+            return false;
+        }
+        baud_rate.packetReceived();
+        out.reset();
+        if (in.read8(0) == HOST_CMD_SET_BAUD_RATE) {
+            out.append8(baud_rate.propose(in.read32(1)) ? RC_OK : RC_GENERIC_ERROR);
+        } else {
+            out.append8(RC_OK);
+        }
+        writePacket(fd, out);
+        if (baud_rate.isSwitching()) setSpeed(fd, baud_rate.switchRate());
+        return true;
+    }
+};
+
+class BaudRateTest : public ::testing::Test {
+protected:
+    int board_fd;
+    int host_fd;
+
+    virtual void SetUp() {
+        board_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        ASSERT_GE(board_fd, 0);
+        ASSERT_EQ(grantpt(board_fd), 0);
+        ASSERT_EQ(unlockpt(board_fd), 0);
+        host_fd = open(ptsname(board_fd), O_RDWR | O_NOCTTY);
+        ASSERT_GE(host_fd, 0);
+        setSpeed(host_fd, start_baud);
+    }
+
+    virtual void TearDown() {
+        close(host_fd);
+        close(board_fd);
+    }
+
+    // Send a command from the host, the board answers it
+    uint8_t query(Board& board, uint8_t command, uint32_t value) {
+        OutPacket request;
+        request.append8(command);
+        request.append32(value);
+        writePacket(host_fd, request);
+        EXPECT_TRUE(board.service(100));
+        InPacket response;
+        EXPECT_TRUE(readPacket(host_fd, response, 100));
+        return response.read8(0);
+    }
+
+    speed_t hostSpeed() {
+        struct termios tio;
+        tcgetattr(host_fd, &tio);
+        return cfgetospeed(&tio);
+    }
+};
+
+TEST(BaudRateDivisorTest, Divisors) {
+    uint16_t ubrr;
+    // The rates that are exact at 16MHz, and the ones the boards start at
+    ASSERT_TRUE(getBaudRateDivisor(1000000, clock_hz, ubrr));
+    ASSERT_EQ(ubrr, 1);
+    ASSERT_TRUE(getBaudRateDivisor(500000, clock_hz, ubrr));
+    ASSERT_EQ(ubrr, 3);
+    ASSERT_TRUE(getBaudRateDivisor(250000, clock_hz, ubrr));
+    ASSERT_EQ(ubrr, 7);
+    ASSERT_TRUE(getBaudRateDivisor(115200, clock_hz, ubrr));
+    ASSERT_EQ(ubrr, 16);
+    ASSERT_TRUE(getBaudRateDivisor(38400, clock_hz, ubrr));
+    ASSERT_EQ(ubrr, 51);
+    // Too far off, too fast and too slow
+    ASSERT_FALSE(getBaudRateDivisor(921600, clock_hz, ubrr));
+    ASSERT_FALSE(getBaudRateDivisor(3000000, clock_hz, ubrr));
+    ASSERT_FALSE(getBaudRateDivisor(300, clock_hz, ubrr));
+    ASSERT_FALSE(getBaudRateDivisor(0, clock_hz, ubrr));
+}
+
+TEST_F(BaudRateTest, Switch) {
+    Board board(board_fd);
+    ASSERT_EQ(query(board, HOST_CMD_SET_BAUD_RATE, 1000000), RC_OK);
+    ASSERT_TRUE(board.baud_rate.isConfirming());
+    // The host switches once it has the acceptance, its next packet confirms the rate
+    setSpeed(host_fd, 1000000);
+    ASSERT_EQ(query(board, HOST_CMD_VERSION, 0), RC_OK);
+    ASSERT_FALSE(board.baud_rate.isConfirming());
+    ASSERT_EQ(board.baud_rate.getBaudRate(), 1000000);
+    ASSERT_EQ(hostSpeed(), B1000000);
+
+    // And on to another one from there
+    ASSERT_EQ(query(board, HOST_CMD_SET_BAUD_RATE, 500000), RC_OK);
+    setSpeed(host_fd, 500000);
+    ASSERT_EQ(query(board, HOST_CMD_VERSION, 0), RC_OK);
+    ASSERT_EQ(board.baud_rate.getBaudRate(), 500000);
+}
+
+TEST_F(BaudRateTest, BadRate) {
+    Board board(board_fd);
+    ASSERT_EQ(query(board, HOST_CMD_SET_BAUD_RATE, 921600), RC_GENERIC_ERROR);
+    ASSERT_FALSE(board.baud_rate.isSwitching());
+    ASSERT_FALSE(board.baud_rate.isConfirming());
+    ASSERT_EQ(board.baud_rate.getBaudRate(), start_baud);
+}
+
+TEST_F(BaudRateTest, Revert) {
+    Board board(board_fd);
+    ASSERT_EQ(query(board, HOST_CMD_SET_BAUD_RATE, 1000000), RC_OK);
+    ASSERT_EQ(board.baud_rate.getBaudRate(), 1000000);
+    // A proposal while one is being confirmed isn't taken
+    ASSERT_FALSE(board.baud_rate.propose(500000));
+    // The host didn't get the acceptance and keeps to the old rate, nothing valid
+    // comes in, and the board goes back
+    ASSERT_FALSE(board.service(50));
+    ASSERT_FALSE(board.baud_rate.isConfirming());
+    ASSERT_EQ(board.baud_rate.getBaudRate(), start_baud);
+    ASSERT_EQ(query(board, HOST_CMD_VERSION, 0), RC_OK);
+    ASSERT_EQ(board.baud_rate.getBaudRate(), start_baud);
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <time.h>
+#include <iostream>
+#include <util/crc16.h>
+#include "PacketCrc.hh"
+
+// PACKET_CRC_TABLE is on in the test Configuration.hh, so packetCrcUpdate() is the
+// table and _crc_ibutton_update() the bit loop it replaces
+
+TEST(PacketCrcTest, TableMatchesBitLoop) {
+    // Every crc and every data byte
+    for (int crc = 0; crc < 256; crc++) {
+        for (int data = 0; data < 256; data++) {
+            ASSERT_EQ(packetCrcUpdate(crc, data), _crc_ibutton_update(crc, data))
+                << "crc " << crc << " data " << data;
+        }
+    }
+}
+
+TEST(PacketCrcTest, Payloads) {
+    for (int length = 0; length < 300; length++) {
+        uint8_t table = 0, loop = 0;
+        for (int i = 0; i < length; i++) {
+            uint8_t b = random();
+            table = packetCrcUpdate(table, b);
+            loop = _crc_ibutton_update(loop, b);
+        }
+        ASSERT_EQ(table, loop);
+        // A packet followed by its CRC checks out to 0
+        ASSERT_EQ(packetCrcUpdate(table, table), 0);
+    }
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+static inline uint64_t cycles() { return __builtin_ia32_rdtsc(); }
+#else
+static inline uint64_t cycles() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+// Cycles (or ns) per byte of the host running the tests, not of the AVR: only the
+// ratio between the two says anything, and only roughly. On the AVR the bit loop
+// is 8 rounds of shift, test and xor, the table an xor, an add and an lpm.
+TEST(PacketCrcTest, CyclesPerByte) {
+    const int length = 1 << 22;
+    uint8_t* data = new uint8_t[length];
+    for (int i = 0; i < length; i++) data[i] = random();
+
+    uint8_t loop_crc = 0;
+    uint64_t start = cycles();
+    for (int i = 0; i < length; i++) loop_crc = _crc_ibutton_update(loop_crc, data[i]);
+    uint64_t loop_cycles = cycles() - start;
+
+    uint8_t table_crc = 0;
+    start = cycles();
+    for (int i = 0; i < length; i++) table_crc = packetCrcUpdate(table_crc, data[i]);
+    uint64_t table_cycles = cycles() - start;
+    delete[] data;
+
+    // Also keeps either loop from being optimized away
+    ASSERT_EQ(table_crc, loop_crc);
+
+    std::cout << "host bit loop: " << (double)loop_cycles / length << " cycles/byte, table: "
+              << (double)table_cycles / length << " cycles/byte" << std::endl;
+    ASSERT_GT(loop_cycles, 0u);
+    ASSERT_GT(table_cycles, 0u);
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include "Motherboard.hh"
+#include "CommandTrace.hh"
+
+// COMMAND_TRACING is on in the test Configuration.hh, and its Motherboard.hh is only
+// a clock the tests set
+
+using namespace commandtrace;
+
+class CommandTraceTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        reset();
+        resetStats();
+        setClock(0);
+    }
+
+    void setClock(micros_t micros) {
+        Motherboard::getBoard().micros = micros;
+    }
+
+    // Run a command that queues no blocks
+    void runCommand(uint8_t trace, uint8_t command) {
+        dispatched(trace, command);
+        ran(trace);
+    }
+};
+
+TEST_F(CommandTraceTest, WithoutBlocks) {
+    arrived(1, 100);
+    uint8_t trace = decoded();
+    ASSERT_NE(trace, 0);
+    setClock(200);
+    dispatched(trace, 0x88);
+    ASSERT_EQ(getFinishedCount(), 0);
+    setClock(250);
+    ran(trace);
+    ASSERT_EQ(getFinishedCount(), 1);
+
+    Trace t;
+    ASSERT_TRUE(drain(t));
+    ASSERT_EQ(t.command, 0x88);
+    ASSERT_EQ(t.blocks, 0);
+    ASSERT_EQ(t.arrived, 100);
+    ASSERT_EQ(t.dispatched, 200);
+    ASSERT_EQ(t.started, 0);
+    ASSERT_EQ(t.finished, 250);
+    ASSERT_FALSE(drain(t));
+}
+
+TEST_F(CommandTraceTest, WithBlocks) {
+    arrived(1, 100);
+    uint8_t trace = decoded();
+    setClock(200);
+    dispatched(trace, 0x8E);
+    uint8_t first = blockQueued();
+    uint8_t second = blockQueued();
+    ASSERT_EQ(first, trace);
+    ASSERT_EQ(second, trace);
+    ran(trace);
+    // Nothing is queued for a command once it has run
+    ASSERT_EQ(blockQueued(), 0);
+
+    setClock(300);
+    blockStarted(first);
+    setClock(400);
+    blockFinished(first);
+    blockStarted(second);
+    ASSERT_EQ(getFinishedCount(), 0);
+    setClock(500);
+    blockFinished(second);
+    ASSERT_EQ(getFinishedCount(), 1);
+
+    Trace t;
+    ASSERT_TRUE(drain(t));
+    ASSERT_EQ(t.blocks, 2);
+    ASSERT_EQ(t.started, 300);
+    ASSERT_EQ(t.finished, 500);
+
+    StageStats stats;
+    getStats(STAGE_PLANNER, stats);
+    ASSERT_EQ(stats.samples, 1);
+    ASSERT_EQ(stats.sum, 100);
+    getStats(STAGE_MOTION, stats);
+    ASSERT_EQ(stats.sum, 200);
+    getStats(STAGE_TOTAL, stats);
+    ASSERT_EQ(stats.sum, 400);
+    ASSERT_EQ(stats.max, 400);
+    ASSERT_EQ(stats.histogram[1], 1);
+}
+
+TEST_F(CommandTraceTest, BlocksFinishedBeforeRan) {
+    // An arc queues chords while the earlier ones are stepped
+    arrived(1, 0);
+    uint8_t trace = decoded();
+    dispatched(trace, 0x9A);
+    uint8_t block = blockQueued();
+    setClock(100);
+    blockStarted(block);
+    setClock(200);
+    blockFinished(block);
+    setClock(300);
+    ran(trace);
+
+    Trace t;
+    ASSERT_TRUE(drain(t));
+    ASSERT_EQ(t.finished, 200);
+}
+
+TEST_F(CommandTraceTest, InOrder) {
+    arrived(2, 10);
+    arrived(1, 20);
+    uint8_t a = decoded();
+    uint8_t b = decoded();
+    uint8_t c = decoded();
+    runCommand(a, 1);
+    // The second is still running, the third has to wait for it to be drained
+    dispatched(b, 2);
+    blockQueued();
+    runCommand(c, 3);
+    ran(b);
+    ASSERT_EQ(getFinishedCount(), 1);
+
+    Trace t;
+    ASSERT_TRUE(drain(t));
+    ASSERT_EQ(t.command, 1);
+    ASSERT_FALSE(drain(t));
+    blockFinished(b);
+    ASSERT_TRUE(drain(t));
+    ASSERT_EQ(t.command, 2);
+    ASSERT_TRUE(drain(t));
+    ASSERT_EQ(t.command, 3);
+    ASSERT_EQ(t.arrived, 20);
+}
+
+TEST_F(CommandTraceTest, SDCommandsUntraced) {
+    // Played back from the card, nothing arrived from the host
+    ASSERT_EQ(decoded(), 0);
+    ASSERT_EQ(decoded(), 0);
+    arrived(1, 0);
+    ASSERT_NE(decoded(), 0);
+    ASSERT_EQ(decoded(), 0);
+    ASSERT_EQ(getLostCount(), 0);
+}
+
+TEST_F(CommandTraceTest, Full) {
+    // Every slot taken by a command in flight, the next one isn't traced
+    arrived(COMMAND_TRACE_SLOTS + 1, 0);
+    ASSERT_EQ(getLostCount(), 1);
+    uint8_t traces[COMMAND_TRACE_SLOTS];
+    for (int i = 0; i < COMMAND_TRACE_SLOTS; i++) {
+        traces[i] = decoded();
+        ASSERT_NE(traces[i], 0);
+    }
+    ASSERT_EQ(decoded(), 0);
+
+    // Finished but not drained, the oldest makes room
+    for (int i = 0; i < COMMAND_TRACE_SLOTS; i++) {
+        runCommand(traces[i], i);
+    }
+    ASSERT_EQ(getFinishedCount(), COMMAND_TRACE_SLOTS);
+    arrived(1, 0);
+    ASSERT_EQ(getLostCount(), 2);
+    ASSERT_EQ(getFinishedCount(), COMMAND_TRACE_SLOTS - 1);
+    Trace t;
+    ASSERT_TRUE(drain(t));
+    ASSERT_EQ(t.command, 1);
+
+    // The commands that were in flight are gone
+    reset();
+    ASSERT_EQ(getFinishedCount(), 0);
+    ASSERT_EQ(decoded(), 0);
+    blockFinished(traces[0]);
+}
@@ -0,0 +1,94 @@
+/*
+ * Helpers for the host tools that read .s3g files
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef S3GFILE_HH_
+#define S3GFILE_HH_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "Commands.hh"
+#include "CompactMove.hh"
+#include "ArcSegmenter.hh"
+
+/// Length of a command including the command code, as command::commandLength()
+/// \return 0 for an unknown command, or if there aren't enough bytes to tell
+static inline uint16_t s3gCommandLength(const uint8_t *bytes, size_t available) {
+	switch (bytes[0]) {
+	case HOST_CMD_QUEUE_POINT_ABS:		return 17;
+	case HOST_CMD_QUEUE_POINT_EXT:		return 25;
+	case HOST_CMD_QUEUE_POINT_NEW:		return 26;
+	case HOST_CMD_CHANGE_TOOL:		return 2;
+	case HOST_CMD_ENABLE_AXES:		return 2;
+	case HOST_CMD_SET_POSITION:		return 13;
+	case HOST_CMD_SET_POSITION_EXT:		return 21;
+	case HOST_CMD_DELAY:			return 5;
+	case HOST_CMD_FIND_AXES_MINIMUM:	return 8;
+	case HOST_CMD_FIND_AXES_MAXIMUM:	return 8;
+	case HOST_CMD_WAIT_FOR_TOOL:		return 6;
+	case HOST_CMD_WAIT_FOR_PLATFORM:	return 6;
+	case HOST_CMD_STORE_HOME_POSITION:	return 2;
+	case HOST_CMD_RECALL_HOME_POSITION:	return 2;
+	case HOST_CMD_TOOL_COMMAND:
+		if ( available < 4 )	return 0;
+		return 4 + bytes[3];
+	case HOST_CMD_QUEUE_POINT_COMPACT:
+		if ( available < 3 )	return 0;
+		return compactmove::length(bytes[1], bytes[2]);
+	case HOST_CMD_QUEUE_ARC:		return ARC_COMMAND_LENGTH;
+	case HOST_CMD_RETRACT:			return 2;
+	case HOST_CMD_UNRETRACT:		return 2;
+	case HOST_CMD_MOOD_LIGHT_SET_RGB:	return 21;
+	case HOST_CMD_MOOD_LIGHT_SET_HSB:	return 17;
+	case HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT:	return 9;
+	case HOST_CMD_BUZZER_REPEATS:		return 2;
+	case HOST_CMD_BUZZER_BUZZ:		return 7;
+	}
+	return 0;
+}
+
+static inline int32_t s3gRead32(const uint8_t *p) {
+	return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static inline void s3gWrite32(uint8_t *p, int32_t value) {
+	for (int i = 0; i < 4; i ++)	p[i] = ((uint32_t)value >> (8 * i)) & 0xFF;
+}
+
+/// Read a whole file
+/// \return The contents, to be freed, or 0 after printing an error
+static inline uint8_t *s3gReadFile(const char *name, size_t &size) {
+	FILE *file = fopen(name, "rb");
+	if ( ! file ) {
+		perror(name);
+		return 0;
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	uint8_t *data = (uint8_t *)malloc(size ? size : 1);
+	if (( ! data ) || ( fread(data, 1, size, file) != size )) {
+		fprintf(stderr, "can't read %s\n", name);
+		fclose(file);
+		free(data);
+		return 0;
+	}
+	fclose(file);
+	return data;
+}
+
+#endif // S3GFILE_HH_
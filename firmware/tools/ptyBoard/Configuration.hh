@@ -0,0 +1,52 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PTY_BOARD_CONFIGURATION_HH_
+#define PTY_BOARD_CONFIGURATION_HH_
+
+// The stand-in runs the host and command code of a Gen3 board without
+// acceleration, with the host UART on a pseudo terminal and a tool that answers
+// everything at once.
+
+#ifndef F_CPU
+#define F_CPU                   16000000L
+#endif
+
+#define STEPPER_COUNT           5
+
+// --- Slave UART configuration ---
+// The tool is simulated, there's no slave UART.
+#define HAS_SLAVE_UART          0
+
+// --- Host UART configuration ---
+#define HOST_BAUD_RATE          115200
+#define HOST_PACKET_WINDOW      4
+#define UART_RX_BUFFER_SIZE     64
+#define MAX_PACKET_PAYLOAD      128
+#define PACKET_CRC_TABLE        1
+#define HOST_FAST_QUERIES       1
+
+#define HONOR_DEBUG_PACKETS     0
+
+// Traced, for s3gBench --latency
+#define COMMAND_TRACING         1
+
+// The UART code switches the RS485 transceiver with these, the stand-in has none.
+#define TX_ENABLE_PIN           Pin()
+#define RX_ENABLE_PIN           Pin()
+
+#endif // PTY_BOARD_CONFIGURATION_HH_
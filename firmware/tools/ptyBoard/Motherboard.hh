@@ -0,0 +1,67 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PTY_BOARD_MOTHERBOARD_HH_
+#define PTY_BOARD_MOTHERBOARD_HH_
+
+#include "UART.hh"
+#include "Types.hh"
+#include "Configuration.hh"
+
+/// Endstops of the stand-in, never triggered
+class StepperInterface {
+public:
+	bool isAtMaximum() { return false; }
+	bool isAtMinimum() { return false; }
+};
+
+/// Stand-in for the motherboard, on the host clock
+class Motherboard {
+private:
+	StepperInterface stepper[STEPPER_COUNT];
+	uint8_t error;
+	uint32_t error_count;
+
+	Motherboard();
+
+	static Motherboard motherboard;
+public:
+	void reset(bool hard_reset);
+
+	void runMotherboardSlice() {}
+
+	const int getStepperCount() const { return STEPPER_COUNT; }
+
+	StepperInterface& getStepperInterface(int n) { return stepper[n]; }
+
+	/// Microseconds of the host clock, wraps like the board's
+	micros_t getCurrentMicros();
+
+	void resetCurrentSeconds() {}
+
+	/// Count the error, the firmware only blinks a LED
+	void indicateError(int errorCode);
+
+	uint8_t getCurrentError() { return error; }
+
+	/// Number of errors indicated since the start
+	uint32_t getErrorCount() const { return error_count; }
+
+	static Motherboard& getBoard() { return motherboard; }
+};
+
+#endif // PTY_BOARD_MOTHERBOARD_HH_
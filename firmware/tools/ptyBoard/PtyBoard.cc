@@ -0,0 +1,228 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+// The host and command code of the motherboard, run on a pseudo terminal. An
+// unmodified host talks to it as to a board on a serial port; the moves are
+// timed but not stepped, and the tool answers at once. See SConstruct.
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include "Main.hh"
+#include "Motherboard.hh"
+#include "Host.hh"
+#include "Tool.hh"
+#include "Command.hh"
+#include "Steppers.hh"
+#include "SDCard.hh"
+#include "Eeprom.hh"
+#include "Scheduler.hh"
+#include "StatusSnapshot.hh"
+#include "PtyUART.hh"
+#include "StepSink.hh"
+#include "AvrPort.hh"
+
+/// EEPROM of the ATmega1280
+#define PTY_EEPROM_SIZE 4096
+
+uint8_t eeprom_memory[PTY_EEPROM_SIZE];
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+	return eeprom_memory[(size_t)address % PTY_EEPROM_SIZE];
+}
+
+uint16_t eeprom_read_word(const uint16_t* address) {
+	uint16_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+uint32_t eeprom_read_dword(const uint32_t* address) {
+	uint32_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+void eeprom_read_block(void* dest, const void* src, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		((uint8_t*)dest)[i] = eeprom_read_byte((const uint8_t*)src + i);
+	}
+}
+
+void eeprom_write_byte(uint8_t* address, uint8_t value) {
+	eeprom_memory[(size_t)address % PTY_EEPROM_SIZE] = value;
+}
+
+void eeprom_write_word(uint16_t* address, uint16_t value) {
+	eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_write_dword(uint32_t* address, uint32_t value) {
+	eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_write_block(const void* src, void* dest, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		eeprom_write_byte((uint8_t*)dest + i, ((const uint8_t*)src)[i]);
+	}
+}
+
+// The stand-in has no pins, writes go nowhere and reads are low
+AvrPort::AvrPort() : port_base(NULL_PORT) {
+}
+
+bool AvrPort::isNull() {
+	return true;
+}
+
+void AvrPort::setPinDirection(uint8_t pin_index, bool out) {
+}
+
+bool AvrPort::getPin(uint8_t pin_index) {
+	return false;
+}
+
+void AvrPort::setPin(uint8_t pin_index, bool on) {
+}
+
+Motherboard Motherboard::motherboard;
+
+Motherboard::Motherboard() :
+	error(0),
+	error_count(0) {
+}
+
+void Motherboard::reset(bool hard_reset) {
+	UART::getHostUART().enable(true);
+	UART::getHostUART().getInPacket().reset();
+	UART::getHostUART().reset();
+	UART::getHostUART().out.reset();
+}
+
+micros_t Motherboard::getCurrentMicros() {
+	return (micros_t)pty::getMicros();
+}
+
+void Motherboard::indicateError(int errorCode) {
+	error = errorCode;
+	error_count++;
+}
+
+void reset(bool hard_reset) {
+	Motherboard& board = Motherboard::getBoard();
+	sdcard::reset();
+	steppers::abort();
+	steppers::reset();
+	command::reset();
+	eeprom::init();
+	board.reset(hard_reset);
+	tool::reset();
+}
+
+void runMotherboardSlice() {
+	Motherboard::getBoard().runMotherboardSlice();
+}
+
+void runCommandSlice() {
+	command::runCommandSlice();
+	statussnapshot::update();
+}
+
+volatile sig_atomic_t running = 1;
+
+void stop(int signal) {
+	running = 0;
+}
+
+void printStats() {
+	const double seconds = pty::getMicros() / 1000000.0;
+	fprintf(stderr, "\n%.1fs at %u baud\n", seconds, pty::getBaudRate());
+	fprintf(stderr, "bytes received %u, sent %u, dropped %u\n",
+		pty::getBytesReceived(), pty::getBytesSent(), pty::getBytesDropped());
+	fprintf(stderr, "moves %u, moving %.1fs, waiting between moves %.1fs (longest %.1fms)\n",
+		sink::getMoveCount(), sink::getMotionMicros() / 1000000.0,
+		sink::getGapMicros() / 1000000.0, sink::getMaxGapMicros() / 1000.0);
+	fprintf(stderr, "errors %u\n", Motherboard::getBoard().getErrorCount());
+	for (uint8_t i = 0; i < scheduler::getTaskCount(); i++) {
+		scheduler::TaskStats stats;
+		scheduler::getStats(i, stats);
+		fprintf(stderr, "%-4s runs %u, mean %uus, max %uus, overruns %u\n", stats.name,
+			stats.runs, ( stats.runs ) ? stats.total / stats.runs : 0, stats.max,
+			stats.overruns);
+	}
+}
+
+void usage() {
+	fprintf(stderr, "Usage: ptyBoard [--link path] [--unpaced]\n"
+		"  --link path  Make a symlink to the terminal at path\n"
+		"  --unpaced    Don't hold the bytes to the baud rate\n");
+}
+
+int main(int argc, char** argv) {
+	const char* link = 0;
+	static struct option options[] = {
+		{ "link", required_argument, 0, 'l' },
+		{ "unpaced", no_argument, 0, 'u' },
+		{ 0, 0, 0, 0 }
+	};
+	int option;
+	while ((option = getopt_long(argc, argv, "l:u", options, 0)) != -1) {
+		switch (option) {
+		case 'l':
+			link = optarg;
+			break;
+		case 'u':
+			pty::setPaced(false);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	memset(eeprom_memory, 0xff, sizeof(eeprom_memory));
+	if (!pty::open(link)) {
+		perror("ptyBoard");
+		return 1;
+	}
+	printf("%s\n", ( link != 0 ) ? link : pty::getName());
+	fflush(stdout);
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	steppers::init(Motherboard::getBoard());
+	reset(true);
+
+	// The same tasks as Main.cc
+	scheduler::addTask(PSTR("Tool"), tool::runToolSlice, 2000L);
+	scheduler::addTask(PSTR("Host"), host::runHostSlice, 2000L);
+	scheduler::addTask(PSTR("Cmd"), runCommandSlice, 20000L, command::isStarving);
+	scheduler::addTask(PSTR("Brd"), runMotherboardSlice, 20000L);
+
+	while (running) {
+		pty::poll();
+		scheduler::runCycle();
+	}
+	printStats();
+	if (link != 0) {
+		unlink(link);
+	}
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "SDCard.hh"
+
+// The stand-in has no card in its slot
+
+namespace sdcard {
+
+void reset() {}
+
+SdErrorCode directoryReset() {
+	return SD_ERR_NO_CARD_PRESENT;
+}
+
+SdErrorCode directoryNextEntry(char* buffer, uint8_t bufsize) {
+	return SD_ERR_NO_CARD_PRESENT;
+}
+
+SdErrorCode startCapture(char* filename) {
+	return SD_ERR_NO_CARD_PRESENT;
+}
+
+void capturePacket(const Packet& packet) {}
+
+void captureBytes(const uint8_t* bytes, uint16_t length) {}
+
+uint32_t finishCapture() {
+	return 0;
+}
+
+bool isCapturing() {
+	return false;
+}
+
+SdErrorCode startPlayback(char* filename) {
+	return SD_ERR_NO_CARD_PRESENT;
+}
+
+float getPercentPlayed() {
+	return 0;
+}
+
+uint32_t getFileSize() {
+	return 0;
+}
+
+uint16_t getFileHash() {
+	return 0;
+}
+
+bool playbackHasNext() {
+	return false;
+}
+
+uint8_t playbackNext() {
+	return 0;
+}
+
+uint16_t playbackRead(uint8_t* dest, uint16_t len) {
+	return 0;
+}
+
+void playbackRestart() {}
+
+void playbackRewind(uint8_t bytes) {}
+
+void finishPlayback() {}
+
+bool isPlaying() {
+	return false;
+}
+
+} // namespace sdcard
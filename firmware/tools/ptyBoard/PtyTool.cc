@@ -0,0 +1,176 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "Tool.hh"
+#include "Commands.hh"
+
+// The tool of the stand-in answers every transaction on the next tool slice, and
+// is at its target temperature as soon as it's set. The answers go through the
+// packet code as they would over the slave UART.
+
+namespace tool {
+
+OutPacket out;
+InPacket in;
+bool transaction_active = false;
+bool locked = false;
+uint8_t tool_index = 0;
+
+uint16_t temperature[2];        ///< Targets of tool 0 and 1, also what they read
+uint16_t platform_temperature;
+bool request_platform;
+
+uint32_t sent_packet_count;
+
+InPacket& getInPacket() {
+	return in;
+}
+
+OutPacket& getOutPacket() {
+	return out;
+}
+
+uint32_t getSentPacketCount() {
+	return sent_packet_count;
+}
+
+uint32_t getPacketFailureCount() {
+	return 0;
+}
+
+uint32_t getRetryCount() {
+	return 0;
+}
+
+uint32_t getNoiseByteCount() {
+	return 0;
+}
+
+/// The answer of the simulated tool to the packet in #out
+void answer(OutPacket& reply) {
+	const uint8_t index = out.read8(0) & 1;
+	reply.append8(RC_OK);
+	switch (out.read8(1)) {
+	case SLAVE_CMD_VERSION:
+		reply.append16(VERSION);
+		break;
+	case SLAVE_CMD_SET_TEMP:
+		temperature[index] = out.read16(2);
+		break;
+	case SLAVE_CMD_SET_PLATFORM_TEMP:
+		platform_temperature = out.read16(2);
+		break;
+	case SLAVE_CMD_GET_TEMP:
+	case SLAVE_CMD_GET_SP:
+		reply.append16(temperature[index]);
+		break;
+	case SLAVE_CMD_GET_PLATFORM_TEMP:
+	case SLAVE_CMD_GET_PLATFORM_SP:
+		reply.append16(platform_temperature);
+		break;
+	case SLAVE_CMD_IS_TOOL_READY:
+	case SLAVE_CMD_IS_PLATFORM_READY:
+		reply.append8(1);
+		break;
+	case SLAVE_CMD_GET_TOOL_STATUS:
+		reply.append8(1);	// Ready
+		break;
+	case SLAVE_CMD_READ_FROM_EEPROM:
+		// Erased
+		for (uint8_t i = 0; i < out.read8(4) && i < 16; i++) {
+			reply.append8(0xff);
+		}
+		break;
+	}
+}
+
+void runToolSlice() {
+	if (transaction_active) {
+		OutPacket reply;
+		answer(reply);
+		in.reset();
+		while (!reply.isFinished()) {
+			in.processByte(reply.getNextByteToSend());
+		}
+		transaction_active = false;
+	}
+}
+
+bool reset() {
+	temperature[0] = 0;
+	temperature[1] = 0;
+	platform_temperature = 0;
+	transaction_active = false;
+	locked = false;
+	return true;
+}
+
+bool test() {
+	sent_packet_count = 0;
+	return true;
+}
+
+bool getLock() {
+	if (transaction_active || locked)
+		return false;
+	locked = true;
+	return true;
+}
+
+void releaseLock() {
+	locked = false;
+}
+
+// A transaction is answered in one slice
+bool waitForLock() {
+	if (transaction_active) {
+		runToolSlice();
+	}
+	return getLock();
+}
+
+void startTransaction() {
+	sent_packet_count++;
+	transaction_active = true;
+	in.reset();
+}
+
+bool isTransactionDone() {
+	return !transaction_active;
+}
+
+uint16_t getCachedTemperature(uint8_t index) {
+	return ( index < 2 ) ? temperature[index] : 0;
+}
+
+uint16_t getCachedPlatformTemperature() {
+	return platform_temperature;
+}
+
+bool requestTemperatures() {
+	return true;
+}
+
+void setCurrentToolheadIndex(uint8_t tool_index_in) {
+	tool_index = tool_index_in;
+}
+
+uint8_t getCurrentToolheadIndex() {
+	return tool_index;
+}
+
+}
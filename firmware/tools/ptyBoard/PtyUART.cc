@@ -0,0 +1,190 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#define _XOPEN_SOURCE 600
+#include "PtyUART.hh"
+#include "Configuration.hh"
+#include <avr/io.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/// How long an idle board waits for the host in poll()
+#define PTY_IDLE_MICROS 50
+
+/// Bytes read from the terminal that the UART hasn't taken yet, the host's side
+/// of the line
+#define PTY_RX_STAGING 256
+
+extern "C" void USART0_RX_vect();
+extern "C" void USART0_TX_vect();
+
+UartDataRegister UDR0;
+volatile uint8_t UBRR0H;
+volatile uint8_t UBRR0L;
+volatile uint8_t UCSR0A;
+volatile uint8_t UCSR0B;
+volatile uint8_t UCSR0C;
+
+namespace pty {
+
+int master_fd = -1;
+int slave_fd = -1;             ///< Kept open so the master reads don't fail without a host
+const char* name;
+bool paced = true;
+uint64_t start_nanos;
+
+uint8_t rx_staging[PTY_RX_STAGING];
+uint16_t rx_head;
+uint16_t rx_count;
+uint8_t rx_data;                ///< What reading UDR0 gives
+uint64_t rx_next;               ///< When the UART can take the next byte
+
+bool tx_busy;
+uint64_t tx_done;               ///< When the byte in UDR0 is out
+
+uint32_t bytes_received;
+uint32_t bytes_sent;
+uint32_t bytes_dropped;
+
+uint64_t getMicros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec - start_nanos) / 1000;
+}
+
+uint32_t getBaudRate() {
+	uint16_t ubrr = ((uint16_t)UBRR0H << 8) | UBRR0L;
+	uint8_t divider = ( UCSR0A & _BV(U2X0) ) ? 8 : 16;
+	return F_CPU / ((uint32_t)divider * (ubrr + 1));
+}
+
+/// Microseconds a byte takes on the line, with a start and a stop bit
+uint32_t getByteMicros() {
+	return ( paced ) ? 10000000L / getBaudRate() : 0;
+}
+
+bool open(const char* link) {
+	start_nanos = 0;
+	start_nanos = getMicros() * 1000;
+	master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+		return false;
+	}
+	name = ptsname(master_fd);
+	slave_fd = ::open(name, O_RDWR | O_NOCTTY);
+	if (slave_fd < 0) {
+		return false;
+	}
+	// Raw until the host sets it up, the line discipline mustn't touch the packets
+	struct termios tio;
+	tcgetattr(slave_fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave_fd, TCSANOW, &tio);
+	if (link != 0) {
+		unlink(link);
+		if (symlink(name, link) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const char* getName() {
+	return name;
+}
+
+void setPaced(bool paced_in) {
+	paced = paced_in;
+}
+
+/// The firmware wrote UDR0: the byte goes to the host, the transmit complete
+/// interrupt comes a byte time later
+void transmit(uint8_t b) {
+	if (write(master_fd, &b, 1) == 1) {
+		bytes_sent++;
+	} else {
+		// The host isn't reading, the byte is lost as it would be on the wire
+		bytes_dropped++;
+	}
+	tx_busy = true;
+	tx_done = getMicros() + getByteMicros();
+}
+
+void poll() {
+	if (rx_count < PTY_RX_STAGING) {
+		uint16_t tail = (rx_head + rx_count) % PTY_RX_STAGING;
+		uint16_t room = ( tail >= rx_head ) ? PTY_RX_STAGING - tail : rx_head - tail;
+		ssize_t n = read(master_fd, rx_staging + tail, room);
+		if (n > 0) {
+			rx_count += n;
+		}
+	}
+	if (rx_count == 0 && !tx_busy) {
+		struct pollfd p = { master_fd, POLLIN, 0 };
+		if (::poll(&p, 1, 0) <= 0 || (p.revents & POLLHUP)) {
+			usleep(PTY_IDLE_MICROS);
+		}
+		return;
+	}
+	uint64_t now = getMicros();
+	if (rx_count > 0 && now >= rx_next) {
+		rx_data = rx_staging[rx_head];
+		rx_head = (rx_head + 1) % PTY_RX_STAGING;
+		rx_count--;
+		rx_next = now + getByteMicros();
+		// With the receiver off the byte is lost
+		if (UCSR0B & _BV(RXCIE0)) {
+			bytes_received++;
+			USART0_RX_vect();
+		}
+	}
+	if (tx_busy && now >= tx_done) {
+		tx_busy = false;
+		if (UCSR0B & _BV(TXCIE0)) {
+			USART0_TX_vect();
+		}
+	}
+}
+
+uint32_t getBytesReceived() {
+	return bytes_received;
+}
+
+uint32_t getBytesSent() {
+	return bytes_sent;
+}
+
+uint32_t getBytesDropped() {
+	return bytes_dropped;
+}
+
+} // namespace pty
+
+UartDataRegister& UartDataRegister::operator=(uint8_t value) {
+	pty::transmit(value);
+	return *this;
+}
+
+UartDataRegister::operator uint8_t() const {
+	return pty::rx_data;
+}
@@ -0,0 +1,57 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef PTY_UART_HH_
+#define PTY_UART_HH_
+
+#include <stdint.h>
+
+/// The host UART registers of the stand-in, on a pseudo terminal. The firmware's
+/// own UART code runs on them: poll() calls its receive and transmit complete
+/// interrupts as a UART at the baud rate in UBRR0 would, so a host sees the line
+/// speed of the board, and a baud rate change by the host takes effect.
+namespace pty {
+
+/// Open the pseudo terminal
+/// \param[in] link Path of a symlink to make to the terminal, or 0
+/// \return False if it couldn't be opened
+bool open(const char* link);
+
+/// Name of the terminal the host opens
+const char* getName();
+
+/// Time the bytes at the baud rate (the default), or move them as soon as they come
+void setPaced(bool paced);
+
+/// Baud rate set by the firmware
+uint32_t getBaudRate();
+
+/// Move the bytes that are due and run the interrupts for them. When there's
+/// nothing to do it waits a little for the host, so an idle board doesn't spin.
+void poll();
+
+/// Host clock, in microseconds since open()
+uint64_t getMicros();
+
+/// Bytes received and sent, and sent bytes the host didn't read in time
+uint32_t getBytesReceived();
+uint32_t getBytesSent();
+uint32_t getBytesDropped();
+
+} // namespace pty
+
+#endif // PTY_UART_HH_
@@ -0,0 +1,41 @@
+/*
+ * s3gBench Serial Port Speed
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "SerialSpeed.hh"
+
+#if HAS_CUSTOM_SPEED
+
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+bool setCustomSpeed(int fd, uint32_t baud) {
+	struct termios2 tio;
+	if ( ioctl(fd, TCGETS2, &tio) != 0 )	return false;
+	tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+	tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+	tio.c_ispeed = baud;
+	tio.c_ospeed = baud;
+	return ioctl(fd, TCSETS2, &tio) == 0;
+}
+
+#else
+
+bool setCustomSpeed(int, uint32_t) {
+	return false;
+}
+
+#endif // HAS_CUSTOM_SPEED
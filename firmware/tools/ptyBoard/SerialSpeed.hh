@@ -0,0 +1,36 @@
+/*
+ * s3gBench Serial Port Speed
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef SERIAL_SPEED_HH_
+#define SERIAL_SPEED_HH_
+
+#include <stdint.h>
+
+/// Only Linux can set a baud rate termios has no B constant for (termios2, BOTHER)
+#ifdef __linux__
+#define HAS_CUSTOM_SPEED 1
+#else
+#define HAS_CUSTOM_SPEED 0
+#endif
+
+/// Set a port, already in raw mode, to any baud rate, such as 250000. Kept apart
+/// from the code using <termios.h>, which declares the same structs as the
+/// kernel header this needs.
+/// \return False if the system or the port can't
+bool setCustomSpeed(int fd, uint32_t baud);
+
+#endif // SERIAL_SPEED_HH_
@@ -0,0 +1,246 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include "StepSink.hh"
+#include "Steppers.hh"
+#include "PtyUART.hh"
+#include "Eeprom.hh"
+#include "EepromMap.hh"
+#include "CommandTrace.hh"
+
+namespace steppers {
+
+Point start;                    ///< Where the move started
+Point target;                   ///< Where it ends
+uint64_t move_start;
+uint64_t move_end;
+bool is_running;
+bool is_homing;
+bool enabled[STEPPER_COUNT];
+uint8_t move_trace;             ///< The command the move belongs to
+
+}
+
+namespace sink {
+
+uint32_t move_count;
+uint64_t motion_micros;
+uint64_t gap_micros;
+uint32_t max_gap_micros;
+
+/// Start a move from the current position, taking us
+void startMove(const Point& to, int32_t us) {
+	using namespace steppers;
+	const uint64_t now = pty::getMicros();
+	if (move_count > 0 && now - move_end < SINK_IDLE_MICROS) {
+		const uint32_t gap = now - move_end;
+		gap_micros += gap;
+		if (gap > max_gap_micros) {
+			max_gap_micros = gap;
+		}
+	}
+	start = getPosition();
+	target = to;
+	move_start = now;
+	move_end = now + ( ( us > 0 ) ? us : 0 );
+	move_count++;
+	motion_micros += move_end - move_start;
+	// Without a planner the move starts at once and replaces the one before
+	COMMAND_TRACE_BLOCK_FINISHED(move_trace);
+#if COMMAND_TRACING
+	move_trace = commandtrace::blockQueued();
+#endif
+	COMMAND_TRACE_BLOCK_STARTED(move_trace);
+	is_running = true;
+}
+
+uint32_t getMoveCount() {
+	return move_count;
+}
+
+uint64_t getMotionMicros() {
+	return motion_micros;
+}
+
+uint64_t getGapMicros() {
+	return gap_micros;
+}
+
+uint32_t getMaxGapMicros() {
+	return max_gap_micros;
+}
+
+} // namespace sink
+
+namespace steppers {
+
+/// Finish the move once its time is up
+void update() {
+	if (( is_running || is_homing ) && pty::getMicros() >= move_end) {
+		start = target;
+		is_running = false;
+		is_homing = false;
+		COMMAND_TRACE_BLOCK_FINISHED(move_trace);
+		move_trace = 0;
+	}
+}
+
+void init(Motherboard& motherboard) {
+	reset();
+}
+
+void reset() {
+	abort();
+}
+
+bool isRunning() {
+	update();
+	return is_running || is_homing;
+}
+
+bool isQueueFull() {
+	return isRunning();
+}
+
+uint8_t getQueueDepth() {
+	return ( isRunning() ) ? 1 : 0;
+}
+
+bool isHoming() {
+	update();
+	return is_homing;
+}
+
+void abort() {
+	target = getPosition();
+	start = target;
+	is_running = false;
+	is_homing = false;
+	COMMAND_TRACE_BLOCK_FINISHED(move_trace);
+	move_trace = 0;
+}
+
+void enableAxis(uint8_t index, bool enable) {
+	if (index < STEPPER_COUNT) {
+		enabled[index] = enable;
+	}
+}
+
+bool isEnabledAxis(uint8_t index) {
+	return ( index < STEPPER_COUNT ) ? enabled[index] : false;
+}
+
+void setTarget(const Point& target_in, int32_t dda_interval) {
+	const Point from = getPosition();
+	int32_t max_delta = 0;
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		int32_t delta = target_in[i] - from[i];
+		if (delta < 0) delta = -delta;
+		if (delta > max_delta) {
+			max_delta = delta;
+		}
+	}
+	sink::startMove(target_in, max_delta * dda_interval);
+}
+
+void setTargetNew(const Point& target_in, int32_t us, uint8_t relative) {
+	Point to = target_in;
+	const Point from = getPosition();
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		if ((relative & (1 << i)) != 0) {
+			to[i] = from[i] + target_in[i];
+		}
+	}
+	sink::startMove(to, us);
+}
+
+/// The endstops are at 0, the homed axes go there from where they are
+void startHoming(const bool maximums, const uint8_t axes_enabled, const uint32_t us_per_step) {
+	Point to = getPosition();
+	int32_t max_delta = 0;
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		if ((axes_enabled & (1 << i)) != 0) {
+			int32_t delta = ( to[i] < 0 ) ? -to[i] : to[i];
+			if (delta > max_delta) {
+				max_delta = delta;
+			}
+			to[i] = 0;
+		}
+	}
+	sink::startMove(to, max_delta * us_per_step);
+	is_running = false;
+	is_homing = true;
+}
+
+void definePosition(const Point& position) {
+	abort();
+	start = position;
+	target = position;
+}
+
+void doLcd() {}
+
+bool doInterrupt() {
+	return isRunning();
+}
+
+bool doAdvanceInterrupt() {
+	return false;
+}
+
+/// Part way through a move, the position is interpolated
+const Point getPosition() {
+	update();
+	if (!is_running && !is_homing) {
+		return start;
+	}
+	const uint64_t now = pty::getMicros();
+	const double done = (double)(now - move_start) / (double)(move_end - move_start);
+	Point position;
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		position[i] = start[i] + (int32_t)((target[i] - start[i]) * done);
+	}
+	return position;
+}
+
+float getStepsPerMM(uint8_t index) {
+	int64_t fallback;
+	switch (index) {
+	case 0:		fallback = STEPS_PER_MM_X_DEFAULT;	break;
+	case 1:		fallback = STEPS_PER_MM_Y_DEFAULT;	break;
+	case 2:		fallback = STEPS_PER_MM_Z_DEFAULT;	break;
+	case 3:		fallback = STEPS_PER_MM_A_DEFAULT;	break;
+	default:	fallback = STEPS_PER_MM_B_DEFAULT;	break;
+	}
+	float steps_per_mm = (float)eeprom::getEepromStepsPerMM(eeprom::STEPS_PER_MM_X + 8 * index, fallback);
+	for (uint8_t i = 0; i < STEPS_PER_MM_PRECISION; i++) {
+		steps_per_mm /= 10.0;
+	}
+	return steps_per_mm;
+}
+
+void setHoldZ(bool holdZ) {}
+
+bool isAtMaximum(uint8_t index) {
+	return false;
+}
+
+bool isAtMinimum(uint8_t index) {
+	return false;
+}
+
+} // namespace steppers
@@ -0,0 +1,47 @@
+/*
+ * PTY Stand-in Motherboard
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef STEP_SINK_HH_
+#define STEP_SINK_HH_
+
+#include <stdint.h>
+
+/// Gaps between moves longer than this are the machine standing idle, not
+/// the host falling behind
+#define SINK_IDLE_MICROS 1000000L
+
+/// The steppers:: of the stand-in take each move for as long as the board would
+/// step it, on the host clock, without stepping anything. How long the motion sat
+/// waiting for the next move shows how well the host keeps up.
+namespace sink {
+
+/// Moves taken since the start
+uint32_t getMoveCount();
+
+/// Time spent moving (microseconds)
+uint64_t getMotionMicros();
+
+/// Time between the end of a move and the start of the next, counting only gaps
+/// shorter than SINK_IDLE_MICROS (microseconds)
+uint64_t getGapMicros();
+
+/// Longest such gap (microseconds)
+uint32_t getMaxGapMicros();
+
+} // namespace sink
+
+#endif // STEP_SINK_HH_
@@ -0,0 +1,24 @@
+#ifndef PTY_BOARD_AVR_EEPROM_H_
+#define PTY_BOARD_AVR_EEPROM_H_
+
+/*
+ * eeprom.h
+ *
+ * The EEPROM of the stand-in is an array in RAM, it starts out erased (0xff) on
+ * every run. See PtyBoard.cc.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+uint16_t eeprom_read_word(const uint16_t* address);
+uint32_t eeprom_read_dword(const uint32_t* address);
+void eeprom_read_block(void* dest, const void* src, size_t length);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+void eeprom_write_word(uint16_t* address, uint16_t value);
+void eeprom_write_dword(uint32_t* address, uint32_t value);
+void eeprom_write_block(const void* src, void* dest, size_t length);
+
+#endif // PTY_BOARD_AVR_EEPROM_H_
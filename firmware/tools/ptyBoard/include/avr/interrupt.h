@@ -0,0 +1,18 @@
+#ifndef PTY_BOARD_AVR_INTERRUPT_H_
+#define PTY_BOARD_AVR_INTERRUPT_H_
+
+/*
+ * interrupt.h
+ *
+ * The stand-in runs everything on one thread, there's nothing to lock out. The
+ * interrupt handlers are plain functions, called by the main loop when the
+ * pseudo terminal has something for them.
+ */
+#include <avr/io.h>
+
+static inline void cli() {}
+static inline void sei() {}
+
+#define ISR(vector) extern "C" void vector()
+
+#endif // PTY_BOARD_AVR_INTERRUPT_H_
@@ -0,0 +1,41 @@
+#ifndef PTY_BOARD_AVR_IO_H_
+#define PTY_BOARD_AVR_IO_H_
+
+/*
+ * io.h
+ *
+ * The only registers of the stand-in are those of the host UART, as on the
+ * ATmega1280. They're backed by the pseudo terminal, see PtyUART.cc.
+ */
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+/// The data register of the host UART: a byte written to it goes out on the
+/// pseudo terminal, reading it gives the byte just received.
+class UartDataRegister {
+public:
+	UartDataRegister& operator=(uint8_t value);
+	operator uint8_t() const;
+};
+
+extern UartDataRegister UDR0;
+extern volatile uint8_t UBRR0H;
+extern volatile uint8_t UBRR0L;
+extern volatile uint8_t UCSR0A;
+extern volatile uint8_t UCSR0B;
+extern volatile uint8_t UCSR0C;
+
+// UCSR0A
+#define TXC0    6
+#define U2X0    1
+// UCSR0B
+#define RXCIE0  7
+#define TXCIE0  6
+#define RXEN0   4
+#define TXEN0   3
+// UCSR0C
+#define UCSZ01  2
+#define UCSZ00  1
+
+#endif // PTY_BOARD_AVR_IO_H_
@@ -0,0 +1,21 @@
+#ifndef PTY_BOARD_AVR_PGMSPACE_H_
+#define PTY_BOARD_AVR_PGMSPACE_H_
+
+/*
+ * pgmspace.h
+ *
+ * Program memory is ordinary memory on the host.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+typedef char prog_char;
+typedef unsigned char prog_uchar;
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_byte_near pgm_read_byte
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define PSTR(s) (s)
+
+#endif // PTY_BOARD_AVR_PGMSPACE_H_
@@ -0,0 +1,11 @@
+#ifndef PTY_BOARD_AVR_SFR_DEFS_H_
+#define PTY_BOARD_AVR_SFR_DEFS_H_
+
+/*
+ * sfr_defs.h
+ *
+ * See io.h for the registers of the stand-in.
+ */
+#include <avr/io.h>
+
+#endif // PTY_BOARD_AVR_SFR_DEFS_H_
@@ -0,0 +1,15 @@
+#ifndef PTY_BOARD_UTIL_ATOMIC_H_
+#define PTY_BOARD_UTIL_ATOMIC_H_
+
+/*
+ * atomic.h
+ *
+ * The stand-in runs everything on one thread, the block just runs once.
+ */
+#include <avr/interrupt.h>
+
+#define ATOMIC_BLOCK(type) for (int atomic_once = 1; atomic_once; atomic_once = 0)
+#define ATOMIC_FORCEON 0
+#define ATOMIC_RESTORESTATE 0
+
+#endif // PTY_BOARD_UTIL_ATOMIC_H_
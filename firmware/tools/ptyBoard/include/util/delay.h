@@ -0,0 +1,12 @@
+#ifndef PTY_BOARD_UTIL_DELAY_H_
+#define PTY_BOARD_UTIL_DELAY_H_
+
+/*
+ * delay.h
+ */
+#include <unistd.h>
+
+static inline void _delay_us(double us) { usleep((useconds_t)us); }
+static inline void _delay_ms(double ms) { usleep((useconds_t)(ms * 1000)); }
+
+#endif // PTY_BOARD_UTIL_DELAY_H_
@@ -0,0 +1,447 @@
+/*
+ * s3gBench - sends .s3g files to a board and measures how the link keeps up
+ *
+ * Sends the commands of each file as a host does, one command per packet and
+ * again after a delay when the board answers RC_BUFFER_OVERFLOW, and reports
+ * the commands per second, how often the buffer overflowed, and the round trip
+ * times of the packets. Meant for ptyBoard, works with a board on a serial port.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Packet.hh"
+#include "S3gFile.hh"
+#include "SerialSpeed.hh"
+
+static void usage() {
+	printf("Usage: s3gBench [options] port file.s3g...\n"
+	       "\n"
+	       "  --baud=n          switch the board to n baud first (HOST_CMD_SET_BAUD_RATE),\n"
+	       "                    rates without a termios speed such as 250000 only on Linux\n"
+	       "  --batch           send the commands in HOST_CMD_BATCH packets\n"
+	       "  --extended        batches as big as the board takes, with extended framing\n"
+	       "  --isr-load=n      report the load of interrupt n (0 steppers, 1 interface,\n"
+	       "                    2 advance) standing still and while the file runs, the\n"
+	       "                    board has to be built with ISR_PROFILING\n"
+	       "  --latency         report the time the commands spent in the board, it has to\n"
+	       "                    be built with COMMAND_TRACING\n"
+	       "  --retry-delay=us  wait before sending again after RC_BUFFER_OVERFLOW (1000)\n"
+	       "  --timeout=ms      wait for a response before sending again (1000)\n");
+}
+
+static int port;
+static uint32_t retry_delay_us	= 1000;
+static int timeout_ms		= 1000;
+static int isr_load		= -1;	///< Interrupt of --isr-load, -1 for none
+
+/// The ISR_PROFILING timer runs at F_CPU, the boards that have it run at 16MHz
+static const double cycles_per_us	= 16.0;
+
+static uint64_t micros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// \return B0 for the rates setCustomSpeed() has to set
+static speed_t termiosSpeed(uint32_t baud) {
+	switch (baud) {
+	case 38400:	return B38400;
+	case 57600:	return B57600;
+	case 115200:	return B115200;
+	case 230400:	return B230400;
+	case 500000:	return B500000;
+	case 1000000:	return B1000000;
+	}
+	return B0;
+}
+
+static bool setSpeed(uint32_t baud) {
+	struct termios tio;
+	if ( tcgetattr(port, &tio) != 0 )	return false;
+	cfmakeraw(&tio);
+	const speed_t speed = termiosSpeed(baud);
+	if ( speed != B0 ) {
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+	}
+	if ( tcsetattr(port, TCSANOW, &tio) != 0 )	return false;
+	return ( speed != B0 ) || setCustomSpeed(port, baud);
+}
+
+/// Time an interrupt took, over the time its profile was taken
+struct IsrLoad {
+	uint64_t cycles;
+	uint64_t us;
+	uint16_t max;			///< Cycles
+	uint32_t missed;		///< Deadlines
+	uint64_t since;			///< When the profile was last cleared, 0 before
+	bool profiled;
+
+	IsrLoad() : cycles(0), us(0), max(0), missed(0), since(0), profiled(true) {}
+};
+
+/// Counts of one run
+struct Stats {
+	uint32_t commands;
+	uint32_t packets;		///< Including the ones sent again
+	uint32_t overflows;
+	uint32_t timeouts;
+	uint32_t errors;		///< Any other response code
+	std::vector<uint32_t> round_trips;	///< Microseconds, of every packet answered
+
+	Stats() : commands(0), packets(0), overflows(0), timeouts(0), errors(0) {}
+};
+
+/// Send a packet and wait for its response
+/// \return False if none came within timeout_ms
+static bool transact(OutPacket &out, InPacket &in, Stats &stats) {
+	out.prepareForResend();
+	uint8_t frame[MAX_PACKET_PAYLOAD + 8];
+	size_t length = 0;
+	while ( ! out.isFinished() )	frame[length ++] = out.getNextByteToSend();
+
+	stats.packets ++;
+	const uint64_t start = micros();
+	if ( write(port, frame, length) != (ssize_t)length )	return false;
+
+	in.reset();
+	struct pollfd p = { port, POLLIN, 0 };
+	while ( true ) {
+		if ( poll(&p, 1, timeout_ms) <= 0 ) {
+			stats.timeouts ++;
+			return false;
+		}
+		uint8_t buffer[64];
+		ssize_t n = read(port, buffer, sizeof(buffer));
+		for (ssize_t i = 0; i < n; i ++) {
+			in.processByte(buffer[i]);
+			if ( in.hasError() )	in.reset();
+			if ( ! in.isFinished() )	continue;
+			// Telemetry frames aren't responses
+			if ( in.read8(0) == RC_TELEMETRY ) {
+				in.reset();
+				continue;
+			}
+			stats.round_trips.push_back(micros() - start);
+			return true;
+		}
+	}
+}
+
+/// Send a packet until the board takes it
+/// \return The response code, 0 if the board never answered
+static uint8_t send(OutPacket &out, InPacket &in, Stats &stats) {
+	for (int attempt = 0; attempt < 10; ) {
+		if ( ! transact(out, in, stats) ) {
+			attempt ++;
+			continue;
+		}
+		uint8_t rc = in.read8(0);
+		if ( rc != RC_BUFFER_OVERFLOW ) {
+			if ( rc != RC_OK )	stats.errors ++;
+			return rc;
+		}
+		stats.overflows ++;
+		if ( out.read8(0) == HOST_CMD_BATCH )	return rc;
+		usleep(retry_delay_us);
+	}
+	return 0;
+}
+
+/// Switch the board and the port to another baud rate
+static bool negotiateBaudRate(uint32_t baud) {
+	if (( termiosSpeed(baud) == B0 ) && ( ! HAS_CUSTOM_SPEED )) {
+		fprintf(stderr, "s3gBench: %u baud has no termios speed here, only Linux can set it;"
+			" use 38400, 57600, 115200, 230400, 500000 or 1000000\n", baud);
+		return false;
+	}
+	Stats stats;
+	OutPacket out;
+	InPacket in;
+	out.append8(HOST_CMD_SET_BAUD_RATE);
+	out.append32(baud);
+	if (( send(out, in, stats) != RC_OK ) || ( ! setSpeed(baud) )) {
+		fprintf(stderr, "s3gBench: the board didn't take %u baud\n", baud);
+		return false;
+	}
+	// The first packet at the new rate confirms it
+	out.reset();
+	out.append8(HOST_CMD_VERSION);
+	out.append16(0);
+	return send(out, in, stats) == RC_OK;
+}
+
+/// Biggest payload the board takes, with extended framing
+static uint16_t getPayloadLimit() {
+	Stats stats;
+	OutPacket out;
+	InPacket in;
+	out.append8(HOST_CMD_GET_PACKET_LIMITS);
+	if ( send(out, in, stats) != RC_OK )	return LEGACY_PACKET_PAYLOAD;
+	return std::min((uint16_t)in.read16(1), (uint16_t)MAX_PACKET_PAYLOAD);
+}
+
+/// Add the profile of the --isr-load interrupt since it was last cleared to load,
+/// and clear it. See HOST_CMD_GET_ISR_PROFILE.
+static void sampleIsrLoad(IsrLoad &load) {
+	Stats stats;
+	OutPacket out;
+	InPacket in;
+	out.append8(HOST_CMD_GET_ISR_PROFILE);
+	out.append8(isr_load);
+	out.append8(0x01);
+	if ( send(out, in, stats) != RC_OK ) {
+		load.profiled = false;
+		return;
+	}
+	const uint64_t now = micros();
+	if ( load.since != 0 ) {
+		// Sampled often enough that the board doesn't halve its counts
+		load.cycles += (uint64_t)in.read16(1) * in.read16(3);
+		load.us += now - load.since;
+		load.max = std::max(load.max, (uint16_t)in.read16(5));
+		load.missed += in.read16(7);
+	}
+	load.since = now;
+}
+
+/// Sample the load every half second while it's measured
+static void pollIsrLoad(IsrLoad &load) {
+	if (( isr_load >= 0 ) && ( micros() - load.since >= 500000 ))	sampleIsrLoad(load);
+}
+
+/// Wait for the board to finish its moves
+static bool waitForMoves(IsrLoad &load) {
+	Stats stats;
+	OutPacket out;
+	InPacket in;
+	out.append8(HOST_CMD_IS_FINISHED);
+	while ( true ) {
+		if ( send(out, in, stats) != RC_OK )	return false;
+		if ( in.read8(1) != 0 )	return true;
+		pollIsrLoad(load);
+		usleep(100000);
+	}
+}
+
+/// Send the commands of a file
+static bool run(const uint8_t *data, size_t size, uint16_t batch_limit, bool extended,
+		Stats &stats, IsrLoad &load) {
+	OutPacket out;
+	InPacket in;
+	size_t offset = 0;
+	while ( offset < size ) {
+		pollIsrLoad(load);
+		uint16_t length = s3gCommandLength(data + offset, size - offset);
+		if (( length == 0 ) || ( offset + length > size )) {
+			fprintf(stderr, "s3gBench: bad command %u at offset %lu\n", data[offset], (unsigned long)offset);
+			return false;
+		}
+		out.reset();
+		if (( batch_limit > 0 ) && ( length < batch_limit )) {
+			if ( extended )	out.setExtended();
+			out.append8(HOST_CMD_BATCH);
+			uint8_t count = 0;
+			while (( offset < size ) && ( out.getLength() + length <= batch_limit )) {
+				for (uint16_t i = 0; i < length; i ++)	out.append8(data[offset + i]);
+				offset += length;
+				count ++;
+				if ( offset < size )	length = s3gCommandLength(data + offset, size - offset);
+				if (( length == 0 ) || ( offset + length > size ))	break;
+			}
+			uint8_t rc = send(out, in, stats);
+			if ( rc == RC_BUFFER_OVERFLOW ) {
+				// Back to the first command the board didn't queue
+				uint8_t queued = in.read8(1);
+				offset -= out.getLength() - 1;
+				for (uint8_t i = 0; i < queued; i ++)	offset += s3gCommandLength(data + offset, size - offset);
+				stats.commands += queued;
+				usleep(retry_delay_us);
+				continue;
+			}
+			if ( rc != RC_OK )	return false;
+			stats.commands += count;
+		} else {
+			for (uint16_t i = 0; i < length; i ++)	out.append8(data[offset + i]);
+			if ( send(out, in, stats) == 0 )	return false;
+			offset += length;
+			stats.commands ++;
+		}
+	}
+	return true;
+}
+
+/// Read the latency of one stage of the commands in the board, and clear them all
+/// when asked. See HOST_CMD_GET_COMMUNICATION_STATS.
+static bool getLatency(uint8_t stage, bool clear, uint16_t &samples, uint32_t &mean, uint32_t &max) {
+	Stats stats;
+	OutPacket out;
+	InPacket in;
+	out.append8(HOST_CMD_GET_COMMUNICATION_STATS);
+	out.append8(stage + 1);
+	out.append8(( clear ) ? 0x01 : 0x00);
+	if ( send(out, in, stats) != RC_OK )	return false;
+	samples = in.read16(1);
+	mean = in.read32(3);
+	max = in.read32(7);
+	return true;
+}
+
+static void reportLatency() {
+	static const char *stages[] = { "queue", "planner", "motion", "total" };
+	printf("  latency us:");
+	for (uint8_t stage = 0; stage < 4; stage ++) {
+		uint16_t samples;
+		uint32_t mean, max;
+		if ( ! getLatency(stage, false, samples, mean, max) ) {
+			printf(" not traced\n");
+			return;
+		}
+		printf(" %s %u/%u", stages[stage], mean, max);
+	}
+	printf(" (mean/max)\n");
+}
+
+static void reportIsrLoad(const IsrLoad &idle, const IsrLoad &running) {
+	if (( ! idle.profiled ) || ( ! running.profiled )) {
+		printf("  isr %d load: not profiled\n", isr_load);
+		return;
+	}
+	const IsrLoad *loads[] = { &idle, &running };
+	printf("  isr %d load:", isr_load);
+	for (int i = 0; i < 2; i ++) {
+		const IsrLoad &l = *loads[i];
+		printf(" %s %.2f%% (max %u cycles, %u missed)", ( i == 0 ) ? "idle" : "running",
+		       ( l.us ) ? 100.0 * l.cycles / (l.us * cycles_per_us) : 0, l.max, l.missed);
+	}
+	printf("\n");
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, uint32_t percent) {
+	if ( sorted.empty() )	return 0;
+	return sorted[std::min(sorted.size() - 1, sorted.size() * percent / 100)];
+}
+
+static void report(const char *name, const Stats &stats, uint64_t us) {
+	std::vector<uint32_t> sorted = stats.round_trips;
+	std::sort(sorted.begin(), sorted.end());
+	const double seconds = us / 1000000.0;
+	printf("%s: %u commands in %.2f s, %.0f commands/s\n", name, stats.commands, seconds,
+	       ( seconds > 0 ) ? stats.commands / seconds : 0);
+	printf("  packets %u, buffer overflows %u (%.1f%%), timeouts %u, errors %u\n", stats.packets,
+	       stats.overflows, ( stats.packets ) ? 100.0 * stats.overflows / stats.packets : 0,
+	       stats.timeouts, stats.errors);
+	printf("  round trip us: p50 %u, p90 %u, p99 %u, max %u\n", percentile(sorted, 50),
+	       percentile(sorted, 90), percentile(sorted, 99), ( sorted.empty() ) ? 0 : sorted.back());
+}
+
+int main(int argc, char **argv) {
+	uint32_t baud	= 0;
+	bool batch	= false;
+	bool extended	= false;
+	bool latency	= false;
+
+	static struct option options[] = {
+		{ "baud",		required_argument,	0, 'b' },
+		{ "batch",		no_argument,		0, 'B' },
+		{ "extended",		no_argument,		0, 'e' },
+		{ "isr-load",		required_argument,	0, 'i' },
+		{ "latency",		no_argument,		0, 'l' },
+		{ "retry-delay",	required_argument,	0, 'r' },
+		{ "timeout",		required_argument,	0, 't' },
+		{ "help",		no_argument,		0, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	int opt;
+	while (( opt = getopt_long(argc, argv, "h", options, 0) ) != -1) {
+		switch (opt) {
+		case 'b':	baud = atoi(optarg);		break;
+		case 'B':	batch = true;			break;
+		case 'e':	batch = extended = true;	break;
+		case 'i':	isr_load = atoi(optarg);	break;
+		case 'l':	latency = true;			break;
+		case 'r':	retry_delay_us = atoi(optarg);	break;
+		case 't':	timeout_ms = atoi(optarg);	break;
+		default:	usage();	return ( opt == 'h' ) ? 0 : 2;
+		}
+	}
+	if ( optind > argc - 2 ) {
+		usage();
+		return 2;
+	}
+
+	port = open(argv[optind], O_RDWR | O_NOCTTY);
+	if (( port < 0 ) || ( ! setSpeed(115200) )) {
+		perror(argv[optind]);
+		return 1;
+	}
+	// Whatever the board sent before we were here
+	tcflush(port, TCIOFLUSH);
+
+	if (( baud != 0 ) && ( ! negotiateBaudRate(baud) ))	return 1;
+	uint16_t batch_limit = 0;
+	// The 8 bit length framing carries one byte less than a response
+	if ( batch )	batch_limit = ( extended ) ? getPayloadLimit() : LEGACY_PACKET_PAYLOAD - 1;
+
+	for (int i = optind + 1; i < argc; i ++) {
+		size_t size;
+		uint8_t *data = s3gReadFile(argv[i], size);
+		if ( ! data )	return 1;
+		if ( latency ) {
+			uint16_t samples;
+			uint32_t mean, max;
+			getLatency(0, true, samples, mean, max);
+		}
+		IsrLoad idle, running;
+		if ( isr_load >= 0 ) {
+			// A second standing still, once the last file's moves are done
+			waitForMoves(idle);
+			sampleIsrLoad(idle);
+			usleep(1000000);
+			sampleIsrLoad(idle);
+			sampleIsrLoad(running);
+		}
+		Stats stats;
+		const uint64_t start = micros();
+		bool ok = run(data, size, batch_limit, extended, stats, running);
+		report(argv[i], stats, micros() - start);
+		if (( ok ) && ( isr_load >= 0 )) {
+			// Up to the end of the last move
+			ok = waitForMoves(running);
+			sampleIsrLoad(running);
+			reportIsrLoad(idle, running);
+		}
+		if ( latency )	reportLatency();
+		free(data);
+		if ( ! ok ) {
+			fprintf(stderr, "s3gBench: %s: the board stopped answering\n", argv[i]);
+			return 1;
+		}
+	}
+	close(port);
+	return 0;
+}
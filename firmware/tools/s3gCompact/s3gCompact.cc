@@ -0,0 +1,218 @@
+/*
+ * s3gCompact - rewrites the moves of an .s3g file as HOST_CMD_QUEUE_POINT_COMPACT
+ *
+ * Moves are converted wherever the position they start from is known, everything
+ * else is copied as it is. With --expand, compact moves are turned back into
+ * HOST_CMD_QUEUE_POINT_NEW for firmware that doesn't know them.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "S3gFile.hh"
+
+#define AXIS_COUNT	COMPACT_MOVE_AXIS_COUNT
+
+static void usage() {
+	printf("Usage: s3gCompact [--expand] in.s3g out.s3g\n");
+}
+
+/// The position the moves so far finish at, as the firmware's last target
+struct Position {
+	int32_t p[AXIS_COUNT];
+	bool known;		///< False until a set position or an absolute move, and after homing
+};
+
+/// Rewrite a move relative to the last target as a compact move
+/// \return Length written to out, 0 if it has to be copied
+static uint8_t compactMove(const uint8_t *cmd, Position &pos, uint8_t *out) {
+	int32_t target[AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+	int32_t delta[AXIS_COUNT];
+	uint32_t us;
+	uint8_t relative = 0;
+
+	switch (cmd[0]) {
+	case HOST_CMD_QUEUE_POINT_ABS:
+	case HOST_CMD_QUEUE_POINT_EXT:
+		{
+			// The steppers run an absolute move for dda times the longest delta
+			uint8_t axes = ( cmd[0] == HOST_CMD_QUEUE_POINT_ABS ) ? 3 : 5;
+			for (uint8_t i = 0; i < axes; i ++)	target[i] = s3gRead32(cmd + 1 + 4 * i);
+			int32_t dda = s3gRead32(cmd + 1 + 4 * axes);
+
+			bool was_known = pos.known;
+			int32_t max = 0;
+			for (uint8_t i = 0; i < AXIS_COUNT; i ++) {
+				delta[i] = target[i] - pos.p[i];
+				if ( labs(delta[i]) > max )	max = labs(delta[i]);
+			}
+			memcpy(pos.p, target, sizeof(target));
+			pos.known = true;
+
+			if (( ! was_known ) || ( dda < 0 ))	return 0;
+			uint64_t duration = (uint64_t)dda * (uint64_t)max;
+			if ( duration > 0xFFFFFF )	return 0;
+			us = (uint32_t)duration;
+		}
+		break;
+	case HOST_CMD_QUEUE_POINT_NEW:
+		{
+			for (uint8_t i = 0; i < AXIS_COUNT; i ++)	target[i] = s3gRead32(cmd + 1 + 4 * i);
+			us = (uint32_t)s3gRead32(cmd + 21);
+			relative = cmd[25];
+
+			bool usable = pos.known || ( relative == 0x1F );
+			for (uint8_t i = 0; i < AXIS_COUNT; i ++) {
+				delta[i] = ( relative & (1 << i) ) ? target[i] : target[i] - pos.p[i];
+				pos.p[i] = ( relative & (1 << i) ) ? pos.p[i] + target[i] : target[i];
+			}
+			// Relative axes from an unknown position stay unknown
+			if (( ! pos.known ) && ( relative == 0 ))	pos.known = true;
+
+			if ( ! usable )	return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+
+	return compactmove::encode(delta, us, out);
+}
+
+/// Track the commands other than moves that change the position
+static void otherCommand(const uint8_t *cmd, Position &pos) {
+	switch (cmd[0]) {
+	case HOST_CMD_SET_POSITION:
+	case HOST_CMD_SET_POSITION_EXT:
+		{
+			uint8_t axes = ( cmd[0] == HOST_CMD_SET_POSITION ) ? 3 : 5;
+			for (uint8_t i = 0; i < AXIS_COUNT; i ++)
+				pos.p[i] = ( i < axes ) ? s3gRead32(cmd + 1 + 4 * i) : 0;
+			pos.known = true;
+		}
+		break;
+	case HOST_CMD_FIND_AXES_MINIMUM:
+	case HOST_CMD_FIND_AXES_MAXIMUM:
+	case HOST_CMD_RECALL_HOME_POSITION:
+	case HOST_CMD_RETRACT:			// moves by the firmware's retract settings
+	case HOST_CMD_UNRETRACT:
+		pos.known = false;
+		break;
+	case HOST_CMD_QUEUE_POINT_COMPACT:
+		{
+			int32_t delta[AXIS_COUNT];
+			uint32_t us;
+			compactmove::decode(cmd, delta, us);
+			for (uint8_t i = 0; i < AXIS_COUNT; i ++)	pos.p[i] += delta[i];
+		}
+		break;
+	case HOST_CMD_QUEUE_ARC:
+		for (uint8_t i = 0; i < 3; i ++)	pos.p[i] += s3gRead32(cmd + 1 + 4 * i);
+		pos.p[( cmd[29] & ARC_FLAG_EXTRUDER_B ) ? 4 : 3] += s3gRead32(cmd + 13);
+		break;
+	}
+}
+
+/// Rewrite a compact move as the HOST_CMD_QUEUE_POINT_NEW it stands for
+/// \return Length written to out
+static uint8_t expandMove(const uint8_t *cmd, uint8_t *out) {
+	int32_t delta[AXIS_COUNT];
+	uint32_t us;
+	compactmove::decode(cmd, delta, us);
+
+	out[0] = HOST_CMD_QUEUE_POINT_NEW;
+	for (uint8_t i = 0; i < AXIS_COUNT; i ++)	s3gWrite32(out + 1 + 4 * i, delta[i]);
+	s3gWrite32(out + 21, (int32_t)us);
+	out[25] = 0x1F;
+	return 26;
+}
+
+int main(int argc, char **argv) {
+	bool expand = false;
+	int arg = 1;
+	if (( argc > 1 ) && ( strcmp(argv[1], "--expand") == 0 )) {
+		expand = true;
+		arg ++;
+	}
+	if ( argc - arg != 2 ) {
+		usage();
+		return 2;
+	}
+
+	size_t size;
+	uint8_t *data = s3gReadFile(argv[arg], size);
+	if ( ! data )	return 1;
+
+	FILE *out = fopen(argv[arg + 1], "wb");
+	if ( ! out ) {
+		perror(argv[arg + 1]);
+		return 1;
+	}
+
+	Position pos;
+	memset(&pos, 0, sizeof(pos));
+	uint32_t moves = 0, converted = 0;
+	size_t written = 0;
+
+	size_t offset = 0;
+	while ( offset < size ) {
+		const uint8_t *p = data + offset;
+		uint16_t length = s3gCommandLength(p, size - offset);
+		if ( length == 0 ) {
+			fprintf(stderr, "s3gCompact: unknown command %u at offset %lu\n", p[0], (unsigned long)offset);
+			return 1;
+		}
+		if ( offset + length > size ) {
+			fprintf(stderr, "s3gCompact: file ends inside command %u at offset %lu\n", p[0], (unsigned long)offset);
+			return 1;
+		}
+
+		uint8_t rewritten[26];
+		uint8_t rewritten_length = 0;
+		if ( expand ) {
+			if ( p[0] == HOST_CMD_QUEUE_POINT_COMPACT )	rewritten_length = expandMove(p, rewritten);
+		} else if (( p[0] == HOST_CMD_QUEUE_POINT_ABS ) || ( p[0] == HOST_CMD_QUEUE_POINT_EXT ) ||
+			   ( p[0] == HOST_CMD_QUEUE_POINT_NEW )) {
+			moves ++;
+			rewritten_length = compactMove(p, pos, rewritten);
+		} else {
+			if ( p[0] == HOST_CMD_QUEUE_POINT_COMPACT )	moves ++;
+			otherCommand(p, pos);
+		}
+
+		if ( rewritten_length ) {
+			converted ++;
+			fwrite(rewritten, 1, rewritten_length, out);
+			written += rewritten_length;
+		} else {
+			fwrite(p, 1, length, out);
+			written += length;
+		}
+		offset += length;
+	}
+
+	if ( fclose(out) != 0 ) {
+		perror(argv[arg + 1]);
+		return 1;
+	}
+
+	if ( expand )	printf("%u compact moves expanded", converted);
+	else		printf("%u of %u moves compacted", converted, moves);
+	printf(", %lu bytes to %lu bytes\n", (unsigned long)size, (unsigned long)written);
+
+	free(data);
+	return 0;
+}
@@ -0,0 +1,309 @@
+/*
+ * s3gEstimate - estimates the build time of an .s3g file
+ *
+ * Runs the build time estimator of the motherboard firmware (BuildEstimator) over
+ * the commands in an .s3g file, so the estimate is the one the LCD would show.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "BuildEstimator.hh"
+#include "S3gFile.hh"
+
+static void usage() {
+	printf("Usage: s3gEstimate [options] file.s3g\n"
+	       "\n"
+	       "Settings default to the firmware's eeprom defaults:\n"
+	       "  --steps-per-mm=x,y,z,a,b     steps per mm\n"
+	       "  --max-feedrate=x,y,z,a,b     mm/s\n"
+	       "  --max-acceleration=x,y,z,a,b mm/s^2\n"
+	       "  --acceleration=n             mm/s^2 of printing moves\n"
+	       "  --retract-acceleration=n     mm/s^2 of extruder only moves\n"
+	       "  --xy-jerk=n                  mm/s\n"
+	       "  --z-jerk=n                   mm/s\n"
+	       "  --retract=length,speed,z-hop mm, mm/s, mm of the firmware retraction\n"
+	       "  --no-acceleration            acceleration switched off\n"
+	       "  --no-planner                 planner switched off, every move on its own\n");
+}
+
+/// Parse up to ESTIMATOR_AXIS_COUNT comma separated numbers, a missing B copies A
+static bool parseAxes(const char *arg, float values[ESTIMATOR_AXIS_COUNT]) {
+	char *end;
+	uint8_t i = 0;
+	for (; ( i < ESTIMATOR_AXIS_COUNT ) && ( *arg ); i ++) {
+		values[i] = strtod(arg, &end);
+		if ( end == arg )	return false;
+		arg = ( *end == ',' ) ? end + 1 : end;
+	}
+	if ( i == 4 )	values[4] = values[3];
+	return ( i >= 4 ) && ( *arg == 0 );
+}
+
+/// Commands that ride along with the moves instead of draining the planner, as
+/// command::isDeferrable()
+static bool isDeferrable(uint8_t command, const uint8_t *bytes) {
+	switch (command) {
+	case HOST_CMD_TOOL_COMMAND:
+		switch (bytes[2]) {
+		case SLAVE_CMD_SET_TEMP:
+		case SLAVE_CMD_SET_PLATFORM_TEMP:
+		case SLAVE_CMD_SET_MOTOR_1_PWM:
+		case SLAVE_CMD_SET_MOTOR_2_PWM:
+		case SLAVE_CMD_SET_MOTOR_1_RPM:
+		case SLAVE_CMD_SET_MOTOR_2_RPM:
+		case SLAVE_CMD_SET_MOTOR_1_DIR:
+		case SLAVE_CMD_SET_MOTOR_2_DIR:
+		case SLAVE_CMD_TOGGLE_MOTOR_1:
+		case SLAVE_CMD_TOGGLE_MOTOR_2:
+		case SLAVE_CMD_TOGGLE_FAN:
+		case SLAVE_CMD_TOGGLE_VALVE:
+			return true;
+		}
+		return false;
+	case HOST_CMD_MOOD_LIGHT_SET_RGB:
+	case HOST_CMD_MOOD_LIGHT_SET_HSB:
+	case HOST_CMD_MOOD_LIGHT_PLAY_SCRIPT:
+	case HOST_CMD_BUZZER_BUZZ:
+		return true;
+	}
+	return false;
+}
+
+static void printTime(const char *label, uint64_t seconds) {
+	printf("%s%u:%02u:%02u (%llu s)\n", label, (unsigned)(seconds / 3600), (unsigned)((seconds / 60) % 60),
+	       (unsigned)(seconds % 60), (unsigned long long)seconds);
+}
+
+int main(int argc, char **argv) {
+	EstimatorSettings settings;
+	float steps_per_mm[ESTIMATOR_AXIS_COUNT]	= { 47.069852, 47.069852, 200.0, 4.4, 4.4 };
+	float max_feedrate[ESTIMATOR_AXIS_COUNT]	= { 160, 160, 10, 100, 100 };
+	float max_acceleration[ESTIMATOR_AXIS_COUNT]	= { 2000, 2000, 150, 60000, 60000 };
+	settings.acceleration		= 5000;
+	settings.retract_acceleration	= 3000;
+	settings.max_xy_jerk		= 0.2;
+	settings.max_z_jerk		= 10.0;
+	settings.lookahead		= true;
+	bool acceleration		= true;
+	float retract_length		= 1.0;
+	float retract_feedrate		= 30.0;
+	float retract_z_hop		= 0.0;
+
+	static struct option options[] = {
+		{ "steps-per-mm",		required_argument,	0, 's' },
+		{ "max-feedrate",		required_argument,	0, 'f' },
+		{ "max-acceleration",		required_argument,	0, 'm' },
+		{ "acceleration",		required_argument,	0, 'a' },
+		{ "retract-acceleration",	required_argument,	0, 'r' },
+		{ "xy-jerk",			required_argument,	0, 'j' },
+		{ "z-jerk",			required_argument,	0, 'z' },
+		{ "retract",			required_argument,	0, 'R' },
+		{ "no-acceleration",		no_argument,		0, 'A' },
+		{ "no-planner",			no_argument,		0, 'P' },
+		{ "help",			no_argument,		0, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	int opt;
+	while (( opt = getopt_long(argc, argv, "h", options, 0) ) != -1) {
+		bool ok = true;
+		switch (opt) {
+		case 's':	ok = parseAxes(optarg, steps_per_mm);		break;
+		case 'f':	ok = parseAxes(optarg, max_feedrate);		break;
+		case 'm':	ok = parseAxes(optarg, max_acceleration);	break;
+		case 'a':	settings.acceleration = atof(optarg);		break;
+		case 'r':	settings.retract_acceleration = atof(optarg);	break;
+		case 'j':	settings.max_xy_jerk = atof(optarg);		break;
+		case 'z':	settings.max_z_jerk = atof(optarg);		break;
+		case 'R':	ok = ( sscanf(optarg, "%f,%f,%f", &retract_length, &retract_feedrate, &retract_z_hop) == 3 ) &&
+				     ( retract_feedrate > 0 );			break;
+		case 'A':	acceleration = false;				break;
+		case 'P':	settings.lookahead = false;			break;
+		default:	usage();	return ( opt == 'h' ) ? 0 : 2;
+		}
+		if ( ! ok ) {
+			fprintf(stderr, "s3gEstimate: bad values %s\n", optarg);
+			return 2;
+		}
+	}
+	if ( optind != argc - 1 ) {
+		usage();
+		return 2;
+	}
+
+	for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++) {
+		settings.steps_per_mm[i]	= steps_per_mm[i];
+		settings.max_feedrate[i]	= max_feedrate[i];
+		settings.max_acceleration[i]	= (uint32_t)max_acceleration[i];
+	}
+	if ( ! acceleration ) {
+		settings.acceleration = 0.0;
+		settings.retract_acceleration = 0.0;
+	}
+
+	size_t size;
+	uint8_t *data = s3gReadFile(argv[optind], size);
+	if ( ! data )	return 1;
+
+	static BuildEstimator estimator;
+	estimator.init(settings);
+
+	// The estimate as command::estimateMoveTo() makes it without acceleration
+	uint64_t constant_rate_us = 0;
+	int32_t last[ESTIMATOR_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+	uint32_t moves = 0, commands = 0;
+	bool retracted = false;
+
+	size_t offset = 0;
+	while ( offset < size ) {
+		const uint8_t *p = data + offset;
+		uint8_t command = p[0];
+		uint16_t length = s3gCommandLength(p, size - offset);
+		if ( length == 0 ) {
+			fprintf(stderr, "s3gEstimate: unknown command %u at offset %lu\n", command, (unsigned long)offset);
+			return 1;
+		}
+		if ( offset + length > size ) {
+			fprintf(stderr, "s3gEstimate: file ends inside command %u at offset %lu\n", command, (unsigned long)offset);
+			return 1;
+		}
+
+		if (( command != HOST_CMD_QUEUE_POINT_ABS ) && ( command != HOST_CMD_QUEUE_POINT_EXT ) &&
+		    ( command != HOST_CMD_QUEUE_POINT_NEW ) && ( command != HOST_CMD_QUEUE_POINT_COMPACT ) &&
+		    ( command != HOST_CMD_QUEUE_ARC ) && ( command != HOST_CMD_RETRACT ) &&
+		    ( command != HOST_CMD_UNRETRACT ) && ( ! isDeferrable(command, p) ))
+			estimator.flush();
+
+		int32_t target[ESTIMATOR_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+		switch (command) {
+		case HOST_CMD_QUEUE_POINT_ABS:
+		case HOST_CMD_QUEUE_POINT_EXT:
+			{
+				uint8_t axes = ( command == HOST_CMD_QUEUE_POINT_ABS ) ? 3 : 5;
+				for (uint8_t i = 0; i < axes; i ++)	target[i] = s3gRead32(p + 1 + 4 * i);
+				int32_t dda = s3gRead32(p + 1 + 4 * axes);
+
+				int32_t max = 0;
+				for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++) {
+					int32_t delta = labs(target[i] - last[i]);
+					if ( delta > max )	max = delta;
+				}
+				constant_rate_us += (uint64_t)max * (uint64_t)dda;
+				memcpy(last, target, sizeof(last));
+
+				estimator.moveTo(target, dda);
+				moves ++;
+			}
+			break;
+		case HOST_CMD_QUEUE_POINT_NEW:
+			{
+				for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++)	target[i] = s3gRead32(p + 1 + 4 * i);
+				int32_t us = s3gRead32(p + 21);
+				uint8_t relative = p[25];
+
+				constant_rate_us += us;
+				for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++)
+					last[i] = ( relative & (1 << i) ) ? last[i] + target[i] : target[i];
+
+				estimator.moveToNew(target, us, relative);
+				moves ++;
+			}
+			break;
+		case HOST_CMD_QUEUE_POINT_COMPACT:
+			{
+				uint32_t us;
+				compactmove::decode(p, target, us);
+
+				constant_rate_us += us;
+				for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++)	last[i] += target[i];
+
+				estimator.moveToNew(target, us, 0x1F);
+				moves ++;
+			}
+			break;
+		case HOST_CMD_QUEUE_ARC:
+			{
+				// Cut into the same chords as the firmware
+				for (uint8_t i = 0; i < 3; i ++)	target[i] = s3gRead32(p + 1 + 4 * i);
+				target[( p[29] & ARC_FLAG_EXTRUDER_B ) ? 4 : 3] = s3gRead32(p + 13);
+				ArcSegmenter arc;
+				arc.start(target, s3gRead32(p + 17), s3gRead32(p + 21), p[29] & ARC_FLAG_CLOCKWISE,
+					  (uint32_t)s3gRead32(p + 25));
+
+				int32_t delta[ESTIMATOR_AXIS_COUNT];
+				uint32_t us;
+				while ( arc.next(delta, us) ) {
+					constant_rate_us += us;
+					for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++)	last[i] += delta[i];
+					estimator.moveToNew(delta, us, 0x1F);
+					moves ++;
+				}
+			}
+			break;
+		case HOST_CMD_RETRACT:
+		case HOST_CMD_UNRETRACT:
+			{
+				// The same moves as command::runRetract()
+				bool retract = ( command == HOST_CMD_RETRACT );
+				if ( retracted == retract )	break;
+				retracted = retract;
+				uint8_t axis = ( p[1] ) ? 4 : 3;
+				for (uint8_t move = 0; move < 2; move ++) {
+					bool extruder = (( move == 0 ) == retract );
+					float mm = ( extruder ) ? retract_length : retract_z_hop;
+					int32_t steps = (int32_t)(mm * steps_per_mm[( extruder ) ? axis : 2]);
+					if ( steps == 0 )	continue;
+					int32_t delta[ESTIMATOR_AXIS_COUNT] = { 0, 0, 0, 0, 0 };
+					delta[( extruder ) ? axis : 2] = ( extruder == retract ) ? -steps : steps;
+					uint32_t us = (uint32_t)(mm * 1000000.0 / (( extruder ) ? retract_feedrate : max_feedrate[2]));
+
+					constant_rate_us += us;
+					for (uint8_t i = 0; i < ESTIMATOR_AXIS_COUNT; i ++)	last[i] += delta[i];
+					estimator.moveToNew(delta, us, 0x1F);
+					moves ++;
+				}
+			}
+			break;
+		case HOST_CMD_SET_POSITION:
+		case HOST_CMD_SET_POSITION_EXT:
+			{
+				uint8_t axes = ( command == HOST_CMD_SET_POSITION ) ? 3 : 5;
+				for (uint8_t i = 0; i < axes; i ++)	target[i] = s3gRead32(p + 1 + 4 * i);
+				memcpy(last, target, sizeof(last));
+				estimator.definePosition(target);
+			}
+			break;
+		case HOST_CMD_DELAY:
+			constant_rate_us += (uint64_t)(uint32_t)s3gRead32(p + 1) * 1000;
+			estimator.addDelay((uint32_t)s3gRead32(p + 1) * 1000);
+			break;
+		}
+
+		commands ++;
+		offset += length;
+	}
+	estimator.flush();
+
+	printf("%s: %u commands, %u moves\n", argv[optind], commands, moves);
+	printTime("Estimated build time:     ", estimator.getSeconds());
+	printTime("Constant rate estimate:   ", constant_rate_us / 1000000);
+	printf("Homing, heating and waits for the tool aren't included.\n");
+
+	free(data);
+	return 0;
+}